@@ -10,1291 +10,11780 @@
 #include <iomanip>
 #include <sstream>
 #include <set>
-
-class PasswordGenerator {
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <string_view>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <array>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <future>
+#include <unordered_set>
+#include <unordered_map>
+#include <iterator>
+#include <limits>
+#include <cerrno>
+#include <atomic>
+#include <charconv>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PSWD_GEN_X86 1
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12's AVX-512 intrinsics start from deliberately undefined values, which its own
+// -Wuninitialized then reports at every use
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Lets one binary carry kernels for instruction sets the compiler flags do not enable
+#if defined(__GNUC__) || defined(__clang__)
+#define PSWD_GEN_TARGET(features) __attribute__((target(features)))
+#else
+#define PSWD_GEN_TARGET(features)
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Zeroes memory in a way the optimizer cannot drop as a dead store
+inline void secureZero(void* data, size_t size) {
+    static void* (*const volatile wipe)(void*, int, size_t) = std::memset;
+    if (data != nullptr && size > 0) {
+        wipe(data, 0, size);
+    }
+}
+
+// Pool allocator for secrets. One region is reserved up front, locked into RAM and
+// excluded from core dumps, then handed out as power-of-two blocks kept on free lists,
+// so an allocation costs a list pop instead of an mlock call. It is a buddy allocator:
+// a missing size is split off a larger free block, and once the region runs out, free
+// buddies are merged back, so space freed by one size serves any other. Blocks are
+// zeroed when released. Requests larger than the biggest block go to the heap and are
+// still zeroed on release; so do all requests once the region is full, which is reported
+// on stderr, as is a region the OS would not lock.
+class SecureMemoryPool {
 private:
-    std::string lowercase = "abcdefghijklmnopqrstuvwxyz";
-    std::string uppercase = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    std::string digits = "0123456789";
-    std::string special_chars = "!@#$%^&*()_+-=[]{}|;:,.<>?";
-    std::string ambiguous_chars = "il1Lo0O";
-
-    std::vector<std::string> fallback_words = {
-        "apple", "mountain", "river", "sunset", "forest", "ocean", "thunder",
-        "crystal", "dragon", "phoenix", "wizard", "castle", "garden", "rainbow",
-        "butterfly", "diamond", "golden", "silver", "storm", "cloud", "moon",
-        "star", "fire", "water", "earth", "wind", "light", "shadow", "dream",
-        "magic", "knight", "sword", "shield", "crown", "tower", "bridge", "flower",
-        "tiger", "eagle", "wolf", "bear", "lion", "shark", "falcon", "panther",
-        "ruby", "emerald", "sapphire", "topaz", "pearl", "jade", "amber", "coral",
-        "hammer", "blade", "arrow", "spear", "axe", "bow", "staff", "wand",
-        "winter", "summer", "spring", "autumn", "frost", "blaze", "mist", "dawn"
-    };
-
-    std::random_device rd;
-    std::mt19937 gen;
-
-public:
-    PasswordGenerator() : gen(rd()) {}
-
-    // Component structures for custom password builder
-    struct Component {
-        enum Type {
-            TEXT,
-            WORD,
-            RANDOM_CHARS,
-            NUMBER,
-            SEPARATOR
-        };
-
-        Type type;
-        std::string value;
-        std::map<std::string, std::string> config;
-        std::vector<std::string> options;
+    static constexpr size_t kMinBlock = 16;
+    static constexpr size_t kMaxBlock = 4096;
+    static constexpr size_t kClassCount = 9;  // 16, 32, ..., 4096
 
-        Component(Type t) : type(t) {}
+    struct FreeBlock {
+        FreeBlock* next;
+        FreeBlock* prev;
     };
 
-    std::string getRandomWord(int min_length = 3, int max_length = 10) {
-        std::vector<std::string> suitable_words;
-        for (const auto& word : fallback_words) {
-            if (word.length() >= min_length && word.length() <= max_length) {
-                suitable_words.push_back(word);
-            }
-        }
-
-        if (suitable_words.empty()) {
-            suitable_words = fallback_words;
+    char* region = nullptr;
+    size_t region_size = 0;
+    size_t region_used = 0;  // carved into kMaxBlock blocks so far
+    bool locked = false;
+    FreeBlock* free_lists[kClassCount] = {};
+    std::vector<uint8_t> free_class;  // per kMinBlock unit: 1 + class of a free block starting there, else 0
+    bool merged = false;  // nothing was released since the last merge, so another would find nothing
+    std::atomic<bool> full_reported{false};
+    std::mutex mutex;
+
+    static size_t sizeClass(size_t bytes) {
+        size_t index = 0;
+        size_t block = kMinBlock;
+        while (block < bytes) {
+            block <<= 1;
+            index++;
         }
-
-        std::uniform_int_distribution<> dis(0, suitable_words.size() - 1);
-        return suitable_words[dis(gen)];
+        return index;
     }
 
-    std::string removeAmbiguous(const std::string& chars) {
-        std::string result;
-        for (char c : chars) {
-            if (ambiguous_chars.find(c) == std::string::npos) {
-                result += c;
-            }
-        }
-        return result;
+    size_t unitOf(const void* block) const {
+        return static_cast<size_t>(static_cast<const char*>(block) - region) / kMinBlock;
     }
 
-    std::string generatePassword(int length = 12, bool use_uppercase = true,
-                                bool use_lowercase = true, bool use_digits = true,
-                                bool use_special = true, bool exclude_ambiguous = false,
-                                int min_uppercase = 1, int min_lowercase = 1,
-                                int min_digits = 1, int min_special = 1) {
-        if (length < 4) {
-            throw std::invalid_argument("Password too short");
-        }
-
-        std::string char_pool;
-        std::vector<char> required_chars;
-
-        if (use_lowercase) {
-            std::string chars = exclude_ambiguous ? removeAmbiguous(lowercase) : lowercase;
-            char_pool += chars;
-            std::uniform_int_distribution<> dis(0, chars.length() - 1);
-            for (int i = 0; i < min_lowercase; i++) {
-                required_chars.push_back(chars[dis(gen)]);
-            }
-        }
-
-        if (use_uppercase) {
-            std::string chars = exclude_ambiguous ? removeAmbiguous(uppercase) : uppercase;
-            char_pool += chars;
-            std::uniform_int_distribution<> dis(0, chars.length() - 1);
-            for (int i = 0; i < min_uppercase; i++) {
-                required_chars.push_back(chars[dis(gen)]);
-            }
+    void pushFree(char* ptr, size_t index) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(ptr);
+        block->prev = nullptr;
+        block->next = free_lists[index];
+        if (block->next != nullptr) {
+            block->next->prev = block;
         }
+        free_lists[index] = block;
+        free_class[unitOf(ptr)] = static_cast<uint8_t>(index + 1);
+    }
 
-        if (use_digits) {
-            std::string chars = exclude_ambiguous ? removeAmbiguous(digits) : digits;
-            char_pool += chars;
-            std::uniform_int_distribution<> dis(0, chars.length() - 1);
-            for (int i = 0; i < min_digits; i++) {
-                required_chars.push_back(chars[dis(gen)]);
-            }
+    void unlinkFree(FreeBlock* block, size_t index) {
+        if (block->prev != nullptr) {
+            block->prev->next = block->next;
+        } else {
+            free_lists[index] = block->next;
         }
-
-        if (use_special) {
-            char_pool += special_chars;
-            std::uniform_int_distribution<> dis(0, special_chars.length() - 1);
-            for (int i = 0; i < min_special; i++) {
-                required_chars.push_back(special_chars[dis(gen)]);
-            }
+        if (block->next != nullptr) {
+            block->next->prev = block->prev;
         }
+        free_class[unitOf(block)] = 0;
+        block->next = block->prev = nullptr;
+    }
 
-        if (char_pool.empty()) {
-            throw std::invalid_argument("No character types selected");
+    // A free block of class index, split from a larger one or carved from the region's
+    // untouched end; null when the region is exhausted
+    char* takeBlock(size_t index) {
+        size_t from = index;
+        while (from < kClassCount && free_lists[from] == nullptr) {
+            from++;
         }
-
-        if (required_chars.size() > length) {
-            throw std::invalid_argument("Requirements exceed password length");
+        char* block;
+        if (from < kClassCount) {
+            block = reinterpret_cast<char*>(free_lists[from]);
+            unlinkFree(free_lists[from], from);
+        } else if (region_used + kMaxBlock <= region_size) {
+            block = region + region_used;
+            region_used += kMaxBlock;
+            from = kClassCount - 1;
+        } else {
+            return nullptr;
         }
-
-        std::uniform_int_distribution<> dis(0, char_pool.length() - 1);
-        int remaining_length = length - required_chars.size();
-        for (int i = 0; i < remaining_length; i++) {
-            required_chars.push_back(char_pool[dis(gen)]);
+        // Keep the lower half, free the upper one, down to the size asked for
+        while (from > index) {
+            from--;
+            pushFree(block + (kMinBlock << from), from);
         }
-
-        std::shuffle(required_chars.begin(), required_chars.end(), gen);
-        return std::string(required_chars.begin(), required_chars.end());
+        return block;
     }
 
-    std::string generateMemorablePassword(int num_words = 4, const std::string& separator = "-",
-                                         bool add_numbers = true, bool capitalize = true,
-                                         int word_min_length = 3, int word_max_length = 8) {
-        std::vector<std::string> selected_words;
-        for (int i = 0; i < num_words; i++) {
-            std::string word = getRandomWord(word_min_length, word_max_length);
-            if (capitalize && !word.empty()) {
-                word[0] = std::toupper(word[0]);
+    // Joins every pair of free buddies, smallest first so merged blocks can merge again.
+    // Run only when the region is exhausted, which keeps release a list push.
+    void mergeFreeBlocks() {
+        for (size_t index = 0; index + 1 < kClassCount; index++) {
+            FreeBlock* block = free_lists[index];
+            while (block != nullptr) {
+                FreeBlock* next = block->next;
+                char* ptr = reinterpret_cast<char*>(block);
+                char* buddy = region + (static_cast<size_t>(ptr - region) ^ (kMinBlock << index));
+                if (free_class[unitOf(buddy)] == index + 1) {
+                    if (next == reinterpret_cast<FreeBlock*>(buddy)) {
+                        next = next->next;
+                    }
+                    unlinkFree(block, index);
+                    unlinkFree(reinterpret_cast<FreeBlock*>(buddy), index);
+                    secureZero(std::max(ptr, buddy), sizeof(FreeBlock));
+                    pushFree(std::min(ptr, buddy), index + 1);
+                }
+                block = next;
             }
-            selected_words.push_back(word);
         }
+    }
 
-        std::string password;
-        for (size_t i = 0; i < selected_words.size(); i++) {
-            password += selected_words[i];
-            if (i < selected_words.size() - 1) {
-                password += separator;
-            }
+    void reportFull() {
+        if (!full_reported.exchange(true)) {
+            std::fputs("Warning: secure memory pool is full, further secrets are kept in ordinary heap memory\n",
+                       stderr);
         }
+    }
 
-        if (add_numbers) {
-            std::uniform_int_distribution<> dis(0, 999);
-            std::ostringstream oss;
-            oss << std::setfill('0') << std::setw(3) << dis(gen);
-            password += oss.str();
+    explicit SecureMemoryPool(size_t capacity) {
+#ifdef _WIN32
+        void* memory = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (memory != nullptr) {
+            region = static_cast<char*>(memory);
+            region_size = capacity;
+            locked = VirtualLock(memory, capacity) != 0;
         }
-
-        return password;
+#else
+        void* memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            region = static_cast<char*>(memory);
+            region_size = capacity;
+            locked = mlock(memory, capacity) == 0;
+#ifdef MADV_DONTDUMP
+            madvise(memory, capacity, MADV_DONTDUMP);
+#endif
+        }
+#endif
+        region_size -= region_size % kMaxBlock;
+        free_class.assign(region_size / kMinBlock, 0);
     }
 
-    std::string generateComplexMemorablePassword(int num_words = 3, bool add_special_chars = true,
-                                               bool add_numbers = true, bool transform_words = true,
-                                               int min_length = 16) {
-        std::vector<std::string> words;
-        for (int i = 0; i < num_words; i++) {
-            std::string word = getRandomWord(4, 8);
-
-            if (transform_words) {
-                std::uniform_int_distribution<> transform_dis(0, 3);
-                int transform_type = transform_dis(gen);
-
-                switch (transform_type) {
-                    case 0:
-                        if (!word.empty()) word[0] = std::toupper(word[0]);
-                        break;
-                    case 1:
-                        std::transform(word.begin(), word.end(), word.begin(), ::toupper);
-                        break;
-                    case 2:
-                        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
-                        break;
-                    case 3:
-                        if (word.length() > 4) {
-                            if (!word.empty()) word[0] = std::toupper(word[0]);
-                        } else {
-                            std::transform(word.begin(), word.end(), word.begin(), ::toupper);
-                        }
-                        break;
-                }
+public:
+    SecureMemoryPool(const SecureMemoryPool&) = delete;
+    SecureMemoryPool& operator=(const SecureMemoryPool&) = delete;
 
-                std::uniform_int_distribution<> replace_dis(0, 2);
-                if (replace_dis(gen) == 0) {
-                    std::map<char, char> replacements = {
-                        {'a', '4'}, {'e', '3'}, {'i', '1'}, {'o', '0'}, {'s', '5'}, {'t', '7'}
-                    };
+    // Never destroyed: secure containers with static storage may outlive any destructor
+    static SecureMemoryPool& instance() {
+        static SecureMemoryPool* pool = new SecureMemoryPool(1 << 20);
+        return *pool;
+    }
 
-                    for (auto& pair : replacements) {
-                        std::uniform_int_distribution<> chance_dis(0, 1);
-                        if (chance_dis(gen) == 0) {
-                            std::replace(word.begin(), word.end(), pair.first, pair.second);
-                            std::replace(word.begin(), word.end(), static_cast<char>(std::toupper(pair.first)), pair.second);
-                            break;
-                        }
-                    }
+    void* allocate(size_t bytes) {
+        if (bytes <= kMaxBlock && region != nullptr) {
+            char* block;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t index = sizeClass(bytes);
+                block = takeBlock(index);
+                if (block == nullptr && !merged) {
+                    mergeFreeBlocks();
+                    merged = true;
+                    block = takeBlock(index);
                 }
             }
+            if (block != nullptr) {
+                return block;
+            }
+            reportFull();
+        }
+        return ::operator new(bytes);
+    }
 
-            words.push_back(word);
+    void deallocate(void* data, size_t bytes) {
+        if (data == nullptr) {
+            return;
         }
 
-        std::vector<std::string> separators = {"", "-", "_", ".", "!", "@", "#"};
-        std::string password;
+        char* ptr = static_cast<char*>(data);
+        if (ptr >= region && ptr < region + region_size) {
+            size_t index = sizeClass(bytes);
+            secureZero(ptr, kMinBlock << index);
 
-        for (size_t i = 0; i < words.size(); i++) {
-            password += words[i];
-            if (i < words.size() - 1) {
-                std::uniform_int_distribution<> sep_dis(0, separators.size() - 1);
-                if (add_special_chars) {
-                    std::uniform_int_distribution<> special_chance(0, 1);
-                    if (special_chance(gen) == 0) {
-                        std::uniform_int_distribution<> special_sep_dis(3, separators.size() - 1);
-                        password += separators[special_sep_dis(gen)];
-                    } else {
-                        std::uniform_int_distribution<> normal_sep_dis(0, 2);
-                        password += separators[normal_sep_dis(gen)];
-                    }
-                } else {
-                    password += separators[sep_dis(gen)];
-                }
-            }
+            std::lock_guard<std::mutex> lock(mutex);
+            pushFree(ptr, index);
+            merged = false;
+            return;
         }
 
-        if (add_numbers) {
-            std::vector<std::string> positions = {"start", "middle", "end"};
-            std::uniform_int_distribution<> pos_dis(0, positions.size() - 1);
-            std::string position = positions[pos_dis(gen)];
-
-            std::uniform_int_distribution<> num_dis(0, 9999);
-            std::ostringstream oss;
-            oss << std::setfill('0') << std::setw(2) << num_dis(gen);
-            std::string number = oss.str();
+        secureZero(data, bytes);
+        ::operator delete(data);
+    }
 
-            if (position == "start") {
-                password = number + password;
-            } else if (position == "end") {
-                password = password + number;
-            } else {
-                int mid = password.length() / 2;
-                password.insert(mid, number);
-            }
-        }
+    bool isLocked() const {
+        return locked;
+    }
 
-        while (password.length() < min_length && add_special_chars) {
-            std::string special_chars_subset = "!@#$%^&*";
-            std::uniform_int_distribution<> char_dis(0, special_chars_subset.length() - 1);
-            std::uniform_int_distribution<> pos_dis(0, password.length());
+    size_t capacity() const {
+        return region_size;
+    }
 
-            char special_char = special_chars_subset[char_dis(gen)];
-            int position = pos_dis(gen);
-            password.insert(position, 1, special_char);
+    // Warns on stderr when secrets cannot be kept out of swap
+    void reportProtection() const {
+        if (!locked) {
+            std::fputs("Warning: secure memory could not be locked, passwords may be swapped to disk\n", stderr);
         }
-
-        return password;
     }
+};
 
-    // NEW: Custom password builder function
-    std::string buildCustomPassword(const std::vector<Component>& components) {
-        std::string password;
+template <typename T>
+class SecureAllocator {
+public:
+    using value_type = T;
 
-        for (const auto& component : components) {
-            switch (component.type) {
-                case Component::TEXT: {
-                    password += component.value;
-                    break;
-                }
+    SecureAllocator() noexcept = default;
 
-                case Component::WORD: {
-                    int min_length = 3, max_length = 10;
-                    bool capitalize = false, uppercase = false, lowercase = false, random_case = false;
-                    std::map<char, char> replacements;
+    template <typename U>
+    SecureAllocator(const SecureAllocator<U>&) noexcept {}
 
-                    // Parse config
-                    auto it = component.config.find("min_length");
-                    if (it != component.config.end()) {
-                        min_length = std::stoi(it->second);
-                    }
+    T* allocate(size_t count) {
+        return static_cast<T*>(SecureMemoryPool::instance().allocate(count * sizeof(T)));
+    }
 
-                    it = component.config.find("max_length");
-                    if (it != component.config.end()) {
-                        max_length = std::stoi(it->second);
-                    }
+    void deallocate(T* data, size_t count) noexcept {
+        SecureMemoryPool::instance().deallocate(data, count * sizeof(T));
+    }
 
-                    it = component.config.find("capitalize");
-                    if (it != component.config.end()) {
-                        capitalize = (it->second == "true");
-                    }
+    template <typename U>
+    bool operator==(const SecureAllocator<U>&) const noexcept { return true; }
 
-                    it = component.config.find("uppercase");
-                    if (it != component.config.end()) {
-                        uppercase = (it->second == "true");
-                    }
+    template <typename U>
+    bool operator!=(const SecureAllocator<U>&) const noexcept { return false; }
+};
 
-                    it = component.config.find("lowercase");
-                    if (it != component.config.end()) {
-                        lowercase = (it->second == "true");
-                    }
+template <typename T>
+using SecureVector = std::vector<T, SecureAllocator<T>>;
 
-                    it = component.config.find("random_case");
-                    if (it != component.config.end()) {
-                        random_case = (it->second == "true");
-                    }
+// Plain heap allocator that wipes blocks on release, for types that only sometimes hold
+// secrets and are too bulky, in bulk, for the locked pool
+template <typename T>
+class WipingAllocator {
+public:
+    using value_type = T;
 
-                    it = component.config.find("replacements");
-                    if (it != component.config.end() && it->second == "true") {
-                        replacements = {{'a', '4'}, {'e', '3'}, {'i', '1'}, {'o', '0'}, {'s', '5'}};
-                    }
+    WipingAllocator() noexcept = default;
 
-                    std::string word = getRandomWord(min_length, max_length);
+    template <typename U>
+    WipingAllocator(const WipingAllocator<U>&) noexcept {}
 
-                    // Apply transformations
-                    if (capitalize && !word.empty()) {
-                        word[0] = std::toupper(word[0]);
-                    } else if (uppercase) {
-                        std::transform(word.begin(), word.end(), word.begin(), ::toupper);
-                    } else if (lowercase) {
-                        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
-                    } else if (random_case) {
-                        std::uniform_int_distribution<> case_dis(0, 1);
-                        for (char& c : word) {
-                            c = case_dis(gen) == 0 ? std::toupper(c) : std::tolower(c);
-                        }
-                    }
+    T* allocate(size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
 
-                    // Apply replacements
-                    for (const auto& pair : replacements) {
-                        std::replace(word.begin(), word.end(), pair.first, pair.second);
-                    }
+    void deallocate(T* data, size_t count) noexcept {
+        secureZero(data, count * sizeof(T));
+        ::operator delete(data);
+    }
 
-                    password += word;
-                    break;
-                }
+    template <typename U>
+    bool operator==(const WipingAllocator<U>&) const noexcept { return true; }
 
-                case Component::RANDOM_CHARS: {
-                    int length = 4;
-                    std::vector<std::string> types = {"lowercase", "uppercase", "digits"};
+    template <typename U>
+    bool operator!=(const WipingAllocator<U>&) const noexcept { return false; }
+};
 
-                    // Parse config
-                    auto it = component.config.find("length");
-                    if (it != component.config.end()) {
-                        length = std::stoi(it->second);
-                    }
+// String whose heap buffer comes from the secure pool. The destructor also wipes the
+// small-string buffer, which lives inside the object rather than in the pool.
+class SecureString : public std::basic_string<char, std::char_traits<char>, SecureAllocator<char>> {
+public:
+    using Base = std::basic_string<char, std::char_traits<char>, SecureAllocator<char>>;
+    using Base::Base;
+
+    SecureString() = default;
+    SecureString(const SecureString&) = default;
+    SecureString(SecureString&&) = default;
+    SecureString(const Base& other) : Base(other) {}
+    SecureString(Base&& other) : Base(std::move(other)) {}
+    explicit SecureString(std::string_view view) : Base(view.data(), view.size()) {}
+
+    SecureString& operator=(const SecureString&) = default;
+    SecureString& operator=(SecureString&&) = default;
+
+    SecureString& operator=(const Base& other) {
+        Base::operator=(other);
+        return *this;
+    }
 
-                    it = component.config.find("types");
-                    if (it != component.config.end()) {
-                        types.clear();
-                        std::istringstream iss(it->second);
-                        std::string type;
-                        while (std::getline(iss, type, ',')) {
-                            types.push_back(type);
-                        }
-                    }
+    SecureString& operator=(Base&& other) {
+        Base::operator=(std::move(other));
+        return *this;
+    }
 
-                    std::string char_pool;
-                    for (const auto& type : types) {
-                        if (type == "lowercase") {
-                            char_pool += lowercase;
-                        } else if (type == "uppercase") {
-                            char_pool += uppercase;
-                        } else if (type == "digits") {
-                            char_pool += digits;
-                        } else if (type == "special") {
-                            char_pool += special_chars;
-                        }
-                    }
+    ~SecureString() {
+        secureZero(&(*this)[0], capacity());
+    }
 
-                    if (!char_pool.empty()) {
-                        std::uniform_int_distribution<> dis(0, char_pool.length() - 1);
-                        for (int i = 0; i < length; i++) {
-                            password += char_pool[dis(gen)];
-                        }
-                    }
-                    break;
-                }
+    std::string_view view() const {
+        return std::string_view(data(), size());
+    }
+};
 
-                case Component::NUMBER: {
-                    int min_val = 0, max_val = 9999, padding = 0;
+using SecureStringList = SecureVector<SecureString>;
 
-                    // Parse config
-                    auto it = component.config.find("min");
-                    if (it != component.config.end()) {
-                        min_val = std::stoi(it->second);
-                    }
+// Arbitrary precision unsigned integer used for exact keyspace sizes. A random keyspace
+// index maps one-to-one onto a password, so every limb buffer, temporaries and quotients
+// included, is wiped when released. Keyspace tables hold thousands of these, so they
+// use the heap rather than the locked pool.
+class BigUnsigned {
+private:
+    using Limbs = std::vector<uint32_t, WipingAllocator<uint32_t>>;
 
-                    it = component.config.find("max");
-                    if (it != component.config.end()) {
-                        max_val = std::stoi(it->second);
-                    }
+    Limbs limbs;
 
-                    it = component.config.find("padding");
-                    if (it != component.config.end()) {
-                        padding = std::stoi(it->second);
-                    }
+    void trim() {
+        while (!limbs.empty() && limbs.back() == 0) {
+            limbs.pop_back();
+        }
+    }
 
-                    std::uniform_int_distribution<> dis(min_val, max_val);
-                    int number = dis(gen);
+public:
+    BigUnsigned(uint64_t value = 0) {
+        while (value > 0) {
+            limbs.push_back(static_cast<uint32_t>(value));
+            value >>= 32;
+        }
+    }
 
-                    std::ostringstream oss;
-                    if (padding > 0) {
-                        oss << std::setfill('0') << std::setw(padding);
-                    }
-                    oss << number;
+    bool isZero() const {
+        return limbs.empty();
+    }
 
-                    password += oss.str();
-                    break;
-                }
+    int compare(const BigUnsigned& other) const {
+        if (limbs.size() != other.limbs.size()) {
+            return limbs.size() < other.limbs.size() ? -1 : 1;
+        }
+        for (size_t i = limbs.size(); i-- > 0;) {
+            if (limbs[i] != other.limbs[i]) {
+                return limbs[i] < other.limbs[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
 
-                case Component::SEPARATOR: {
-                    std::vector<std::string> separators = {"-", "_", ".", "!", "@", "#"};
+    bool operator<(const BigUnsigned& other) const { return compare(other) < 0; }
+    bool operator==(const BigUnsigned& other) const { return compare(other) == 0; }
 
-                    if (!component.options.empty()) {
-                        separators = component.options;
-                    }
+    BigUnsigned& operator+=(const BigUnsigned& other) {
+        if (limbs.size() < other.limbs.size()) {
+            limbs.resize(other.limbs.size(), 0);
+        }
+        uint64_t carry = 0;
+        for (size_t i = 0; i < limbs.size(); i++) {
+            uint64_t sum = carry + limbs[i] + (i < other.limbs.size() ? other.limbs[i] : 0);
+            limbs[i] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        if (carry) {
+            limbs.push_back(static_cast<uint32_t>(carry));
+        }
+        return *this;
+    }
 
-                    std::uniform_int_distribution<> dis(0, separators.size() - 1);
-                    password += separators[dis(gen)];
-                    break;
-                }
+    BigUnsigned& mulSmall(uint32_t factor) {
+        uint64_t carry = 0;
+        for (auto& limb : limbs) {
+            uint64_t product = static_cast<uint64_t>(limb) * factor + carry;
+            limb = static_cast<uint32_t>(product);
+            carry = product >> 32;
+        }
+        if (carry) {
+            limbs.push_back(static_cast<uint32_t>(carry));
+        }
+        trim();
+        return *this;
+    }
+
+    BigUnsigned operator*(const BigUnsigned& other) const {
+        BigUnsigned result;
+        if (isZero() || other.isZero()) {
+            return result;
+        }
+        result.limbs.assign(limbs.size() + other.limbs.size(), 0);
+        for (size_t i = 0; i < limbs.size(); i++) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < other.limbs.size(); j++) {
+                uint64_t cur = result.limbs[i + j] + static_cast<uint64_t>(limbs[i]) * other.limbs[j] + carry;
+                result.limbs[i + j] = static_cast<uint32_t>(cur);
+                carry = cur >> 32;
             }
+            result.limbs[i + other.limbs.size()] = static_cast<uint32_t>(carry);
         }
+        result.trim();
+        return result;
+    }
 
-        return password;
+    // Divides in place and returns the remainder
+    uint32_t divSmall(uint32_t divisor) {
+        uint64_t remainder = 0;
+        for (size_t i = limbs.size(); i-- > 0;) {
+            uint64_t cur = (remainder << 32) | limbs[i];
+            limbs[i] = static_cast<uint32_t>(cur / divisor);
+            remainder = cur % divisor;
+        }
+        trim();
+        return static_cast<uint32_t>(remainder);
     }
 
-    std::string generatePasswordByComplexity(int complexity = 5) {
-        if (complexity < 1 || complexity > 10) {
-            throw std::invalid_argument("Complexity must be 1-10");
+    size_t bitLength() const {
+        if (limbs.empty()) {
+            return 0;
         }
+        size_t bits = 32 * (limbs.size() - 1);
+        for (uint32_t top = limbs.back(); top != 0; top >>= 1) {
+            bits++;
+        }
+        return bits;
+    }
 
-        int length;
-        bool use_uppercase, use_lowercase, use_digits, use_special, exclude_ambiguous;
-        int min_uppercase, min_lowercase, min_digits, min_special;
+    // Divides in place by a multiprecision divisor and returns the remainder
+    BigUnsigned divMod(const BigUnsigned& divisor) {
+        if (divisor.isZero()) {
+            throw std::domain_error("Division by zero");
+        }
+        if (divisor.limbs.size() == 1) {
+            return BigUnsigned(divSmall(divisor.limbs[0]));
+        }
 
-        if (complexity <= 2) {
-            length = 8 + complexity;
-            use_uppercase = complexity >= 2;
-            use_lowercase = true;
-            use_digits = complexity >= 2;
-            use_special = false;
-            exclude_ambiguous = true;
-            min_uppercase = use_uppercase ? 1 : 0;
-            min_lowercase = 2;
-            min_digits = use_digits ? 1 : 0;
-            min_special = 0;
-        } else if (complexity <= 4) {
-            length = 10 + complexity;
-            use_uppercase = true;
-            use_lowercase = true;
-            use_digits = true;
-            use_special = complexity >= 4;
-            exclude_ambiguous = complexity <= 3;
-            min_uppercase = 1;
-            min_lowercase = 2;
-            min_digits = 1;
-            min_special = use_special ? 1 : 0;
-        } else if (complexity <= 6) {
-            length = 12 + complexity;
-            use_uppercase = true;
-            use_lowercase = true;
-            use_digits = true;
-            use_special = true;
-            exclude_ambiguous = false;
-            min_uppercase = 2;
-            min_lowercase = 2;
-            min_digits = 2;
-            min_special = 1;
-        } else if (complexity <= 8) {
-            length = 16 + (complexity - 6) * 2;
-            use_uppercase = true;
-            use_lowercase = true;
-            use_digits = true;
-            use_special = true;
-            exclude_ambiguous = false;
-            min_uppercase = 2;
-            min_lowercase = 3;
-            min_digits = 2;
-            min_special = 2;
-        } else {
-            length = 20 + (complexity - 8) * 4;
-            use_uppercase = true;
-            use_lowercase = true;
-            use_digits = true;
-            use_special = true;
-            exclude_ambiguous = false;
-            min_uppercase = 3;
-            min_lowercase = 4;
-            min_digits = 3;
-            min_special = 3;
+        BigUnsigned remainder;
+        Limbs quotient(limbs.size(), 0);
+        for (size_t bit = bitLength(); bit-- > 0;) {
+            // remainder = remainder * 2 + next bit of the dividend
+            uint32_t carry = (limbs[bit / 32] >> (bit % 32)) & 1;
+            for (auto& limb : remainder.limbs) {
+                uint32_t next = limb >> 31;
+                limb = (limb << 1) | carry;
+                carry = next;
+            }
+            if (carry) {
+                remainder.limbs.push_back(carry);
+            }
+            if (remainder.compare(divisor) >= 0) {
+                remainder -= divisor;
+                quotient[bit / 32] |= 1u << (bit % 32);
+            }
         }
+        limbs = std::move(quotient);
+        trim();
+        return remainder;
+    }
 
-        return generatePassword(length, use_uppercase, use_lowercase, use_digits,
-                              use_special, exclude_ambiguous, min_uppercase,
-                              min_lowercase, min_digits, min_special);
+    static BigUnsigned fromString(const std::string& text) {
+        if (text.empty()) {
+            throw std::invalid_argument("Empty number");
+        }
+        BigUnsigned value;
+        for (char c : text) {
+            if (c < '0' || c > '9') {
+                throw std::invalid_argument("Not a decimal number: " + text);
+            }
+            value.mulSmall(10);
+            value += BigUnsigned(static_cast<uint64_t>(c - '0'));
+        }
+        return value;
     }
 
-    std::string getComplexityDescription(int complexity) {
-        std::map<int, std::string> descriptions = {
-            {1, "Very Simple - lowercase only (9 chars)"},
-            {2, "Simple - letters and digits (10 chars)"},
-            {3, "Basic - letters and digits, no ambiguous (13 chars)"},
-            {4, "Medium - all types, no ambiguous (14 chars)"},
-            {5, "Good - all character types (17 chars)"},
-            {6, "Strong - all types, more requirements (18 chars)"},
-            {7, "Very Strong - increased length (18 chars)"},
-            {8, "Excellent - high requirements (20 chars)"},
-            {9, "Maximum - very long and complex (24 chars)"},
-            {10, "Extreme - maximum protection (28 chars)"}
-        };
+    // Uniform in [0, bound): draws bitLength(bound) random bits and retries when the
+    // draw lands above the bound, which happens less than half the time
+    template <typename Engine>
+    static BigUnsigned random(const BigUnsigned& bound, Engine& engine) {
+        if (bound.isZero()) {
+            throw std::invalid_argument("Empty range");
+        }
+        size_t bits = bound.bitLength();
+        std::uniform_int_distribution<uint32_t> word;
+        while (true) {
+            BigUnsigned value;
+            value.limbs.resize((bits + 31) / 32);
+            for (auto& limb : value.limbs) {
+                limb = word(engine);
+            }
+            if (bits % 32 != 0) {
+                value.limbs.back() &= (1u << (bits % 32)) - 1;
+            }
+            value.trim();
+            if (value < bound) {
+                return value;
+            }
+        }
+    }
 
-        auto it = descriptions.find(complexity);
-        return it != descriptions.end() ? it->second : "Unknown level";
+    // Assumes other <= *this
+    BigUnsigned& operator-=(const BigUnsigned& other) {
+        int64_t borrow = 0;
+        for (size_t i = 0; i < limbs.size(); i++) {
+            int64_t diff = static_cast<int64_t>(limbs[i]) - borrow -
+                           (i < other.limbs.size() ? other.limbs[i] : 0);
+            borrow = diff < 0 ? 1 : 0;
+            limbs[i] = static_cast<uint32_t>(diff + (borrow << 32));
+        }
+        trim();
+        return *this;
     }
 
-    struct PasswordAnalysis {
-        int score;
-        std::string strength;
-        std::vector<std::string> feedback;
-        int length;
-        bool has_lowercase;
-        bool has_uppercase;
-        bool has_digits;
-        bool has_special;
-        int unique_chars;
-    };
+    static BigUnsigned power(uint32_t base, unsigned exponent) {
+        BigUnsigned result(1);
+        BigUnsigned square(base);
+        while (exponent > 0) {
+            if (exponent & 1) {
+                result = result * square;
+            }
+            exponent >>= 1;
+            if (exponent > 0) {
+                square = square * square;
+            }
+        }
+        return result;
+    }
 
-    PasswordAnalysis checkPasswordStrength(const std::string& password) {
-        PasswordAnalysis analysis;
-        analysis.score = 0;
-        analysis.length = password.length();
+    double log2() const {
+        if (limbs.empty()) {
+            return -INFINITY;
+        }
+        size_t n = limbs.size();
+        double top = limbs[n - 1];
+        if (n >= 2) top = top * 4294967296.0 + limbs[n - 2];
+        if (n >= 3) top = top * 4294967296.0 + limbs[n - 3];
+        size_t used = std::min<size_t>(n, 3);
+        return std::log2(top) + 32.0 * (n - used);
+    }
 
-        if (password.length() >= 16) {
-            analysis.score += 3;
-        } else if (password.length() >= 12) {
-            analysis.score += 2;
-        } else if (password.length() >= 8) {
-            analysis.score += 1;
-        } else {
-            analysis.feedback.push_back("Too short");
+    std::string toString() const {
+        if (limbs.empty()) {
+            return "0";
         }
+        BigUnsigned copy = *this;
+        std::string digits_out;
+        while (!copy.isZero()) {
+            digits_out += static_cast<char>('0' + copy.divSmall(10));
+        }
+        std::reverse(digits_out.begin(), digits_out.end());
+        return digits_out;
+    }
+};
 
-        analysis.has_lowercase = std::any_of(password.begin(), password.end(), ::islower);
-        analysis.has_uppercase = std::any_of(password.begin(), password.end(), ::isupper);
-        analysis.has_digits = std::any_of(password.begin(), password.end(), ::isdigit);
-        analysis.has_special = std::any_of(password.begin(), password.end(),
-            [this](char c) { return special_chars.find(c) != std::string::npos; });
+// CRC-32 (IEEE 802.3, reflected), used for file and token checksums. Slicing-by-8:
+// table[k][b] is the CRC of byte b followed by k zero bytes, so eight input bytes
+// take eight independent lookups instead of a chain of eight.
+inline uint32_t crc32(const void* data, size_t size, uint32_t crc = 0) {
+    static const std::vector<std::array<uint32_t, 256>> table = [] {
+        std::vector<std::array<uint32_t, 256>> entries(8);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            entries[0][i] = value;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                entries[k][i] = entries[0][entries[k - 1][i] & 0xFF] ^ (entries[k - 1][i] >> 8);
+            }
+        }
+        return entries;
+    }();
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint32_t low = crc ^ (static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+                              static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24);
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^
+              table[4][low >> 24] ^ table[3][bytes[4]] ^ table[2][bytes[5]] ^ table[1][bytes[6]] ^
+              table[0][bytes[7]];
+    }
+    for (size_t i = 0; i < size; i++) {
+        crc = table[0][(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
 
-        int char_types = analysis.has_lowercase + analysis.has_uppercase +
-                        analysis.has_digits + analysis.has_special;
-        analysis.score += char_types;
+// Read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* mapped = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
 
-        if (char_types < 3) {
-            analysis.feedback.push_back("Use different character types");
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        length = static_cast<size_t>(file_size.QuadPart);
+        if (length > 0) {
+            mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) {
+                CloseHandle(file_handle);
+                throw std::runtime_error("Cannot map '" + path + "'");
+            }
+            mapped = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat '" + path + "'");
         }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* memory = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map '" + path + "'");
+            }
+            mapped = static_cast<const char*>(memory);
+        }
+        ::close(fd);
+#endif
+    }
 
-        std::set<char> unique_set(password.begin(), password.end());
-        analysis.unique_chars = unique_set.size();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (mapped != nullptr) UnmapViewOfFile(mapped);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+#else
+        if (mapped != nullptr) munmap(const_cast<char*>(mapped), length);
+#endif
+    }
 
-        if (analysis.unique_chars >= password.length() * 0.8) {
-            analysis.score += 2;
-        } else if (analysis.unique_chars >= password.length() * 0.6) {
-            analysis.score += 1;
-        } else {
-            analysis.feedback.push_back("Too many repeated characters");
-        }
+    const char* data() const {
+        return mapped;
+    }
 
-        std::vector<std::regex> patterns = {
-            std::regex(R"((.)\1{2,})"),
-            std::regex(R"((012|123|234|345|456|567|678|789|890))"),
-            std::regex(R"((abc|bcd|cde|def|efg|fgh|ghi|hij|ijk|jkl|klm|lmn|mno|nop|opq|pqr|qrs|rst|stu|tuv|uvw|vwx|wxy|xyz))"),
-            std::regex(R"((qwe|wer|ert|rty|tyu|yui|uio|iop|asd|sdf|dfg|fgh|ghj|hjk|jkl|zxc|xcv|cvb|vbn|bnm))")
-        };
+    size_t size() const {
+        return length;
+    }
+};
 
-        std::string lower_password = password;
-        std::transform(lower_password.begin(), lower_password.end(), lower_password.begin(), ::tolower);
+// Writable shared mapping of a file created (or truncated) at a fixed size up front.
+// Stores into data() reach the file through the page cache, like write() would;
+// disjoint ranges may be filled from different threads.
+class MappedOutputFile {
+private:
+    char* mapped = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
 
-        bool pattern_found = false;
-        for (const auto& pattern : patterns) {
-            if (std::regex_search(lower_password, pattern)) {
-                pattern_found = true;
-                break;
+public:
+    MappedOutputFile(const std::string& path, size_t size) : length(size) {
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot create '" + path + "'");
+        }
+        if (length > 0) {
+            // Mapping more than the file holds extends it to that size
+            uint64_t wide = length;
+            mapping = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE,
+                                         static_cast<DWORD>(wide >> 32), static_cast<DWORD>(wide), nullptr);
+            if (mapping == nullptr) {
+                CloseHandle(file_handle);
+                throw std::runtime_error("Cannot map '" + path + "'");
+            }
+            mapped = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+            if (mapped == nullptr) {
+                CloseHandle(mapping);
+                CloseHandle(file_handle);
+                throw std::runtime_error("Cannot map '" + path + "'");
             }
         }
-
-        if (pattern_found) {
-            analysis.score -= 2;
-            analysis.feedback.push_back("Avoid simple sequences");
+#else
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create '" + path + "'");
         }
-
-        std::vector<std::string> common_passwords = {"password", "123456", "qwerty", "admin", "login", "welcome"};
-        for (const auto& common : common_passwords) {
-            if (lower_password.find(common) != std::string::npos) {
-                analysis.score -= 3;
-                analysis.feedback.push_back("Avoid common passwords");
-                break;
+        if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot size '" + path + "'");
+        }
+        if (length > 0) {
+            void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (memory == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map '" + path + "'");
             }
+            mapped = static_cast<char*>(memory);
         }
+        ::close(fd);
+#endif
+    }
 
-        analysis.score = std::max(0, analysis.score);
+    MappedOutputFile(const MappedOutputFile&) = delete;
+    MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+
+    ~MappedOutputFile() {
+#ifdef _WIN32
+        if (mapped != nullptr) UnmapViewOfFile(mapped);
+        if (mapping != nullptr) CloseHandle(mapping);
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+#else
+        if (mapped != nullptr) munmap(mapped, length);
+#endif
+    }
 
-        if (analysis.score >= 10) {
-            analysis.strength = "Excellent";
-        } else if (analysis.score >= 8) {
-            analysis.strength = "Very Strong";
-        } else if (analysis.score >= 6) {
-            analysis.strength = "Strong";
-        } else if (analysis.score >= 4) {
-            analysis.strength = "Medium";
-        } else if (analysis.score >= 2) {
-            analysis.strength = "Weak";
-        } else {
-            analysis.strength = "Very Weak";
-        }
+    char* data() {
+        return mapped;
+    }
 
-        return analysis;
+    size_t size() const {
+        return length;
     }
 };
 
-class UserInterface {
+// Creates or empties path with access for the owner only, for files that hold secrets;
+// callers then write it with std::ofstream. Only regular files have their mode changed,
+// so /dev/stdout and the like stay as they are. Windows relies on the directory's ACL.
+inline void createPrivateFile(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+#else
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create '" + path + "'");
+    }
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && (!S_ISREG(info.st_mode) || fchmod(fd, 0600) == 0);
+    ::close(fd);
+    if (!ok) {
+        throw std::runtime_error("Cannot restrict access to '" + path + "'");
+    }
+#endif
+}
+
+// Moves a fully written file over target in one step, after syncing it, so readers and
+// crashes see either the old contents or the new ones
+inline void replaceFile(const std::string& written, const std::string& target) {
+#ifdef _WIN32
+    if (!MoveFileExA(written.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        throw std::runtime_error("Cannot replace '" + target + "'");
+    }
+#else
+    int fd = ::open(written.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!synced || std::rename(written.c_str(), target.c_str()) != 0) {
+        std::remove(written.c_str());
+        throw std::runtime_error("Cannot replace '" + target + "'");
+    }
+#endif
+}
+
+// Precompiled word list, used straight from a memory mapping.
+//
+// Layout (native byte order, sections 8-byte aligned):
+//   Header
+//   buckets  uint32[max_length + 2]  index of the first word of each length
+//   blocks   uint32[ceil(count / block_size)]  pool offset of each block
+//   pool     front-coded words sorted by (length, text): every block starts with
+//            [len][bytes], the rest are [shared prefix][suffix len][suffix bytes]
+//   weights  uint64[count + 1]  cumulative weights, present when flags & kWeighted
+//
+// Opening only checks the header, the section bounds and the length buckets, so it
+// touches a few pages however large the list is. Lookups check the block offset and
+// weights they use, and verify() scans every entry and the checksum.
+class BinaryWordlist {
+public:
+    static constexpr char kMagic[4] = {'P', 'G', 'W', 'L'};
+    static constexpr uint32_t kByteOrder = 0x01020304;
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kWeighted = 1;
+    static constexpr int kMaxWordLength = 64;
+
+    struct Header {
+        char magic[4];
+        uint32_t byte_order;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t word_count;
+        uint32_t max_length;
+        uint32_t block_size;
+        uint32_t checksum;  // CRC-32 of everything after the header
+        uint64_t buckets_offset;
+        uint64_t blocks_offset;
+        uint64_t pool_offset;
+        uint64_t pool_size;
+        uint64_t weights_offset;
+        uint64_t file_size;
+    };
+
 private:
-    PasswordGenerator gen;
+    MappedFile file;
+    Header header;
+    const uint32_t* buckets = nullptr;
+    const uint32_t* blocks = nullptr;
+    const unsigned char* pool = nullptr;
+    const uint64_t* cumulative = nullptr;
+
+    bool sectionFits(uint64_t offset, uint64_t bytes) const {
+        return offset % 8 == 0 && offset <= file.size() && bytes <= file.size() - offset;
+    }
 
 public:
-    bool askYesNo(const std::string& prompt, bool default_value = true) {
-        std::string default_text = default_value ? "y" : "n";
-        std::string input;
+    explicit BinaryWordlist(const std::string& path) : file(path) {
+        if (file.size() < sizeof(Header)) {
+            throw std::runtime_error("Not a compiled word list: " + path);
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
 
-        while (true) {
-            std::cout << prompt << " (y/n, default " << default_text << "): ";
-            std::getline(std::cin, input);
+        if (std::memcmp(header.magic, kMagic, 4) != 0) {
+            throw std::runtime_error("Not a compiled word list: " + path);
+        }
+        if (header.byte_order != kByteOrder) {
+            throw std::runtime_error("Word list was compiled on a machine with a different byte order");
+        }
+        if (header.version != kVersion) {
+            throw std::runtime_error("Unsupported word list version " + std::to_string(header.version));
+        }
 
-            if (input.empty()) {
-                return default_value;
-            }
+        uint64_t block_count = header.block_size ? (header.word_count + header.block_size - 1) / header.block_size : 0;
+        bool valid = header.file_size == file.size() && header.word_count > 0 && header.block_size > 0 &&
+                     header.max_length <= kMaxWordLength &&
+                     sectionFits(header.buckets_offset, (header.max_length + 2ull) * sizeof(uint32_t)) &&
+                     sectionFits(header.blocks_offset, block_count * sizeof(uint32_t)) &&
+                     header.pool_offset <= file.size() && header.pool_size <= file.size() - header.pool_offset;
+        if (valid && (header.flags & kWeighted)) {
+            valid = sectionFits(header.weights_offset, (header.word_count + 1ull) * sizeof(uint64_t));
+        }
+        if (!valid) {
+            throw std::runtime_error("Corrupt word list: " + path);
+        }
 
-            std::transform(input.begin(), input.end(), input.begin(), ::tolower);
+        buckets = reinterpret_cast<const uint32_t*>(file.data() + header.buckets_offset);
+        blocks = reinterpret_cast<const uint32_t*>(file.data() + header.blocks_offset);
+        pool = reinterpret_cast<const unsigned char*>(file.data() + header.pool_offset);
+        if (header.flags & kWeighted) {
+            cumulative = reinterpret_cast<const uint64_t*>(file.data() + header.weights_offset);
+        }
 
-            if (input == "y" || input == "yes") {
-                return true;
-            } else if (input == "n" || input == "no") {
-                return false;
-            } else {
-                std::cout << "Please enter 'y' or 'n'\n";
-            }
+        // Buckets split [0, word_count) by length
+        valid = buckets[0] == 0 && buckets[header.max_length + 1] == header.word_count;
+        for (uint32_t length = 0; valid && length <= header.max_length; length++) {
+            valid = buckets[length] <= buckets[length + 1];
+        }
+        if (!valid) {
+            throw std::runtime_error("Corrupt word list: " + path);
         }
     }
 
-    int askNumber(const std::string& prompt, int min_val = 1, int max_val = 100, int default_val = -1) {
-        std::string input;
+    uint32_t size() const {
+        return header.word_count;
+    }
 
-        while (true) {
-            if (default_val != -1) {
-                std::cout << prompt << " (default " << default_val << "): ";
-            } else {
-                std::cout << prompt << ": ";
-            }
+    bool weighted() const {
+        return cumulative != nullptr;
+    }
 
-            std::getline(std::cin, input);
+    // Index range [first, second) of words whose length is within the bounds
+    std::pair<uint32_t, uint32_t> lengthRange(int min_length, int max_length) const {
+        int low = std::max(0, min_length);
+        int high = std::min<int>(max_length, header.max_length);
+        if (low > high) {
+            return {0, 0};
+        }
+        return {buckets[low], buckets[high + 1]};
+    }
 
-            if (input.empty() && default_val != -1) {
-                return default_val;
-            }
+    // Total weight of [begin, end); the word count when the list is unweighted
+    uint64_t rangeWeight(uint32_t begin, uint32_t end) const {
+        return cumulative ? cumulative[end] - cumulative[begin] : end - begin;
+    }
 
-            try {
-                int value = std::stoi(input);
-                if (value >= min_val && value <= max_val) {
-                    return value;
+    // Word whose cumulative weight interval within [begin, end) contains target
+    uint32_t weightedIndex(uint32_t begin, uint32_t end, uint64_t target) const {
+        if (!cumulative) {
+            return begin + static_cast<uint32_t>(target);
+        }
+        const uint64_t* found = std::upper_bound(cumulative + begin + 1, cumulative + end + 1,
+                                                 cumulative[begin] + target);
+        uint32_t index = static_cast<uint32_t>(found - cumulative - 1);
+        // Weights out of order can land outside the range or on an empty interval
+        if (index >= end || cumulative[index + 1] <= cumulative[index]) {
+            throw std::runtime_error("Corrupt word list weights");
+        }
+        return index;
+    }
+
+    // Decodes words [begin, end) in order, calling callback(word, weight)
+    template <typename Callback>
+    void forEach(uint32_t begin, uint32_t end, Callback callback) const {
+        if (begin > end || end > header.word_count) {
+            throw std::out_of_range("Word index outside the list");
+        }
+        char buffer[kMaxWordLength + 1];
+        size_t length = 0;
+        const unsigned char* pool_end = pool + header.pool_size;
+
+        for (uint32_t block = begin / header.block_size; block * header.block_size < end; block++) {
+            if (blocks[block] >= header.pool_size) {
+                throw std::runtime_error("Corrupt word list pool");
+            }
+            const unsigned char* pos = pool + blocks[block];
+            uint32_t first = block * header.block_size;
+            uint32_t last = std::min(first + header.block_size, end);
+
+            for (uint32_t index = first; index < last; index++) {
+                size_t shared = 0, suffix;
+                if (index == first) {
+                    if (pos >= pool_end) throw std::runtime_error("Corrupt word list pool");
+                    suffix = *pos++;
                 } else {
-                    std::cout << "Value must be between " << min_val << " and " << max_val << "\n";
+                    if (pos + 1 >= pool_end) throw std::runtime_error("Corrupt word list pool");
+                    shared = *pos++;
+                    suffix = *pos++;
+                }
+                if (shared > length || shared + suffix > kMaxWordLength || pos + suffix > pool_end) {
+                    throw std::runtime_error("Corrupt word list pool");
+                }
+                std::memcpy(buffer + shared, pos, suffix);
+                pos += suffix;
+                length = shared + suffix;
+
+                if (index >= begin) {
+                    uint64_t weight = cumulative ? cumulative[index + 1] - cumulative[index] : 1;
+                    callback(std::string_view(buffer, length), weight);
                 }
-            } catch (const std::exception&) {
-                std::cout << "Please enter a valid number\n";
             }
         }
+        secureZero(buffer, sizeof(buffer));
     }
 
-    std::string askString(const std::string& prompt, const std::string& default_val = "") {
-        std::string input;
+    template <typename String>
+    void wordAt(uint32_t index, String& out) const {
+        forEach(index, index + 1, [&out](std::string_view word, uint64_t) {
+            out.assign(word.data(), word.size());
+        });
+    }
 
-        if (!default_val.empty()) {
-            std::cout << prompt << " (default '" << default_val << "'): ";
-        } else {
-            std::cout << prompt << ": ";
+    // Every block starts inside the pool in order, every word has a positive weight, and
+    // the checksum of everything after the header matches
+    bool verify() const {
+        uint64_t block_count = (header.word_count + header.block_size - 1) / header.block_size;
+        for (uint64_t block = 0; block < block_count; block++) {
+            if (blocks[block] >= header.pool_size || (block == 0 ? blocks[0] != 0 : blocks[block - 1] >= blocks[block])) {
+                return false;
+            }
+        }
+        if (cumulative != nullptr) {
+            if (cumulative[0] != 0) {
+                return false;
+            }
+            for (uint32_t index = 0; index < header.word_count; index++) {
+                if (cumulative[index] >= cumulative[index + 1]) {
+                    return false;
+                }
+            }
         }
+        const char* body = file.data() + sizeof(Header);
+        return crc32(body, file.size() - sizeof(Header)) == header.checksum;
+    }
+};
 
-        std::getline(std::cin, input);
+// Offline compiler from text word lists (one word per line, optionally followed by a
+// weight) to the BinaryWordlist format. Words are lowercased, limited to ASCII letters
+// and deduplicated; weights of duplicates are summed.
+class WordlistCompiler {
+private:
+    std::map<std::string, uint64_t> words;
+    bool has_weights = false;
+    uint64_t total_weight = 0;  // the last cumulative weight written, kept below 2^64
+
+    template <typename T>
+    static void appendValue(std::vector<char>& out, const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
 
-        return input.empty() && !default_val.empty() ? default_val : input;
+    static void alignTo8(std::vector<char>& out) {
+        while (out.size() % 8 != 0) {
+            out.push_back(0);
+        }
     }
 
-    void showMenu() {
-        std::cout << "\n" << std::string(50, '=') << "\n";
-        std::cout << "           PASSWORD GENERATOR\n";
-        std::cout << std::string(50, '=') << "\n";
-        std::cout << "1. Standard password\n";
-        std::cout << "2. Memorable password\n";
-        std::cout << "3. Complex memorable password\n";
-        std::cout << "4. Custom password builder\n";
-        std::cout << "5. Multiple passwords\n";
-        std::cout << "6. Check password strength\n";
-        std::cout << "7. Quick generation\n";
-        std::cout << "8. Generate by complexity level\n";
-        std::cout << "0. Exit\n";
-        std::cout << std::string(50, '=') << "\n";
+public:
+    bool addWord(std::string_view raw, uint64_t weight = 1) {
+        std::string word;
+        for (char c : raw) {
+            if (!std::isalpha(static_cast<unsigned char>(c))) {
+                return false;
+            }
+            word += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        if (word.empty() || word.size() > BinaryWordlist::kMaxWordLength || weight == 0) {
+            return false;
+        }
+        if (weight > std::numeric_limits<uint64_t>::max() - total_weight) {
+            throw std::overflow_error("Word weights add up to more than 2^64");
+        }
+        total_weight += weight;
+        words[word] += weight;
+        return true;
     }
 
-    // NEW: Custom password builder interactive function
-    void buildCustomPasswordInteractive() {
-        std::cout << "\n--- CUSTOM PASSWORD BUILDER ---\n";
-        std::cout << "Build a password from components of your choice!\n";
-        std::cout << "\nAvailable component types:\n";
-        std::cout << "1. Text (fixed string)\n";
-        std::cout << "2. Random word\n";
-        std::cout << "3. Random characters\n";
-        std::cout << "4. Number\n";
-        std::cout << "5. Separator\n";
+    // Returns the number of accepted lines
+    size_t addTextFile(const std::string& path) {
+        std::ifstream input(path);
+        if (!input) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
 
-        std::vector<PasswordGenerator::Component> components;
+        size_t accepted = 0;
+        uint64_t line_number = 0;
+        std::string line;
+        while (std::getline(input, line)) {
+            line_number++;
+            std::istringstream fields(line);
+            std::string word, weight_text;
+            if (!(fields >> word) || word[0] == '#') {
+                continue;
+            }
+            auto where = [&] { return " on line " + std::to_string(line_number) + " of '" + path + "'"; };
+
+            // A positive decimal integer and nothing else: no sign, no trailing text
+            uint64_t weight = 1;
+            if (fields >> weight_text) {
+                const char* end = weight_text.data() + weight_text.size();
+                auto parsed = std::from_chars(weight_text.data(), end, weight);
+                if (parsed.ec != std::errc() || parsed.ptr != end || weight == 0) {
+                    throw std::invalid_argument("Bad weight '" + weight_text + "'" + where());
+                }
+                has_weights = true;
+            }
+
+            if (weight > std::numeric_limits<uint64_t>::max() - total_weight) {
+                throw std::overflow_error("Word weights add up to more than 2^64" + where());
+            }
+            if (addWord(word, weight)) {
+                accepted++;
+            }
+        }
+        return accepted;
+    }
+
+    size_t size() const {
+        return words.size();
+    }
+
+    void write(const std::string& path, uint32_t block_size = 16) const {
+        if (words.empty()) {
+            throw std::invalid_argument("No words to compile");
+        }
+
+        std::vector<std::pair<std::string, uint64_t>> sorted(words.begin(), words.end());
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+            return a.first.size() < b.first.size();
+        });
+
+        BinaryWordlist::Header header = {};
+        std::memcpy(header.magic, BinaryWordlist::kMagic, 4);
+        header.byte_order = BinaryWordlist::kByteOrder;
+        header.version = BinaryWordlist::kVersion;
+        header.flags = has_weights ? BinaryWordlist::kWeighted : 0;
+        header.word_count = static_cast<uint32_t>(sorted.size());
+        header.max_length = static_cast<uint32_t>(sorted.back().first.size());
+        header.block_size = block_size;
+
+        std::vector<char> out(sizeof(BinaryWordlist::Header), 0);
+
+        header.buckets_offset = out.size();
+        for (uint32_t length = 0, index = 0; length <= header.max_length + 1; length++) {
+            while (index < sorted.size() && sorted[index].first.size() < length) {
+                index++;
+            }
+            appendValue(out, index);
+        }
+        alignTo8(out);
+
+        std::vector<char> pool;
+        std::vector<uint32_t> block_offsets;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            const std::string& word = sorted[i].first;
+            if (i % block_size == 0) {
+                block_offsets.push_back(static_cast<uint32_t>(pool.size()));
+                pool.push_back(static_cast<char>(word.size()));
+                pool.insert(pool.end(), word.begin(), word.end());
+            } else {
+                const std::string& previous = sorted[i - 1].first;
+                size_t shared = 0;
+                while (shared < previous.size() && shared < word.size() && previous[shared] == word[shared]) {
+                    shared++;
+                }
+                pool.push_back(static_cast<char>(shared));
+                pool.push_back(static_cast<char>(word.size() - shared));
+                pool.insert(pool.end(), word.begin() + shared, word.end());
+            }
+        }
+
+        header.blocks_offset = out.size();
+        for (uint32_t offset : block_offsets) {
+            appendValue(out, offset);
+        }
+        alignTo8(out);
+
+        header.pool_offset = out.size();
+        header.pool_size = pool.size();
+        out.insert(out.end(), pool.begin(), pool.end());
+        alignTo8(out);
+
+        if (has_weights) {
+            header.weights_offset = out.size();
+            uint64_t total = 0;
+            appendValue(out, total);
+            for (const auto& entry : sorted) {
+                total += entry.second;
+                appendValue(out, total);
+            }
+        }
+
+        header.file_size = out.size();
+        header.checksum = crc32(out.data() + sizeof(header), out.size() - sizeof(header));
+        std::memcpy(out.data(), &header, sizeof(header));
+
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        if (!output.write(out.data(), out.size())) {
+            throw std::runtime_error("Cannot write '" + path + "'");
+        }
+    }
+};
+
+// Binary password batch, read straight from a memory mapping so record i costs one
+// address computation.
+//
+// Layout (native byte order, sections 8-byte aligned):
+//   Header
+//   policy     text of the spec the batch was generated from
+//   records    fixed width: record_width bytes per password, padded with NUL
+//              indexed: the passwords back to back
+//   offsets    uint64[count + 1]  start of each password in records, when flags & kIndexed
+//   strengths  uint8[count]  strength score per password, when flags & kStrength
+class BatchFile {
+public:
+    static constexpr char kMagic[4] = {'P', 'G', 'B', 'T'};
+    static constexpr uint32_t kByteOrder = 0x01020304;
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kIndexed = 1;
+    static constexpr uint32_t kStrength = 2;
+
+    struct Header {
+        char magic[4];
+        uint32_t byte_order;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t record_width;  // 0 when indexed
+        uint32_t policy_hash;   // CRC-32 of the policy text
+        uint32_t checksum;      // CRC-32 of everything after the header
+        uint32_t reserved;
+        uint64_t record_count;
+        uint64_t policy_offset;
+        uint64_t policy_size;
+        uint64_t records_offset;
+        uint64_t records_size;
+        uint64_t offsets_offset;
+        uint64_t strengths_offset;
+        uint64_t file_size;
+    };
+
+private:
+    MappedFile file;
+    Header header;
+    const char* records = nullptr;
+    const uint64_t* offsets = nullptr;
+    const uint8_t* strengths = nullptr;
+
+    bool sectionFits(uint64_t offset, uint64_t bytes) const {
+        return offset % 8 == 0 && offset <= file.size() && bytes <= file.size() - offset;
+    }
+
+public:
+    explicit BatchFile(const std::string& path) : file(path) {
+        if (file.size() < sizeof(Header)) {
+            throw std::runtime_error("Not a password batch: " + path);
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+
+        if (std::memcmp(header.magic, kMagic, 4) != 0) {
+            throw std::runtime_error("Not a password batch: " + path);
+        }
+        if (header.byte_order != kByteOrder) {
+            throw std::runtime_error("Batch was written on a machine with a different byte order");
+        }
+        if (header.version != kVersion) {
+            throw std::runtime_error("Unsupported batch version " + std::to_string(header.version));
+        }
+
+        uint64_t count = header.record_count;
+        bool indexed = (header.flags & kIndexed) != 0;
+        bool valid = header.file_size == file.size() && (indexed == (header.record_width == 0)) &&
+                     sectionFits(header.policy_offset, header.policy_size) &&
+                     sectionFits(header.records_offset, header.records_size) &&
+                     count <= file.size();
+        if (valid && !indexed) {
+            valid = header.records_size / header.record_width == count &&
+                    header.records_size % header.record_width == 0;
+        }
+        if (valid && indexed) {
+            valid = sectionFits(header.offsets_offset, (count + 1) * sizeof(uint64_t));
+        }
+        if (valid && (header.flags & kStrength)) {
+            valid = sectionFits(header.strengths_offset, count);
+        }
+        if (!valid) {
+            throw std::runtime_error("Corrupt password batch: " + path);
+        }
+
+        records = file.data() + header.records_offset;
+        if (indexed) {
+            offsets = reinterpret_cast<const uint64_t*>(file.data() + header.offsets_offset);
+        }
+        if (header.flags & kStrength) {
+            strengths = reinterpret_cast<const uint8_t*>(file.data() + header.strengths_offset);
+        }
+    }
+
+    uint64_t size() const {
+        return header.record_count;
+    }
+
+    bool indexed() const {
+        return offsets != nullptr;
+    }
+
+    bool hasStrength() const {
+        return strengths != nullptr;
+    }
+
+    uint32_t recordWidth() const {
+        return header.record_width;
+    }
+
+    std::string_view policy() const {
+        return std::string_view(file.data() + header.policy_offset, header.policy_size);
+    }
+
+    uint32_t policyHash() const {
+        return header.policy_hash;
+    }
+
+    // A view into the mapping; copy it into a SecureString to keep it past the file
+    std::string_view record(uint64_t index) const {
+        if (index >= header.record_count) {
+            throw std::out_of_range("Record outside the batch");
+        }
+        if (offsets) {
+            // Checked per record so opening a batch stays O(1)
+            uint64_t begin = offsets[index], end = offsets[index + 1];
+            if (begin > end || end > header.records_size) {
+                throw std::runtime_error("Corrupt password batch offsets");
+            }
+            return std::string_view(records + begin, end - begin);
+        }
+        const char* start = records + index * header.record_width;
+        const void* end = std::memchr(start, 0, header.record_width);
+        return std::string_view(start, end ? static_cast<const char*>(end) - start : header.record_width);
+    }
+
+    // Strength score of a record, 0 when the batch carries none
+    uint8_t strength(uint64_t index) const {
+        if (index >= header.record_count) {
+            throw std::out_of_range("Record outside the batch");
+        }
+        return strengths ? strengths[index] : 0;
+    }
+
+    bool verify() const {
+        const char* body = file.data() + sizeof(Header);
+        return crc32(body, file.size() - sizeof(Header)) == header.checksum;
+    }
+};
+
+// Streams passwords into the BatchFile format. Records go to disk as they are added;
+// only the offsets and strengths (9 bytes per password at most) are held until finish()
+// appends them and rewrites the header.
+class BatchWriter {
+private:
+    std::string path;
+    std::ofstream output;
+    BatchFile::Header header = {};
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> strengths;
+    std::vector<char> record;
+    uint32_t checksum = 0;
+    uint64_t position = 0;
+    bool finished = false;
+
+    void put(const char* data, size_t size) {
+        if (!output.write(data, size)) {
+            throw std::runtime_error("Cannot write '" + path + "'");
+        }
+        checksum = crc32(data, size, checksum);
+        position += size;
+    }
+
+    void alignTo8() {
+        static const char zeros[8] = {};
+        if (position % 8 != 0) {
+            put(zeros, 8 - position % 8);
+        }
+    }
+
+public:
+    // record_width 0 writes an indexed batch, which takes passwords of any length
+    BatchWriter(const std::string& file_path, std::string_view policy, uint32_t record_width,
+                bool with_strength)
+        : path(file_path) {
+        // Records are cleartext passwords
+        createPrivateFile(path);
+        output.open(path, std::ios::binary | std::ios::trunc);
+        if (!output) {
+            throw std::runtime_error("Cannot create '" + path + "'");
+        }
+        std::memcpy(header.magic, BatchFile::kMagic, 4);
+        header.byte_order = BatchFile::kByteOrder;
+        header.version = BatchFile::kVersion;
+        header.flags = (record_width == 0 ? BatchFile::kIndexed : 0) | (with_strength ? BatchFile::kStrength : 0);
+        header.record_width = record_width;
+        header.policy_hash = crc32(policy.data(), policy.size());
+
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        position = sizeof(header);
+        header.policy_offset = position;
+        header.policy_size = policy.size();
+        put(policy.data(), policy.size());
+        alignTo8();
+        header.records_offset = position;
+
+        if (record_width == 0) {
+            offsets.push_back(0);
+        } else {
+            record.resize(record_width);
+        }
+    }
+
+    BatchWriter(const BatchWriter&) = delete;
+    BatchWriter& operator=(const BatchWriter&) = delete;
+
+    ~BatchWriter() {
+        secureZero(record.data(), record.size());
+    }
+
+    void add(std::string_view password, int strength = 0) {
+        if (finished) {
+            throw std::logic_error("Batch already finished");
+        }
+        if (header.record_width == 0) {
+            put(password.data(), password.size());
+            offsets.push_back(position - header.records_offset);
+        } else {
+            if (password.size() > header.record_width || password.find('\0') != std::string_view::npos) {
+                throw std::invalid_argument("Password does not fit a fixed-width record");
+            }
+            std::fill(record.begin(), record.end(), 0);
+            std::memcpy(record.data(), password.data(), password.size());
+            put(record.data(), record.size());
+        }
+        if (header.flags & BatchFile::kStrength) {
+            strengths.push_back(static_cast<uint8_t>(std::min(255, std::max(0, strength))));
+        }
+        header.record_count++;
+    }
+
+    uint64_t size() const {
+        return header.record_count;
+    }
+
+    void finish() {
+        if (finished) {
+            return;
+        }
+        header.records_size = position - header.records_offset;
+        alignTo8();
+        if (header.flags & BatchFile::kIndexed) {
+            header.offsets_offset = position;
+            put(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        }
+        if (header.flags & BatchFile::kStrength) {
+            header.strengths_offset = position;
+            put(reinterpret_cast<const char*>(strengths.data()), strengths.size());
+        }
+        header.file_size = position;
+        header.checksum = checksum;
+
+        output.seekp(0);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.close();
+        if (!output) {
+            throw std::runtime_error("Cannot write '" + path + "'");
+        }
+        finished = true;
+    }
+};
+
+// Walker/Vose alias table: samples a discrete distribution with one slot draw and one
+// 32-bit coin flip. probability() is the exact probability of the quantized table,
+// not of the input weights, so log-probabilities describe what is actually sampled.
+class AliasTable {
+private:
+    std::vector<uint32_t> thresholds;
+    std::vector<uint32_t> aliases;
+    std::vector<double> probabilities;
+
+    void computeProbabilities() {
+        size_t n = thresholds.size();
+        std::vector<double> mass(n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            if (aliases[i] == i) {
+                mass[i] += 4294967296.0;
+            } else {
+                mass[i] += thresholds[i];
+                mass[aliases[i]] += 4294967296.0 - thresholds[i];
+            }
+        }
+        probabilities.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            probabilities[i] = mass[i] / (4294967296.0 * n);
+        }
+    }
+
+public:
+    AliasTable() = default;
+
+    explicit AliasTable(const std::vector<double>& weights) {
+        size_t n = weights.size();
+        double total = 0.0;
+        for (double weight : weights) {
+            if (weight < 0.0) {
+                throw std::invalid_argument("Negative weight");
+            }
+            total += weight;
+        }
+        if (n == 0 || total <= 0.0) {
+            throw std::invalid_argument("Alias table needs a positive weight");
+        }
+
+        thresholds.assign(n, 0);
+        aliases.resize(n);
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = weights[i] * n / total;
+            aliases[i] = static_cast<uint32_t>(i);
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+
+        while (!small.empty() && !large.empty()) {
+            uint32_t low = small.back();
+            small.pop_back();
+            uint32_t high = large.back();
+
+            thresholds[low] = static_cast<uint32_t>(std::min(4294967295.0, std::floor(scaled[low] * 4294967296.0)));
+            aliases[low] = high;
+            scaled[high] -= 1.0 - scaled[low];
+            if (scaled[high] < 1.0) {
+                large.pop_back();
+                small.push_back(high);
+            }
+        }
+        // Leftovers are full slots up to rounding error; aliasing a slot to itself marks it full
+        for (uint32_t i : small) aliases[i] = i;
+        for (uint32_t i : large) aliases[i] = i;
+
+        computeProbabilities();
+    }
+
+    // Rebuilds a table from stored slots
+    AliasTable(std::vector<uint32_t> slot_thresholds, std::vector<uint32_t> slot_aliases)
+        : thresholds(std::move(slot_thresholds)), aliases(std::move(slot_aliases)) {
+        if (thresholds.empty() || thresholds.size() != aliases.size()) {
+            throw std::invalid_argument("Malformed alias table");
+        }
+        for (uint32_t alias : aliases) {
+            if (alias >= thresholds.size()) {
+                throw std::invalid_argument("Malformed alias table");
+            }
+        }
+        computeProbabilities();
+    }
+
+    size_t size() const {
+        return thresholds.size();
+    }
+
+    bool empty() const {
+        return thresholds.empty();
+    }
+
+    template <typename Engine>
+    uint32_t sample(Engine& engine) const {
+        std::uniform_int_distribution<uint32_t> slot_dis(0, static_cast<uint32_t>(thresholds.size() - 1));
+        uint32_t slot = slot_dis(engine);
+        uint32_t coin = static_cast<uint32_t>(engine());
+        return coin < thresholds[slot] ? slot : aliases[slot];
+    }
+
+    double probability(uint32_t index) const {
+        return probabilities[index];
+    }
+
+    double entropy() const {
+        double bits = 0.0;
+        for (double p : probabilities) {
+            if (p > 0.0) {
+                bits -= p * std::log2(p);
+            }
+        }
+        return bits;
+    }
+
+    const std::vector<uint32_t>& slotThresholds() const {
+        return thresholds;
+    }
+
+    const std::vector<uint32_t>& slotAliases() const {
+        return aliases;
+    }
+};
+
+// Character n-gram model over lowercase letters for pronounceable passwords. Every
+// context (the previous order - 1 letters, padded with a word boundary) owns an alias
+// table of next letters, so generation costs one table sample per character.
+class MarkovModel {
+public:
+    static constexpr int kSymbols = 27;  // word boundary + a-z
+    static constexpr int kMaxOrder = 4;
+    static constexpr char kMagic[4] = {'P', 'G', 'M', 'K'};
+    static constexpr uint32_t kVersion = 1;
+
+private:
+    int order = 3;
+    uint32_t context_count = 0;
+    std::vector<int32_t> table_index;  // context -> tables slot, -1 when never followed by a letter
+    std::vector<AliasTable> tables;
+    std::vector<std::vector<double>> counts;  // training only
+    std::map<int, double> entropy_cache;
+
+    static int symbolOf(char c) {
+        return c >= 'a' && c <= 'z' ? c - 'a' + 1 : -1;
+    }
+
+    uint32_t nextContext(uint32_t context, int symbol) const {
+        return (context * kSymbols + symbol) % context_count;
+    }
+
+public:
+    explicit MarkovModel(int model_order = 3) : order(model_order) {
+        if (order < 1 || order > kMaxOrder) {
+            throw std::invalid_argument("Markov order must be 1-" + std::to_string(kMaxOrder));
+        }
+        context_count = 1;
+        for (int i = 1; i < order; i++) {
+            context_count *= kSymbols;
+        }
+        counts.assign(context_count, std::vector<double>(26, 0.0));
+    }
+
+    int getOrder() const {
+        return order;
+    }
+
+    // The context that starts a word: all positions are boundaries
+    uint32_t startContext() const {
+        return 0;
+    }
+
+    // Adds one word; characters other than letters split it into separate words
+    void train(std::string_view text, double weight = 1.0) {
+        uint32_t context = startContext();
+        for (char raw : text) {
+            int symbol = symbolOf(static_cast<char>(std::tolower(static_cast<unsigned char>(raw))));
+            if (symbol < 0) {
+                context = startContext();
+                continue;
+            }
+            counts[context][symbol - 1] += weight;
+            context = nextContext(context, symbol);
+        }
+    }
+
+    void trainFile(const std::string& path) {
+        std::ifstream input(path);
+        if (!input) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        std::string line;
+        while (std::getline(input, line)) {
+            train(line);
+        }
+    }
+
+    // Turns the training counts into alias tables
+    void build() {
+        table_index.assign(context_count, -1);
+        tables.clear();
+        for (uint32_t context = 0; context < context_count; context++) {
+            const auto& row = counts[context];
+            if (std::any_of(row.begin(), row.end(), [](double count) { return count > 0.0; })) {
+                table_index[context] = static_cast<int32_t>(tables.size());
+                tables.emplace_back(row);
+            }
+        }
+        if (table_index[startContext()] < 0) {
+            throw std::invalid_argument("Markov model needs at least one training word");
+        }
+        counts.clear();
+        entropy_cache.clear();
+    }
+
+    // Appends length letters and adds the log-probability of the choices to bits.
+    // Contexts that were only ever seen at the end of a word restart from the start
+    // context, which strings pseudo-words together.
+    template <typename String, typename Engine>
+    void generate(int length, Engine& engine, String& out, double& bits) const {
+        uint32_t context = startContext();
+        for (int i = 0; i < length; i++) {
+            int32_t slot = table_index[context];
+            if (slot < 0) {
+                context = startContext();
+                slot = table_index[context];
+            }
+            const AliasTable& table = tables[slot];
+            uint32_t letter = table.sample(engine);
+            bits -= std::log2(table.probability(letter));
+            out += static_cast<char>('a' + letter);
+            context = nextContext(context, letter + 1);
+        }
+    }
+
+    // Exact Shannon entropy of generate(length): the per-step conditional entropies
+    // weighted by the probability of being in each context at that step
+    double expectedEntropy(int length) {
+        auto cached = entropy_cache.find(length);
+        if (cached != entropy_cache.end()) {
+            return cached->second;
+        }
+
+        std::vector<double> state(context_count, 0.0), next(context_count, 0.0);
+        state[startContext()] = 1.0;
+        double bits = 0.0;
+        for (int step = 0; step < length; step++) {
+            std::fill(next.begin(), next.end(), 0.0);
+            for (uint32_t context = 0; context < context_count; context++) {
+                if (state[context] == 0.0) {
+                    continue;
+                }
+                uint32_t effective = table_index[context] < 0 ? startContext() : context;
+                const AliasTable& table = tables[table_index[effective]];
+                bits += state[context] * table.entropy();
+                for (uint32_t letter = 0; letter < table.size(); letter++) {
+                    double p = table.probability(letter);
+                    if (p > 0.0) {
+                        next[nextContext(effective, letter + 1)] += state[context] * p;
+                    }
+                }
+            }
+            state.swap(next);
+        }
+        entropy_cache[length] = bits;
+        return bits;
+    }
+
+    void save(const std::string& path) const {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        if (!output) {
+            throw std::runtime_error("Cannot write '" + path + "'");
+        }
+        uint32_t fields[4] = {BinaryWordlist::kByteOrder, kVersion, static_cast<uint32_t>(order),
+                              static_cast<uint32_t>(tables.size())};
+        output.write(kMagic, 4);
+        output.write(reinterpret_cast<const char*>(fields), sizeof(fields));
+        for (uint32_t context = 0; context < context_count; context++) {
+            if (table_index[context] < 0) {
+                continue;
+            }
+            const AliasTable& table = tables[table_index[context]];
+            output.write(reinterpret_cast<const char*>(&context), sizeof(context));
+            output.write(reinterpret_cast<const char*>(table.slotThresholds().data()), 26 * sizeof(uint32_t));
+            output.write(reinterpret_cast<const char*>(table.slotAliases().data()), 26 * sizeof(uint32_t));
+        }
+        if (!output) {
+            throw std::runtime_error("Cannot write '" + path + "'");
+        }
+    }
+
+    static std::shared_ptr<MarkovModel> load(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        char magic[4];
+        uint32_t fields[4];
+        if (!input.read(magic, 4) || std::memcmp(magic, kMagic, 4) != 0 ||
+            !input.read(reinterpret_cast<char*>(fields), sizeof(fields))) {
+            throw std::runtime_error("Not a Markov model: " + path);
+        }
+        if (fields[0] != BinaryWordlist::kByteOrder || fields[1] != kVersion) {
+            throw std::runtime_error("Unsupported Markov model: " + path);
+        }
+
+        auto model = std::make_shared<MarkovModel>(static_cast<int>(fields[2]));
+        model->counts.clear();
+        model->table_index.assign(model->context_count, -1);
+        for (uint32_t i = 0; i < fields[3]; i++) {
+            uint32_t context;
+            std::vector<uint32_t> thresholds(26), aliases(26);
+            if (!input.read(reinterpret_cast<char*>(&context), sizeof(context)) ||
+                !input.read(reinterpret_cast<char*>(thresholds.data()), 26 * sizeof(uint32_t)) ||
+                !input.read(reinterpret_cast<char*>(aliases.data()), 26 * sizeof(uint32_t)) ||
+                context >= model->context_count) {
+                throw std::runtime_error("Corrupt Markov model: " + path);
+            }
+            model->table_index[context] = static_cast<int32_t>(model->tables.size());
+            model->tables.emplace_back(std::move(thresholds), std::move(aliases));
+        }
+        if (model->table_index[model->startContext()] < 0) {
+            throw std::runtime_error("Corrupt Markov model: " + path);
+        }
+        return model;
+    }
+};
+
+// Estimates how many guesses an attacker trying likely passwords first needs before
+// reaching a given one, from a byte n-gram model trained offline on a password corpus.
+// The model is a Katz backoff: the previous order-1 bytes (padded with 0 at the start;
+// 0 also ends a password) predict the next byte with an absolutely discounted
+// probability, and pass the remaining mass to the next shorter context. Costs, -log2 P,
+// are quantized to 1/16 bit and packed with a 20-bit fingerprint into 32-bit slots.
+// Sixteen slots make a cache-line bucket, and the buckets form one open-addressed
+// table used straight from a memory mapping. A password's cost
+// becomes a guess number through a table built from Monte Carlo samples of the model
+// (Dell'Amico and Filippone): reaching cost c takes sum(2^c_i) / n guesses over the n
+// samples c_i cheaper than c.
+//
+// Layout (native byte order, sections 8-byte aligned):
+//   Header
+//   unigram  uint16[256]         cost of each byte with no context
+//   guesses  uint16[kCostSteps]  log2 of the guess number in 1/16 bits, by cost step
+//   buckets  uint32[kBucketSlots << bucket_bits], 64-byte aligned: fingerprint << 12 |
+//            cost, filled from the front, 0 when empty. The cost of a context's
+//            backoff weight is stored plus kBackoffBias, as it can be negative.
+class GuessModel {
+public:
+    static constexpr char kMagic[4] = {'P', 'G', 'G', 'M'};
+    static constexpr uint32_t kVersion = 1;
+    static constexpr int kMaxOrder = 6;
+    static constexpr uint32_t kCostScale = 16;    // cost steps per bit
+    static constexpr uint32_t kCostSteps = 4096;
+    static constexpr uint32_t kBackoff = 256;     // symbol that keys a context's backoff weight
+    static constexpr int kBackoffBias = 2048;
+    static constexpr size_t kBucketSlots = 16;
+    static constexpr double kGuessable = 33.2;    // log2 of 10^10 guesses, a fast offline attack
+
+    struct Header {
+        char magic[4];
+        uint32_t byte_order;
+        uint32_t version;
+        uint32_t order;
+        uint32_t bucket_bits;
+        uint32_t checksum;  // CRC-32 of everything after the header
+        uint64_t training_lines;
+        uint64_t samples;
+        uint64_t unigram_offset;
+        uint64_t guesses_offset;
+        uint64_t buckets_offset;
+        uint64_t file_size;
+    };
+
+    // Hash of the last k context bytes; a symbol after it only costs an XOR more
+    static uint64_t contextHash(int k, uint64_t context) {
+        uint64_t key = (static_cast<uint64_t>(k) << 60) ^ context;
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    static uint64_t slotHash(uint64_t context_hash, uint32_t symbol) {
+        return context_hash ^ ((symbol + 1ull) * 0x9e3779b97f4a7c15ull);
+    }
+
+    static uint32_t fingerprint(uint64_t hash) {
+        uint32_t tag = static_cast<uint32_t>(hash >> 44);
+        return tag != 0 ? tag : 1;
+    }
+
+    // The trainer keeps tables at most half full, so nearly every search ends in its first
+    // bucket and a miss meets an empty slot early
+    static bool loadFits(uint64_t used, uint64_t slots) {
+        return used * 2 <= slots;
+    }
+
+    // Models built before the limit was halved are up to 3/4 full and still load
+    static bool loadAccepted(uint64_t used, uint64_t slots) {
+        return used * 4 <= slots * 3;
+    }
+
+    static uint64_t contextMask(int k) {
+        return k == 0 ? 0 : ~0ull >> (64 - 8 * k);
+    }
+
+private:
+    MappedFile file;
+    Header header;
+    const uint16_t* unigram = nullptr;
+    const uint16_t* guesses = nullptr;
+    const uint32_t* buckets = nullptr;
+    uint64_t bucket_mask = 0;
+    int order = 1;
+
+    bool sectionFits(uint64_t offset, uint64_t bytes) const {
+        return offset % 8 == 0 && offset <= file.size() && bytes <= file.size() - offset;
+    }
+
+    const uint32_t* bucketOf(uint64_t hash) const {
+        return buckets + (hash & bucket_mask) * kBucketSlots;
+    }
+
+    // Stored value for hash, or -1 when there is none. A bucket with an empty slot ends
+    // the search; full ones, which the load factor makes rare, pass on to the next, at
+    // most once around the table.
+    int find(uint64_t hash) const {
+        uint32_t tag = fingerprint(hash) << 12;
+        for (uint64_t probed = 0; probed <= bucket_mask; probed++) {
+            const uint32_t* bucket = bucketOf(hash + probed);
+#ifdef PSWD_GEN_X86
+            // SSE2 is part of x86-64, so the whole bucket is compared in four loads with
+            // no dispatch. Tags are never 0, so a match always precedes the first empty slot.
+            const __m128i want = _mm_set1_epi32(static_cast<int>(tag));
+            const __m128i tag_bits = _mm_set1_epi32(static_cast<int>(~0xFFFu));
+            const __m128i zero = _mm_setzero_si128();
+            uint32_t matches = 0, empties = 0;
+            for (int part = 0; part < 4; part++) {
+                __m128i slots = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bucket) + part);
+                matches |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(
+                               _mm_cmpeq_epi32(_mm_and_si128(slots, tag_bits), want)))) << (4 * part);
+                empties |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(slots, zero))))
+                           << (4 * part);
+            }
+            if (matches != 0) {
+                return static_cast<int>(bucket[lowestBit(matches)] & 0xFFF);
+            }
+            if (empties != 0) {
+                return -1;
+            }
+#else
+            for (size_t i = 0; i < kBucketSlots; i++) {
+                if (bucket[i] == 0) {
+                    return -1;
+                }
+                if ((bucket[i] & ~0xFFFu) == tag) {
+                    return static_cast<int>(bucket[i] & 0xFFF);
+                }
+            }
+#endif
+        }
+        return -1;
+    }
+
+    static int lowestBit(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(bits);
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return static_cast<int>(index);
+#else
+        int index = 0;
+        while ((bits & 1) == 0) {
+            bits >>= 1;
+            index++;
+        }
+        return index;
+#endif
+    }
+
+    static void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#elif defined(PSWD_GEN_X86)
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+        (void)address;
+#endif
+    }
+
+    // Cost steps of one symbol from the hashes of its lookups. Starts at the longest
+    // context: one listing the symbol gives its cost, one that does not adds its backoff
+    // weight and defers to the next shorter, and an unseen one (no backoff entry) is
+    // skipped.
+    int symbolCost(const uint64_t* hashes, uint32_t symbol) const {
+        int cost = 0;
+        for (int k = order - 1; k >= 1; k--) {
+            const uint64_t* lookup = hashes + 2 * (k - 1);
+            int backoff = find(lookup[0]);
+            if (backoff < 0) {
+                continue;
+            }
+            int gram = find(lookup[1]);
+            if (gram >= 0) {
+                return std::max(0, cost + gram);
+            }
+            cost += backoff - kBackoffBias;
+        }
+        return std::max(0, cost + unigram[symbol]);
+    }
+
+public:
+    explicit GuessModel(const std::string& path) : file(path) {
+        if (file.size() < sizeof(Header)) {
+            throw std::runtime_error("Not a guess model: " + path);
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+
+        if (std::memcmp(header.magic, kMagic, 4) != 0) {
+            throw std::runtime_error("Not a guess model: " + path);
+        }
+        if (header.byte_order != BinaryWordlist::kByteOrder) {
+            throw std::runtime_error("Guess model was built on a machine with a different byte order");
+        }
+        if (header.version != kVersion) {
+            throw std::runtime_error("Unsupported guess model version " + std::to_string(header.version));
+        }
+        bool valid = header.file_size == file.size() && header.order >= 1 && header.order <= kMaxOrder &&
+                     header.bucket_bits < 36 && header.buckets_offset % 64 == 0 &&
+                     sectionFits(header.unigram_offset, 256 * sizeof(uint16_t)) &&
+                     sectionFits(header.guesses_offset, kCostSteps * sizeof(uint16_t)) &&
+                     sectionFits(header.buckets_offset, (kBucketSlots << header.bucket_bits) * sizeof(uint32_t));
+        if (!valid) {
+            throw std::runtime_error("Corrupt guess model: " + path);
+        }
+
+        order = static_cast<int>(header.order);
+        unigram = reinterpret_cast<const uint16_t*>(file.data() + header.unigram_offset);
+        guesses = reinterpret_cast<const uint16_t*>(file.data() + header.guesses_offset);
+        buckets = reinterpret_cast<const uint32_t*>(file.data() + header.buckets_offset);
+        bucket_mask = (1ull << header.bucket_bits) - 1;
+
+        uint64_t used = 0;
+        for (uint64_t i = 0; i < slotCount(); i++) {
+            used += buckets[i] != 0;
+        }
+        if (!loadAccepted(used, slotCount())) {
+            throw std::runtime_error("Corrupt guess model: " + path);
+        }
+    }
+
+    int getOrder() const {
+        return order;
+    }
+
+    uint64_t trainingLines() const {
+        return header.training_lines;
+    }
+
+    uint64_t slotCount() const {
+        return (bucket_mask + 1) * kBucketSlots;
+    }
+
+    // -log2 of the password's probability under the model, its end included
+    double cost(std::string_view password) const {
+        return costSteps(password) / static_cast<double>(kCostScale);
+    }
+
+    // Hashes a chunk's lookups and starts loading their slots before resolving any, so
+    // the cache misses of a large table overlap instead of queueing
+    uint64_t costSteps(std::string_view password) const {
+        constexpr size_t kChunk = 32;
+        uint64_t hashes[kChunk][2 * (kMaxOrder - 1)];
+        uint32_t symbols[kChunk];
+
+        uint64_t total = 0;
+        uint64_t context = 0;
+        uint64_t mask = contextMask(order - 1);
+        size_t length = password.size() + 1;  // the end counts as a symbol
+        for (size_t position = 0; position < length; position += kChunk) {
+            size_t count = std::min(kChunk, length - position);
+            for (size_t i = 0; i < count; i++) {
+                size_t at = position + i;
+                uint32_t symbol = at < password.size() ? static_cast<unsigned char>(password[at]) : 0;
+                symbols[i] = symbol;
+                for (int k = 1; k < order; k++) {
+                    uint64_t context_hash = contextHash(k, context & contextMask(k));
+                    uint64_t* lookup = hashes[i] + 2 * (k - 1);
+                    lookup[0] = slotHash(context_hash, kBackoff);
+                    lookup[1] = slotHash(context_hash, symbol);
+                    prefetch(bucketOf(lookup[0]));
+                    prefetch(bucketOf(lookup[1]));
+                }
+                context = ((context << 8) | symbol) & mask;
+            }
+            for (size_t i = 0; i < count; i++) {
+                total += symbolCost(hashes[i], symbols[i]);
+            }
+        }
+        return total;
+    }
+
+    // log2 of an exhaustive search over the classes the password uses: lowercase (26),
+    // uppercase (26), digits (10), the rest of printable ASCII (33) and any other byte
+    // (161), per byte of the password
+    static double bruteForceBits(std::string_view password) {
+        bool lower = false, upper = false, digit = false, symbol = false, other = false;
+        for (char c : password) {
+            unsigned char byte = static_cast<unsigned char>(c);
+            if (byte >= 'a' && byte <= 'z') {
+                lower = true;
+            } else if (byte >= 'A' && byte <= 'Z') {
+                upper = true;
+            } else if (byte >= '0' && byte <= '9') {
+                digit = true;
+            } else if (byte >= 0x20 && byte < 0x7F) {
+                symbol = true;
+            } else {
+                other = true;
+            }
+        }
+        int alphabet = 26 * lower + 26 * upper + 10 * digit + 33 * symbol + 161 * other;
+        return alphabet > 1 ? password.size() * std::log2(static_cast<double>(alphabet)) : 0.0;
+    }
+
+    // log2 of the estimated guess number. Costs past the table add a doubling per bit, up
+    // to the brute-force bound: no password takes more guesses than trying every string
+    // of its length over its alphabet, however unlikely the model finds it.
+    double log2Guesses(std::string_view password) const {
+        uint64_t steps = costSteps(password);
+        uint64_t last = kCostSteps - 1;
+        double bits = steps <= last ? guesses[steps] : guesses[last] + static_cast<double>(steps - last);
+        return std::min(bits / kCostScale, bruteForceBits(password));
+    }
+
+    bool verify() const {
+        const char* body = file.data() + sizeof(Header);
+        return crc32(body, file.size() - sizeof(Header)) == header.checksum;
+    }
+};
+
+// Offline trainer for GuessModel, from password lists with one password per line. Counts
+// every n-gram up to the order, turns them into a normalized Katz backoff model with a
+// per-order absolute discount D = n1 / (n1 + 2 n2), samples it for the guess table and
+// writes the quantized tables.
+class GuessModelTrainer {
+private:
+    struct Context {
+        uint64_t total = 0;
+        std::vector<std::pair<uint32_t, double>> followers;  // (symbol, probability), by symbol
+        double kept = 0.0;    // probability of the followers together
+        double alpha = 1.0;   // scale of the shorter context's probability for other symbols
+    };
+
+    int order;
+    uint64_t lines = 0;
+    std::vector<std::unordered_map<uint64_t, uint64_t>> grams;  // per context length: context << 8 | symbol
+    std::vector<std::unordered_map<uint64_t, Context>> contexts;
+    std::vector<double> unigram;
+
+    template <typename T>
+    static void appendValue(std::vector<char>& out, const T& value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    static void alignTo8(std::vector<char>& out) {
+        while (out.size() % 8 != 0) {
+            out.push_back(0);
+        }
+    }
+
+    static uint32_t quantize(double bits) {
+        double steps = std::round(bits * GuessModel::kCostScale);
+        return static_cast<uint32_t>(std::max(0.0, std::min(4095.0, steps)));
+    }
+
+    double probability(int k, uint64_t context, uint32_t symbol) const {
+        for (; k > 0; k--) {
+            auto found = contexts[k].find(context & GuessModel::contextMask(k));
+            if (found == contexts[k].end()) {
+                continue;
+            }
+            const auto& followers = found->second.followers;
+            auto follower = std::lower_bound(followers.begin(), followers.end(), std::make_pair(symbol, 0.0));
+            if (follower != followers.end() && follower->first == symbol) {
+                return follower->second;
+            }
+            return found->second.alpha * probability(k - 1, context, symbol);
+        }
+        return unigram[symbol];
+    }
+
+    // Draws the next symbol; symbols a context lists itself are rejected when drawn from
+    // the shorter context, which leaves exactly the backoff distribution
+    template <typename Engine>
+    uint32_t sampleSymbol(int k, uint64_t context, Engine& engine, const AliasTable& base) const {
+        for (; k > 0; k--) {
+            auto found = contexts[k].find(context & GuessModel::contextMask(k));
+            if (found == contexts[k].end()) {
+                continue;
+            }
+            const Context& state = found->second;
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(engine);
+            if (u < state.kept) {
+                for (const auto& follower : state.followers) {
+                    u -= follower.second;
+                    if (u < 0.0) {
+                        return follower.first;
+                    }
+                }
+                return state.followers.back().first;
+            }
+            for (int attempt = 0; attempt < 1000; attempt++) {
+                uint32_t symbol = sampleSymbol(k - 1, context, engine, base);
+                auto follower = std::lower_bound(state.followers.begin(), state.followers.end(),
+                                                 std::make_pair(symbol, 0.0));
+                if (follower == state.followers.end() || follower->first != symbol) {
+                    return symbol;
+                }
+            }
+            return 0;
+        }
+        return base.sample(engine);
+    }
+
+    void build() {
+        if (lines == 0) {
+            throw std::invalid_argument("Guess model needs at least one training password");
+        }
+
+        uint64_t total = 0;
+        unigram.assign(256, 0.0);
+        for (const auto& gram : grams[0]) {
+            unigram[gram.first] = static_cast<double>(gram.second);
+            total += gram.second;
+        }
+        for (auto& p : unigram) {
+            p = (p + 0.5) / (static_cast<double>(total) + 128.0);
+        }
+
+        contexts.assign(order, {});
+        for (int k = 1; k < order; k++) {
+            uint64_t n1 = 0, n2 = 0;
+            for (const auto& gram : grams[k]) {
+                n1 += gram.second == 1;
+                n2 += gram.second == 2;
+            }
+            double discount = n1 + n2 == 0 ? 0.5 : std::max(0.05, std::min(0.95, n1 / (n1 + 2.0 * n2)));
+
+            auto& level = contexts[k];
+            for (const auto& gram : grams[k]) {
+                Context& state = level[gram.first >> 8];
+                state.total += gram.second;
+                state.followers.push_back({static_cast<uint32_t>(gram.first & 0xFF), static_cast<double>(gram.second)});
+            }
+            for (auto& entry : level) {
+                Context& state = entry.second;
+                std::sort(state.followers.begin(), state.followers.end());
+                double covered = 0.0;
+                for (auto& follower : state.followers) {
+                    covered += probability(k - 1, entry.first, follower.first);
+                    follower.second = (follower.second - discount) / state.total;
+                    state.kept += follower.second;
+                }
+                state.alpha = (1.0 - state.kept) / std::max(1.0 - covered, 1e-12);
+            }
+        }
+    }
+
+public:
+    explicit GuessModelTrainer(int model_order = 4) : order(model_order) {
+        if (order < 1 || order > GuessModel::kMaxOrder) {
+            throw std::invalid_argument("Guess model order must be 1-" + std::to_string(GuessModel::kMaxOrder));
+        }
+        grams.resize(order);
+    }
+
+    // Adds one password; NUL bytes are not allowed in one and end it early
+    void train(std::string_view password) {
+        uint64_t context = 0;
+        uint64_t mask = GuessModel::contextMask(order - 1);
+        for (size_t i = 0; i <= password.size(); i++) {
+            uint32_t symbol = i < password.size() ? static_cast<unsigned char>(password[i]) : 0;
+            for (int k = 0; k < order; k++) {
+                grams[k][((context & GuessModel::contextMask(k)) << 8) | symbol]++;
+            }
+            if (symbol == 0) {
+                break;
+            }
+            context = ((context << 8) | symbol) & mask;
+        }
+        lines++;
+    }
+
+    void trainFile(const std::string& path) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        std::string line;
+        while (std::getline(input, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                train(line);
+            }
+        }
+    }
+
+    uint64_t size() const {
+        return lines;
+    }
+
+    void write(const std::string& path, uint64_t samples = 100000) {
+        build();
+
+        // Monte Carlo guess table from the model's own samples
+        std::random_device entropy;
+        std::mt19937_64 engine((static_cast<uint64_t>(entropy()) << 32) | entropy());
+        AliasTable base(unigram);
+        std::vector<double> sample_costs(samples);
+        uint64_t mask = GuessModel::contextMask(order - 1);
+        for (auto& bits : sample_costs) {
+            uint64_t context = 0;
+            bits = 0.0;
+            for (int length = 0; length < 256; length++) {
+                uint32_t symbol = sampleSymbol(order - 1, context, engine, base);
+                bits -= std::log2(probability(order - 1, context, symbol));
+                if (symbol == 0) {
+                    break;
+                }
+                context = ((context << 8) | symbol) & mask;
+            }
+        }
+        std::sort(sample_costs.begin(), sample_costs.end());
+
+        std::vector<uint16_t> guess_table(GuessModel::kCostSteps);
+        double guesses = 0.0, last_cost = 0.0;
+        size_t next = 0;
+        for (uint32_t step = 0; step < GuessModel::kCostSteps; step++) {
+            double cost = step / static_cast<double>(GuessModel::kCostScale);
+            while (next < sample_costs.size() && sample_costs[next] < cost) {
+                guesses += std::exp2(sample_costs[next]) / samples;
+                last_cost = sample_costs[next];
+                next++;
+            }
+            double log2 = std::log2(std::max(1.0, guesses));
+            if (next == sample_costs.size()) {
+                // Past the rarest sample each extra bit of cost doubles the guesses
+                log2 += cost - last_cost;
+            }
+            guess_table[step] = static_cast<uint16_t>(std::min(65535.0, std::round(log2 * GuessModel::kCostScale)));
+        }
+
+        // Slots for every listed follower and every seen context's backoff weight
+        std::vector<std::pair<uint64_t, uint32_t>> entries;
+        for (int k = 1; k < order; k++) {
+            for (const auto& entry : contexts[k]) {
+                uint64_t context_hash = GuessModel::contextHash(k, entry.first);
+                for (const auto& follower : entry.second.followers) {
+                    entries.push_back({GuessModel::slotHash(context_hash, follower.first),
+                                       quantize(-std::log2(follower.second))});
+                }
+                double backoff = -std::log2(entry.second.alpha) * GuessModel::kCostScale;
+                int steps = static_cast<int>(std::round(std::max(-2048.0, std::min(2047.0, backoff))));
+                entries.push_back({GuessModel::slotHash(context_hash, GuessModel::kBackoff),
+                                   static_cast<uint32_t>(steps + GuessModel::kBackoffBias)});
+            }
+        }
+
+        const size_t bucket_slots = GuessModel::kBucketSlots;
+        uint32_t bucket_bits = 0;
+        while (!GuessModel::loadFits(entries.size(), bucket_slots << bucket_bits)) {
+            bucket_bits++;
+        }
+        std::vector<uint32_t> slots(bucket_slots << bucket_bits, 0);
+        uint64_t bucket_mask = (1ull << bucket_bits) - 1;
+        for (const auto& entry : entries) {
+            uint32_t* slot = nullptr;
+            for (uint64_t b = entry.first; slot == nullptr; b++) {
+                uint32_t* bucket = slots.data() + (b & bucket_mask) * bucket_slots;
+                for (size_t i = 0; i < bucket_slots && slot == nullptr; i++) {
+                    if (bucket[i] == 0) {
+                        slot = bucket + i;
+                    }
+                }
+            }
+            *slot = GuessModel::fingerprint(entry.first) << 12 | entry.second;
+        }
+
+        GuessModel::Header header = {};
+        std::memcpy(header.magic, GuessModel::kMagic, 4);
+        header.byte_order = BinaryWordlist::kByteOrder;
+        header.version = GuessModel::kVersion;
+        header.order = static_cast<uint32_t>(order);
+        header.bucket_bits = bucket_bits;
+        header.training_lines = lines;
+        header.samples = samples;
+
+        std::vector<char> out(sizeof(header));
+        header.unigram_offset = out.size();
+        for (double p : unigram) {
+            appendValue(out, static_cast<uint16_t>(quantize(-std::log2(p))));
+        }
+        alignTo8(out);
+        header.guesses_offset = out.size();
+        for (uint16_t value : guess_table) {
+            appendValue(out, value);
+        }
+        while (out.size() % 64 != 0) {
+            out.push_back(0);
+        }
+        header.buckets_offset = out.size();
+        const char* slot_bytes = reinterpret_cast<const char*>(slots.data());
+        out.insert(out.end(), slot_bytes, slot_bytes + slots.size() * sizeof(uint32_t));
+
+        header.file_size = out.size();
+        header.checksum = crc32(out.data() + sizeof(header), out.size() - sizeof(header));
+        std::memcpy(out.data(), &header, sizeof(header));
+
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        if (!output.write(out.data(), out.size())) {
+            throw std::runtime_error("Cannot write '" + path + "'");
+        }
+    }
+};
+
+// Numbers the strings of `length` characters drawn from disjoint character classes,
+// each with a minimum count, as [0, size()). An index is read as nested blocks: how many
+// characters class 0 gets, which free positions they take (combinatorial number system),
+// which characters they are (mixed radix), then the same for class 1 in the positions
+// left, and so on. Tables of binomials, powers and per-class tail counts are built once,
+// so unrank and rank cost a few multiprecision divisions and comparisons per class.
+// An index identifies its password, so treat it as equally secret.
+class KeyspaceIndex {
+private:
+    int length;
+    std::vector<std::string> classes;
+    std::vector<int> minimums;
+    std::vector<std::vector<BigUnsigned>> binomials;   // [n][k] = C(n, k)
+    std::vector<std::vector<BigUnsigned>> powers;      // [class][count] = class size ^ count
+    std::vector<std::vector<BigUnsigned>> tails;       // [class][m] = strings of m characters from
+                                                       // classes >= class meeting their minimums
+    std::vector<std::vector<std::vector<BigUnsigned>>> blocks;  // [class][m][count] = strings of m
+                                                                // characters giving class `count` of them
+    int class_of[256];
+    int index_of[256];
+    double size_bits = 0.0;
+
+public:
+    KeyspaceIndex(std::vector<std::string> class_chars, std::vector<int> min_counts, int total_length)
+        : length(total_length), classes(std::move(class_chars)), minimums(std::move(min_counts)) {
+        if (classes.empty() || classes.size() != minimums.size() || length < 0) {
+            throw std::invalid_argument("Bad keyspace description");
+        }
+        std::fill(std::begin(class_of), std::end(class_of), -1);
+        for (size_t k = 0; k < classes.size(); k++) {
+            if (classes[k].empty()) {
+                throw std::invalid_argument("Empty character class");
+            }
+            for (size_t i = 0; i < classes[k].size(); i++) {
+                unsigned char c = static_cast<unsigned char>(classes[k][i]);
+                if (class_of[c] >= 0) {
+                    throw std::invalid_argument("Character classes overlap");
+                }
+                class_of[c] = static_cast<int>(k);
+                index_of[c] = static_cast<int>(i);
+            }
+        }
+
+        binomials.assign(length + 1, {});
+        for (int n = 0; n <= length; n++) {
+            binomials[n].assign(n + 1, BigUnsigned(1));
+            for (int k = 1; k < n; k++) {
+                binomials[n][k] = binomials[n - 1][k - 1];
+                binomials[n][k] += binomials[n - 1][k];
+            }
+        }
+
+        size_t count = classes.size();
+        powers.assign(count, std::vector<BigUnsigned>(length + 1, BigUnsigned(1)));
+        for (size_t k = 0; k < count; k++) {
+            for (int c = 1; c <= length; c++) {
+                powers[k][c] = powers[k][c - 1];
+                powers[k][c].mulSmall(static_cast<uint32_t>(classes[k].size()));
+            }
+        }
+
+        tails.assign(count + 1, std::vector<BigUnsigned>(length + 1));
+        tails[count][0] = BigUnsigned(1);
+        blocks.assign(count, std::vector<std::vector<BigUnsigned>>(length + 1));
+        for (size_t k = count; k-- > 0;) {
+            for (int m = 0; m <= length; m++) {
+                blocks[k][m].assign(m + 1, BigUnsigned());
+                for (int c = std::max(0, minimums[k]); c <= m; c++) {
+                    if (!tails[k + 1][m - c].isZero()) {
+                        blocks[k][m][c] = binomials[m][c] * powers[k][c] * tails[k + 1][m - c];
+                        tails[k][m] += blocks[k][m][c];
+                    }
+                }
+            }
+        }
+        size_bits = size().isZero() ? 0.0 : size().log2();
+    }
+
+    const BigUnsigned& size() const {
+        return tails[0][length];
+    }
+
+    // log2(size()), the entropy of a uniform index
+    double bits() const {
+        return size_bits;
+    }
+
+    SecureString unrank(BigUnsigned index) const {
+        SecureString password(static_cast<size_t>(length), '\0');
+        unrankInto(std::move(index), &password[0]);
+        return password;
+    }
+
+    // Writes the password at index to the `length` bytes at password, for callers that
+    // own the destination (a slot of a mapped output file, say)
+    void unrankInto(BigUnsigned index, char* password) const {
+        if (!(index < size())) {
+            throw std::out_of_range("Index outside the keyspace");
+        }
+
+        // Positions and digits spell out the password, so they stay in secure memory
+        SecureVector<int> free_positions(length);
+        for (int i = 0; i < length; i++) free_positions[i] = i;
+
+        int m = length;
+        for (size_t k = 0; k < classes.size(); k++) {
+            int c = std::max(0, minimums[k]);
+            for (; c <= m; c++) {
+                if (index < blocks[k][m][c]) break;
+                index -= blocks[k][m][c];
+            }
+
+            BigUnsigned rest = index.divMod(tails[k + 1][m - c]);
+
+            SecureVector<int> digits(c);
+            for (int j = 0; j < c; j++) {
+                digits[j] = static_cast<int>(index.divSmall(static_cast<uint32_t>(classes[k].size())));
+            }
+
+            // index is now the combination rank: positions p_c > ... > p_1 among the free
+            // slots with index = sum C(p_i, i)
+            SecureVector<int> chosen(c);
+            int p = m;
+            for (int i = c; i >= 1; i--) {
+                p--;
+                while (p >= i && index < binomials[p][i]) {
+                    p--;
+                }
+                if (p >= i) {
+                    index -= binomials[p][i];
+                }
+                chosen[i - 1] = p;
+            }
+
+            for (int j = 0; j < c; j++) {
+                password[free_positions[chosen[j]]] = classes[k][digits[j]];
+            }
+            for (int j = c; j-- > 0;) {
+                free_positions.erase(free_positions.begin() + chosen[j]);
+            }
+
+            index = std::move(rest);
+            m -= c;
+        }
+    }
+
+    BigUnsigned rank(std::string_view password) const {
+        if (static_cast<int>(password.size()) != length) {
+            throw std::invalid_argument("Password length does not match the policy");
+        }
+
+        struct Part {
+            BigUnsigned offset;
+            BigUnsigned local;
+            const BigUnsigned* tail;
+        };
+        std::vector<Part> parts;
+
+        SecureVector<int> free_positions(length);
+        for (int i = 0; i < length; i++) free_positions[i] = i;
+        int m = length;
+        for (size_t k = 0; k < classes.size(); k++) {
+            SecureVector<int> chosen;
+            for (int slot = 0; slot < m; slot++) {
+                unsigned char ch = static_cast<unsigned char>(password[free_positions[slot]]);
+                if (class_of[ch] < 0) {
+                    throw std::invalid_argument("Password uses characters outside the policy");
+                }
+                if (class_of[ch] == static_cast<int>(k)) {
+                    chosen.push_back(slot);
+                }
+            }
+            int c = static_cast<int>(chosen.size());
+            if (c < minimums[k]) {
+                throw std::invalid_argument("Password misses a minimum count of the policy");
+            }
+
+            Part part;
+            for (int below = std::max(0, minimums[k]); below < c; below++) {
+                part.offset += blocks[k][m][below];
+            }
+            BigUnsigned combination;
+            for (int i = 0; i < c; i++) {
+                if (chosen[i] >= i + 1) {
+                    combination += binomials[chosen[i]][i + 1];
+                }
+            }
+            BigUnsigned chars;
+            for (int j = c; j-- > 0;) {
+                chars.mulSmall(static_cast<uint32_t>(classes[k].size()));
+                chars += BigUnsigned(static_cast<uint64_t>(index_of[static_cast<unsigned char>(password[free_positions[chosen[j]]])]));
+            }
+            part.local = combination * powers[k][c];
+            part.local += chars;
+            part.tail = &tails[k + 1][m - c];
+            parts.push_back(std::move(part));
+
+            for (int j = c; j-- > 0;) {
+                free_positions.erase(free_positions.begin() + chosen[j]);
+            }
+            m -= c;
+        }
+
+        BigUnsigned index;
+        for (size_t k = parts.size(); k-- > 0;) {
+            BigUnsigned value = parts[k].local * *parts[k].tail;
+            value += parts[k].offset;
+            value += index;
+            index = std::move(value);
+        }
+        return index;
+    }
+
+    // Uniform over [begin, end), so a keyspace can be split into disjoint shards
+    template <typename Engine>
+    SecureString sample(Engine& engine, const BigUnsigned& begin, const BigUnsigned& end) const {
+        if (!(begin < end)) {
+            throw std::invalid_argument("Empty index range");
+        }
+        BigUnsigned span = end;
+        span -= begin;
+        BigUnsigned index = BigUnsigned::random(span, engine);
+        index += begin;
+        return unrank(std::move(index));
+    }
+
+    template <typename Engine>
+    SecureString sample(Engine& engine) const {
+        return unrank(BigUnsigned::random(size(), engine));
+    }
+
+    template <typename Engine>
+    void sampleInto(Engine& engine, char* password) const {
+        unrankInto(BigUnsigned::random(size(), engine), password);
+    }
+};
+
+// Instruction set extensions of the running CPU, detected once. Kernels pick their
+// implementation from get(), which leaves out anything above the level cap, so one
+// binary runs the best code each machine supports and any lower level can be forced
+// for testing and benchmarks: PSWD_GEN_SIMD or --simd set the cap to scalar, sse4.2,
+// avx2 or avx512.
+struct CpuFeatures {
+    enum Level {
+        SCALAR,
+        SSE42,
+        AVX2,
+        AVX512
+    };
+
+    bool ssse3 = false;
+    bool sse42 = false;
+    bool avx2 = false;
+    bool avx512 = false;  // AVX-512 F and BW, with the OS saving the ZMM registers
+
+    static const CpuFeatures& get() {
+        return effective();
+    }
+
+    static const CpuFeatures& detected() {
+        static const CpuFeatures features = detect();
+        return features;
+    }
+
+    Level level() const {
+        return avx512 ? AVX512 : avx2 ? AVX2 : sse42 ? SSE42 : SCALAR;
+    }
+
+    static const char* levelName(Level level) {
+        static const char* const names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+        return names[level];
+    }
+
+    static Level parseLevel(const std::string& name) {
+        for (int level = SCALAR; level <= AVX512; level++) {
+            if (name == levelName(static_cast<Level>(level))) {
+                return static_cast<Level>(level);
+            }
+        }
+        throw std::invalid_argument("Unknown SIMD level '" + name + "' (scalar, sse4.2, avx2 or avx512)");
+    }
+
+    // Lowers the cap; call before any kernel has chosen its implementation
+    static void limit(Level cap) {
+        effective() = capped(detected(), cap);
+    }
+
+private:
+    static CpuFeatures& effective() {
+        static CpuFeatures features = [] {
+            const char* cap = std::getenv("PSWD_GEN_SIMD");
+            return capped(detected(), cap != nullptr && *cap != '\0' ? parseLevel(cap) : AVX512);
+        }();
+        return features;
+    }
+
+    static CpuFeatures capped(CpuFeatures features, Level cap) {
+        features.ssse3 = features.ssse3 && cap >= SSE42;
+        features.sse42 = features.sse42 && cap >= SSE42;
+        features.avx2 = features.avx2 && cap >= AVX2;
+        features.avx512 = features.avx512 && cap >= AVX512;
+        return features;
+    }
+
+    static CpuFeatures detect() {
+        CpuFeatures features;
+#if defined(PSWD_GEN_X86) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        features.ssse3 = __builtin_cpu_supports("ssse3");
+        features.sse42 = __builtin_cpu_supports("sse4.2");
+        features.avx2 = __builtin_cpu_supports("avx2");
+        features.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#elif defined(PSWD_GEN_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        features.ssse3 = (info[2] & (1 << 9)) != 0;
+        features.sse42 = (info[2] & (1 << 20)) != 0;
+        bool os_saves_avx = (info[2] & (1 << 27)) != 0;
+        unsigned long long saved = os_saves_avx ? _xgetbv(0) : 0;
+        __cpuidex(info, 7, 0);
+        features.avx2 = (saved & 6) == 6 && (info[1] & (1 << 5)) != 0;
+        features.avx512 = (saved & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+#endif
+        return features;
+    }
+};
+
+// Everything checkPasswordStrength needs to know about the bytes of a password,
+// gathered in one pass
+struct CharacterProfile {
+    static constexpr uint32_t LOWERCASE = 1;
+    static constexpr uint32_t UPPERCASE = 2;
+    static constexpr uint32_t DIGIT = 4;
+    static constexpr uint32_t SPECIAL = 8;
+    static constexpr uint32_t OTHER = 16;
+    static constexpr uint32_t UNCASED = 32;   // letters of scripts without case (CJK, Arabic, ...)
+
+    uint32_t classes = 0;
+    uint64_t presence[4] = {0, 0, 0, 0};  // bit b set when byte b occurs
+    int longest_run = 0;                  // longest run of one repeated byte, ignoring case
+
+    int uniqueCount() const {
+        int count = 0;
+        for (uint64_t word : presence) {
+            for (; word != 0; word &= word - 1) {
+                count++;
+            }
+        }
+        return count;
+    }
+};
+
+// Classifies bytes, fills the presence bitmap and measures repeat runs. Vector paths
+// compare 16 (SSSE3) or 32 (AVX2) bytes at once; special characters are matched with
+// a nibble lookup (low nibble table AND high nibble table), which pshufb evaluates for
+// a whole vector.
+class CharacterKernel {
+private:
+    uint8_t classes_of[256];
+    uint8_t folded[256];
+    alignas(16) uint8_t special_low[16];
+    alignas(16) uint8_t special_high[16];
+
+    // Folds a run mask (bit i set when byte i equals byte i + 1) into the current and
+    // best runs of equal neighbours
+    static void foldRunMask(uint32_t mask, int bits, int& current, int& best) {
+        uint32_t full = bits == 32 ? 0xFFFFFFFFu : ((1u << bits) - 1);
+        mask &= full;
+        if (mask == full) {
+            current += bits;
+            return;
+        }
+        int low = 0;
+        while (mask & (1u << low)) low++;
+        best = std::max(best, current + low);
+
+        int inner = 0;
+        for (uint32_t m = mask; m != 0; m &= m >> 1) inner++;
+        best = std::max(best, inner);
+
+        current = 0;
+        while (current < bits && (mask & (1u << (bits - 1 - current)))) current++;
+    }
+
+    void scalarRange(const unsigned char* data, size_t begin, size_t end, size_t size,
+                     CharacterProfile& profile, int& current, int& best) const {
+        for (size_t i = begin; i < end; i++) {
+            unsigned char c = data[i];
+            profile.classes |= classes_of[c];
+            profile.presence[c >> 6] |= 1ull << (c & 63);
+            if (i + 1 < size) {
+                foldRunMask(folded[data[i]] == folded[data[i + 1]] ? 1u : 0u, 1, current, best);
+            }
+        }
+    }
+
+#ifdef PSWD_GEN_X86
+    PSWD_GEN_TARGET("ssse3")
+    size_t profileSsse3(const unsigned char* data, size_t size, CharacterProfile& profile,
+                        int& current, int& best) const {
+        const __m128i low_table = _mm_load_si128(reinterpret_cast<const __m128i*>(special_low));
+        const __m128i high_table = _mm_load_si128(reinterpret_cast<const __m128i*>(special_high));
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        __m128i lower = _mm_setzero_si128(), upper = lower, digit = lower, special = lower, any = lower;
+
+        size_t i = 0;
+        // i + 16 < size keeps the neighbour load at i + 1 inside the buffer
+        for (; i + 16 < size; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+
+            __m128i is_lower = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(128 - 'a'))),
+                                              _mm_set1_epi8(static_cast<char>(-128 + 26)));
+            __m128i is_upper = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(128 - 'A'))),
+                                              _mm_set1_epi8(static_cast<char>(-128 + 26)));
+            __m128i is_digit = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(128 - '0'))),
+                                              _mm_set1_epi8(static_cast<char>(-128 + 10)));
+            __m128i low_bits = _mm_shuffle_epi8(low_table, _mm_and_si128(v, nibble));
+            __m128i high_bits = _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            __m128i is_special = _mm_xor_si128(_mm_cmpeq_epi8(_mm_and_si128(low_bits, high_bits), _mm_setzero_si128()),
+                                               _mm_set1_epi8(-1));
+
+            lower = _mm_or_si128(lower, is_lower);
+            upper = _mm_or_si128(upper, is_upper);
+            digit = _mm_or_si128(digit, is_digit);
+            special = _mm_or_si128(special, is_special);
+            any = _mm_or_si128(any, _mm_xor_si128(_mm_or_si128(_mm_or_si128(is_lower, is_upper),
+                                                               _mm_or_si128(is_digit, is_special)),
+                                                  _mm_set1_epi8(-1)));
+
+            __m128i next_upper = _mm_cmplt_epi8(_mm_add_epi8(next, _mm_set1_epi8(static_cast<char>(128 - 'A'))),
+                                                _mm_set1_epi8(static_cast<char>(-128 + 26)));
+            __m128i v_folded = _mm_or_si128(v, _mm_and_si128(is_upper, _mm_set1_epi8(0x20)));
+            __m128i next_folded = _mm_or_si128(next, _mm_and_si128(next_upper, _mm_set1_epi8(0x20)));
+            foldRunMask(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v_folded, next_folded))), 16,
+                        current, best);
+            for (size_t j = 0; j < 16; j++) {
+                unsigned char c = data[i + j];
+                profile.presence[c >> 6] |= 1ull << (c & 63);
+            }
+        }
+
+        profile.classes |= (_mm_movemask_epi8(lower) ? CharacterProfile::LOWERCASE : 0u) |
+                           (_mm_movemask_epi8(upper) ? CharacterProfile::UPPERCASE : 0u) |
+                           (_mm_movemask_epi8(digit) ? CharacterProfile::DIGIT : 0u) |
+                           (_mm_movemask_epi8(special) ? CharacterProfile::SPECIAL : 0u) |
+                           (_mm_movemask_epi8(any) ? CharacterProfile::OTHER : 0u);
+        return i;
+    }
+
+    PSWD_GEN_TARGET("avx2")
+    size_t profileAvx2(const unsigned char* data, size_t size, CharacterProfile& profile,
+                       int& current, int& best) const {
+        const __m256i low_table = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(special_low)));
+        const __m256i high_table = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(special_high)));
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        const __m256i ones = _mm256_set1_epi8(-1);
+        __m256i lower = _mm256_setzero_si256(), upper = lower, digit = lower, special = lower, any = lower;
+
+        size_t i = 0;
+        for (; i + 32 < size; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+
+            __m256i is_lower = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)),
+                                                 _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(128 - 'a'))));
+            __m256i is_upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)),
+                                                 _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(128 - 'A'))));
+            __m256i is_digit = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 10)),
+                                                 _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(128 - '0'))));
+            __m256i low_bits = _mm256_shuffle_epi8(low_table, _mm256_and_si256(v, nibble));
+            __m256i high_bits = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            __m256i is_special = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_and_si256(low_bits, high_bits),
+                                                                    _mm256_setzero_si256()), ones);
+
+            lower = _mm256_or_si256(lower, is_lower);
+            upper = _mm256_or_si256(upper, is_upper);
+            digit = _mm256_or_si256(digit, is_digit);
+            special = _mm256_or_si256(special, is_special);
+            any = _mm256_or_si256(any, _mm256_xor_si256(_mm256_or_si256(_mm256_or_si256(is_lower, is_upper),
+                                                                        _mm256_or_si256(is_digit, is_special)), ones));
+
+            __m256i next_upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)),
+                                                   _mm256_add_epi8(next, _mm256_set1_epi8(static_cast<char>(128 - 'A'))));
+            __m256i v_folded = _mm256_or_si256(v, _mm256_and_si256(is_upper, _mm256_set1_epi8(0x20)));
+            __m256i next_folded = _mm256_or_si256(next, _mm256_and_si256(next_upper, _mm256_set1_epi8(0x20)));
+            foldRunMask(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v_folded, next_folded))), 32,
+                        current, best);
+            for (size_t j = 0; j < 32; j++) {
+                unsigned char c = data[i + j];
+                profile.presence[c >> 6] |= 1ull << (c & 63);
+            }
+        }
+
+        profile.classes |= (_mm256_movemask_epi8(lower) ? CharacterProfile::LOWERCASE : 0u) |
+                           (_mm256_movemask_epi8(upper) ? CharacterProfile::UPPERCASE : 0u) |
+                           (_mm256_movemask_epi8(digit) ? CharacterProfile::DIGIT : 0u) |
+                           (_mm256_movemask_epi8(special) ? CharacterProfile::SPECIAL : 0u) |
+                           (_mm256_movemask_epi8(any) ? CharacterProfile::OTHER : 0u);
+        return i;
+    }
+#endif
+
+public:
+    enum Level {
+        SCALAR,
+        SSSE3,
+        AVX2
+    };
+
+    explicit CharacterKernel(std::string_view special_chars) {
+        std::memset(special_low, 0, sizeof(special_low));
+        std::memset(special_high, 0, sizeof(special_high));
+        for (int c = 0; c < 256; c++) {
+            classes_of[c] = c >= 'a' && c <= 'z' ? CharacterProfile::LOWERCASE
+                          : c >= 'A' && c <= 'Z' ? CharacterProfile::UPPERCASE
+                          : c >= '0' && c <= '9' ? CharacterProfile::DIGIT
+                          : CharacterProfile::OTHER;
+            folded[c] = static_cast<uint8_t>(c >= 'A' && c <= 'Z' ? c + 32 : c);
+        }
+        for (char raw : special_chars) {
+            unsigned char c = static_cast<unsigned char>(raw);
+            if (c >= 0x80) {
+                continue;  // the nibble tables only cover ASCII
+            }
+            classes_of[c] = CharacterProfile::SPECIAL;
+            special_low[c & 0x0F] |= static_cast<uint8_t>(1u << (c >> 4));
+            special_high[c >> 4] = static_cast<uint8_t>(1u << (c >> 4));
+        }
+    }
+
+    uint32_t classify(unsigned char byte) const {
+        return classes_of[byte];
+    }
+
+    static Level bestLevel() {
+        const CpuFeatures& cpu = CpuFeatures::get();
+        return cpu.avx2 ? AVX2 : cpu.ssse3 ? SSSE3 : SCALAR;
+    }
+
+    CharacterProfile profile(std::string_view text, Level level = bestLevel()) const {
+        CharacterProfile result;
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        size_t size = text.size();
+        int current = 0, best = 0;
+        size_t done = 0;
+
+#ifdef PSWD_GEN_X86
+        if (level == AVX2) {
+            done = profileAvx2(data, size, result, current, best);
+        }
+        if (level >= SSSE3 && done + 16 < size) {
+            done += profileSsse3(data + done, size - done, result, current, best);
+        }
+#else
+        (void)level;
+#endif
+        scalarRange(data, done, size, size, result, current, best);
+
+        best = std::max(best, current);
+        result.longest_run = size > 0 ? best + 1 : 0;
+        return result;
+    }
+};
+
+// Strict UTF-8 decoding and encoding, plus a coarse classification of non-ASCII
+// codepoints by block: cased letters of the Latin, Greek, Cyrillic and Armenian blocks
+// and fullwidth forms, decimal digits of common scripts, punctuation and symbol
+// blocks (including emoji) as special, and every other letter as uncased.
+struct Utf8 {
+    // Decodes the codepoint at pos and advances past it; rejects overlong forms,
+    // surrogates and values above U+10FFFF
+    static bool next(std::string_view text, size_t& pos, uint32_t& codepoint) {
+        unsigned char lead = static_cast<unsigned char>(text[pos]);
+        int extra;
+        uint32_t minimum;
+        if (lead < 0x80) {
+            codepoint = lead;
+            pos++;
+            return true;
+        } else if ((lead & 0xE0) == 0xC0) {
+            extra = 1;
+            minimum = 0x80;
+            codepoint = lead & 0x1F;
+        } else if ((lead & 0xF0) == 0xE0) {
+            extra = 2;
+            minimum = 0x800;
+            codepoint = lead & 0x0F;
+        } else if ((lead & 0xF8) == 0xF0) {
+            extra = 3;
+            minimum = 0x10000;
+            codepoint = lead & 0x07;
+        } else {
+            return false;
+        }
+        if (pos + extra >= text.size()) {
+            return false;
+        }
+        for (int i = 1; i <= extra; i++) {
+            unsigned char c = static_cast<unsigned char>(text[pos + i]);
+            if ((c & 0xC0) != 0x80) {
+                return false;
+            }
+            codepoint = (codepoint << 6) | (c & 0x3F);
+        }
+        if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+            return false;
+        }
+        pos += extra + 1;
+        return true;
+    }
+
+    static bool valid(std::string_view text) {
+        uint32_t codepoint;
+        for (size_t pos = 0; pos < text.size();) {
+            if (!next(text, pos, codepoint)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Writes 1-4 bytes and returns how many
+    static int encode(uint32_t codepoint, char* out) {
+        if (codepoint < 0x80) {
+            out[0] = static_cast<char>(codepoint);
+            return 1;
+        } else if (codepoint < 0x800) {
+            out[0] = static_cast<char>(0xC0 | (codepoint >> 6));
+            out[1] = static_cast<char>(0x80 | (codepoint & 0x3F));
+            return 2;
+        } else if (codepoint < 0x10000) {
+            out[0] = static_cast<char>(0xE0 | (codepoint >> 12));
+            out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out[2] = static_cast<char>(0x80 | (codepoint & 0x3F));
+            return 3;
+        }
+        out[0] = static_cast<char>(0xF0 | (codepoint >> 18));
+        out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out[3] = static_cast<char>(0x80 | (codepoint & 0x3F));
+        return 4;
+    }
+
+    // CharacterProfile class of a codepoint at or above U+0080
+    static uint32_t classify(uint32_t cp) {
+        auto in = [cp](uint32_t low, uint32_t high) { return cp >= low && cp <= high; };
+        // Blocks where upper and lower case alternate, upper first
+        auto paired = [cp](bool upper_even) {
+            return (cp % 2 == 0) == upper_even ? CharacterProfile::UPPERCASE : CharacterProfile::LOWERCASE;
+        };
+
+        if (cp < 0xA0) {
+            return CharacterProfile::OTHER;
+        } else if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) {
+            return CharacterProfile::SPECIAL;
+        } else if (cp < 0x100) {
+            return cp < 0xDF ? CharacterProfile::UPPERCASE : CharacterProfile::LOWERCASE;
+        } else if (cp < 0x180) {
+            if (cp == 0x138 || cp == 0x149 || cp == 0x17F) {
+                return CharacterProfile::LOWERCASE;
+            }
+            return paired(!in(0x139, 0x148) && !in(0x179, 0x17E));
+        } else if (in(0x386, 0x3AB)) {
+            return cp == 0x387 ? CharacterProfile::SPECIAL : CharacterProfile::UPPERCASE;
+        } else if (in(0x3AC, 0x3CE)) {
+            return CharacterProfile::LOWERCASE;
+        } else if (in(0x400, 0x42F)) {
+            return CharacterProfile::UPPERCASE;
+        } else if (in(0x430, 0x45F)) {
+            return CharacterProfile::LOWERCASE;
+        } else if (in(0x460, 0x481) || in(0x48A, 0x4BF) || in(0x4D0, 0x52F)) {
+            return paired(true);
+        } else if (in(0x531, 0x556)) {
+            return CharacterProfile::UPPERCASE;
+        } else if (in(0x560, 0x588)) {
+            return CharacterProfile::LOWERCASE;
+        } else if (in(0x660, 0x669) || in(0x6F0, 0x6F9) || in(0x966, 0x96F) || in(0xFF10, 0xFF19)) {
+            return CharacterProfile::DIGIT;
+        } else if (in(0xFF21, 0xFF3A)) {
+            return CharacterProfile::UPPERCASE;
+        } else if (in(0xFF41, 0xFF5A)) {
+            return CharacterProfile::LOWERCASE;
+        } else if (in(0x2000, 0x2BFF) || in(0x3000, 0x303F) || in(0xFE30, 0xFE4F) || in(0xFF01, 0xFF0F) ||
+                   in(0xFF1A, 0xFF20) || in(0xFF3B, 0xFF40) || in(0xFF5B, 0xFF65) || in(0x1F000, 0x1FAFF)) {
+            return CharacterProfile::SPECIAL;
+        } else if (in(0xE000, 0xF8FF) || cp >= 0xF0000) {
+            return CharacterProfile::OTHER;   // private use
+        }
+        return CharacterProfile::UNCASED;
+    }
+};
+
+// Classes, length and repeats of a password counted in codepoints; ASCII bytes keep
+// the kernel's classes. Used when a password has non-ASCII bytes.
+struct CodepointProfile {
+    uint32_t classes = 0;
+    int length = 0;
+    int unique = 0;
+    int longest_run = 0;   // ignoring ASCII case, like CharacterProfile
+
+    // False when text is not valid UTF-8
+    bool build(std::string_view text, const CharacterKernel& kernel) {
+        SecureVector<uint32_t> codepoints;  // the password itself, decoded
+        codepoints.reserve(text.size());
+        int run = 0;
+        uint32_t previous = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            uint32_t cp;
+            if (!Utf8::next(text, pos, cp)) {
+                return false;
+            }
+            classes |= cp < 0x80 ? kernel.classify(static_cast<unsigned char>(cp)) : Utf8::classify(cp);
+            uint32_t folded = cp >= 'A' && cp <= 'Z' ? cp + 32 : cp;
+            run = !codepoints.empty() && folded == previous ? run + 1 : 1;
+            longest_run = std::max(longest_run, run);
+            previous = folded;
+            codepoints.push_back(cp);
+        }
+        length = static_cast<int>(codepoints.size());
+        std::sort(codepoints.begin(), codepoints.end());
+        unique = static_cast<int>(std::unique(codepoints.begin(), codepoints.end()) - codepoints.begin());
+        return true;
+    }
+};
+
+// A user-defined alphabet of arbitrary codepoints, pre-encoded: every entry holds its
+// UTF-8 bytes padded to four and its byte length, so generation copies four bytes per
+// character and advances by the length, with no encoding on the hot path.
+class Utf8Alphabet {
+public:
+    enum Unit {
+        CODEPOINTS,
+        BYTES
+    };
+
+private:
+    struct Entry {
+        char bytes[4];
+        uint8_t length;
+        uint32_t codepoint;
+    };
+
+    std::vector<Entry> entries;
+    int min_bytes = 4;
+    int max_bytes = 1;
+
+public:
+    // Duplicates are dropped, keeping the first occurrence; throws on invalid UTF-8
+    explicit Utf8Alphabet(std::string_view characters) {
+        std::unordered_set<uint32_t> seen;
+        for (size_t pos = 0; pos < characters.size();) {
+            size_t start = pos;
+            Entry entry = {};
+            if (!Utf8::next(characters, pos, entry.codepoint)) {
+                throw std::invalid_argument("Alphabet is not valid UTF-8");
+            }
+            if (!seen.insert(entry.codepoint).second) {
+                continue;
+            }
+            entry.length = static_cast<uint8_t>(pos - start);
+            std::memcpy(entry.bytes, characters.data() + start, entry.length);
+            min_bytes = std::min<int>(min_bytes, entry.length);
+            max_bytes = std::max<int>(max_bytes, entry.length);
+            entries.push_back(entry);
+        }
+        if (entries.empty()) {
+            throw std::invalid_argument("Alphabet is empty");
+        }
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    int maxBytes() const {
+        return max_bytes;
+    }
+
+    // The alphabet without the given characters, by codepoint (removeAmbiguous for Unicode)
+    Utf8Alphabet without(std::string_view characters) const {
+        std::unordered_set<uint32_t> removed;
+        for (size_t pos = 0; pos < characters.size();) {
+            uint32_t cp;
+            if (!Utf8::next(characters, pos, cp)) {
+                throw std::invalid_argument("Characters are not valid UTF-8");
+            }
+            removed.insert(cp);
+        }
+        std::string kept;
+        for (const Entry& entry : entries) {
+            if (!removed.count(entry.codepoint)) {
+                kept.append(entry.bytes, entry.length);
+            }
+        }
+        return Utf8Alphabet(kept);
+    }
+
+    std::string toString() const {
+        std::string text;
+        for (const Entry& entry : entries) {
+            text.append(entry.bytes, entry.length);
+        }
+        return text;
+    }
+
+    // length counts codepoints, or with BYTES is a byte budget: characters are drawn
+    // until the next one would not fit. bits receives log2(size) per character drawn.
+    template <typename Engine>
+    SecureString generate(Engine& engine, int length, Unit unit = CODEPOINTS, double* bits = nullptr) const {
+        if (length < 1) {
+            throw std::invalid_argument("Password too short");
+        }
+        size_t budget = unit == BYTES ? static_cast<size_t>(length) : static_cast<size_t>(length) * max_bytes;
+        if (unit == BYTES && budget < static_cast<size_t>(min_bytes)) {
+            throw std::invalid_argument("Byte limit below the shortest character");
+        }
+
+        SecureString password(budget + 3, '\0');   // room for the last four-byte copy
+        std::uniform_int_distribution<size_t> dis(0, entries.size() - 1);
+        size_t used = 0;
+        int drawn = 0;
+        while (unit == BYTES || drawn < length) {
+            const Entry& entry = entries[dis(engine)];
+            if (used + entry.length > budget) {
+                break;
+            }
+            std::memcpy(&password[used], entry.bytes, 4);
+            used += entry.length;
+            drawn++;
+        }
+        password.resize(used);   // the bytes past used are entry padding, all zero
+
+        if (bits != nullptr) {
+            *bits = drawn * std::log2(static_cast<double>(entries.size()));
+        }
+        return password;
+    }
+};
+
+// ChaCha20 keystream (RFC 8439 block function) used as a bulk source of random bytes.
+// Key and nonce come from std::random_device; the 32-bit block counter is never
+// allowed to wrap, the generator rekeys first. The AVX2 path computes eight blocks at
+// once, one per 32-bit lane, and transposes them back to the scalar byte order, so
+// both paths produce the same stream.
+class ChaCha20 {
+public:
+    enum Level {
+        SCALAR,
+        AVX2,
+        AVX512
+    };
+
+private:
+    uint32_t state[16];
+    alignas(64) uint8_t buffer[1024];
+    size_t buffered = 0;     // unread bytes at the end of buffer
+    Level level;
+
+    static uint32_t rotl(uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    static void quarterRound(uint32_t* x, int a, int b, int c, int d) {
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+        x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+        x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+    }
+
+    void blockScalar(uint8_t* out) {
+        uint32_t x[16];
+        std::memcpy(x, state, sizeof(x));
+        for (int round = 0; round < 10; round++) {
+            quarterRound(x, 0, 4, 8, 12);
+            quarterRound(x, 1, 5, 9, 13);
+            quarterRound(x, 2, 6, 10, 14);
+            quarterRound(x, 3, 7, 11, 15);
+            quarterRound(x, 0, 5, 10, 15);
+            quarterRound(x, 1, 6, 11, 12);
+            quarterRound(x, 2, 7, 8, 13);
+            quarterRound(x, 3, 4, 9, 14);
+        }
+        for (int i = 0; i < 16; i++) {
+            uint32_t word = x[i] + state[i];
+            out[4 * i] = static_cast<uint8_t>(word);
+            out[4 * i + 1] = static_cast<uint8_t>(word >> 8);
+            out[4 * i + 2] = static_cast<uint8_t>(word >> 16);
+            out[4 * i + 3] = static_cast<uint8_t>(word >> 24);
+        }
+        secureZero(x, sizeof(x));
+        state[12]++;
+    }
+
+#ifdef PSWD_GEN_X86
+    // Rotations by 16 and 8 move whole bytes, so they are a pshufb
+    PSWD_GEN_TARGET("avx2")
+    static void quarterAvx2(__m256i* x, int a, int b, int c, int d) {
+        const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                               2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+        const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                              3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+        x[a] = _mm256_add_epi32(x[a], x[b]);
+        x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rot16);
+        x[c] = _mm256_add_epi32(x[c], x[d]);
+        x[b] = _mm256_xor_si256(x[b], x[c]);
+        x[b] = _mm256_or_si256(_mm256_slli_epi32(x[b], 12), _mm256_srli_epi32(x[b], 20));
+        x[a] = _mm256_add_epi32(x[a], x[b]);
+        x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rot8);
+        x[c] = _mm256_add_epi32(x[c], x[d]);
+        x[b] = _mm256_xor_si256(x[b], x[c]);
+        x[b] = _mm256_or_si256(_mm256_slli_epi32(x[b], 7), _mm256_srli_epi32(x[b], 25));
+    }
+
+    PSWD_GEN_TARGET("avx2")
+    void blocksAvx2(uint8_t* out) {
+        __m256i input[16], x[16];
+        for (int i = 0; i < 16; i++) {
+            input[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+        }
+        input[12] = _mm256_add_epi32(input[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (int i = 0; i < 16; i++) {
+            x[i] = input[i];
+        }
+
+        for (int round = 0; round < 10; round++) {
+            quarterAvx2(x, 0, 4, 8, 12);
+            quarterAvx2(x, 1, 5, 9, 13);
+            quarterAvx2(x, 2, 6, 10, 14);
+            quarterAvx2(x, 3, 7, 11, 15);
+            quarterAvx2(x, 0, 5, 10, 15);
+            quarterAvx2(x, 1, 6, 11, 12);
+            quarterAvx2(x, 2, 7, 8, 13);
+            quarterAvx2(x, 3, 4, 9, 14);
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm256_add_epi32(x[i], input[i]);
+        }
+
+        // Lane k of x[i] is word i of block k; transpose each half of the words so a
+        // 32-byte store writes eight consecutive words of one block
+        for (int half = 0; half < 2; half++) {
+            __m256i* w = x + 8 * half;
+            __m256i t0 = _mm256_unpacklo_epi32(w[0], w[1]), t1 = _mm256_unpackhi_epi32(w[0], w[1]);
+            __m256i t2 = _mm256_unpacklo_epi32(w[2], w[3]), t3 = _mm256_unpackhi_epi32(w[2], w[3]);
+            __m256i t4 = _mm256_unpacklo_epi32(w[4], w[5]), t5 = _mm256_unpackhi_epi32(w[4], w[5]);
+            __m256i t6 = _mm256_unpacklo_epi32(w[6], w[7]), t7 = _mm256_unpackhi_epi32(w[6], w[7]);
+            __m256i low[4] = {_mm256_unpacklo_epi64(t0, t2), _mm256_unpackhi_epi64(t0, t2),
+                              _mm256_unpacklo_epi64(t1, t3), _mm256_unpackhi_epi64(t1, t3)};
+            __m256i high[4] = {_mm256_unpacklo_epi64(t4, t6), _mm256_unpackhi_epi64(t4, t6),
+                               _mm256_unpacklo_epi64(t5, t7), _mm256_unpackhi_epi64(t5, t7)};
+            for (int k = 0; k < 4; k++) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 64 * k + 32 * half),
+                                    _mm256_permute2x128_si256(low[k], high[k], 0x20));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 64 * (k + 4) + 32 * half),
+                                    _mm256_permute2x128_si256(low[k], high[k], 0x31));
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm256_setzero_si256();
+        }
+        state[12] += 8;
+    }
+
+    // Sixteen blocks with native rotations. Words are transposed within each 128-bit
+    // lane as in blocksAvx2, then across lanes, so each store writes a whole block.
+    PSWD_GEN_TARGET("avx512f")
+    void blocksAvx512(uint8_t* out) {
+        __m512i input[16], x[16];
+        for (int i = 0; i < 16; i++) {
+            input[i] = _mm512_set1_epi32(static_cast<int>(state[i]));
+        }
+        input[12] = _mm512_add_epi32(input[12], _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+        for (int i = 0; i < 16; i++) {
+            x[i] = input[i];
+        }
+
+        static const int kQuarters[8][4] = {{0, 4, 8, 12}, {1, 5, 9, 13}, {2, 6, 10, 14}, {3, 7, 11, 15},
+                                            {0, 5, 10, 15}, {1, 6, 11, 12}, {2, 7, 8, 13}, {3, 4, 9, 14}};
+        for (int round = 0; round < 10; round++) {
+            for (const auto& q : kQuarters) {
+                __m512i &a = x[q[0]], &b = x[q[1]], &c = x[q[2]], &d = x[q[3]];
+                a = _mm512_add_epi32(a, b); d = _mm512_rol_epi32(_mm512_xor_si512(d, a), 16);
+                c = _mm512_add_epi32(c, d); b = _mm512_rol_epi32(_mm512_xor_si512(b, c), 12);
+                a = _mm512_add_epi32(a, b); d = _mm512_rol_epi32(_mm512_xor_si512(d, a), 8);
+                c = _mm512_add_epi32(c, d); b = _mm512_rol_epi32(_mm512_xor_si512(b, c), 7);
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm512_add_epi32(x[i], input[i]);
+        }
+
+        // After the in-lane step, lane L of group[g][j] holds words 4g..4g+3 of block 4L+j
+        __m512i group[4][4];
+        for (int g = 0; g < 4; g++) {
+            __m512i* w = x + 4 * g;
+            __m512i t0 = _mm512_unpacklo_epi32(w[0], w[1]), t1 = _mm512_unpackhi_epi32(w[0], w[1]);
+            __m512i t2 = _mm512_unpacklo_epi32(w[2], w[3]), t3 = _mm512_unpackhi_epi32(w[2], w[3]);
+            group[g][0] = _mm512_unpacklo_epi64(t0, t2);
+            group[g][1] = _mm512_unpackhi_epi64(t0, t2);
+            group[g][2] = _mm512_unpacklo_epi64(t1, t3);
+            group[g][3] = _mm512_unpackhi_epi64(t1, t3);
+        }
+        for (int j = 0; j < 4; j++) {
+            __m512i low01 = _mm512_shuffle_i32x4(group[0][j], group[1][j], 0x44);
+            __m512i high01 = _mm512_shuffle_i32x4(group[0][j], group[1][j], 0xEE);
+            __m512i low23 = _mm512_shuffle_i32x4(group[2][j], group[3][j], 0x44);
+            __m512i high23 = _mm512_shuffle_i32x4(group[2][j], group[3][j], 0xEE);
+            _mm512_storeu_si512(out + 64 * j, _mm512_shuffle_i32x4(low01, low23, 0x88));
+            _mm512_storeu_si512(out + 64 * (4 + j), _mm512_shuffle_i32x4(low01, low23, 0xDD));
+            _mm512_storeu_si512(out + 64 * (8 + j), _mm512_shuffle_i32x4(high01, high23, 0x88));
+            _mm512_storeu_si512(out + 64 * (12 + j), _mm512_shuffle_i32x4(high01, high23, 0xDD));
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm512_setzero_si512();
+        }
+        for (auto& row : group) {
+            for (auto& word : row) {
+                word = _mm512_setzero_si512();
+            }
+        }
+        state[12] += 16;
+    }
+#endif
+
+    // Writes whole blocks, sixteen or eight at a time when the CPU allows
+    void blocks(uint8_t* out, size_t count) {
+        if (state[12] > 0xFFFFFFFFu - count) {
+            rekey();
+        }
+#ifdef PSWD_GEN_X86
+        if (level == AVX512) {
+            for (; count >= 16; count -= 16, out += 1024) {
+                blocksAvx512(out);
+            }
+        }
+        if (level >= AVX2) {
+            for (; count >= 8; count -= 8, out += 512) {
+                blocksAvx2(out);
+            }
+        }
+#endif
+        for (; count > 0; count--, out += 64) {
+            blockScalar(out);
+        }
+    }
+
+public:
+    static Level bestLevel() {
+        const CpuFeatures& cpu = CpuFeatures::get();
+        return cpu.avx512 ? AVX512 : cpu.avx2 ? AVX2 : SCALAR;
+    }
+
+    explicit ChaCha20(Level kernel = bestLevel()) : level(kernel) {
+        rekey();
+    }
+
+    // Fixed key, nonce and counter, for test vectors and reproducible streams
+    ChaCha20(const uint32_t key[8], const uint32_t nonce[3], uint32_t counter, Level kernel = bestLevel())
+        : level(kernel) {
+        state[0] = 0x61707865;
+        state[1] = 0x3320646e;
+        state[2] = 0x79622d32;
+        state[3] = 0x6b206574;
+        std::memcpy(state + 4, key, 8 * sizeof(uint32_t));
+        state[12] = counter;
+        std::memcpy(state + 13, nonce, 3 * sizeof(uint32_t));
+    }
+
+    ChaCha20(const ChaCha20&) = delete;
+    ChaCha20& operator=(const ChaCha20&) = delete;
+
+    ~ChaCha20() {
+        secureZero(state, sizeof(state));
+        secureZero(buffer, sizeof(buffer));
+    }
+
+    void rekey() {
+        std::random_device entropy;
+        uint32_t key[8], nonce[3];
+        for (auto& word : key) word = entropy();
+        for (auto& word : nonce) word = entropy();
+        state[0] = 0x61707865;
+        state[1] = 0x3320646e;
+        state[2] = 0x79622d32;
+        state[3] = 0x6b206574;
+        std::memcpy(state + 4, key, sizeof(key));
+        state[12] = 0;
+        std::memcpy(state + 13, nonce, sizeof(nonce));
+        secureZero(key, sizeof(key));
+        secureZero(buffer, sizeof(buffer));
+        buffered = 0;
+    }
+
+    void fill(uint8_t* out, size_t size) {
+        while (size > 0) {
+            if (buffered > 0) {
+                size_t take = std::min(size, buffered);
+                uint8_t* source = buffer + sizeof(buffer) - buffered;
+                std::memcpy(out, source, take);
+                secureZero(source, take);
+                buffered -= take;
+                out += take;
+                size -= take;
+            } else if (size >= 64) {
+                size_t count = size / 64;
+                blocks(out, count);
+                out += 64 * count;
+                size -= 64 * count;
+            } else {
+                blocks(buffer, sizeof(buffer) / 64);
+                buffered = sizeof(buffer);
+            }
+        }
+    }
+
+    // UniformRandomBitGenerator, so the stream also works with the standard distributions
+    using result_type = uint32_t;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFFu; }
+    result_type operator()() {
+        uint8_t bytes[4];
+        fill(bytes, sizeof(bytes));
+        return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+               static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+};
+
+// API keys and recovery codes: random bytes from ChaCha20, encoded as lowercase hex,
+// Crockford Base32 or unpadded Base64url. A token may start with a fixed prefix and end
+// with a CRC-32 of everything before it, encoded the same way, so secret scanners can
+// find tokens by prefix and discard look-alikes without asking anyone. All three
+// alphabets have a power-of-two size, so every byte maps to characters with no
+// rejection sampling and the entropy is exactly 8 bits per random byte.
+class TokenGenerator {
+public:
+    enum Encoding {
+        HEX,
+        BASE32,
+        BASE64URL
+    };
+
+    enum Level {
+        SCALAR,
+        AVX2
+    };
+
+    struct Format {
+        Encoding encoding = BASE64URL;
+        size_t bytes = 32;
+        std::string prefix;
+        bool checksum = false;
+
+        size_t length() const {
+            return prefix.size() + encodedLength(encoding, bytes) + (checksum ? encodedLength(encoding, 4) : 0);
+        }
+
+        // "ENCODING[+crc]:BYTES[:PREFIX]", e.g. "base64url+crc:32:pgk_"
+        static Format parse(const std::string& text) {
+            Format format;
+            size_t colon = text.find(':');
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("Token format needs ENCODING:BYTES");
+            }
+            std::string encoding = text.substr(0, colon);
+            const std::string suffix = "+crc";
+            if (encoding.size() > suffix.size() && encoding.compare(encoding.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                format.checksum = true;
+                encoding.resize(encoding.size() - suffix.size());
+            }
+            if (encoding == "hex") {
+                format.encoding = HEX;
+            } else if (encoding == "base32") {
+                format.encoding = BASE32;
+            } else if (encoding == "base64url") {
+                format.encoding = BASE64URL;
+            } else {
+                throw std::invalid_argument("Unknown token encoding '" + encoding + "'");
+            }
+
+            size_t next = text.find(':', colon + 1);
+            format.bytes = static_cast<size_t>(std::stoul(text.substr(colon + 1, next - colon - 1)));
+            if (format.bytes < 8 || format.bytes > 1024) {
+                throw std::invalid_argument("Tokens take 8 to 1024 random bytes");
+            }
+            if (next != std::string::npos) {
+                format.prefix = text.substr(next + 1);
+                for (char c : format.prefix) {
+                    if (c <= ' ' || c > '~') {
+                        throw std::invalid_argument("Token prefixes must be printable ASCII");
+                    }
+                }
+            }
+            return format;
+        }
+    };
+
+private:
+    static constexpr const char* kHex = "0123456789abcdef";
+    static constexpr const char* kBase32 = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+    static constexpr const char* kBase64Url = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    static constexpr size_t kChunkBytes = 64 * 1024;
+
+    ChaCha20 random;
+    SecureVector<uint8_t> raw;
+
+    static void encodeHexScalar(const uint8_t* in, size_t size, char* out) {
+        for (size_t i = 0; i < size; i++) {
+            out[2 * i] = kHex[in[i] >> 4];
+            out[2 * i + 1] = kHex[in[i] & 15];
+        }
+    }
+
+    // Every 5 bytes become 8 characters; a final partial group is zero-padded on the right
+    static void encodeBase32Scalar(const uint8_t* in, size_t size, char* out) {
+        for (; size >= 5; size -= 5, in += 5, out += 8) {
+            uint64_t group = static_cast<uint64_t>(in[0]) << 32 | static_cast<uint64_t>(in[1]) << 24 |
+                             static_cast<uint64_t>(in[2]) << 16 | static_cast<uint64_t>(in[3]) << 8 | in[4];
+            for (int k = 0; k < 8; k++) {
+                out[k] = kBase32[(group >> (35 - 5 * k)) & 31];
+            }
+        }
+        uint64_t group = 0;
+        for (size_t i = 0; i < size; i++) {
+            group |= static_cast<uint64_t>(in[i]) << (32 - 8 * i);
+        }
+        for (size_t k = 0; k < encodedLength(BASE32, size); k++) {
+            out[k] = kBase32[(group >> (35 - 5 * k)) & 31];
+        }
+    }
+
+    static void encodeBase64Scalar(const uint8_t* in, size_t size, char* out) {
+        for (; size >= 3; size -= 3, in += 3, out += 4) {
+            uint32_t group = static_cast<uint32_t>(in[0]) << 16 | static_cast<uint32_t>(in[1]) << 8 | in[2];
+            out[0] = kBase64Url[group >> 18];
+            out[1] = kBase64Url[(group >> 12) & 63];
+            out[2] = kBase64Url[(group >> 6) & 63];
+            out[3] = kBase64Url[group & 63];
+        }
+        uint32_t group = 0;
+        for (size_t i = 0; i < size; i++) {
+            group |= static_cast<uint32_t>(in[i]) << (16 - 8 * i);
+        }
+        for (size_t k = 0; k < encodedLength(BASE64URL, size); k++) {
+            out[k] = kBase64Url[(group >> (18 - 6 * k)) & 63];
+        }
+    }
+
+#ifdef PSWD_GEN_X86
+    // Copies in[done, size), under 32 bytes, to tail[0, 64) with zeros after it. Byte
+    // stores followed by wide loads of the same bytes stall store forwarding, so the
+    // bytes are gathered in registers (a 16-byte load ending at `size`, shifted down by
+    // pshufb) and stored with two 32-byte stores.
+    PSWD_GEN_TARGET("avx2")
+    static void loadTailAvx2(const uint8_t* in, size_t size, size_t done, uint8_t* tail) {
+        static const uint8_t window[32] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                           0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+                                           0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+        size_t rest = size - done;
+        if (size < 16) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(tail), _mm256_setzero_si256());
+            std::memcpy(tail, in + done, rest);
+        } else {
+            // The last 16 bytes hold the final rest % 16 (or 16) bytes at their top
+            size_t top = rest > 16 ? rest - 16 : rest;
+            __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + size - 16));
+            __m128i moved = _mm_shuffle_epi8(last, _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + 16 - top)));
+            __m256i bytes = rest > 16
+                ? _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done))), moved, 1)
+                : _mm256_inserti128_si256(_mm256_setzero_si256(), moved, 0);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(tail), bytes);
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(tail + 32), _mm256_setzero_si256());
+    }
+
+    // 32 bytes to 64 characters: split nibbles, interleave, look up with pshufb
+    PSWD_GEN_TARGET("avx2")
+    static size_t encodeHexAvx2(const uint8_t* in, size_t size, char* out) {
+        const __m256i digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                                '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+            __m256i low = _mm256_and_si256(v, nibble);
+            __m256i first = _mm256_unpacklo_epi8(high, low);    // bytes 0-7 | 16-23
+            __m256i second = _mm256_unpackhi_epi8(high, low);   // bytes 8-15 | 24-31
+            __m256i a = _mm256_permute2x128_si256(first, second, 0x20);
+            __m256i b = _mm256_permute2x128_si256(first, second, 0x31);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_shuffle_epi8(digits, a));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_shuffle_epi8(digits, b));
+        }
+        return i;
+    }
+
+    // 20 bytes (four groups of five) to 32 characters. Each 16-bit lane receives the two
+    // bytes holding one 5-bit field, big-endian, and a multiply-high by 2^(16 - shift)
+    // performs that lane's own right shift, which AVX2 has no instruction for.
+    PSWD_GEN_TARGET("avx2")
+    static size_t encodeBase32Avx2(const uint8_t* in, size_t size, char* out) {
+        const __m256i gather = _mm256_setr_epi8(1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4,
+                                                1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4);
+        // field k sits at bit 11 - (5k mod 8) of its window
+        const __m256i shifts = _mm256_setr_epi16(1 << 5, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6, 1 << 11, 1 << 8,
+                                                 1 << 5, 1 << 10, 1 << 7, 1 << 12, 1 << 9, 1 << 6, 1 << 11, 1 << 8);
+        const __m256i table_low = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
+                                                   '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+        const __m256i table_high = _mm256_setr_epi8('G', 'H', 'J', 'K', 'M', 'N', 'P', 'Q', 'R', 'S', 'T', 'V', 'W', 'X', 'Y', 'Z',
+                                                    'G', 'H', 'J', 'K', 'M', 'N', 'P', 'Q', 'R', 'S', 'T', 'V', 'W', 'X', 'Y', 'Z');
+        const __m256i mask = _mm256_set1_epi16(31);
+        size_t i = 0;
+        // The second pair of groups is read as 16 bytes from offset 15
+        for (; i + 31 <= size; i += 20) {
+            __m256i pair0 = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 5)), 1);
+            __m256i pair1 = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 10))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 15)), 1);
+            __m256i fields0 = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(pair0, gather), shifts), mask);
+            __m256i fields1 = _mm256_and_si256(_mm256_mulhi_epu16(_mm256_shuffle_epi8(pair1, gather), shifts), mask);
+            // Packing interleaves the groups as 0, 2 | 1, 3 across the lanes
+            __m256i fields = _mm256_permute4x64_epi64(_mm256_packus_epi16(fields0, fields1), 0xD8);
+            __m256i is_high = _mm256_cmpgt_epi8(fields, _mm256_set1_epi8(15));
+            __m256i chars = _mm256_blendv_epi8(_mm256_shuffle_epi8(table_low, fields),
+                                               _mm256_shuffle_epi8(table_high, fields), is_high);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 5 * 8), chars);
+        }
+        return i;
+    }
+
+    // 24 bytes to 32 characters with Mula and Lemire's multiply-shift unpacking
+    PSWD_GEN_TARGET("avx2")
+    static size_t encodeBase64Avx2(const uint8_t* in, size_t size, char* out) {
+        const __m256i gather = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        // Offsets added to the 6-bit values by range: 26-51, 52-61, 62, 63, then 0-25
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+                                                 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+        size_t i = 0;
+        // The second lane reads 16 bytes from offset 12
+        for (; i + 28 <= size; i += 24) {
+            __m256i v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12)), 1);
+            v = _mm256_shuffle_epi8(v, gather);
+            __m256i high = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+                                              _mm256_set1_epi32(0x04000040));
+            __m256i low = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+                                             _mm256_set1_epi32(0x01000010));
+            __m256i values = _mm256_or_si256(high, low);
+            __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+            range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), values),
+                                                             _mm256_set1_epi8(13)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 3 * 4),
+                                _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, range)));
+        }
+        return i;
+    }
+#endif
+
+    static int valueOf(Encoding encoding, char c) {
+        const char* alphabet = encoding == HEX ? kHex : encoding == BASE32 ? kBase32 : kBase64Url;
+        const char* found = std::strchr(alphabet, c);
+        return c != '\0' && found != nullptr ? static_cast<int>(found - alphabet) : -1;
+    }
+
+    static void encodeChecksum(const Format& format, char* token) {
+        size_t covered = format.length() - encodedLength(format.encoding, 4);
+        uint32_t crc = crc32(token, covered);
+        uint8_t bytes[4] = {static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                            static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc)};
+        encode(format.encoding, bytes, 4, token + covered, SCALAR);
+    }
+
+public:
+    static Level bestLevel() {
+        return CpuFeatures::get().avx2 ? AVX2 : SCALAR;
+    }
+
+    static size_t encodedLength(Encoding encoding, size_t bytes) {
+        switch (encoding) {
+            case HEX:
+                return 2 * bytes;
+            case BASE32:
+                return (8 * bytes + 4) / 5;
+            case BASE64URL:
+                return (4 * bytes + 2) / 3;
+        }
+        return 0;
+    }
+
+    static void encode(Encoding encoding, const uint8_t* in, size_t size, char* out, Level level = bestLevel()) {
+        size_t done = 0;
+#ifdef PSWD_GEN_X86
+        if (level == AVX2) {
+            auto vector = encoding == HEX ? encodeHexAvx2 : encoding == BASE32 ? encodeBase32Avx2 : encodeBase64Avx2;
+            done = vector(in, size, out);
+            // Tokens are short, so the remainder (under 32 bytes) is usually most of the
+            // input: zero-pad it and run the vector loop once more. Zero padding is also
+            // what the scalar encoders assume for a partial group.
+            if (done < size) {
+                alignas(32) uint8_t tail_in[64];
+                alignas(32) char tail_out[128];
+                loadTailAvx2(in, size, done, tail_in);
+                // Just enough of the padded tail for the vector loop to cover the rest
+                size_t step = encoding == HEX ? 32 : encoding == BASE32 ? 20 : 24;
+                size_t reach = encoding == HEX ? 32 : encoding == BASE32 ? 31 : 28;
+                vector(tail_in, (size - done - 1) / step * step + reach, tail_out);
+                std::memcpy(out + encodedLength(encoding, done), tail_out, encodedLength(encoding, size - done));
+                secureZero(tail_in, sizeof(tail_in));
+                secureZero(tail_out, sizeof(tail_out));
+                return;
+            }
+        }
+#else
+        (void)level;
+#endif
+        char* rest = out + encodedLength(encoding, done);
+        switch (encoding) {
+            case HEX:
+                encodeHexScalar(in + done, size - done, rest);
+                break;
+            case BASE32:
+                encodeBase32Scalar(in + done, size - done, rest);
+                break;
+            case BASE64URL:
+                encodeBase64Scalar(in + done, size - done, rest);
+                break;
+        }
+    }
+
+    // Shape and checksum only; says nothing about whether the token was ever issued
+    static bool verify(const Format& format, std::string_view token) {
+        if (token.size() != format.length() || token.compare(0, format.prefix.size(), format.prefix) != 0) {
+            return false;
+        }
+        for (size_t i = format.prefix.size(); i < token.size(); i++) {
+            if (valueOf(format.encoding, token[i]) < 0) {
+                return false;
+            }
+        }
+        if (!format.checksum) {
+            return true;
+        }
+        std::string expected(token);
+        encodeChecksum(format, &expected[0]);
+        return expected == token;
+    }
+
+    // Writes format.length() characters, without a terminator
+    void mint(const Format& format, char* out) {
+        raw.resize(format.bytes);
+        random.fill(raw.data(), raw.size());
+        std::memcpy(out, format.prefix.data(), format.prefix.size());
+        encode(format.encoding, raw.data(), raw.size(), out + format.prefix.size());
+        secureZero(raw.data(), raw.size());
+        if (format.checksum) {
+            encodeChecksum(format, out);
+        }
+    }
+
+    SecureString mint(const Format& format) {
+        SecureString token(format.length(), '\0');
+        mint(format, &token[0]);
+        return token;
+    }
+
+    // count newline-terminated tokens, (format.length() + 1) * count bytes. Random bytes
+    // are drawn 64 KiB at a time.
+    void mintLines(const Format& format, size_t count, char* out) {
+        size_t line = format.length() + 1;
+        size_t per_chunk = std::max<size_t>(1, kChunkBytes / format.bytes);
+        raw.resize(per_chunk * format.bytes);
+        while (count > 0) {
+            size_t tokens = std::min(count, per_chunk);
+            random.fill(raw.data(), tokens * format.bytes);
+            for (size_t t = 0; t < tokens; t++, out += line) {
+                std::memcpy(out, format.prefix.data(), format.prefix.size());
+                encode(format.encoding, raw.data() + t * format.bytes, format.bytes, out + format.prefix.size());
+                if (format.checksum) {
+                    encodeChecksum(format, out);
+                }
+                out[line - 1] = '\n';
+            }
+            secureZero(raw.data(), tokens * format.bytes);
+            count -= tokens;
+        }
+    }
+};
+
+// Finds keyboard walks ("qwerty", "1qaz2wsx", "zaq1", "7896321") in one pass. Each layout
+// maps bytes to keys, shifted or not, and stores the neighbours of every key as a 64-bit
+// mask, so following a walk costs one table load and one bit test per layout and byte.
+// Key positions are kept in quarter-key units to tell a straight line from a turn.
+class KeyboardWalkDetector {
+public:
+    struct Walk {
+        int length = 0;              // keys in the longest walk
+        int turns = 0;               // direction changes along it
+        int straight = 0;            // keys in the longest straight stretch of any walk
+        const char* layout = "";     // layout of the longest walk
+
+        // Four keys in a line ("asdf", "1qaz") or a long walk with few turns ("zaq12wsx").
+        // Three keys would flag about 4% of random 16-character passwords; this flags 0.2%.
+        bool obvious() const {
+            return straight >= 4 || (length >= 5 && turns <= 2);
+        }
+    };
+
+private:
+    struct Layout {
+        const char* name;
+        int8_t key_of[256];
+        int8_t row[64];
+        int8_t x[64];
+        uint64_t neighbours[64];
+    };
+
+    // Rows as unshifted and shifted characters of equal length; ' ' marks a key with no
+    // ASCII character. offsets are the x of each row's first key, reach the largest x
+    // distance that still touches a key in the next row.
+    static Layout build(const char* name, std::initializer_list<std::pair<const char*, const char*>> rows,
+                        std::initializer_list<int> offsets, int reach) {
+        Layout layout;
+        layout.name = name;
+        std::fill(std::begin(layout.key_of), std::end(layout.key_of), -1);
+        std::fill(std::begin(layout.neighbours), std::end(layout.neighbours), 0);
+
+        int keys = 0, r = 0;
+        auto offset = offsets.begin();
+        for (const auto& row : rows) {
+            size_t count = std::strlen(row.first);
+            for (size_t c = 0; c < count; c++) {
+                if (row.first[c] == ' ' && row.second[c] == ' ') {
+                    continue;
+                }
+                layout.row[keys] = static_cast<int8_t>(r);
+                layout.x[keys] = static_cast<int8_t>(*offset + 4 * static_cast<int>(c));
+                for (char ch : {row.first[c], row.second[c]}) {
+                    if (ch != ' ') {
+                        layout.key_of[static_cast<unsigned char>(ch)] = static_cast<int8_t>(keys);
+                    }
+                }
+                keys++;
+            }
+            r++;
+            ++offset;
+        }
+
+        for (int a = 0; a < keys; a++) {
+            for (int b = 0; b < keys; b++) {
+                int rows_apart = std::abs(layout.row[a] - layout.row[b]);
+                int dx = std::abs(layout.x[a] - layout.x[b]);
+                if ((rows_apart == 0 && dx == 4) || (rows_apart == 1 && dx <= reach)) {
+                    layout.neighbours[a] |= 1ull << b;
+                }
+            }
+        }
+        return layout;
+    }
+
+    static const std::vector<Layout>& layouts() {
+        static const std::vector<Layout> all = {
+            build("QWERTY", {{"`1234567890-=", "~!@#$%^&*()_+"},
+                             {"qwertyuiop[]\\", "QWERTYUIOP{}|"},
+                             {"asdfghjkl;'", "ASDFGHJKL:\""},
+                             {"zxcvbnm,./", "ZXCVBNM<>?"}}, {0, 6, 7, 9}, 3),
+            build("AZERTY", {{" & \"'(- _  )=", " 1234567890 +"},
+                             {"azertyuiop^$", "AZERTYUIOP  "},
+                             {"qsdfghjklm *", "QSDFGHJKLM% "},
+                             {"<wxcvbn,;:!", ">WXCVBN?./ "}}, {0, 6, 7, 5}, 3),
+            build("QWERTZ", {{"^1234567890  ", " !\" $%&/()=?`"},
+                             {"qwertzuiop +", "QWERTZUIOP *"},
+                             {"asdfghjkl  #", "ASDFGHJKL  '"},
+                             {"<yxcvbnm,.-", ">YXCVBNM;:_"}}, {0, 6, 7, 5}, 3),
+            build("keypad", {{" /*-", "    "},
+                             {"789+", "    "},
+                             {"456 ", "    "},
+                             {"123 ", "    "},
+                             {"0 . ", "    "}}, {0, 0, 0, 0, 0}, 4),
+        };
+        return all;
+    }
+
+public:
+    static Walk longestWalk(std::string_view text) {
+        Walk best;
+        for (const Layout& layout : layouts()) {
+            int previous = -1, length = 0, turns = 0, straight = 0;
+            int drow = 0, dx = 0;
+            for (char ch : text) {
+                int key = layout.key_of[static_cast<unsigned char>(ch)];
+                if (key >= 0 && previous >= 0 && (layout.neighbours[previous] >> key & 1)) {
+                    int step_row = layout.row[key] - layout.row[previous];
+                    int step_x = layout.x[key] - layout.x[previous];
+                    // Staggered rows never line up exactly, so a line keeps the sign of its x step
+                    bool same = length > 1 && step_row == drow && (step_x > 0) == (dx > 0) && (step_x < 0) == (dx < 0);
+                    if (length > 1 && !same) {
+                        turns++;
+                        straight = 1;
+                    }
+                    length++;
+                    straight++;
+                    drow = step_row;
+                    dx = step_x;
+                } else {
+                    length = key >= 0 ? 1 : 0;
+                    turns = 0;
+                    straight = length;
+                }
+                previous = key;
+
+                if (length > best.length || (length == best.length && turns < best.turns)) {
+                    best.length = length;
+                    best.turns = turns;
+                    best.layout = layout.name;
+                }
+                best.straight = std::max(best.straight, straight);
+            }
+        }
+        return best;
+    }
+};
+
+// Recent passwords of one account, for rotation rules of the form "not within edit
+// distance k of any of the last N". Comparing a candidate against thousands of entries
+// stays cheap because most are rejected before any distance is computed: entries whose
+// length differs by more than k, or whose character histograms differ by more than k
+// edits can explain, are skipped. The survivors go through Myers' bit-parallel
+// Levenshtein, one 64-bit step per character, with the candidate as the pattern.
+class PasswordHistory {
+public:
+    struct Match {
+        bool found = false;
+        size_t index = 0;      // entry position, oldest first
+        int distance = 0;
+    };
+
+    // Filter counters of the last closest() call
+    struct Stats {
+        size_t compared = 0;   // entries that needed an edit distance
+        size_t skipped = 0;    // entries ruled out by length or histogram
+    };
+
+private:
+    static constexpr int kBuckets = 32;
+    static constexpr size_t kMaxPattern = 64;
+
+    // Kept apart from the passwords so the filter streams 32 bytes per entry
+    struct Signature {
+        alignas(16) uint8_t histogram[kBuckets];
+    };
+
+    // Ring of at most `keep` entries; once full, head is the oldest
+    SecureStringList passwords;
+    std::vector<Signature> signatures;
+    std::vector<uint32_t> lengths;
+    size_t head = 0;
+    size_t keep;
+    mutable Stats last_stats;
+
+    // Folding bytes into buckets only shrinks histogram differences, so the bound holds.
+    // The fold keeps the two cases of a letter apart.
+    static void fillHistogram(std::string_view text, uint8_t* histogram) {
+        std::fill(histogram, histogram + kBuckets, 0);
+        for (char c : text) {
+            unsigned char byte = static_cast<unsigned char>(c);
+            uint8_t& count = histogram[(byte ^ (byte >> 5)) % kBuckets];
+            count = static_cast<uint8_t>(std::min(255, count + 1));
+        }
+    }
+
+    // A substitution lowers the surplus of a on each side by at most one and an insertion
+    // or deletion one side only, so the larger side surplus bounds the edit distance
+    static int histogramBound(const uint8_t* a, const uint8_t* b, int length_difference) {
+        int surplus = 0;
+#ifdef __SSE2__
+        // Saturating subtraction is max(0, a - b) per bucket; SAD against zero sums it
+        __m128i sum = _mm_setzero_si128();
+        for (int i = 0; i < kBuckets; i += 16) {
+            __m128i diff = _mm_subs_epu8(_mm_load_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                         _mm_load_si128(reinterpret_cast<const __m128i*>(b + i)));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(diff, _mm_setzero_si128()));
+        }
+        surplus = _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+#else
+        for (int i = 0; i < kBuckets; i++) {
+            surplus += std::max(0, a[i] - b[i]);
+        }
+#endif
+        return std::max(surplus, surplus - length_difference);
+    }
+
+    // Hyyro's form of Myers' algorithm; gives up once the distance must exceed limit
+    static int myersDistance(const uint64_t* peq, size_t m, std::string_view text, int limit) {
+        if (m == 0) {
+            return static_cast<int>(std::min<size_t>(text.size(), limit + 1));
+        }
+        uint64_t top = 1ull << (m - 1);
+        uint64_t pv = m == 64 ? ~0ull : (1ull << m) - 1;
+        uint64_t mv = 0;
+        int score = static_cast<int>(m);
+        for (size_t j = 0; j < text.size(); j++) {
+            uint64_t eq = peq[static_cast<unsigned char>(text[j])];
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & top) {
+                score++;
+            } else if (mh & top) {
+                score--;
+            }
+            if (score - static_cast<int>(text.size() - j - 1) > limit) {
+                return limit + 1;
+            }
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return std::min(score, limit + 1);
+    }
+
+    // Row-by-row fallback for candidates longer than one machine word
+    static int rowDistance(std::string_view a, std::string_view b, int limit) {
+        std::vector<int> row(b.size() + 1);
+        for (size_t j = 0; j <= b.size(); j++) row[j] = static_cast<int>(j);
+        for (size_t i = 1; i <= a.size(); i++) {
+            int diagonal = row[0];
+            row[0] = static_cast<int>(i);
+            int smallest = row[0];
+            for (size_t j = 1; j <= b.size(); j++) {
+                int above = row[j];
+                row[j] = std::min({above + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1])});
+                diagonal = above;
+                smallest = std::min(smallest, row[j]);
+            }
+            if (smallest > limit) {
+                return limit + 1;
+            }
+        }
+        return std::min(row[b.size()], limit + 1);
+    }
+
+public:
+    explicit PasswordHistory(size_t entries_kept = 24) : keep(std::max<size_t>(1, entries_kept)) {}
+
+    // Levenshtein distance, or limit + 1 when it exceeds limit
+    static int distance(std::string_view a, std::string_view b, int limit = std::numeric_limits<int>::max() - 1) {
+        if (a.size() > kMaxPattern) {
+            return rowDistance(a, b, limit);
+        }
+        uint64_t peq[256] = {};
+        for (size_t i = 0; i < a.size(); i++) {
+            peq[static_cast<unsigned char>(a[i])] |= 1ull << i;
+        }
+        return myersDistance(peq, a.size(), b, limit);
+    }
+
+    // The oldest entry falls out once the history is full
+    void add(std::string_view password) {
+        Signature signature;
+        fillHistogram(password, signature.histogram);
+        if (passwords.size() < keep) {
+            passwords.emplace_back(password.data(), password.size());
+            signatures.push_back(signature);
+            lengths.push_back(static_cast<uint32_t>(password.size()));
+            return;
+        }
+        passwords[head].assign(password.data(), password.size());
+        signatures[head] = signature;
+        lengths[head] = static_cast<uint32_t>(password.size());
+        head = (head + 1) % keep;
+    }
+
+    size_t size() const {
+        return passwords.size();
+    }
+
+    // Entry i, oldest first
+    const SecureString& entry(size_t i) const {
+        return passwords[(head + i) % passwords.size()];
+    }
+
+    const Stats& stats() const {
+        return last_stats;
+    }
+
+    // One password per line, oldest first
+    void load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        SecureString line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                add(line);
+            }
+        }
+    }
+
+    // The history holds plain passwords: it is written to a private temporary file and
+    // then replaces path, so a crash leaves either the old history or the new one
+    void save(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+        createPrivateFile(temporary);
+        {
+            std::ofstream file(temporary, std::ios::trunc);
+            for (size_t i = 0; i < size(); i++) {
+                file << entry(i) << "\n";
+            }
+            if (!file.flush()) {
+                file.close();
+                std::remove(temporary.c_str());
+                throw std::runtime_error("Cannot write '" + path + "'");
+            }
+        }
+        replaceFile(temporary, path);
+    }
+
+    // Closest entry at distance max_distance or less
+    Match closest(std::string_view candidate, int max_distance) const {
+        last_stats = Stats();
+        Match best;
+        if (max_distance < 0) {
+            return best;
+        }
+
+        Signature signature;
+        fillHistogram(candidate, signature.histogram);
+        uint64_t peq[256] = {};
+        bool bit_parallel = candidate.size() <= kMaxPattern;
+        if (bit_parallel) {
+            for (size_t i = 0; i < candidate.size(); i++) {
+                peq[static_cast<unsigned char>(candidate[i])] |= 1ull << i;
+            }
+        }
+
+        int limit = max_distance;
+        for (size_t i = 0; i < passwords.size(); i++) {
+            int length_difference = static_cast<int>(candidate.size()) - static_cast<int>(lengths[i]);
+            if (std::abs(length_difference) > limit ||
+                histogramBound(signature.histogram, signatures[i].histogram, length_difference) > limit) {
+                last_stats.skipped++;
+                continue;
+            }
+            last_stats.compared++;
+            int d = bit_parallel ? myersDistance(peq, candidate.size(), passwords[i], limit)
+                                 : rowDistance(candidate, passwords[i], limit);
+            if (d <= limit) {
+                best.found = true;
+                best.index = (i + passwords.size() - head) % passwords.size();
+                best.distance = d;
+                if (d == 0) {
+                    break;
+                }
+                // Only a strictly closer entry can replace this one
+                limit = d - 1;
+            }
+        }
+        return best;
+    }
+
+    bool tooSimilar(std::string_view candidate, int max_distance) const {
+        return closest(candidate, max_distance).found;
+    }
+};
+
+// Fixed-size worker pool for CPU-bound batch work
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, threads);
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    template <typename Task>
+    std::future<void> submit(Task task) {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packaged] { (*packaged)(); });
+        }
+        ready.notify_one();
+        return result;
+    }
+
+    // Runs body(begin, end) over [0, count) in chunks of `grain` and waits for all of
+    // them; the first exception thrown by a chunk is rethrown here
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+        std::vector<std::future<void>> pending;
+        for (size_t begin = 0; begin < count; begin += grain) {
+            size_t end = std::min(count, begin + grain);
+            pending.push_back(submit([&body, begin, end] { body(begin, end); }));
+        }
+        for (auto& result : pending) {
+            result.wait();
+        }
+        for (auto& result : pending) {
+            result.get();
+        }
+    }
+};
+
+// Checks existing passwords against a character policy, one per line. The policy
+// compiles to a counting automaton: a 256-entry table sends each byte to one of eight
+// categories (the four classes and four ways to break the policy) as a one in that
+// category's byte of a 64-bit word, so counting a byte is a load and an add with no
+// branch. The counts are read off at each line end, and every 255 bytes of a longer
+// line before a byte lane can overflow. Files are mapped and cut at line boundaries
+// into chunks checked in parallel; failing lines are still reported in order.
+class PolicyValidator {
+public:
+    enum Violation : uint32_t {
+        TOO_SHORT = 1,
+        TOO_LONG = 2,
+        FEW_LOWERCASE = 4,
+        FEW_UPPERCASE = 8,
+        FEW_DIGITS = 16,
+        FEW_SPECIAL = 32,
+        DISALLOWED_CLASS = 64,  // a character of a class the policy leaves out
+        AMBIGUOUS = 128,        // an ambiguous character the policy excludes
+        EXCLUDED = 256,         // a character weighted 0
+        INVALID_BYTE = 512      // in no class: spaces, control bytes, non-ASCII
+    };
+    static constexpr int kViolationKinds = 10;
+
+    // Lowercase, uppercase, digits and special characters, in that order
+    struct ClassRule {
+        std::string members;  // every character of the class
+        std::string allowed;  // the members the policy uses; empty when the class is off
+        int min_count = 0;
+    };
+
+    struct Summary {
+        uint64_t lines = 0;
+        uint64_t compliant = 0;
+        uint64_t bytes = 0;
+        uint64_t by_violation[kViolationKinds] = {};
+    };
+
+    static const char* violationName(int bit) {
+        static const char* const names[kViolationKinds] = {
+            "too-short", "too-long", "few-lowercase", "few-uppercase", "few-digits",
+            "few-special", "disallowed-class", "ambiguous", "excluded", "invalid-byte"
+        };
+        return names[bit];
+    }
+
+    static std::string describe(uint32_t violations) {
+        std::string text;
+        for (int bit = 0; bit < kViolationKinds; bit++) {
+            if (violations & (1u << bit)) {
+                text += text.empty() ? "" : ",";
+                text += violationName(bit);
+            }
+        }
+        return text;
+    }
+
+private:
+    static constexpr int kCategories = 8;
+    static constexpr int kFirstOffence = 4;  // categories from here on are violations
+    static constexpr size_t kLaneLimit = 255;
+    static constexpr uint64_t kLaneTops = 0x8080808080808080ull;
+    static constexpr size_t kChunkSize = 4 << 20;
+
+    struct ChunkResult {
+        Summary summary;
+        std::vector<std::pair<uint64_t, uint32_t>> failures;  // line within the chunk, violations
+    };
+
+    uint64_t increment[256];
+    uint64_t minimums[4];
+    uint64_t minimum_lanes = 0;  // the minimums capped at 128, one per class lane
+    uint64_t min_length;
+    uint64_t max_length;
+
+    static uint64_t countLanes(const unsigned char* data, size_t size, const uint64_t* table) {
+        uint64_t even = 0, odd = 0;
+        size_t i = 0;
+        for (; i + 1 < size; i += 2) {
+            even += table[data[i]];
+            odd += table[data[i + 1]];
+        }
+        if (i < size) {
+            even += table[data[i]];
+        }
+        return even + odd;
+    }
+
+    uint32_t checkBytes(const unsigned char* data, size_t size) const {
+        uint32_t violations = (size < min_length ? TOO_SHORT : 0u) | (size > max_length ? TOO_LONG : 0u);
+        if (size < 128) {
+            // No lane can reach 128, so one subtraction compares every class lane with its
+            // minimum and one addition finds the nonzero offence lanes. The top bit of
+            // each lane then says whether it failed, and a multiply gathers them.
+            uint64_t lanes = countLanes(data, size, increment);
+            uint64_t met = ((lanes | kLaneTops) - minimum_lanes) & kLaneTops;
+            uint64_t nonzero = (lanes + 0x7F7F7F7F7F7F7F7Full) & kLaneTops;
+            uint64_t failed = ((~met & 0x80808080ull) | (nonzero & 0x8080808000000000ull)) >> 7;
+            return violations | static_cast<uint32_t>((failed * 0x0102040810204080ull) >> 56) << 2;
+        }
+
+        uint64_t counts[kCategories] = {};
+        for (size_t done = 0; done < size; done += kLaneLimit) {
+            uint64_t lanes = countLanes(data + done, std::min(kLaneLimit, size - done), increment);
+            for (int k = 0; k < kCategories; k++) {
+                counts[k] += (lanes >> (8 * k)) & 0xFF;
+            }
+        }
+        for (int k = 0; k < kFirstOffence; k++) {
+            violations |= counts[k] < minimums[k] ? FEW_LOWERCASE << k : 0u;
+        }
+        for (int k = kFirstOffence; k < kCategories; k++) {
+            violations |= counts[k] > 0 ? DISALLOWED_CLASS << (k - kFirstOffence) : 0u;
+        }
+        return violations;
+    }
+
+    void checkChunk(const char* data, size_t size, ChunkResult& result) const {
+        const char* end = data + size;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(std::memchr(data, '\n', static_cast<size_t>(end - data)));
+            const char* line_end = newline != nullptr ? newline : end;
+            const char* next = newline != nullptr ? newline + 1 : end;
+            if (line_end > data && line_end[-1] == '\r') {
+                line_end--;
+            }
+
+            uint32_t violations = checkBytes(reinterpret_cast<const unsigned char*>(data),
+                                             static_cast<size_t>(line_end - data));
+            if (violations == 0) {
+                result.summary.compliant++;
+            } else {
+                result.failures.emplace_back(result.summary.lines, violations);
+                for (int bit = 0; bit < kViolationKinds; bit++) {
+                    result.summary.by_violation[bit] += (violations >> bit) & 1;
+                }
+            }
+            result.summary.lines++;
+            result.summary.bytes += static_cast<uint64_t>(next - data);
+            data = next;
+        }
+    }
+
+public:
+    PolicyValidator(const std::vector<ClassRule>& classes, std::string_view ambiguous, uint64_t min_chars,
+                    uint64_t max_chars = std::numeric_limits<uint64_t>::max())
+        : min_length(min_chars), max_length(max_chars) {
+        if (classes.size() != kFirstOffence) {
+            throw std::invalid_argument("A policy has four character classes");
+        }
+        std::fill(std::begin(increment), std::end(increment), 1ull << (8 * (kFirstOffence + 3)));
+        for (int k = 0; k < kFirstOffence; k++) {
+            const ClassRule& rule = classes[k];
+            for (char c : rule.members) {
+                int category = rule.allowed.empty() ? kFirstOffence
+                             : rule.allowed.find(c) != std::string::npos ? k
+                             : ambiguous.find(c) != std::string_view::npos ? kFirstOffence + 1
+                             : kFirstOffence + 2;
+                increment[static_cast<unsigned char>(c)] = 1ull << (8 * category);
+            }
+            minimums[k] = rule.allowed.empty() ? 0 : static_cast<uint64_t>(std::max(0, rule.min_count));
+            minimum_lanes |= std::min<uint64_t>(minimums[k], 128) << (8 * k);
+        }
+    }
+
+    uint32_t check(std::string_view password) const {
+        return checkBytes(reinterpret_cast<const unsigned char*>(password.data()), password.size());
+    }
+
+    // Checks each line of a file (a final '\r' is ignored) and calls report(line, violations),
+    // counting lines from 1, for every failing one in file order
+    Summary checkFile(const std::string& path, const std::function<void(uint64_t, uint32_t)>& report) const {
+        MappedFile file(path);
+        const char* data = file.data();
+        size_t size = file.size();
+
+        // Chunks start after the first newline at or past each multiple of kChunkSize
+        std::vector<size_t> starts(1, 0);
+        for (size_t nominal = kChunkSize; nominal < size; nominal += kChunkSize) {
+            const char* newline = static_cast<const char*>(std::memchr(data + nominal, '\n', size - nominal));
+            size_t start = newline != nullptr ? static_cast<size_t>(newline - data) + 1 : size;
+            if (start >= size) {
+                break;
+            }
+            if (start > starts.back()) {
+                starts.push_back(start);
+            }
+        }
+        starts.push_back(size);
+
+        // Rounds of a few chunks per thread bound the failures held before reporting
+        Summary total;
+        ThreadPool& pool = ThreadPool::shared();
+        size_t chunk_count = starts.size() - 1;
+        size_t round = std::max<size_t>(1, pool.size()) * 4;
+        for (size_t first = 0; first < chunk_count; first += round) {
+            size_t count = std::min(round, chunk_count - first);
+            std::vector<ChunkResult> results(count);
+            pool.parallelFor(count, 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    size_t chunk = first + i;
+                    checkChunk(data + starts[chunk], starts[chunk + 1] - starts[chunk], results[i]);
+                }
+            });
+
+            for (const ChunkResult& result : results) {
+                for (const auto& failure : result.failures) {
+                    report(total.lines + failure.first + 1, failure.second);
+                }
+                total.lines += result.summary.lines;
+                total.compliant += result.summary.compliant;
+                total.bytes += result.summary.bytes;
+                for (int bit = 0; bit < kViolationKinds; bit++) {
+                    total.by_violation[bit] += result.summary.by_violation[bit];
+                }
+            }
+        }
+        return total;
+    }
+};
+
+// Groups near-duplicate passwords in a dump, such as Summer2024! and summer2025!, so
+// reuse shows up even when no two entries are equal. Passwords are normalized (ASCII
+// case folded, common leet substitutions undone) and cut into 3-byte shingles, with
+// markers for the start and end. Close variants share most shingles, so their MinHash
+// values mostly agree: each of kBands bands hashes kRows MinHash values into a key, and
+// entries sharing a key in any band are candidates. A cluster is named by its first
+// entry, and a candidate joins the cluster of the first entry seen with its key when the
+// Jaccard similarity of their shingle sets, measured against that first entry, reaches
+// the threshold. Every member is thus close to one representative, so clusters cannot
+// drift through chains of small edits, and each entry costs one table probe and at most
+// one exact check per band.
+//
+// Memory is about 16 bytes per entry plus 4 per band held at once (line offsets, cluster
+// of each entry, the bucket table, band keys); the file itself stays mapped.
+// Band keys are computed on all cores, as many bands per pass as kPassBudget allows.
+class VariantClusterer {
+public:
+    static constexpr int kBands = 12;
+    static constexpr int kRows = 3;  // bands of 3 rows catch most pairs above 0.5 similarity
+    static constexpr size_t kMaxLength = 64;  // bytes of a line that are compared
+    static constexpr size_t kPassBudget = 256 << 20;
+
+    struct Cluster {
+        uint64_t size = 0;
+        std::vector<std::pair<std::string_view, uint64_t>> variants;  // most common first
+    };
+
+    struct Summary {
+        uint64_t entries = 0;
+        uint64_t clusters = 0;  // of two or more entries
+        uint64_t clustered_entries = 0;
+        uint64_t varied_clusters = 0;  // with two or more distinct passwords
+        uint64_t largest = 0;
+        uint64_t checks = 0;  // exact similarity checks of candidates
+    };
+
+private:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFFu;
+
+    MappedFile file;
+    double threshold;
+    std::vector<uint64_t> offsets;  // entry i is the line from offsets[i] to the next newline
+    std::vector<uint32_t> parent;  // first entry of the cluster, or the entry itself
+    std::vector<bool> leads;       // entries with members, which stay where they are
+    uint64_t multipliers[kBands * kRows];
+    uint64_t checks = 0;
+
+    std::string_view entry(uint32_t id) const {
+        const char* start = file.data() + offsets[id];
+        const char* end = file.data() + file.size();
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', static_cast<size_t>(end - start)));
+        size_t length = static_cast<size_t>((newline != nullptr ? newline : end) - start);
+        if (length > 0 && start[length - 1] == '\r') {
+            length--;
+        }
+        return std::string_view(start, length);
+    }
+
+    static uint64_t mix(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    // Shingles of the normalized password, in order; returns how many
+    static size_t shingles(std::string_view password, uint32_t* out) {
+        static const std::array<unsigned char, 256> normal = [] {
+            std::array<unsigned char, 256> table;
+            for (int c = 0; c < 256; c++) {
+                table[c] = static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c + 32 : c);
+            }
+            const char* leet = "0o1i!i|i3e4a@a5s$s7t+t8b9g";
+            for (size_t i = 0; leet[i] != '\0'; i += 2) {
+                table[static_cast<unsigned char>(leet[i])] = static_cast<unsigned char>(leet[i + 1]);
+            }
+            return table;
+        }();
+
+        size_t length = std::min(password.size(), kMaxLength);
+        unsigned char text[kMaxLength + 2];
+        text[0] = 0x02;  // start and end markers, below every printable character
+        for (size_t i = 0; i < length; i++) {
+            text[i + 1] = normal[static_cast<unsigned char>(password[i])];
+        }
+        text[length + 1] = 0x03;
+
+        size_t count = 0;
+        for (size_t i = 0; i < length; i++) {
+            out[count++] = static_cast<uint32_t>(text[i]) << 16 | static_cast<uint32_t>(text[i + 1]) << 8 | text[i + 2];
+        }
+        return count;
+    }
+
+    static size_t shingleSet(std::string_view password, uint32_t* out) {
+        size_t count = shingles(password, out);
+        std::sort(out, out + count);
+        return static_cast<size_t>(std::unique(out, out + count) - out);
+    }
+
+    bool similar(uint32_t a, uint32_t b) {
+        std::string_view first = entry(a), second = entry(b);
+        if (first == second) {
+            return true;
+        }
+        checks++;
+        uint32_t left[kMaxLength], right[kMaxLength];
+        size_t left_count = shingleSet(first, left);
+        size_t right_count = shingleSet(second, right);
+        size_t shared = 0;
+        for (size_t i = 0, j = 0; i < left_count && j < right_count;) {
+            if (left[i] == right[j]) {
+                shared++;
+                i++;
+                j++;
+            } else if (left[i] < right[j]) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+        size_t either = left_count + right_count - shared;
+        return either > 0 && shared >= threshold * either;
+    }
+
+    // Keys of bands [first, first + count) for entry id
+    void bandKeys(uint32_t id, int first, int count, uint32_t* keys) const {
+        uint32_t values[kMaxLength];
+        uint64_t hashes[kMaxLength];
+        size_t shingle_count = shingles(entry(id), values);
+        for (size_t i = 0; i < shingle_count; i++) {
+            hashes[i] = mix(values[i]);
+        }
+        for (int band = 0; band < count; band++) {
+            uint64_t key = static_cast<uint64_t>(first + band);
+            for (int row = 0; row < kRows; row++) {
+                uint64_t multiplier = multipliers[(first + band) * kRows + row];
+                uint32_t minimum = kEmpty;
+                for (size_t i = 0; i < shingle_count; i++) {
+                    minimum = std::min(minimum, static_cast<uint32_t>((hashes[i] * multiplier) >> 32));
+                }
+                key = mix(key ^ minimum);
+            }
+            keys[band] = static_cast<uint32_t>(key);
+        }
+    }
+
+    // Moves each lone entry into the cluster of the first entry with the same key, when it
+    // is similar enough to that cluster's representative
+    void bucketBand(const uint32_t* keys, std::vector<uint32_t>& table) {
+        size_t mask = table.size() - 1;
+        std::fill(table.begin(), table.end(), kEmpty);
+        uint32_t count = static_cast<uint32_t>(offsets.size());
+        for (uint32_t id = 0; id < count; id++) {
+            uint32_t key = keys[id];
+            size_t slot = key & mask;
+            while (table[slot] != kEmpty && keys[table[slot]] != key) {
+                slot = (slot + 1) & mask;
+            }
+            if (table[slot] == kEmpty) {
+                table[slot] = id;
+                continue;
+            }
+            uint32_t representative = parent[table[slot]];
+            if (parent[id] == id && !leads[id] && representative != id && similar(id, representative)) {
+                parent[id] = representative;
+                leads[representative] = true;
+            }
+        }
+    }
+
+public:
+    VariantClusterer(const std::string& path, double similarity) : file(path), threshold(similarity) {
+        if (!(similarity > 0.0 && similarity <= 1.0)) {
+            throw std::invalid_argument("Similarity must be in (0, 1]");
+        }
+        uint64_t seed = 0x243f6a8885a308d3ull;
+        for (auto& multiplier : multipliers) {
+            seed += 0x9e3779b97f4a7c15ull;
+            multiplier = mix(seed) | 1;
+        }
+
+        const char* data = file.data();
+        size_t size = file.size();
+        for (size_t position = 0; position < size;) {
+            const char* newline = static_cast<const char*>(std::memchr(data + position, '\n', size - position));
+            size_t next = newline != nullptr ? static_cast<size_t>(newline - data) + 1 : size;
+            bool blank = next - position <= 1 || (next - position == 2 && data[position] == '\r');
+            if (!blank) {
+                offsets.push_back(position);
+            }
+            position = next;
+        }
+        if (offsets.size() >= kEmpty) {
+            throw std::length_error("Too many passwords in '" + path + "'");
+        }
+    }
+
+    uint64_t size() const {
+        return offsets.size();
+    }
+
+    void run() {
+        uint32_t count = static_cast<uint32_t>(offsets.size());
+        parent.resize(count);
+        leads.assign(count, false);
+        for (uint32_t id = 0; id < count; id++) {
+            parent[id] = id;
+        }
+        if (count == 0) {
+            return;
+        }
+
+        size_t table_size = 1;
+        while (table_size < 2 * static_cast<size_t>(count)) {
+            table_size <<= 1;
+        }
+        std::vector<uint32_t> table(table_size);
+
+        int per_pass = static_cast<int>(std::min<size_t>(kBands, std::max<size_t>(1, kPassBudget / (4 * count))));
+        std::vector<uint32_t> keys(static_cast<size_t>(per_pass) * count);
+        for (int first = 0; first < kBands; first += per_pass) {
+            int bands = std::min(per_pass, kBands - first);
+            ThreadPool::shared().parallelFor(count, 1 << 14, [&](size_t begin, size_t end) {
+                uint32_t row[kBands];
+                for (size_t id = begin; id < end; id++) {
+                    bandKeys(static_cast<uint32_t>(id), first, bands, row);
+                    for (int band = 0; band < bands; band++) {
+                        keys[static_cast<size_t>(band) * count + id] = row[band];
+                    }
+                }
+            });
+            for (int band = 0; band < bands; band++) {
+                bucketBand(keys.data() + static_cast<size_t>(band) * count, table);
+            }
+        }
+    }
+
+    // The `top` largest clusters, after run()
+    std::vector<Cluster> clusters(size_t top, Summary& summary) {
+        uint32_t count = static_cast<uint32_t>(offsets.size());
+        std::vector<uint32_t> sizes(count, 0);
+        std::vector<bool> varied(count, false);
+        for (uint32_t id = 0; id < count; id++) {
+            uint32_t root = parent[id];
+            sizes[root]++;
+            if (root != id && !varied[root] && entry(id) != entry(root)) {
+                varied[root] = true;
+            }
+        }
+
+        summary = Summary();
+        summary.entries = count;
+        summary.checks = checks;
+        std::vector<std::pair<uint32_t, uint32_t>> ranked;  // size, root
+        for (uint32_t id = 0; id < count; id++) {
+            if (sizes[id] >= 2) {
+                summary.clusters++;
+                summary.clustered_entries += sizes[id];
+                summary.varied_clusters += varied[id];
+                summary.largest = std::max<uint64_t>(summary.largest, sizes[id]);
+                ranked.emplace_back(sizes[id], id);
+            }
+        }
+        top = std::min(top, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(),
+                          [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                              return a.first != b.first ? a.first > b.first : a.second < b.second;
+                          });
+
+        std::unordered_map<uint32_t, size_t> slot_of;
+        for (size_t i = 0; i < top; i++) {
+            slot_of[ranked[i].second] = i;
+        }
+        std::vector<std::vector<std::string_view>> members(top);
+        for (uint32_t id = 0; id < count && top > 0; id++) {
+            auto found = slot_of.find(parent[id]);
+            if (found != slot_of.end()) {
+                members[found->second].push_back(entry(id));
+            }
+        }
+
+        std::vector<Cluster> result(top);
+        for (size_t i = 0; i < top; i++) {
+            std::vector<std::string_view>& passwords = members[i];
+            std::sort(passwords.begin(), passwords.end());
+            result[i].size = passwords.size();
+            for (size_t j = 0; j < passwords.size();) {
+                size_t k = j;
+                while (k < passwords.size() && passwords[k] == passwords[j]) {
+                    k++;
+                }
+                result[i].variants.emplace_back(passwords[j], k - j);
+                j = k;
+            }
+            std::stable_sort(result[i].variants.begin(), result[i].variants.end(),
+                             [](const std::pair<std::string_view, uint64_t>& a,
+                                const std::pair<std::string_view, uint64_t>& b) { return a.second > b.second; });
+        }
+        return result;
+    }
+};
+
+// SHA-2 compression written once over a word type V, which is either the plain word
+// (one message) or a vector of words (one independent message per lane). Hashing
+// several equal-length messages side by side fills the vector units, which is what
+// makes batch PBKDF2 and sha512-crypt fast.
+#if defined(__GNUC__) || defined(__clang__)
+#define PSWD_GEN_VECTOR_EXTENSIONS 1
+#define PSWD_GEN_ALWAYS_INLINE inline __attribute__((always_inline))
+typedef uint32_t U32x4 __attribute__((vector_size(16)));
+typedef uint32_t U32x8 __attribute__((vector_size(32)));
+typedef uint64_t U64x2 __attribute__((vector_size(16)));
+typedef uint64_t U64x4 __attribute__((vector_size(32)));
+#elif defined(_MSC_VER)
+#define PSWD_GEN_ALWAYS_INLINE __forceinline
+#else
+#define PSWD_GEN_ALWAYS_INLINE inline
+#endif
+
+constexpr int kShaMaxLanes = 8;
+
+struct Sha256Traits {
+    typedef uint32_t Word;
+#ifdef PSWD_GEN_VECTOR_EXTENSIONS
+    typedef U32x4 Narrow;
+    typedef U32x8 Wide;
+#endif
+    static constexpr int kRounds = 64;
+    static constexpr size_t kBlockSize = 64;
+    static constexpr size_t kDigestSize = 32;
+    static constexpr size_t kLengthSize = 8;
+
+    static constexpr Word kInit[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    static constexpr Word kConstants[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sum0(const V& x, V& out) {
+        out = ((x >> 2) | (x << 30)) ^ ((x >> 13) | (x << 19)) ^ ((x >> 22) | (x << 10));
+    }
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sum1(const V& x, V& out) {
+        out = ((x >> 6) | (x << 26)) ^ ((x >> 11) | (x << 21)) ^ ((x >> 25) | (x << 7));
+    }
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sigma0(const V& x, V& out) {
+        out = ((x >> 7) | (x << 25)) ^ ((x >> 18) | (x << 14)) ^ (x >> 3);
+    }
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sigma1(const V& x, V& out) {
+        out = ((x >> 17) | (x << 15)) ^ ((x >> 19) | (x << 13)) ^ (x >> 10);
+    }
+};
+
+struct Sha512Traits {
+    typedef uint64_t Word;
+#ifdef PSWD_GEN_VECTOR_EXTENSIONS
+    typedef U64x2 Narrow;
+    typedef U64x4 Wide;
+#endif
+    static constexpr int kRounds = 80;
+    static constexpr size_t kBlockSize = 128;
+    static constexpr size_t kDigestSize = 64;
+    static constexpr size_t kLengthSize = 16;
+
+    static constexpr Word kInit[8] = {
+        0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+        0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+    };
+
+    static constexpr Word kConstants[80] = {
+        0x428a2f98d728ae22ull, 0x7137449123ef65cdull, 0xb5c0fbcfec4d3b2full, 0xe9b5dba58189dbbcull,
+        0x3956c25bf348b538ull, 0x59f111f1b605d019ull, 0x923f82a4af194f9bull, 0xab1c5ed5da6d8118ull,
+        0xd807aa98a3030242ull, 0x12835b0145706fbeull, 0x243185be4ee4b28cull, 0x550c7dc3d5ffb4e2ull,
+        0x72be5d74f27b896full, 0x80deb1fe3b1696b1ull, 0x9bdc06a725c71235ull, 0xc19bf174cf692694ull,
+        0xe49b69c19ef14ad2ull, 0xefbe4786384f25e3ull, 0x0fc19dc68b8cd5b5ull, 0x240ca1cc77ac9c65ull,
+        0x2de92c6f592b0275ull, 0x4a7484aa6ea6e483ull, 0x5cb0a9dcbd41fbd4ull, 0x76f988da831153b5ull,
+        0x983e5152ee66dfabull, 0xa831c66d2db43210ull, 0xb00327c898fb213full, 0xbf597fc7beef0ee4ull,
+        0xc6e00bf33da88fc2ull, 0xd5a79147930aa725ull, 0x06ca6351e003826full, 0x142929670a0e6e70ull,
+        0x27b70a8546d22ffcull, 0x2e1b21385c26c926ull, 0x4d2c6dfc5ac42aedull, 0x53380d139d95b3dfull,
+        0x650a73548baf63deull, 0x766a0abb3c77b2a8ull, 0x81c2c92e47edaee6ull, 0x92722c851482353bull,
+        0xa2bfe8a14cf10364ull, 0xa81a664bbc423001ull, 0xc24b8b70d0f89791ull, 0xc76c51a30654be30ull,
+        0xd192e819d6ef5218ull, 0xd69906245565a910ull, 0xf40e35855771202aull, 0x106aa07032bbd1b8ull,
+        0x19a4c116b8d2d0c8ull, 0x1e376c085141ab53ull, 0x2748774cdf8eeb99ull, 0x34b0bcb5e19b48a8ull,
+        0x391c0cb3c5c95a63ull, 0x4ed8aa4ae3418acbull, 0x5b9cca4f7763e373ull, 0x682e6ff3d6b2b8a3ull,
+        0x748f82ee5defb2fcull, 0x78a5636f43172f60ull, 0x84c87814a1f0ab72ull, 0x8cc702081a6439ecull,
+        0x90befffa23631e28ull, 0xa4506cebde82bde9ull, 0xbef9a3f7b2c67915ull, 0xc67178f2e372532bull,
+        0xca273eceea26619cull, 0xd186b8c721c0c207ull, 0xeada7dd6cde0eb1eull, 0xf57d4f7fee6ed178ull,
+        0x06f067aa72176fbaull, 0x0a637dc5a2c898a6ull, 0x113f9804bef90daeull, 0x1b710b35131c471bull,
+        0x28db77f523047d84ull, 0x32caab7b40c72493ull, 0x3c9ebe0a15c9bebcull, 0x431d67c49c100d4cull,
+        0x4cc5d4becb3e42b6ull, 0x597f299cfc657e2aull, 0x5fcb6fab3ad6faecull, 0x6c44198c4a475817ull
+    };
+
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sum0(const V& x, V& out) {
+        out = ((x >> 28) | (x << 36)) ^ ((x >> 34) | (x << 30)) ^ ((x >> 39) | (x << 25));
+    }
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sum1(const V& x, V& out) {
+        out = ((x >> 14) | (x << 50)) ^ ((x >> 18) | (x << 46)) ^ ((x >> 41) | (x << 23));
+    }
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sigma0(const V& x, V& out) {
+        out = ((x >> 1) | (x << 63)) ^ ((x >> 8) | (x << 56)) ^ (x >> 7);
+    }
+    template <typename V> static PSWD_GEN_ALWAYS_INLINE void sigma1(const V& x, V& out) {
+        out = ((x >> 19) | (x << 45)) ^ ((x >> 61) | (x << 3)) ^ (x >> 6);
+    }
+};
+
+template <typename Word>
+inline Word loadBigEndian(const uint8_t* bytes) {
+    Word value = 0;
+    for (size_t i = 0; i < sizeof(Word); i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+template <typename Word>
+inline void storeBigEndian(uint8_t* bytes, Word value) {
+    for (size_t i = 0; i < sizeof(Word); i++) {
+        bytes[i] = static_cast<uint8_t>(value >> (8 * (sizeof(Word) - 1 - i)));
+    }
+}
+
+// Compresses one block into each of the Lanes states starting at `first`. State is kept
+// transposed (state[word][lane]) so that a row of lanes loads straight into a vector.
+template <typename Traits, typename V, int Lanes>
+PSWD_GEN_ALWAYS_INLINE void compressShaBlocks(typename Traits::Word state[8][kShaMaxLanes],
+                                              const uint8_t* const* blocks, int first) {
+    typedef typename Traits::Word Word;
+    V s[8];
+    V w[Traits::kRounds];
+
+    for (int i = 0; i < 8; i++) {
+        std::memcpy(&s[i], &state[i][first], sizeof(V));
+    }
+    for (int t = 0; t < 16; t++) {
+        Word row[Lanes];
+        for (int lane = 0; lane < Lanes; lane++) {
+            row[lane] = loadBigEndian<Word>(blocks[first + lane] + t * sizeof(Word));
+        }
+        std::memcpy(&w[t], row, sizeof(V));
+    }
+    for (int t = 16; t < Traits::kRounds; t++) {
+        V s0, s1;
+        Traits::sigma0(w[t - 15], s0);
+        Traits::sigma1(w[t - 2], s1);
+        w[t] = s1 + w[t - 7] + s0 + w[t - 16];
+    }
+
+    V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int t = 0; t < Traits::kRounds; t++) {
+        V s0, s1;
+        Traits::sum0(a, s0);
+        Traits::sum1(e, s1);
+        V t1 = h + s1 + ((e & f) ^ (~e & g)) + Traits::kConstants[t] + w[t];
+        V t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+    s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+    for (int i = 0; i < 8; i++) {
+        std::memcpy(&state[i][first], &s[i], sizeof(V));
+    }
+}
+
+#if defined(PSWD_GEN_VECTOR_EXTENSIONS) && defined(PSWD_GEN_X86)
+template <typename Traits>
+PSWD_GEN_TARGET("avx2")
+void compressShaBlocksAvx2(typename Traits::Word state[8][kShaMaxLanes], const uint8_t* const* blocks, int first) {
+    compressShaBlocks<Traits, typename Traits::Wide,
+                      sizeof(typename Traits::Wide) / sizeof(typename Traits::Word)>(state, blocks, first);
+}
+#endif
+
+// Compresses one block per lane, as many lanes per instruction as the CPU allows
+template <typename Traits>
+void compressShaLanes(typename Traits::Word state[8][kShaMaxLanes], const uint8_t* const* blocks, int lanes) {
+    typedef typename Traits::Word Word;
+    int done = 0;
+#ifdef PSWD_GEN_VECTOR_EXTENSIONS
+    constexpr int narrow = sizeof(typename Traits::Narrow) / sizeof(Word);
+    if (lanes > 1) {
+#ifdef PSWD_GEN_X86
+        constexpr int wide = sizeof(typename Traits::Wide) / sizeof(Word);
+        if (CpuFeatures::get().avx2) {
+            for (; done + wide <= lanes; done += wide) {
+                compressShaBlocksAvx2<Traits>(state, blocks, done);
+            }
+        }
+#endif
+        for (; done + narrow <= lanes; done += narrow) {
+            compressShaBlocks<Traits, typename Traits::Narrow, narrow>(state, blocks, done);
+        }
+    }
+#endif
+    for (; done < lanes; done++) {
+        compressShaBlocks<Traits, Word, 1>(state, blocks, done);
+    }
+}
+
+// Up to kShaMaxLanes SHA-2 computations over messages of equal length, fed in lockstep.
+// One lane makes an ordinary streaming hash.
+template <typename Traits>
+class ShaLanes {
+private:
+    typedef typename Traits::Word Word;
+
+    int lanes;
+    Word state[8][kShaMaxLanes];
+    uint8_t buffer[kShaMaxLanes][Traits::kBlockSize];
+    size_t buffered;
+    uint64_t total;
+
+    void compressBuffers() {
+        const uint8_t* blocks[kShaMaxLanes];
+        for (int lane = 0; lane < lanes; lane++) {
+            blocks[lane] = buffer[lane];
+        }
+        compressShaLanes<Traits>(state, blocks, lanes);
+        buffered = 0;
+    }
+
+public:
+    explicit ShaLanes(int count = 1) {
+        reset(count);
+    }
+
+    ~ShaLanes() {
+        secureZero(state, sizeof(state));
+        secureZero(buffer, sizeof(buffer));
+    }
+
+    void reset(int count) {
+        if (count < 1 || count > kShaMaxLanes) {
+            throw std::invalid_argument("Unsupported number of hash lanes");
+        }
+        lanes = count;
+        for (int i = 0; i < 8; i++) {
+            for (int lane = 0; lane < kShaMaxLanes; lane++) {
+                state[i][lane] = Traits::kInit[i];
+            }
+        }
+        buffered = 0;
+        total = 0;
+    }
+
+    // Continues lane from a state saved after `prefix` bytes, a whole number of blocks
+    void restore(int lane, const Word saved[8], uint64_t prefix) {
+        for (int i = 0; i < 8; i++) {
+            state[i][lane] = saved[i];
+        }
+        total = prefix;
+    }
+
+    // State after the bytes absorbed so far; only meaningful on a block boundary
+    void save(int lane, Word saved[8]) const {
+        for (int i = 0; i < 8; i++) {
+            saved[i] = state[i][lane];
+        }
+    }
+
+    // Absorbs `length` bytes from each data[lane]
+    void update(const uint8_t* const* data, size_t length) {
+        size_t offset = 0;
+        while (offset < length) {
+            size_t take = std::min(Traits::kBlockSize - buffered, length - offset);
+            for (int lane = 0; lane < lanes; lane++) {
+                std::memcpy(buffer[lane] + buffered, data[lane] + offset, take);
+            }
+            buffered += take;
+            offset += take;
+            total += take;
+            if (buffered == Traits::kBlockSize) {
+                compressBuffers();
+            }
+        }
+    }
+
+    void update(const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        update(&bytes, length);
+    }
+
+    void final(uint8_t* const* digests) {
+        uint64_t bits = total * 8;
+        size_t end = buffered;
+        for (int lane = 0; lane < lanes; lane++) {
+            buffer[lane][end] = 0x80;
+            std::memset(buffer[lane] + end + 1, 0, Traits::kBlockSize - end - 1);
+        }
+        if (end + 1 > Traits::kBlockSize - Traits::kLengthSize) {
+            compressBuffers();
+            for (int lane = 0; lane < lanes; lane++) {
+                std::memset(buffer[lane], 0, Traits::kBlockSize);
+            }
+        }
+        for (int lane = 0; lane < lanes; lane++) {
+            storeBigEndian<uint64_t>(buffer[lane] + Traits::kBlockSize - 8, bits);
+        }
+        compressBuffers();
+
+        for (int lane = 0; lane < lanes; lane++) {
+            for (size_t i = 0; i < Traits::kDigestSize / sizeof(Word); i++) {
+                storeBigEndian<Word>(digests[lane] + i * sizeof(Word), state[i][lane]);
+            }
+        }
+    }
+
+    void final(uint8_t* digest) {
+        final(&digest);
+    }
+};
+
+using Sha256 = ShaLanes<Sha256Traits>;
+using Sha512 = ShaLanes<Sha512Traits>;
+
+// Hashes passwords into standard modular-crypt strings: PBKDF2-HMAC-SHA256 in the passlib
+// layout ($pbkdf2-sha256$rounds$salt$checksum, adapted base64) and glibc sha512-crypt ($6$).
+// Batches run on a thread pool, each task hashing up to kShaMaxLanes passwords in lockstep.
+class PasswordHasher {
+public:
+    enum Scheme {
+        PBKDF2_SHA256,
+        SHA512_CRYPT
+    };
+
+    static constexpr unsigned kDefaultPbkdf2Rounds = 600000;
+    static constexpr unsigned kDefaultSha512Rounds = 5000;
+    static constexpr size_t kSaltSize = 16;
+
+private:
+
+    Scheme scheme;
+    unsigned rounds;
+
+    static const char* cryptAlphabet() {
+        return "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    }
+
+    // passlib's adapted base64: standard alphabet with '.' for '+', no padding
+    static std::string adaptedBase64(const uint8_t* data, size_t size) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789./";
+        std::string out;
+        for (size_t i = 0; i < size; i += 3) {
+            uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+            if (i + 1 < size) group |= static_cast<uint32_t>(data[i + 1]) << 8;
+            if (i + 2 < size) group |= data[i + 2];
+            size_t chars = std::min<size_t>(4, (size - i) * 8 / 6 + 1);
+            for (size_t c = 0; c < chars; c++) {
+                out += alphabet[(group >> (18 - 6 * c)) & 0x3F];
+            }
+        }
+        return out;
+    }
+
+    // HMAC-SHA256 inner and outer states after the padded key block
+    static void hmacStates(std::string_view key, uint32_t inner[8], uint32_t outer[8]) {
+        uint8_t block[Sha256Traits::kBlockSize] = {};
+        if (key.size() > sizeof(block)) {
+            Sha256 digest;
+            digest.update(key.data(), key.size());
+            digest.final(block);
+        } else {
+            std::memcpy(block, key.data(), key.size());
+        }
+
+        for (int pass = 0; pass < 2; pass++) {
+            uint8_t pad[Sha256Traits::kBlockSize];
+            for (size_t i = 0; i < sizeof(pad); i++) {
+                pad[i] = block[i] ^ (pass == 0 ? 0x36 : 0x5C);
+            }
+            Sha256 digest;
+            digest.update(pad, sizeof(pad));
+            digest.save(0, pass == 0 ? inner : outer);
+            secureZero(pad, sizeof(pad));
+        }
+        secureZero(block, sizeof(block));
+    }
+
+    // PBKDF2 with a 32-byte output for `count` passwords. After the first HMAC every
+    // iteration is two single-block compressions whose layout does not depend on the
+    // password, so the lanes stay in lockstep for the whole run.
+    void pbkdf2Lanes(const std::string_view* passwords, const uint8_t (*salts)[kSaltSize],
+                     uint8_t (*keys)[32], int count) const {
+        uint32_t inner[8][kShaMaxLanes], outer[8][kShaMaxLanes];
+        for (int lane = 0; lane < count; lane++) {
+            uint32_t lane_inner[8], lane_outer[8];
+            hmacStates(passwords[lane], lane_inner, lane_outer);
+            for (int i = 0; i < 8; i++) {
+                inner[i][lane] = lane_inner[i];
+                outer[i][lane] = lane_outer[i];
+            }
+        }
+
+        // U1 = HMAC(password, salt || INT(1))
+        uint8_t u[kShaMaxLanes][32];
+        uint8_t* u_out[kShaMaxLanes];
+        const uint8_t* salt_in[kShaMaxLanes];
+        const uint8_t* u_in[kShaMaxLanes];
+        const uint8_t* block_index[kShaMaxLanes];
+        static const uint8_t first_block[4] = {0, 0, 0, 1};
+        Sha256 lanes(count);
+        for (int lane = 0; lane < count; lane++) {
+            uint32_t saved[8];
+            for (int i = 0; i < 8; i++) saved[i] = inner[i][lane];
+            lanes.restore(lane, saved, Sha256Traits::kBlockSize);
+            salt_in[lane] = salts[lane];
+            block_index[lane] = first_block;
+            u_out[lane] = u[lane];
+            u_in[lane] = u[lane];
+        }
+        lanes.update(salt_in, kSaltSize);
+        lanes.update(block_index, sizeof(first_block));
+        lanes.final(u_out);
+
+        lanes.reset(count);
+        for (int lane = 0; lane < count; lane++) {
+            uint32_t saved[8];
+            for (int i = 0; i < 8; i++) saved[i] = outer[i][lane];
+            lanes.restore(lane, saved, Sha256Traits::kBlockSize);
+        }
+        lanes.update(u_in, 32);
+        lanes.final(u_out);
+
+        for (int lane = 0; lane < count; lane++) {
+            std::memcpy(keys[lane], u[lane], 32);
+        }
+
+        // Later rounds hash a 32-byte message after a one-block key prefix, so both
+        // blocks carry fixed padding for 96 bytes
+        uint8_t blocks[kShaMaxLanes][Sha256Traits::kBlockSize] = {};
+        const uint8_t* block_ptrs[kShaMaxLanes];
+        for (int lane = 0; lane < count; lane++) {
+            std::memcpy(blocks[lane], u[lane], 32);
+            blocks[lane][32] = 0x80;
+            storeBigEndian<uint64_t>(blocks[lane] + 56, (64 + 32) * 8);
+            block_ptrs[lane] = blocks[lane];
+        }
+
+        uint32_t state[8][kShaMaxLanes];
+        for (unsigned round = 1; round < rounds; round++) {
+            std::memcpy(state, inner, sizeof(state));
+            compressShaLanes<Sha256Traits>(state, block_ptrs, count);
+            for (int lane = 0; lane < count; lane++) {
+                for (int i = 0; i < 8; i++) storeBigEndian<uint32_t>(blocks[lane] + 4 * i, state[i][lane]);
+            }
+
+            std::memcpy(state, outer, sizeof(state));
+            compressShaLanes<Sha256Traits>(state, block_ptrs, count);
+            for (int lane = 0; lane < count; lane++) {
+                for (int i = 0; i < 8; i++) {
+                    storeBigEndian<uint32_t>(blocks[lane] + 4 * i, state[i][lane]);
+                    for (int b = 0; b < 4; b++) {
+                        keys[lane][4 * i + b] ^= blocks[lane][4 * i + b];
+                    }
+                }
+            }
+        }
+
+        secureZero(inner, sizeof(inner));
+        secureZero(outer, sizeof(outer));
+        secureZero(u, sizeof(u));
+        secureZero(blocks, sizeof(blocks));
+        secureZero(state, sizeof(state));
+    }
+
+    // sha512-crypt for `count` passwords of one length with salts of one length. Every
+    // step but the salt-repetition digest has a layout set by those two lengths alone.
+    void sha512CryptLanes(const std::string_view* passwords, const std::string* salts,
+                          uint8_t (*results)[64], int count) const {
+        const size_t password_size = passwords[0].size();
+        const size_t salt_size = salts[0].size();
+
+        const uint8_t* p_in[kShaMaxLanes];
+        const uint8_t* s_in[kShaMaxLanes];
+        const uint8_t* b_in[kShaMaxLanes];
+        const uint8_t* p_bytes_in[kShaMaxLanes];
+        const uint8_t* s_bytes_in[kShaMaxLanes];
+        const uint8_t* c_in[kShaMaxLanes];
+        uint8_t* b_out[kShaMaxLanes];
+        uint8_t* c_out[kShaMaxLanes];
+        uint8_t* dp_out[kShaMaxLanes];
+
+        uint8_t alternate[kShaMaxLanes][64];
+        uint8_t dp[kShaMaxLanes][64];
+        uint8_t ds[64];
+        std::vector<uint8_t, SecureAllocator<uint8_t>> p_bytes(count * std::max<size_t>(password_size, 1));
+        std::vector<uint8_t, SecureAllocator<uint8_t>> s_bytes(count * std::max<size_t>(salt_size, 1));
+
+        for (int lane = 0; lane < count; lane++) {
+            p_in[lane] = reinterpret_cast<const uint8_t*>(passwords[lane].data());
+            s_in[lane] = reinterpret_cast<const uint8_t*>(salts[lane].data());
+            b_in[lane] = alternate[lane];
+            b_out[lane] = alternate[lane];
+            c_in[lane] = results[lane];
+            c_out[lane] = results[lane];
+            dp_out[lane] = dp[lane];
+            p_bytes_in[lane] = p_bytes.data() + lane * password_size;
+            s_bytes_in[lane] = s_bytes.data() + lane * salt_size;
+        }
+
+        Sha512 lanes(count);
+        lanes.update(p_in, password_size);
+        lanes.update(s_in, salt_size);
+        lanes.update(p_in, password_size);
+        lanes.final(b_out);
+
+        lanes.reset(count);
+        lanes.update(p_in, password_size);
+        lanes.update(s_in, salt_size);
+        size_t remaining = password_size;
+        for (; remaining > 64; remaining -= 64) {
+            lanes.update(b_in, 64);
+        }
+        lanes.update(b_in, remaining);
+        for (size_t bits = password_size; bits > 0; bits >>= 1) {
+            if (bits & 1) {
+                lanes.update(b_in, 64);
+            } else {
+                lanes.update(p_in, password_size);
+            }
+        }
+        lanes.final(c_out);
+
+        lanes.reset(count);
+        for (size_t i = 0; i < password_size; i++) {
+            lanes.update(p_in, password_size);
+        }
+        lanes.final(dp_out);
+
+        for (int lane = 0; lane < count; lane++) {
+            uint8_t* p_lane = p_bytes.data() + lane * password_size;
+            for (size_t i = 0; i < password_size; i++) {
+                p_lane[i] = dp[lane][i % 64];
+            }
+
+            // The repetition count depends on this lane's first digest byte
+            Sha512 single;
+            for (int i = 0; i < 16 + results[lane][0]; i++) {
+                single.update(salts[lane].data(), salt_size);
+            }
+            single.final(ds);
+            uint8_t* s_lane = s_bytes.data() + lane * salt_size;
+            for (size_t i = 0; i < salt_size; i++) {
+                s_lane[i] = ds[i % 64];
+            }
+        }
+
+        for (unsigned round = 0; round < rounds; round++) {
+            lanes.reset(count);
+            if (round & 1) {
+                lanes.update(p_bytes_in, password_size);
+            } else {
+                lanes.update(c_in, 64);
+            }
+            if (round % 3 != 0) {
+                lanes.update(s_bytes_in, salt_size);
+            }
+            if (round % 7 != 0) {
+                lanes.update(p_bytes_in, password_size);
+            }
+            if (round & 1) {
+                lanes.update(c_in, 64);
+            } else {
+                lanes.update(p_bytes_in, password_size);
+            }
+            lanes.final(c_out);
+        }
+
+        secureZero(alternate, sizeof(alternate));
+        secureZero(dp, sizeof(dp));
+        secureZero(ds, sizeof(ds));
+    }
+
+    std::string formatPbkdf2(const uint8_t* salt, const uint8_t* key) const {
+        return "$pbkdf2-sha256$" + std::to_string(rounds) + "$" + adaptedBase64(salt, kSaltSize) +
+               "$" + adaptedBase64(key, 32);
+    }
+
+    std::string formatSha512Crypt(const std::string& salt, const uint8_t* digest) const {
+        static const int order[21][3] = {
+            {0, 21, 42}, {22, 43, 1}, {44, 2, 23}, {3, 24, 45}, {25, 46, 4}, {47, 5, 26}, {6, 27, 48},
+            {28, 49, 7}, {50, 8, 29}, {9, 30, 51}, {31, 52, 10}, {53, 11, 32}, {12, 33, 54}, {34, 55, 13},
+            {56, 14, 35}, {15, 36, 57}, {37, 58, 16}, {59, 17, 38}, {18, 39, 60}, {40, 61, 19}, {62, 20, 41}
+        };
+
+        std::string out = "$6$";
+        if (rounds != kDefaultSha512Rounds) {
+            out += "rounds=" + std::to_string(rounds) + "$";
+        }
+        out += salt + "$";
+
+        auto emit = [&out](uint32_t group, int chars) {
+            for (int i = 0; i < chars; i++) {
+                out += cryptAlphabet()[group & 0x3F];
+                group >>= 6;
+            }
+        };
+        for (const auto& bytes : order) {
+            emit((static_cast<uint32_t>(digest[bytes[0]]) << 16) |
+                 (static_cast<uint32_t>(digest[bytes[1]]) << 8) | digest[bytes[2]], 4);
+        }
+        emit(digest[63], 2);
+        return out;
+    }
+
+public:
+    explicit PasswordHasher(Scheme hash_scheme, unsigned hash_rounds = 0)
+        : scheme(hash_scheme), rounds(hash_rounds) {
+        if (rounds == 0) {
+            rounds = scheme == PBKDF2_SHA256 ? kDefaultPbkdf2Rounds : kDefaultSha512Rounds;
+        }
+        if (scheme == SHA512_CRYPT) {
+            rounds = std::max(1000u, std::min(999999999u, rounds));
+        }
+    }
+
+    static bool parseScheme(const std::string& name, Scheme& parsed) {
+        if (name == "pbkdf2-sha256" || name == "pbkdf2") {
+            parsed = PBKDF2_SHA256;
+        } else if (name == "sha512-crypt" || name == "sha512") {
+            parsed = SHA512_CRYPT;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    const char* schemeName() const {
+        return scheme == PBKDF2_SHA256 ? "pbkdf2-sha256" : "sha512-crypt";
+    }
+
+    unsigned getRounds() const { return rounds; }
+
+    // Hashes every password with a fresh random salt; output order follows the input
+    std::vector<std::string> hash(const SecureStringList& passwords, ThreadPool& pool = ThreadPool::shared()) const {
+        std::vector<std::string> hashes(passwords.size());
+        std::random_device entropy;
+
+        if (scheme == PBKDF2_SHA256) {
+            std::vector<std::array<uint8_t, kSaltSize>> salts(passwords.size());
+            for (auto& salt : salts) {
+                for (auto& byte : salt) byte = static_cast<uint8_t>(entropy());
+            }
+
+            pool.parallelFor(passwords.size(), kShaMaxLanes, [&](size_t begin, size_t end) {
+                std::string_view views[kShaMaxLanes];
+                uint8_t salt_bytes[kShaMaxLanes][kSaltSize];
+                uint8_t keys[kShaMaxLanes][32];
+                int count = static_cast<int>(end - begin);
+                for (int lane = 0; lane < count; lane++) {
+                    views[lane] = passwords[begin + lane].view();
+                    std::memcpy(salt_bytes[lane], salts[begin + lane].data(), kSaltSize);
+                }
+                pbkdf2Lanes(views, salt_bytes, keys, count);
+                for (int lane = 0; lane < count; lane++) {
+                    hashes[begin + lane] = formatPbkdf2(salt_bytes[lane], keys[lane]);
+                }
+                secureZero(keys, sizeof(keys));
+            });
+            return hashes;
+        }
+
+        std::vector<std::string> salts(passwords.size());
+        for (auto& salt : salts) {
+            for (size_t i = 0; i < kSaltSize; i++) salt += cryptAlphabet()[entropy() % 64];
+        }
+
+        // Lockstep lanes need equal password lengths, so group by length first
+        std::vector<size_t> order(passwords.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&passwords](size_t a, size_t b) {
+            return passwords[a].size() < passwords[b].size();
+        });
+        std::vector<std::pair<size_t, size_t>> groups;
+        for (size_t begin = 0; begin < order.size();) {
+            size_t end = begin + 1;
+            while (end < order.size() && end - begin < kShaMaxLanes &&
+                   passwords[order[end]].size() == passwords[order[begin]].size()) {
+                end++;
+            }
+            groups.push_back({begin, end});
+            begin = end;
+        }
+
+        pool.parallelFor(groups.size(), 1, [&](size_t first_group, size_t last_group) {
+            for (size_t g = first_group; g < last_group; g++) {
+                std::string_view views[kShaMaxLanes];
+                std::string lane_salts[kShaMaxLanes];
+                uint8_t digests[kShaMaxLanes][64];
+                int count = static_cast<int>(groups[g].second - groups[g].first);
+                for (int lane = 0; lane < count; lane++) {
+                    size_t index = order[groups[g].first + lane];
+                    views[lane] = passwords[index].view();
+                    lane_salts[lane] = salts[index];
+                }
+                sha512CryptLanes(views, lane_salts, digests, count);
+                for (int lane = 0; lane < count; lane++) {
+                    size_t index = order[groups[g].first + lane];
+                    hashes[index] = formatSha512Crypt(lane_salts[lane], digests[lane]);
+                }
+                secureZero(digests, sizeof(digests));
+            }
+        });
+        return hashes;
+    }
+
+    std::string hash(const SecureString& password) const {
+        SecureStringList single;
+        single.push_back(password);
+        return hash(single).front();
+    }
+
+    // PBKDF2-HMAC-SHA256 of a passphrase with this hasher's rounds, for encryption keys
+    void deriveKey(std::string_view passphrase, const uint8_t salt[kSaltSize], uint8_t key[32]) const {
+        uint8_t salts[1][kSaltSize];
+        uint8_t keys[1][32];
+        std::memcpy(salts[0], salt, kSaltSize);
+        pbkdf2Lanes(&passphrase, salts, keys, 1);
+        std::memcpy(key, keys[0], 32);
+        secureZero(keys, sizeof(keys));
+    }
+
+    static void hmac(std::string_view key, const void* data, size_t size, uint8_t mac[32]) {
+        uint32_t inner[8], outer[8];
+        hmacStates(key, inner, outer);
+        uint8_t digest[32];
+        Sha256 hash;
+        hash.restore(0, inner, Sha256Traits::kBlockSize);
+        hash.update(data, size);
+        hash.final(digest);
+        hash.reset(1);
+        hash.restore(0, outer, Sha256Traits::kBlockSize);
+        hash.update(digest, sizeof(digest));
+        hash.final(mac);
+        secureZero(inner, sizeof(inner));
+        secureZero(outer, sizeof(outer));
+        secureZero(digest, sizeof(digest));
+    }
+};
+
+// Append-only journal of generated secrets: the time, policy and password of each record,
+// optionally encrypted under a passphrase. Appends from many threads are group committed:
+// a caller that finds no write in progress takes everything queued so far and makes it
+// durable with one write and one fsync, while appends arriving meanwhile queue for the
+// next round. append() returns once its record is on disk. Opening a journal scans the
+// records and truncates a torn tail left by a crash mid-write. A crash can only tear the
+// last commit, so a bad record is a torn tail only if no valid record follows it and it
+// is within kMaxBatch bytes (the largest commit) of the end. Anything else is corruption
+// of synced records, and the journal refuses to open rather than drop them. A journal
+// opened READ_ONLY is never modified; a torn tail is skipped, not cut.
+//
+// Layout (native byte order):
+//   Header
+//   records  [uint32 body size][uint32 CRC-32 of body][body]
+//   body     uint64 ms since the epoch, uint16 policy size, policy, password; encrypted
+//            bodies are nonce[12], the same fields under ChaCha20, and the first 16 bytes
+//            of an HMAC-SHA256 of nonce and ciphertext
+//
+// The CRC only finds torn writes; the MAC is what shows a record was not altered.
+class GenerationJournal {
+public:
+    static constexpr char kMagic[4] = {'P', 'G', 'J', 'N'};
+    static constexpr uint32_t kByteOrder = 0x01020304;
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kEncrypted = 1;
+    static constexpr size_t kMaxRecord = 1 << 16;
+    static constexpr size_t kMaxBatch = 1 << 20;
+
+    enum Access { APPEND, READ_ONLY };
+
+    struct Header {
+        char magic[4];
+        uint32_t byte_order;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t kdf_rounds;
+        uint32_t reserved;
+        uint8_t salt[PasswordHasher::kSaltSize];
+        uint8_t key_check[16];  // MAC of a fixed label, to reject a wrong passphrase
+    };
+
+    struct Entry {
+        uint64_t timestamp_ms;
+        std::string policy;
+        SecureString record;
+    };
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t commits = 0;  // write and fsync rounds
+        uint64_t bytes = 0;
+    };
+
+private:
+    static constexpr size_t kFrameSize = 8;
+    static constexpr size_t kNonceSize = 12;
+    static constexpr size_t kTagSize = 16;
+    static constexpr size_t kFixedFields = 10;
+
+    std::string path;
+#ifdef _WIN32
+    HANDLE file_handle = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    bool encrypted = false;
+    bool read_only = false;
+    uint32_t cipher_key[8] = {};
+    uint8_t mac_key[32] = {};
+    uint64_t torn = 0;
+
+    mutable std::mutex mutex;
+    std::condition_variable committed;
+    SecureVector<char> pending;   // encoded records waiting for the next commit
+    SecureVector<char> writing;   // the batch being written, owned by the flushing caller
+    uint64_t queued = 0;
+    uint64_t durable = 0;
+    uint64_t end = 0;             // header plus every durable record
+    bool flushing = false;
+    std::string failure;
+    Stats totals;
+
+    std::string_view macKey() const {
+        return std::string_view(reinterpret_cast<const char*>(mac_key), sizeof(mac_key));
+    }
+
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    static bool sameTag(const uint8_t* a, const uint8_t* b) {
+        uint8_t difference = 0;
+        for (size_t i = 0; i < kTagSize; i++) {
+            difference |= a[i] ^ b[i];
+        }
+        return difference == 0;
+    }
+
+    // Cipher and MAC keys are labelled HMACs of the PBKDF2 output; the key check is
+    // what a journal created with the same passphrase stores in its header
+    void deriveKeys(std::string_view passphrase, const Header& header, uint8_t check[16]) {
+        uint8_t master[32], derived[32];
+        PasswordHasher(PasswordHasher::PBKDF2_SHA256, header.kdf_rounds).deriveKey(passphrase, header.salt, master);
+        std::string_view master_key(reinterpret_cast<const char*>(master), sizeof(master));
+        auto label = [](std::string_view key, const char* text, uint8_t out[32]) {
+            PasswordHasher::hmac(key, text, std::strlen(text), out);
+        };
+
+        label(master_key, "journal encryption", derived);
+        std::memcpy(cipher_key, derived, sizeof(cipher_key));
+        label(master_key, "journal authentication", mac_key);
+        label(macKey(), "journal key check", derived);
+        std::memcpy(check, derived, 16);
+        secureZero(master, sizeof(master));
+        secureZero(derived, sizeof(derived));
+    }
+
+    void crypt(const uint8_t* nonce, uint8_t* data, size_t size) const {
+        uint32_t words[3];
+        std::memcpy(words, nonce, sizeof(words));
+        ChaCha20 stream(cipher_key, words, 1);
+        uint8_t keystream[64];
+        for (size_t offset = 0; offset < size; offset += sizeof(keystream)) {
+            size_t take = std::min(sizeof(keystream), size - offset);
+            stream.fill(keystream, take);
+            for (size_t i = 0; i < take; i++) {
+                data[offset + i] ^= keystream[i];
+            }
+        }
+        secureZero(keystream, sizeof(keystream));
+    }
+
+    // Appends one framed record to out
+    void encode(uint64_t timestamp, std::string_view policy, std::string_view record, SecureVector<char>& out) const {
+        size_t plain = kFixedFields + policy.size() + record.size();
+        size_t body = plain + (encrypted ? kNonceSize + kTagSize : 0);
+        if (policy.size() > 0xFFFF || body > kMaxRecord) {
+            throw std::length_error("Journal record too large");
+        }
+
+        size_t start = out.size();
+        out.resize(start + kFrameSize + body);
+        uint8_t* frame = reinterpret_cast<uint8_t*>(out.data() + start);
+        uint8_t* payload = frame + kFrameSize + (encrypted ? kNonceSize : 0);
+        uint16_t policy_size = static_cast<uint16_t>(policy.size());
+        std::memcpy(payload, &timestamp, sizeof(timestamp));
+        std::memcpy(payload + 8, &policy_size, sizeof(policy_size));
+        std::memcpy(payload + kFixedFields, policy.data(), policy.size());
+        std::memcpy(payload + kFixedFields + policy.size(), record.data(), record.size());
+
+        if (encrypted) {
+            // Random nonces, not offsets: truncating a torn tail reuses offsets
+            static thread_local ChaCha20 nonces;
+            uint8_t* nonce = frame + kFrameSize;
+            nonces.fill(nonce, kNonceSize);
+            crypt(nonce, payload, plain);
+            uint8_t tag[32];
+            PasswordHasher::hmac(macKey(), nonce, kNonceSize + plain, tag);
+            std::memcpy(payload + plain, tag, kTagSize);
+        }
+
+        uint32_t size = static_cast<uint32_t>(body);
+        uint32_t crc = crc32(frame + kFrameSize, body);
+        std::memcpy(frame, &size, sizeof(size));
+        std::memcpy(frame + 4, &crc, sizeof(crc));
+    }
+
+    // Walks records from the header on, calling visit with each body, and returns the
+    // offset after the last record whose frame and CRC check out
+    uint64_t scan(uint64_t limit, const std::function<void(uint8_t*, size_t)>& visit) const {
+        std::ifstream in(path, std::ios::binary);
+        in.seekg(sizeof(Header));
+        size_t smallest = kFixedFields + (encrypted ? kNonceSize + kTagSize : 0);
+
+        SecureVector<uint8_t> body;
+        uint64_t offset = sizeof(Header);
+        while (offset + kFrameSize <= limit) {
+            uint32_t frame[2];
+            if (!in.read(reinterpret_cast<char*>(frame), sizeof(frame))) {
+                break;
+            }
+            if (frame[0] < smallest || frame[0] > kMaxRecord || offset + kFrameSize + frame[0] > limit) {
+                break;
+            }
+            body.resize(frame[0]);
+            if (!in.read(reinterpret_cast<char*>(body.data()), frame[0]) || crc32(body.data(), frame[0]) != frame[1]) {
+                break;
+            }
+            if (visit) {
+                visit(body.data(), body.size());
+            }
+            offset += kFrameSize + frame[0];
+        }
+        secureZero(body.data(), body.size());
+        return offset;
+    }
+
+    // Whether a frame that checks out starts anywhere in (from, limit), meaning the bad
+    // record at from has written records after it rather than being a torn tail
+    bool resyncs(uint64_t from, uint64_t limit) const {
+        constexpr size_t kStep = 1 << 20;
+        std::ifstream in(path, std::ios::binary);
+        size_t smallest = kFixedFields + (encrypted ? kNonceSize + kTagSize : 0);
+
+        SecureVector<uint8_t> window;
+        bool found = false;
+        for (uint64_t start = from + 1; !found && start + kFrameSize <= limit; start += kStep) {
+            // Overlaps the next step by a whole record, so frames starting near the end fit
+            size_t size = static_cast<size_t>(std::min<uint64_t>(limit - start, kStep + kFrameSize + kMaxRecord));
+            window.resize(size);
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(start));
+            if (!in.read(reinterpret_cast<char*>(window.data()), static_cast<std::streamsize>(size))) {
+                break;
+            }
+            for (size_t i = 0; !found && i < kStep && i + kFrameSize <= size; i++) {
+                uint32_t frame[2];
+                std::memcpy(frame, window.data() + i, sizeof(frame));
+                found = frame[0] >= smallest && frame[0] <= kMaxRecord && i + kFrameSize + frame[0] <= size &&
+                        crc32(window.data() + i + kFrameSize, frame[0]) == frame[1];
+            }
+        }
+        secureZero(window.data(), window.size());
+        return found;
+    }
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            DWORD written = 0;
+            if (!WriteFile(file_handle, data, static_cast<DWORD>(std::min<size_t>(size, 1u << 30)), &written, nullptr)) {
+                throw std::runtime_error("Cannot write '" + path + "'");
+            }
+#else
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0) {
+                throw std::runtime_error("Cannot write '" + path + "'");
+            }
+#endif
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    void sync() {
+#ifdef _WIN32
+        bool synced = FlushFileBuffers(file_handle) != 0;
+#elif defined(__APPLE__)
+        // Plain fsync leaves the data in the drive's cache on macOS
+        bool synced = fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0;
+#else
+        bool synced = ::fdatasync(fd) == 0;
+#endif
+        if (!synced) {
+            throw std::runtime_error("Cannot sync '" + path + "'");
+        }
+    }
+
+    // Cuts the file at size and moves the write position there
+    void truncateTo(uint64_t size) {
+#ifdef _WIN32
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file_handle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(file_handle)) {
+            throw std::runtime_error("Cannot truncate '" + path + "'");
+        }
+#else
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0 || lseek(fd, static_cast<off_t>(size), SEEK_SET) < 0) {
+            throw std::runtime_error("Cannot truncate '" + path + "'");
+        }
+#endif
+    }
+
+    // A new file's directory entry needs its own fsync to survive a crash
+    void syncDirectory() const {
+#ifndef _WIN32
+        size_t slash = path.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        int dir = ::open(directory.c_str(), O_RDONLY);
+        if (dir >= 0) {
+            ::fsync(dir);
+            ::close(dir);
+        }
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+        file_handle = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        secureZero(cipher_key, sizeof(cipher_key));
+        secureZero(mac_key, sizeof(mac_key));
+    }
+
+    void open(std::string_view passphrase, unsigned kdf_rounds) {
+        uint64_t size = 0;
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), read_only ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, read_only ? OPEN_EXISTING : OPEN_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        size = static_cast<uint64_t>(file_size.QuadPart);
+#else
+        fd = read_only ? ::open(path.c_str(), O_RDONLY) : ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open '" + path + "'");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            throw std::runtime_error("Cannot stat '" + path + "'");
+        }
+        size = static_cast<uint64_t>(info.st_size);
+#endif
+
+        Header header = {};
+        if (size < sizeof(Header)) {
+            // Only an empty file or the start of a header is taken for a torn header;
+            // anything else is someone else's file
+            char start[sizeof(kMagic) + sizeof(kByteOrder)];
+            std::memcpy(start, kMagic, sizeof(kMagic));
+            std::memcpy(start + sizeof(kMagic), &kByteOrder, sizeof(kByteOrder));
+            char existing[sizeof(Header)] = {};
+            size_t compared = static_cast<size_t>(std::min<uint64_t>(size, sizeof(start)));
+            std::ifstream in(path, std::ios::binary);
+            if (read_only || !in.read(existing, static_cast<std::streamsize>(size)) ||
+                std::memcmp(existing, start, compared) != 0) {
+                throw std::runtime_error("'" + path + "' is not a generation journal");
+            }
+        }
+        if (size < sizeof(Header)) {
+            // New, or created by a run that crashed before its header was synced, so no
+            // record was ever acknowledged
+            torn = size;
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.byte_order = kByteOrder;
+            header.version = kVersion;
+            if (!passphrase.empty()) {
+                encrypted = true;
+                header.flags = kEncrypted;
+                header.kdf_rounds = kdf_rounds;
+                std::random_device entropy;
+                for (auto& byte : header.salt) byte = static_cast<uint8_t>(entropy());
+                deriveKeys(passphrase, header, header.key_check);
+            }
+            truncateTo(0);
+            writeAll(reinterpret_cast<const char*>(&header), sizeof(header));
+            sync();
+            syncDirectory();
+            end = sizeof(header);
+            return;
+        }
+
+        std::ifstream in(path, std::ios::binary);
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("'" + path + "' is not a generation journal");
+        }
+        if (header.byte_order != kByteOrder || header.version != kVersion) {
+            throw std::runtime_error("Unsupported journal '" + path + "'");
+        }
+
+        encrypted = (header.flags & kEncrypted) != 0;
+        if (encrypted != !passphrase.empty()) {
+            throw std::runtime_error(encrypted ? "Journal '" + path + "' is encrypted; a passphrase is needed"
+                                               : "Journal '" + path + "' is not encrypted");
+        }
+        if (encrypted) {
+            if (header.kdf_rounds == 0) {
+                throw std::runtime_error("Unsupported journal '" + path + "'");
+            }
+            uint8_t check[16];
+            deriveKeys(passphrase, header, check);
+            if (!sameTag(check, header.key_check)) {
+                throw std::runtime_error("Wrong passphrase for journal '" + path + "'");
+            }
+        }
+
+        end = scan(size, nullptr);
+        torn = size - end;
+        if (torn > kMaxBatch || (torn > 0 && resyncs(end, size))) {
+            throw std::runtime_error("Journal '" + path + "' is corrupt at byte " + std::to_string(end) +
+                                     ", before its last commit");
+        }
+        if (read_only) {
+            return;
+        }
+        truncateTo(end);
+        if (torn > 0) {
+            sync();
+        }
+    }
+
+    // Queues encoded records and returns once they are durable. Whoever finds no commit
+    // running leads the next one for everything queued, its own records included.
+    void commit(SecureVector<char>& encoded, size_t records) {
+        if (read_only) {
+            throw std::logic_error("Journal '" + path + "' is open read-only");
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (failure.empty() && !pending.empty() && pending.size() + encoded.size() > kMaxBatch) {
+            committed.wait(lock);
+        }
+        if (!failure.empty()) {
+            throw std::runtime_error(failure);
+        }
+        pending.insert(pending.end(), encoded.begin(), encoded.end());
+        secureZero(encoded.data(), encoded.size());
+        queued += records;
+        uint64_t ticket = queued;
+
+        while (durable < ticket) {
+            if (!failure.empty()) {
+                throw std::runtime_error(failure);
+            }
+            if (flushing) {
+                committed.wait(lock);
+                continue;
+            }
+
+            flushing = true;
+            writing.swap(pending);
+            uint64_t through = queued;
+            committed.notify_all();
+            lock.unlock();
+            std::string error;
+            try {
+                writeAll(writing.data(), writing.size());
+                sync();
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            lock.lock();
+
+            flushing = false;
+            if (error.empty()) {
+                totals.records += through - durable;
+                totals.commits++;
+                totals.bytes += writing.size();
+                end += writing.size();
+                durable = through;
+            } else {
+                // The tail may be torn now; the next open cuts it off
+                failure = error + "; reopen the journal to recover";
+            }
+            secureZero(writing.data(), writing.size());
+            writing.clear();
+            committed.notify_all();
+        }
+    }
+
+public:
+    static constexpr unsigned kDefaultRounds = PasswordHasher::kDefaultPbkdf2Rounds;
+
+    // Opens or creates the journal; an empty passphrase means no encryption. The rounds
+    // only apply to a new journal, an existing one keeps what its header says. READ_ONLY
+    // needs an existing journal and leaves the file as it is.
+    explicit GenerationJournal(const std::string& file, std::string_view passphrase = {},
+                               unsigned kdf_rounds = kDefaultRounds, Access access = APPEND)
+        : path(file), read_only(access == READ_ONLY) {
+        try {
+            open(passphrase, kdf_rounds);
+        } catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    GenerationJournal(const GenerationJournal&) = delete;
+    GenerationJournal& operator=(const GenerationJournal&) = delete;
+
+    ~GenerationJournal() {
+        close();
+    }
+
+    void append(std::string_view policy, std::string_view record) {
+        SecureVector<char> encoded;
+        encode(now(), policy, record, encoded);
+        commit(encoded, 1);
+    }
+
+    // The list shares one commit per kMaxBatch bytes
+    void append(std::string_view policy, const SecureStringList& records) {
+        SecureVector<char> encoded;
+        uint64_t timestamp = now();
+        size_t batched = 0;
+        for (const auto& record : records) {
+            encode(timestamp, policy, record.view(), encoded);
+            batched++;
+            if (encoded.size() > kMaxBatch - kMaxRecord - kFrameSize) {
+                commit(encoded, batched);
+                encoded.clear();
+                batched = 0;
+            }
+        }
+        if (batched > 0) {
+            commit(encoded, batched);
+        }
+    }
+
+    // Calls callback(entry) for every durable record, oldest first; a record that fails
+    // its MAC throws
+    template <typename Callback>
+    void forEach(Callback callback) const {
+        uint64_t limit;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            limit = end;
+        }
+
+        uint64_t index = 0;
+        scan(limit, [&](uint8_t* body, size_t size) {
+            index++;
+            uint8_t* payload = body;
+            size_t plain = size;
+            if (encrypted) {
+                plain = size - kNonceSize - kTagSize;
+                uint8_t tag[32];
+                PasswordHasher::hmac(macKey(), body, kNonceSize + plain, tag);
+                if (!sameTag(tag, body + kNonceSize + plain)) {
+                    throw std::runtime_error("Journal record " + std::to_string(index) + " failed authentication");
+                }
+                payload = body + kNonceSize;
+                crypt(body, payload, plain);
+            }
+
+            Entry entry;
+            uint16_t policy_size;
+            std::memcpy(&entry.timestamp_ms, payload, sizeof(entry.timestamp_ms));
+            std::memcpy(&policy_size, payload + 8, sizeof(policy_size));
+            if (kFixedFields + policy_size > plain) {
+                throw std::runtime_error("Journal record " + std::to_string(index) + " is malformed");
+            }
+            const char* text = reinterpret_cast<const char*>(payload);
+            entry.policy.assign(text + kFixedFields, policy_size);
+            entry.record.assign(text + kFixedFields + policy_size, plain - kFixedFields - policy_size);
+            callback(entry);
+        });
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totals;
+    }
+
+    // Bytes of torn tail the opening scan cut off, or skipped when read-only
+    uint64_t recoveredBytes() const {
+        return torn;
+    }
+
+    bool isEncrypted() const {
+        return encrypted;
+    }
+};
+
+class PasswordGenerator {
+private:
+    std::string lowercase = "abcdefghijklmnopqrstuvwxyz";
+    std::string uppercase = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    std::string digits = "0123456789";
+    std::string special_chars = "!@#$%^&*()_+-=[]{}|;:,.<>?";
+    std::string ambiguous_chars = "il1Lo0O";
+    CharacterKernel character_kernel{special_chars};
+
+    std::vector<std::string> fallback_words = {
+        "apple", "mountain", "river", "sunset", "forest", "ocean", "thunder",
+        "crystal", "dragon", "phoenix", "wizard", "castle", "garden", "rainbow",
+        "butterfly", "diamond", "golden", "silver", "storm", "cloud", "moon",
+        "star", "fire", "water", "earth", "wind", "light", "shadow", "dream",
+        "magic", "knight", "sword", "shield", "crown", "tower", "bridge", "flower",
+        "tiger", "eagle", "wolf", "bear", "lion", "shark", "falcon", "panther",
+        "ruby", "emerald", "sapphire", "topaz", "pearl", "jade", "amber", "coral",
+        "hammer", "blade", "arrow", "spear", "axe", "bow", "staff", "wand",
+        "winter", "summer", "spring", "autumn", "frost", "blaze", "mist", "dawn"
+    };
+
+    // Compiled word library; the built-in fallback_words are used when none is loaded
+    std::shared_ptr<const BinaryWordlist> wordlist;
+
+    // Pronounceable mode model, trained from the word source on first use unless loaded
+    std::shared_ptr<MarkovModel> markov;
+
+    // Trained guess-number estimator for strength checks, when one is loaded
+    std::shared_ptr<const GuessModel> guess_model;
+
+    // Every draw comes from ChaCha20 keyed with 256 bits from the OS, so entropy and
+    // keyspace figures hold: a 32-bit seed would cap each generator at 2^32 outputs, and
+    // a Mersenne Twister's output gives away its state
+    ChaCha20 gen;
+
+    // Token modes draw bytes from their own ChaCha20 stream, created on first use
+    std::unique_ptr<TokenGenerator> token_generator;
+
+    // Exact keyspace and entropy results, keyed by policy description
+    std::map<std::string, BigUnsigned> keyspace_cache;
+    std::map<std::string, double> entropy_cache;
+
+    static double shannonEntropy(const std::map<std::string, double>& distribution) {
+        double bits = 0.0;
+        for (const auto& entry : distribution) {
+            if (entry.second > 0.0) {
+                bits -= entry.second * std::log2(entry.second);
+            }
+        }
+        return bits;
+    }
+
+public:
+    PasswordGenerator() = default;
+
+    // Component structures for custom password builder
+    struct Component {
+        enum Type {
+            TEXT,
+            WORD,
+            RANDOM_CHARS,
+            NUMBER,
+            SEPARATOR
+        };
+
+        Type type;
+        std::string value;
+        std::map<std::string, std::string> config;
+        std::vector<std::string> options;
+
+        Component(Type t) : type(t) {}
+    };
+
+    // What a generator knows about the password it just made; generators taking one
+    // overwrite it. entropy_bits is -log2 of the probability of the choices behind the
+    // password, which is the entropy whenever the choices are uniform, so bulk callers
+    // need no re-analysis.
+    struct GenerationInfo {
+        double entropy_bits = 0.0;
+        std::string policy;                                       // mode id, e.g. "memorable:4"
+        std::vector<std::pair<const char*, double>> components;   // bits per choice, in order
+
+        void add(const char* part, double bits) {
+            components.emplace_back(part, bits);
+            entropy_bits += bits;
+        }
+    };
+
+    // Parameters accepted by generatePassword, bundled so they can be sized and cached
+    struct PasswordPolicy {
+        int length = 12;
+        bool use_uppercase = true;
+        bool use_lowercase = true;
+        bool use_digits = true;
+        bool use_special = true;
+        bool exclude_ambiguous = false;
+        int min_uppercase = 1;
+        int min_lowercase = 1;
+        int min_digits = 1;
+        int min_special = 1;
+
+        // Relative weight of each class for the characters beyond the minimums;
+        // 0 keeps the class's natural weight, its number of characters
+        double weight_uppercase = 0.0;
+        double weight_lowercase = 0.0;
+        double weight_digits = 0.0;
+        double weight_special = 0.0;
+
+        // Per-character multipliers within their class (default 1, 0 excludes)
+        std::map<char, double> char_weights;
+
+        bool operator==(const PasswordPolicy& other) const {
+            return length == other.length && use_uppercase == other.use_uppercase &&
+                   use_lowercase == other.use_lowercase && use_digits == other.use_digits &&
+                   use_special == other.use_special && exclude_ambiguous == other.exclude_ambiguous &&
+                   min_uppercase == other.min_uppercase && min_lowercase == other.min_lowercase &&
+                   min_digits == other.min_digits && min_special == other.min_special &&
+                   weight_uppercase == other.weight_uppercase && weight_lowercase == other.weight_lowercase &&
+                   weight_digits == other.weight_digits && weight_special == other.weight_special &&
+                   char_weights == other.char_weights;
+        }
+
+        bool isWeighted() const {
+            return weight_uppercase > 0.0 || weight_lowercase > 0.0 || weight_digits > 0.0 ||
+                   weight_special > 0.0 || !char_weights.empty();
+        }
+
+        std::string key() const {
+            std::ostringstream oss;
+            oss << length << ':' << use_uppercase << use_lowercase << use_digits << use_special
+                << exclude_ambiguous << ':' << min_uppercase << ',' << min_lowercase << ','
+                << min_digits << ',' << min_special;
+            if (isWeighted()) {
+                oss << ":w" << weight_uppercase << ',' << weight_lowercase << ','
+                    << weight_digits << ',' << weight_special;
+                for (const auto& entry : char_weights) {
+                    oss << ',' << entry.first << '=' << entry.second;
+                }
+            }
+            return oss.str();
+        }
+    };
+
+    struct CharacterClass {
+        std::string chars;
+        int min_count;
+        double weight = 0.0;
+    };
+
+    // Alias tables for a weighted policy: one over the whole pool for free characters and
+    // one per class for required characters
+    struct WeightedSampler {
+        std::string pool;
+        AliasTable pool_table;
+        std::vector<AliasTable> class_tables;
+    };
+
+    // A checked policy with everything generation needs, built once: its classes, and
+    // the alias tables of a weighted policy or the keyspace index of an unweighted one
+    struct CompiledPolicy {
+        PasswordPolicy policy;
+        std::string id;  // "chars:" and the policy key, as reported in GenerationInfo
+        std::vector<CharacterClass> classes;
+        std::shared_ptr<const WeightedSampler> sampler;
+        std::shared_ptr<const KeyspaceIndex> index;
+    };
+
+private:
+    // Few policies are live at once, so a most-recent-first list beats formatting a key
+    std::vector<std::pair<PasswordPolicy, std::shared_ptr<const WeightedSampler>>> sampler_cache;
+    std::vector<std::pair<PasswordPolicy, std::shared_ptr<const KeyspaceIndex>>> index_cache;
+
+    // Inclusion-exclusion step: each class is either unconstrained or pinned to a count
+    // below its minimum, which flips the sign of the term
+    void accumulateKeyspace(const std::vector<CharacterClass>& classes, size_t index, int remaining,
+                            size_t free_size, bool negative, const BigUnsigned& term,
+                            BigUnsigned& added, BigUnsigned& subtracted) {
+        if (index == classes.size()) {
+            BigUnsigned total = term * BigUnsigned::power(static_cast<uint32_t>(free_size), remaining);
+            (negative ? subtracted : added) += total;
+            return;
+        }
+
+        const CharacterClass& cls = classes[index];
+        accumulateKeyspace(classes, index + 1, remaining, free_size + cls.chars.size(),
+                           negative, term, added, subtracted);
+
+        // term * C(remaining, count) * size^count for each count below the minimum
+        BigUnsigned choose(1);
+        BigUnsigned size_power(1);
+        for (int count = 0; count < cls.min_count && count <= remaining; count++) {
+            if (count > 0) {
+                choose.mulSmall(remaining - count + 1);
+                choose.divSmall(count);
+                size_power.mulSmall(static_cast<uint32_t>(cls.chars.size()));
+            }
+            accumulateKeyspace(classes, index + 1, remaining - count, free_size, !negative,
+                               term * choose * size_power, added, subtracted);
+        }
+    }
+
+public:
+    static int componentInt(const Component& component, const std::string& key, int default_value) {
+        auto it = component.config.find(key);
+        return it != component.config.end() ? std::stoi(it->second) : default_value;
+    }
+
+    static bool componentFlag(const Component& component, const std::string& key) {
+        auto it = component.config.find(key);
+        return it != component.config.end() && it->second == "true";
+    }
+
+    std::vector<std::string> suitableWords(int min_length, int max_length) {
+        std::vector<std::string> suitable_words;
+        for (const auto& word : fallback_words) {
+            if (static_cast<int>(word.length()) >= min_length && static_cast<int>(word.length()) <= max_length) {
+                suitable_words.push_back(word);
+            }
+        }
+
+        if (suitable_words.empty()) {
+            suitable_words = fallback_words;
+        }
+        return suitable_words;
+    }
+
+    // Loads a file produced by WordlistCompiler and returns its word count
+    size_t loadWordlist(const std::string& path) {
+        wordlist = std::make_shared<const BinaryWordlist>(path);
+        entropy_cache.clear();
+        return wordlist->size();
+    }
+
+    bool hasWordlist() const {
+        return wordlist != nullptr;
+    }
+
+    void loadMarkovModel(const std::string& path) {
+        markov = MarkovModel::load(path);
+    }
+
+    void loadGuessModel(const std::string& path) {
+        guess_model = std::make_shared<const GuessModel>(path);
+    }
+
+    const GuessModel* guessModel() const {
+        return guess_model.get();
+    }
+
+    // Lets a worker generator use libraries already loaded by another one; the maps are
+    // read-only, so sharing them across threads is safe
+    void shareLibraries(PasswordGenerator& other) {
+        wordlist = other.wordlist;
+        markov = other.markov;
+        guess_model = other.guess_model;
+        entropy_cache.clear();
+    }
+
+    MarkovModel& markovModel() {
+        if (!markov) {
+            auto model = std::make_shared<MarkovModel>(3);
+            forEachSuitableWord(1, BinaryWordlist::kMaxWordLength, [&model](std::string_view word, double) {
+                model->train(word);
+            });
+            model->build();
+            markov = model;
+        }
+        return *markov;
+    }
+
+    // Calls callback(word, probability) for every word getRandomWord can return
+    template <typename Callback>
+    void forEachSuitableWord(int min_length, int max_length, Callback callback) {
+        if (wordlist) {
+            auto range = wordlist->lengthRange(min_length, max_length);
+            if (range.first == range.second) {
+                range = {0, wordlist->size()};
+            }
+            double total = static_cast<double>(wordlist->rangeWeight(range.first, range.second));
+            wordlist->forEach(range.first, range.second, [&](std::string_view word, uint64_t weight) {
+                callback(word, weight / total);
+            });
+            return;
+        }
+
+        std::vector<std::string> words = suitableWords(min_length, max_length);
+        for (const auto& word : words) {
+            callback(std::string_view(word), 1.0 / words.size());
+        }
+    }
+
+    // bits, when given, receives -log2 of the chosen word's probability
+    SecureString getRandomWord(int min_length = 3, int max_length = 10, double* bits = nullptr) {
+        if (wordlist) {
+            auto range = wordlist->lengthRange(min_length, max_length);
+            if (range.first == range.second) {
+                range = {0, wordlist->size()};
+            }
+            uint64_t total = wordlist->rangeWeight(range.first, range.second);
+            std::uniform_int_distribution<uint64_t> dis(0, total - 1);
+            uint32_t index = wordlist->weightedIndex(range.first, range.second, dis(gen));
+            SecureString word;
+            wordlist->wordAt(index, word);
+            if (bits != nullptr) {
+                *bits = std::log2(static_cast<double>(total) / wordlist->rangeWeight(index, index + 1));
+            }
+            return word;
+        }
+
+        std::vector<std::string> suitable_words = suitableWords(min_length, max_length);
+        std::uniform_int_distribution<> dis(0, suitable_words.size() - 1);
+        if (bits != nullptr) {
+            *bits = std::log2(static_cast<double>(suitable_words.size()));
+        }
+        return SecureString(suitable_words[dis(gen)]);
+    }
+
+    // Appends value zero-padded to width without passing it through a stream buffer
+    static void appendNumber(SecureString& out, int value, int width) {
+        char buffer[32];
+        int written = std::snprintf(buffer, sizeof(buffer), "%0*d", std::min(width, 16), value);
+        out.append(buffer, written);
+        secureZero(buffer, sizeof(buffer));
+    }
+
+    static const std::vector<std::pair<char, char>>& leetReplacements() {
+        static const std::vector<std::pair<char, char>> replacements = {
+            {'a', '4'}, {'e', '3'}, {'i', '1'}, {'o', '0'}, {'s', '5'}, {'t', '7'}
+        };
+        return replacements;
+    }
+
+    // Word transformation used by generateComplexMemorablePassword; replacement is an
+    // index into leetReplacements() or -1 for none
+    template <typename String>
+    static void transformWord(String& word, int transform_type, int replacement) {
+        switch (transform_type) {
+            case 0:
+                if (!word.empty()) word[0] = std::toupper(word[0]);
+                break;
+            case 1:
+                std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+                break;
+            case 2:
+                std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+                break;
+            case 3:
+                if (word.length() > 4) {
+                    if (!word.empty()) word[0] = std::toupper(word[0]);
+                } else {
+                    std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+                }
+                break;
+        }
+
+        if (replacement >= 0) {
+            const auto& pair = leetReplacements()[replacement];
+            std::replace(word.begin(), word.end(), pair.first, pair.second);
+            std::replace(word.begin(), word.end(), static_cast<char>(std::toupper(pair.first)), pair.second);
+        }
+    }
+
+    // Chance that generateComplexMemorablePassword picks a replacement (-1 for none):
+    // each is tried with chance 1/2 after a 1/3 chance to replace at all
+    static double replacementProbability(int replacement) {
+        int options = leetReplacements().size();
+        if (replacement < 0) {
+            return 2.0 / 3.0 + (1.0 / 3.0) * std::pow(0.5, options);
+        }
+        return (1.0 / 3.0) * std::pow(0.5, replacement + 1);
+    }
+
+    // Chance that a word comes out of the random transform as result, summed over the
+    // transform and replacement pairs that produce it
+    static double transformProbability(const SecureString& original, const SecureString& result) {
+        double p = 0.0;
+        SecureString candidate;
+        for (int transform_type = 0; transform_type < 4; transform_type++) {
+            for (int replacement = -1; replacement < static_cast<int>(leetReplacements().size()); replacement++) {
+                candidate = original;
+                transformWord(candidate, transform_type, replacement);
+                if (candidate == result) {
+                    p += replacementProbability(replacement) / 4.0;
+                }
+            }
+        }
+        return p;
+    }
+
+    std::string removeAmbiguous(const std::string& chars) {
+        std::string result;
+        for (char c : chars) {
+            if (ambiguous_chars.find(c) == std::string::npos) {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    // Character classes enabled by a policy, in the order required characters are drawn
+    std::vector<CharacterClass> policyClasses(const PasswordPolicy& policy) {
+        std::vector<CharacterClass> classes;
+        if (policy.use_lowercase) {
+            classes.push_back({policy.exclude_ambiguous ? removeAmbiguous(lowercase) : lowercase,
+                               std::max(0, policy.min_lowercase), policy.weight_lowercase});
+        }
+        if (policy.use_uppercase) {
+            classes.push_back({policy.exclude_ambiguous ? removeAmbiguous(uppercase) : uppercase,
+                               std::max(0, policy.min_uppercase), policy.weight_uppercase});
+        }
+        if (policy.use_digits) {
+            classes.push_back({policy.exclude_ambiguous ? removeAmbiguous(digits) : digits,
+                               std::max(0, policy.min_digits), policy.weight_digits});
+        }
+        if (policy.use_special) {
+            classes.push_back({special_chars, std::max(0, policy.min_special), policy.weight_special});
+        }
+        for (auto& cls : classes) {
+            if (cls.weight < 0.0) {
+                throw std::invalid_argument("Class weights must not be negative");
+            }
+            if (cls.weight == 0.0) {
+                cls.weight = static_cast<double>(cls.chars.size());
+            }
+        }
+        return classes;
+    }
+
+    SecureString generatePassword(int length = 12, bool use_uppercase = true,
+                                bool use_lowercase = true, bool use_digits = true,
+                                bool use_special = true, bool exclude_ambiguous = false,
+                                int min_uppercase = 1, int min_lowercase = 1,
+                                int min_digits = 1, int min_special = 1, GenerationInfo* info = nullptr) {
+        PasswordPolicy policy;
+        policy.length = length;
+        policy.use_uppercase = use_uppercase;
+        policy.use_lowercase = use_lowercase;
+        policy.use_digits = use_digits;
+        policy.use_special = use_special;
+        policy.exclude_ambiguous = exclude_ambiguous;
+        policy.min_uppercase = min_uppercase;
+        policy.min_lowercase = min_lowercase;
+        policy.min_digits = min_digits;
+        policy.min_special = min_special;
+        return generatePassword(policy, info);
+    }
+
+    // Builds (once per policy) the alias tables that implement its weights
+    std::shared_ptr<const WeightedSampler> weightedSampler(const PasswordPolicy& policy) {
+        for (size_t i = 0; i < sampler_cache.size(); i++) {
+            if (sampler_cache[i].first == policy) {
+                if (i > 0) {
+                    std::swap(sampler_cache[i], sampler_cache[0]);
+                }
+                return sampler_cache[0].second;
+            }
+        }
+
+        auto sampler = std::make_shared<WeightedSampler>();
+        std::vector<double> pool_weights;
+        for (const auto& cls : policyClasses(policy)) {
+            std::vector<double> char_weights;
+            for (char c : cls.chars) {
+                auto it = policy.char_weights.find(c);
+                char_weights.push_back(it != policy.char_weights.end() ? it->second : 1.0);
+            }
+            AliasTable class_table(char_weights);
+            for (size_t i = 0; i < cls.chars.size(); i++) {
+                sampler->pool += cls.chars[i];
+                pool_weights.push_back(cls.weight * class_table.probability(i));
+            }
+            sampler->class_tables.push_back(std::move(class_table));
+        }
+        sampler->pool_table = AliasTable(pool_weights);
+
+        sampler_cache.insert(sampler_cache.begin(), {policy, sampler});
+        if (sampler_cache.size() > 16) {
+            sampler_cache.pop_back();
+        }
+        return sampler;
+    }
+
+    // Rank/unrank tables for a policy, built once; the weights do not affect the keyspace
+    std::shared_ptr<const KeyspaceIndex> keyspaceIndex(const PasswordPolicy& policy) {
+        for (size_t i = 0; i < index_cache.size(); i++) {
+            if (index_cache[i].first == policy) {
+                if (i > 0) {
+                    std::swap(index_cache[i], index_cache[0]);
+                }
+                return index_cache[0].second;
+            }
+        }
+
+        std::vector<std::string> class_chars;
+        std::vector<int> min_counts;
+        for (const auto& cls : policyClasses(policy)) {
+            class_chars.push_back(cls.chars);
+            min_counts.push_back(cls.min_count);
+        }
+        auto index = std::make_shared<const KeyspaceIndex>(std::move(class_chars), std::move(min_counts),
+                                                           std::max(0, policy.length));
+        index_cache.insert(index_cache.begin(), {policy, index});
+        if (index_cache.size() > 16) {
+            index_cache.pop_back();
+        }
+        return index;
+    }
+
+    // Checks passwords made elsewhere against a policy. Its length is a minimum unless
+    // exact_length is set.
+    PolicyValidator policyValidator(const PasswordPolicy& policy, bool exact_length = false) const {
+        auto rule = [&](const std::string& members, bool used, int min_count) {
+            PolicyValidator::ClassRule result;
+            result.members = members;
+            if (used) {
+                for (char c : members) {
+                    auto weight = policy.char_weights.find(c);
+                    bool excluded = weight != policy.char_weights.end() && weight->second == 0.0;
+                    bool ambiguous = policy.exclude_ambiguous && ambiguous_chars.find(c) != std::string::npos;
+                    if (!excluded && !ambiguous) {
+                        result.allowed += c;
+                    }
+                }
+                result.min_count = min_count;
+            }
+            return result;
+        };
+
+        uint64_t length = static_cast<uint64_t>(std::max(0, policy.length));
+        return PolicyValidator({rule(lowercase, policy.use_lowercase, policy.min_lowercase),
+                                rule(uppercase, policy.use_uppercase, policy.min_uppercase),
+                                rule(digits, policy.use_digits, policy.min_digits),
+                                rule(special_chars, policy.use_special, policy.min_special)},
+                               ambiguous_chars, length,
+                               exact_length ? length : std::numeric_limits<uint64_t>::max());
+    }
+
+    // Checks a policy and builds its tables once, for callers that generate many
+    // passwords from it
+    std::shared_ptr<const CompiledPolicy> compilePolicy(const PasswordPolicy& policy) {
+        if (policy.length < 4) {
+            throw std::invalid_argument("Password too short");
+        }
+        auto compiled = std::make_shared<CompiledPolicy>();
+        compiled->policy = policy;
+        compiled->id = "chars:" + policy.key();
+        compiled->classes = policyClasses(policy);
+        if (compiled->classes.empty()) {
+            throw std::invalid_argument("No character types selected");
+        }
+
+        int required = 0;
+        for (const auto& cls : compiled->classes) {
+            required += cls.min_count;
+        }
+        if (required > policy.length) {
+            throw std::invalid_argument("Requirements exceed password length");
+        }
+
+        if (policy.isWeighted()) {
+            compiled->sampler = weightedSampler(policy);
+        } else {
+            compiled->index = keyspaceIndex(policy);
+        }
+        return compiled;
+    }
+
+    SecureString generatePassword(const PasswordPolicy& policy, GenerationInfo* info = nullptr) {
+        return generatePassword(*compilePolicy(policy), info);
+    }
+
+    SecureString generatePassword(const CompiledPolicy& compiled, GenerationInfo* info = nullptr) {
+        SecureString password(static_cast<size_t>(compiled.policy.length), '\0');
+        generatePasswordInto(&password[0], compiled, info);
+        return password;
+    }
+
+    void generatePasswordInto(char* out, const PasswordPolicy& policy, GenerationInfo* info = nullptr) {
+        generatePasswordInto(out, *compilePolicy(policy), info);
+    }
+
+    // Writes exactly policy.length characters to out, without a terminator, so bulk
+    // writers can generate straight into their destination
+    void generatePasswordInto(char* out, const CompiledPolicy& compiled, GenerationInfo* info = nullptr) {
+        if (info != nullptr) {
+            *info = GenerationInfo();
+            info->policy = compiled.id;
+        }
+
+        if (compiled.sampler) {
+            const WeightedSampler& sampler = *compiled.sampler;
+            const std::vector<CharacterClass>& classes = compiled.classes;
+            int remaining_length = compiled.policy.length;
+            char* next = out;
+            double bits = 0.0;
+            for (size_t c = 0; c < classes.size(); c++) {
+                for (int i = 0; i < classes[c].min_count; i++) {
+                    uint32_t index = sampler.class_tables[c].sample(gen);
+                    bits -= std::log2(sampler.class_tables[c].probability(index));
+                    *next++ = classes[c].chars[index];
+                }
+                remaining_length -= classes[c].min_count;
+            }
+            for (int i = 0; i < remaining_length; i++) {
+                uint32_t index = sampler.pool_table.sample(gen);
+                bits -= std::log2(sampler.pool_table.probability(index));
+                *next++ = sampler.pool[index];
+            }
+            std::shuffle(out, next, gen);
+            if (info != nullptr) {
+                // The draws only, like passwordEntropy: the shuffle is not credited
+                info->add("characters", bits);
+            }
+            return;
+        }
+
+        // Unweighted: draw an index of the keyspace, so every accepted string is equally
+        // likely (filling the minimums first and shuffling over-weights strings that have
+        // exactly the minimum of some class)
+        if (info != nullptr) {
+            info->add("characters", compiled.index->bits());
+        }
+        compiled.index->sampleInto(gen, out);
+    }
+
+    SecureString generateMemorablePassword(int num_words = 4, const std::string& separator = "-",
+                                          bool add_numbers = true, bool capitalize = true,
+                                          int word_min_length = 3, int word_max_length = 8,
+                                          GenerationInfo* info = nullptr) {
+        if (info != nullptr) {
+            *info = GenerationInfo();
+        }
+        SecureStringList selected_words;
+        for (int i = 0; i < num_words; i++) {
+            double bits = 0.0;
+            SecureString word = getRandomWord(word_min_length, word_max_length, &bits);
+            if (info != nullptr) {
+                info->add("word", bits);
+            }
+            if (capitalize && !word.empty()) {
+                word[0] = std::toupper(word[0]);
+            }
+            selected_words.push_back(word);
+        }
+
+        SecureString password;
+        for (size_t i = 0; i < selected_words.size(); i++) {
+            password += selected_words[i];
+            if (i < selected_words.size() - 1) {
+                password += separator;
+            }
+        }
+
+        if (add_numbers) {
+            std::uniform_int_distribution<> dis(0, 999);
+            appendNumber(password, dis(gen), 3);
+            if (info != nullptr) {
+                info->add("number", std::log2(1000.0));
+            }
+        }
+
+        if (info != nullptr) {
+            info->policy = "memorable:" + std::to_string(num_words);
+        }
+        return password;
+    }
+
+    SecureString generateComplexMemorablePassword(int num_words = 3, bool add_special_chars = true,
+                                                 bool add_numbers = true, bool transform_words = true,
+                                                 int min_length = 16, GenerationInfo* info = nullptr) {
+        if (info != nullptr) {
+            *info = GenerationInfo();
+        }
+        SecureStringList words;
+        for (int i = 0; i < num_words; i++) {
+            double bits = 0.0;
+            SecureString word = getRandomWord(4, 8, &bits);
+            if (info != nullptr) {
+                info->add("word", bits);
+            }
+
+            if (transform_words) {
+                SecureString original = word;
+                std::uniform_int_distribution<> transform_dis(0, 3);
+                int transform_type = transform_dis(gen);
+
+                int replacement = -1;
+                std::uniform_int_distribution<> replace_dis(0, 2);
+                if (replace_dis(gen) == 0) {
+                    std::uniform_int_distribution<> chance_dis(0, 1);
+                    for (size_t r = 0; r < leetReplacements().size(); r++) {
+                        if (chance_dis(gen) == 0) {
+                            replacement = r;
+                            break;
+                        }
+                    }
+                }
+
+                transformWord(word, transform_type, replacement);
+                if (info != nullptr) {
+                    info->add("transform", -std::log2(transformProbability(original, word)));
+                }
+            }
+
+            words.push_back(word);
+        }
+
+        std::vector<std::string> separators = {"", "-", "_", ".", "!", "@", "#"};
+        SecureString password;
+
+        for (size_t i = 0; i < words.size(); i++) {
+            password += words[i];
+            if (i < words.size() - 1) {
+                std::uniform_int_distribution<> sep_dis(0, separators.size() - 1);
+                double choices;
+                if (add_special_chars) {
+                    std::uniform_int_distribution<> special_chance(0, 1);
+                    if (special_chance(gen) == 0) {
+                        std::uniform_int_distribution<> special_sep_dis(3, separators.size() - 1);
+                        password += separators[special_sep_dis(gen)];
+                        choices = 2.0 * (separators.size() - 3);
+                    } else {
+                        std::uniform_int_distribution<> normal_sep_dis(0, 2);
+                        password += separators[normal_sep_dis(gen)];
+                        choices = 2.0 * 3;
+                    }
+                } else {
+                    password += separators[sep_dis(gen)];
+                    choices = separators.size();
+                }
+                if (info != nullptr) {
+                    info->add("separator", std::log2(choices));
+                }
+            }
+        }
+
+        if (add_numbers) {
+            std::vector<std::string> positions = {"start", "middle", "end"};
+            std::uniform_int_distribution<> pos_dis(0, positions.size() - 1);
+            std::string position = positions[pos_dis(gen)];
+
+            std::uniform_int_distribution<> num_dis(0, 9999);
+            SecureString number;
+            appendNumber(number, num_dis(gen), 2);
+
+            if (position == "start") {
+                password.insert(0, number);
+            } else if (position == "end") {
+                password = password + number;
+            } else {
+                int mid = password.length() / 2;
+                password.insert(mid, number);
+            }
+            if (info != nullptr) {
+                info->add("number", std::log2(3.0) + std::log2(10000.0));
+            }
+        }
+
+        while (static_cast<int>(password.length()) < min_length && add_special_chars) {
+            std::string special_chars_subset = "!@#$%^&*";
+            std::uniform_int_distribution<> char_dis(0, special_chars_subset.length() - 1);
+            std::uniform_int_distribution<> pos_dis(0, password.length());
+
+            char special_char = special_chars_subset[char_dis(gen)];
+            int position = pos_dis(gen);
+            password.insert(position, 1, special_char);
+        }
+
+        // Padding characters are not credited, as in complexMemorableEntropy
+        if (info != nullptr) {
+            info->policy = "complex:" + std::to_string(num_words);
+        }
+        return password;
+    }
+
+    // Pronounceable letters from the Markov model, optionally followed by two digits.
+    // info receives the log-probability of this particular password.
+    SecureString generatePronounceablePassword(int length = 12, bool capitalize = true,
+                                               bool add_numbers = true, GenerationInfo* info = nullptr) {
+        if (length < 4) {
+            throw std::invalid_argument("Password too short");
+        }
+
+        int letters = add_numbers ? length - 2 : length;
+        SecureString password;
+        password.reserve(length);
+        double bits = 0.0;
+        markovModel().generate(letters, gen, password, bits);
+
+        if (capitalize) {
+            password[0] = std::toupper(password[0]);
+        }
+        if (info != nullptr) {
+            *info = GenerationInfo();
+            info->policy = "pronounceable:" + std::to_string(length);
+            info->add("letters", bits);
+        }
+        if (add_numbers) {
+            std::uniform_int_distribution<> dis(0, 99);
+            appendNumber(password, dis(gen), 2);
+            if (info != nullptr) {
+                info->add("number", std::log2(100.0));
+            }
+        }
+        return password;
+    }
+
+    // Average entropy of generatePronounceablePassword with these settings
+    double pronounceableEntropy(int length = 12, bool add_numbers = true) {
+        return markovModel().expectedEntropy(add_numbers ? length - 2 : length) +
+               (add_numbers ? std::log2(100.0) : 0.0);
+    }
+
+    // Character pool of a RANDOM_CHARS component; repeated types repeat their characters
+    std::string componentCharPool(const Component& component) {
+        std::vector<std::string> types = {"lowercase", "uppercase", "digits"};
+
+        auto it = component.config.find("types");
+        if (it != component.config.end()) {
+            types.clear();
+            std::istringstream iss(it->second);
+            std::string type;
+            while (std::getline(iss, type, ',')) {
+                types.push_back(type);
+            }
+        }
+
+        std::string char_pool;
+        for (const auto& type : types) {
+            if (type == "lowercase") {
+                char_pool += lowercase;
+            } else if (type == "uppercase") {
+                char_pool += uppercase;
+            } else if (type == "digits") {
+                char_pool += digits;
+            } else if (type == "special") {
+                char_pool += special_chars;
+            }
+        }
+        return char_pool;
+    }
+
+    static std::vector<std::string> componentSeparators(const Component& component) {
+        if (!component.options.empty()) {
+            return component.options;
+        }
+        return {"-", "_", ".", "!", "@", "#"};
+    }
+
+    // NEW: Custom password builder function
+    SecureString buildCustomPassword(const std::vector<Component>& components, GenerationInfo* info = nullptr) {
+        SecureString password;
+        if (info != nullptr) {
+            *info = GenerationInfo();
+            info->policy = "template";
+        }
+
+        for (const auto& component : components) {
+            switch (component.type) {
+                case Component::TEXT: {
+                    password += component.value;
+                    break;
+                }
+
+                case Component::WORD: {
+                    int min_length = componentInt(component, "min_length", 3);
+                    int max_length = componentInt(component, "max_length", 10);
+                    bool capitalize = componentFlag(component, "capitalize");
+                    bool uppercase = componentFlag(component, "uppercase");
+                    bool lowercase = componentFlag(component, "lowercase");
+                    bool random_case = componentFlag(component, "random_case");
+                    std::map<char, char> replacements;
+
+                    if (componentFlag(component, "replacements")) {
+                        replacements = {{'a', '4'}, {'e', '3'}, {'i', '1'}, {'o', '0'}, {'s', '5'}};
+                    }
+
+                    double bits = 0.0;
+                    SecureString word = getRandomWord(min_length, max_length, &bits);
+
+                    // Apply transformations
+                    if (capitalize && !word.empty()) {
+                        word[0] = std::toupper(word[0]);
+                    } else if (uppercase) {
+                        std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+                    } else if (lowercase) {
+                        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+                    } else if (random_case) {
+                        std::uniform_int_distribution<> case_dis(0, 1);
+                        for (char& c : word) {
+                            c = case_dis(gen) == 0 ? std::toupper(c) : std::tolower(c);
+                        }
+                        // Every letter independently flips case
+                        bits += std::count_if(word.begin(), word.end(), ::isalpha);
+                    }
+
+                    // Apply replacements
+                    for (const auto& pair : replacements) {
+                        std::replace(word.begin(), word.end(), pair.first, pair.second);
+                    }
+
+                    password += word;
+                    if (info != nullptr) {
+                        info->add("word", bits);
+                    }
+                    break;
+                }
+
+                case Component::RANDOM_CHARS: {
+                    int length = componentInt(component, "length", 4);
+                    std::string char_pool = componentCharPool(component);
+
+                    if (!char_pool.empty()) {
+                        password.reserve(password.size() + length);
+                        std::uniform_int_distribution<> dis(0, char_pool.length() - 1);
+                        double bits = 0.0;
+                        for (int i = 0; i < length; i++) {
+                            char c = char_pool[dis(gen)];
+                            password += c;
+                            if (info != nullptr) {
+                                // Repeated types make some characters more likely
+                                bits += std::log2(static_cast<double>(char_pool.size()) /
+                                                  std::count(char_pool.begin(), char_pool.end(), c));
+                            }
+                        }
+                        if (info != nullptr) {
+                            info->add("characters", bits);
+                        }
+                    }
+                    break;
+                }
+
+                case Component::NUMBER: {
+                    int min_val = componentInt(component, "min", 0);
+                    int max_val = componentInt(component, "max", 9999);
+                    int padding = componentInt(component, "padding", 0);
+
+                    std::uniform_int_distribution<> dis(min_val, max_val);
+                    appendNumber(password, dis(gen), padding);
+                    if (info != nullptr) {
+                        info->add("number", max_val > min_val ? std::log2(static_cast<double>(max_val) - min_val + 1) : 0.0);
+                    }
+                    break;
+                }
+
+                case Component::SEPARATOR: {
+                    std::vector<std::string> separators = componentSeparators(component);
+                    std::uniform_int_distribution<> dis(0, separators.size() - 1);
+                    const std::string& separator = separators[dis(gen)];
+                    password += separator;
+                    if (info != nullptr) {
+                        info->add("separator", std::log2(static_cast<double>(separators.size()) /
+                                                         std::count(separators.begin(), separators.end(), separator)));
+                    }
+                    break;
+                }
+            }
+        }
+
+        return password;
+    }
+
+    // Uniform characters from a Unicode alphabet
+    SecureString generateAlphabetPassword(const Utf8Alphabet& alphabet, int length,
+                                          Utf8Alphabet::Unit unit = Utf8Alphabet::CODEPOINTS,
+                                          GenerationInfo* info = nullptr) {
+        double bits = 0.0;
+        SecureString password = alphabet.generate(gen, length, unit, &bits);
+        if (info != nullptr) {
+            *info = GenerationInfo();
+            info->policy = "alphabet:" + std::to_string(length) + (unit == Utf8Alphabet::BYTES ? "b" : "");
+            info->add("characters", bits);
+        }
+        return password;
+    }
+
+    SecureString generateToken(const TokenGenerator::Format& format, GenerationInfo* info = nullptr) {
+        if (!token_generator) {
+            token_generator.reset(new TokenGenerator());
+        }
+        SecureString token = token_generator->mint(format);
+        if (info != nullptr) {
+            *info = GenerationInfo();
+            info->policy = "token";
+            info->add("bytes", 8.0 * format.bytes);
+        }
+        return token;
+    }
+
+    PasswordPolicy getComplexityPolicy(int complexity) {
+        if (complexity < 1 || complexity > 10) {
+            throw std::invalid_argument("Complexity must be 1-10");
+        }
+
+        PasswordPolicy policy;
+
+        if (complexity <= 2) {
+            policy.length = 8 + complexity;
+            policy.use_uppercase = complexity >= 2;
+            policy.use_lowercase = true;
+            policy.use_digits = complexity >= 2;
+            policy.use_special = false;
+            policy.exclude_ambiguous = true;
+            policy.min_uppercase = policy.use_uppercase ? 1 : 0;
+            policy.min_lowercase = 2;
+            policy.min_digits = policy.use_digits ? 1 : 0;
+            policy.min_special = 0;
+        } else if (complexity <= 4) {
+            policy.length = 10 + complexity;
+            policy.use_uppercase = true;
+            policy.use_lowercase = true;
+            policy.use_digits = true;
+            policy.use_special = complexity >= 4;
+            policy.exclude_ambiguous = complexity <= 3;
+            policy.min_uppercase = 1;
+            policy.min_lowercase = 2;
+            policy.min_digits = 1;
+            policy.min_special = policy.use_special ? 1 : 0;
+        } else if (complexity <= 6) {
+            policy.length = 12 + complexity;
+            policy.use_uppercase = true;
+            policy.use_lowercase = true;
+            policy.use_digits = true;
+            policy.use_special = true;
+            policy.exclude_ambiguous = false;
+            policy.min_uppercase = 2;
+            policy.min_lowercase = 2;
+            policy.min_digits = 2;
+            policy.min_special = 1;
+        } else if (complexity <= 8) {
+            policy.length = 16 + (complexity - 6) * 2;
+            policy.use_uppercase = true;
+            policy.use_lowercase = true;
+            policy.use_digits = true;
+            policy.use_special = true;
+            policy.exclude_ambiguous = false;
+            policy.min_uppercase = 2;
+            policy.min_lowercase = 3;
+            policy.min_digits = 2;
+            policy.min_special = 2;
+        } else {
+            policy.length = 20 + (complexity - 8) * 4;
+            policy.use_uppercase = true;
+            policy.use_lowercase = true;
+            policy.use_digits = true;
+            policy.use_special = true;
+            policy.exclude_ambiguous = false;
+            policy.min_uppercase = 3;
+            policy.min_lowercase = 4;
+            policy.min_digits = 3;
+            policy.min_special = 3;
+        }
+
+        return policy;
+    }
+
+    SecureString generatePasswordByComplexity(int complexity = 5, GenerationInfo* info = nullptr) {
+        SecureString password = generatePassword(getComplexityPolicy(complexity), info);
+        if (info != nullptr) {
+            info->policy = "complexity:" + std::to_string(complexity);
+        }
+        return password;
+    }
+
+    // A mode spec resolved once into what its generator needs, so batch jobs that
+    // repeat a spec skip the parsing and policy setup
+    struct GenerationSpec {
+        enum Mode {
+            POLICY,
+            MEMORABLE,
+            COMPLEX,
+            PRONOUNCEABLE,
+            TEMPLATE,
+            ALPHABET,
+            TOKEN
+        };
+
+        Mode mode = POLICY;
+        int value = 0;
+        PasswordPolicy policy;
+        std::shared_ptr<const CompiledPolicy> compiled_policy;  // set by compileSpec
+        std::vector<Component> components;
+        std::shared_ptr<const Utf8Alphabet> alphabet;
+        Utf8Alphabet::Unit unit = Utf8Alphabet::CODEPOINTS;
+        TokenGenerator::Format token;
+        std::string text;   // the spec as given, reported as the policy id
+    };
+
+    // Parses the text form of a custom template: literal text with {word}, {chars},
+    // {number} and {sep} placeholders, each optionally followed by ':' and
+    // ';'-separated component settings, e.g. "{word:capitalize}{sep:options=-,.}{number:max=99}"
+    static std::vector<Component> parseTemplate(const std::string& text) {
+        std::vector<Component> components;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t open = text.find('{', pos);
+            if (open != pos) {
+                Component literal(Component::TEXT);
+                literal.value = text.substr(pos, open - pos);
+                components.push_back(literal);
+                if (open == std::string::npos) {
+                    break;
+                }
+            }
+
+            size_t close = text.find('}', open);
+            if (close == std::string::npos) {
+                throw std::invalid_argument("Unclosed '{' in template");
+            }
+            std::string body = text.substr(open + 1, close - open - 1);
+            std::string name = body.substr(0, body.find(':'));
+
+            Component component(Component::TEXT);
+            if (name == "word") {
+                component.type = Component::WORD;
+            } else if (name == "chars") {
+                component.type = Component::RANDOM_CHARS;
+            } else if (name == "number") {
+                component.type = Component::NUMBER;
+            } else if (name == "sep") {
+                component.type = Component::SEPARATOR;
+            } else {
+                throw std::invalid_argument("Unknown template component '" + name + "'");
+            }
+
+            if (name.size() < body.size()) {
+                std::istringstream settings(body.substr(name.size() + 1));
+                std::string setting;
+                while (std::getline(settings, setting, ';')) {
+                    size_t equals = setting.find('=');
+                    std::string key = setting.substr(0, equals);
+                    std::string value = equals == std::string::npos ? "true" : setting.substr(equals + 1);
+                    if (component.type == Component::SEPARATOR && key == "options") {
+                        std::istringstream options(value);
+                        std::string option;
+                        while (std::getline(options, option, ',')) {
+                            component.options.push_back(option);
+                        }
+                    } else {
+                        component.config[key] = value;
+                    }
+                }
+            }
+            components.push_back(component);
+            pos = close + 1;
+        }
+        return components;
+    }
+
+    // Compact mode specs for non-interactive use: standard:LENGTH, complexity:LEVEL,
+    // memorable:WORDS, complex:WORDS, pronounceable:LENGTH, template:TEXT,
+    // alphabet:LENGTH:CHARACTERS (LENGTH in codepoints, or bytes with a 'b' suffix) or
+    // token:ENCODING[+crc]:BYTES[:PREFIX]
+    GenerationSpec compileSpec(const std::string& spec) {
+        size_t colon = spec.find(':');
+        std::string mode = spec.substr(0, colon);
+        std::string argument = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+        GenerationSpec compiled;
+        compiled.text = spec;
+        if (mode == "template") {
+            compiled.mode = GenerationSpec::TEMPLATE;
+            compiled.components = parseTemplate(argument);
+            return compiled;
+        }
+        if (mode == "token") {
+            compiled.mode = GenerationSpec::TOKEN;
+            compiled.token = TokenGenerator::Format::parse(argument);
+            return compiled;
+        }
+        if (mode == "alphabet") {
+            size_t split = argument.find(':');
+            std::string length = argument.substr(0, split);
+            if (split == std::string::npos || length.empty()) {
+                throw std::invalid_argument("Alphabet spec needs LENGTH:CHARACTERS");
+            }
+            compiled.mode = GenerationSpec::ALPHABET;
+            if (length.back() == 'b') {
+                compiled.unit = Utf8Alphabet::BYTES;
+                length.pop_back();
+            }
+            try {
+                compiled.value = std::stoi(length);
+            } catch (const std::exception&) {
+                throw std::invalid_argument("Bad number in spec '" + spec + "'");
+            }
+            compiled.alphabet = std::make_shared<const Utf8Alphabet>(argument.substr(split + 1));
+            return compiled;
+        }
+
+        if (!argument.empty()) {
+            try {
+                compiled.value = std::stoi(argument);
+            } catch (const std::exception&) {
+                throw std::invalid_argument("Bad number in spec '" + spec + "'");
+            }
+        }
+
+        if (mode == "standard") {
+            compiled.policy.length = compiled.value > 0 ? compiled.value : 12;
+        } else if (mode == "complexity") {
+            compiled.policy = getComplexityPolicy(compiled.value > 0 ? compiled.value : 5);
+        } else if (mode == "memorable") {
+            compiled.mode = GenerationSpec::MEMORABLE;
+            compiled.value = compiled.value > 0 ? compiled.value : 4;
+        } else if (mode == "complex") {
+            compiled.mode = GenerationSpec::COMPLEX;
+            compiled.value = compiled.value > 0 ? compiled.value : 3;
+        } else if (mode == "pronounceable") {
+            compiled.mode = GenerationSpec::PRONOUNCEABLE;
+            compiled.value = compiled.value > 0 ? compiled.value : 12;
+        } else {
+            throw std::invalid_argument("Unknown password mode '" + mode + "'");
+        }
+        if (compiled.mode == GenerationSpec::POLICY) {
+            compiled.compiled_policy = compilePolicy(compiled.policy);
+        }
+        return compiled;
+    }
+
+    SecureString generate(const GenerationSpec& spec, GenerationInfo* info = nullptr) {
+        SecureString password;
+        switch (spec.mode) {
+            case GenerationSpec::MEMORABLE:
+                password = generateMemorablePassword(spec.value, "-", true, true, 3, 8, info);
+                break;
+            case GenerationSpec::COMPLEX:
+                password = generateComplexMemorablePassword(spec.value, true, true, true, 16, info);
+                break;
+            case GenerationSpec::PRONOUNCEABLE:
+                password = generatePronounceablePassword(spec.value, true, true, info);
+                break;
+            case GenerationSpec::TEMPLATE:
+                password = buildCustomPassword(spec.components, info);
+                break;
+            case GenerationSpec::ALPHABET:
+                password = generateAlphabetPassword(*spec.alphabet, spec.value, spec.unit, info);
+                break;
+            case GenerationSpec::TOKEN:
+                password = generateToken(spec.token, info);
+                break;
+            case GenerationSpec::POLICY:
+                password = spec.compiled_policy ? generatePassword(*spec.compiled_policy, info)
+                                                : generatePassword(spec.policy, info);
+                break;
+        }
+        if (info != nullptr && !spec.text.empty()) {
+            info->policy = spec.text;
+        }
+        return password;
+    }
+
+    SecureString generateFromSpec(const std::string& spec, GenerationInfo* info = nullptr) {
+        return generate(compileSpec(spec), info);
+    }
+
+    // Regenerates until the password is further than max_distance edits from every
+    // history entry. Rejections remove a negligible share of a policy's keyspace, so
+    // info still describes the spec.
+    SecureString generateAvoiding(const GenerationSpec& spec, const PasswordHistory& history, int max_distance,
+                                  GenerationInfo* info = nullptr, int max_attempts = 1000) {
+        for (int attempt = 0; attempt < max_attempts; attempt++) {
+            SecureString password = generate(spec, info);
+            if (!history.tooSimilar(password, max_distance)) {
+                return password;
+            }
+        }
+        throw std::runtime_error("No password far enough from the history; lower the distance or use a longer policy");
+    }
+
+    std::string getComplexityDescription(int complexity) {
+        std::map<int, std::string> descriptions = {
+            {1, "Very Simple - lowercase only"},
+            {2, "Simple - letters and digits"},
+            {3, "Basic - letters and digits, no ambiguous"},
+            {4, "Medium - all types, no ambiguous"},
+            {5, "Good - all character types"},
+            {6, "Strong - all types, more requirements"},
+            {7, "Very Strong - increased length"},
+            {8, "Excellent - high requirements"},
+            {9, "Maximum - very long and complex"},
+            {10, "Extreme - maximum protection"}
+        };
+
+        auto it = descriptions.find(complexity);
+        if (it == descriptions.end()) {
+            return "Unknown level";
+        }
+
+        PasswordPolicy policy = getComplexityPolicy(complexity);
+        std::ostringstream oss;
+        oss << it->second << " (" << policy.length << " chars, "
+            << std::fixed << std::setprecision(1) << passwordEntropy(policy) << " bits)";
+        return oss.str();
+    }
+
+    // Number of strings a policy accepts: every character from an enabled class and at
+    // least min_count characters of each class. Counted by inclusion-exclusion over the
+    // classes whose minimum is violated, so the cost depends on the minimums, not the length.
+    BigUnsigned passwordKeyspace(const PasswordPolicy& policy) {
+        std::string key = policy.key();
+        auto cached = keyspace_cache.find(key);
+        if (cached != keyspace_cache.end()) {
+            return cached->second;
+        }
+
+        std::vector<CharacterClass> classes = policyClasses(policy);
+        BigUnsigned added, subtracted;
+        accumulateKeyspace(classes, 0, std::max(0, policy.length), 0, false, BigUnsigned(1), added, subtracted);
+
+        BigUnsigned keyspace = added;
+        keyspace -= subtracted;
+        keyspace_cache[key] = keyspace;
+        return keyspace;
+    }
+
+    double passwordEntropy(const PasswordPolicy& policy) {
+        std::string key = "chars:" + policy.key();
+        auto cached = entropy_cache.find(key);
+        if (cached != entropy_cache.end()) {
+            return cached->second;
+        }
+
+        double bits;
+        if (policy.isWeighted()) {
+            // Weighted draws are not uniform over the keyspace: use the Shannon entropy
+            // of the independent draws instead
+            const WeightedSampler& sampler = *weightedSampler(policy);
+            std::vector<CharacterClass> classes = policyClasses(policy);
+            int required = 0;
+            bits = 0.0;
+            for (size_t c = 0; c < classes.size(); c++) {
+                required += classes[c].min_count;
+                bits += classes[c].min_count * sampler.class_tables[c].entropy();
+            }
+            bits += std::max(0, policy.length - required) * sampler.pool_table.entropy();
+        } else {
+            BigUnsigned keyspace = passwordKeyspace(policy);
+            bits = keyspace.isZero() ? 0.0 : keyspace.log2();
+        }
+        entropy_cache[key] = bits;
+        return bits;
+    }
+
+    // Entropy of one word drawn by getRandomWord within the length bounds
+    double wordEntropy(int min_length, int max_length) {
+        std::string key = "word:" + std::to_string(min_length) + ":" + std::to_string(max_length);
+        auto cached = entropy_cache.find(key);
+        if (cached != entropy_cache.end()) {
+            return cached->second;
+        }
+
+        double bits = 0.0;
+        forEachSuitableWord(min_length, max_length, [&bits](std::string_view, double p) {
+            bits -= p * std::log2(p);
+        });
+        entropy_cache[key] = bits;
+        return bits;
+    }
+
+    double memorableEntropy(int num_words = 4, bool add_numbers = true,
+                            int word_min_length = 3, int word_max_length = 8) {
+        double bits = num_words * wordEntropy(word_min_length, word_max_length);
+        if (add_numbers) {
+            bits += std::log2(1000.0);
+        }
+        return bits;
+    }
+
+    // Entropy of the choices made by generateComplexMemorablePassword. Distinct words,
+    // separators and numbers are counted exactly; the characters inserted to reach
+    // min_length are not credited, so the figure is a lower bound for short settings.
+    double complexMemorableEntropy(int num_words = 3, bool add_special_chars = true,
+                                   bool add_numbers = true, bool transform_words = true) {
+        std::ostringstream key;
+        key << "complex:" << add_special_chars << transform_words;
+        auto cached = entropy_cache.find(key.str());
+        double word_bits, separator_bits;
+
+        if (cached != entropy_cache.end()) {
+            word_bits = cached->second;
+            separator_bits = entropy_cache[key.str() + ":sep"];
+        } else {
+            // Words are lowercase letters and every replacement digit maps back to one
+            // letter, so transforms of different words never collide: the entropy is
+            // H(word) plus the average entropy of each word's own transform outcomes.
+            word_bits = wordEntropy(4, 8);
+            if (transform_words) {
+                forEachSuitableWord(4, 8, [&word_bits](std::string_view candidate, double word_p) {
+                    std::map<std::string, double> outcomes;
+                    int options = leetReplacements().size();
+                    for (int transform_type = 0; transform_type < 4; transform_type++) {
+                        for (int replacement = -1; replacement < options; replacement++) {
+                            std::string word(candidate);
+                            transformWord(word, transform_type, replacement);
+                            outcomes[word] += replacementProbability(replacement) / 4.0;
+                        }
+                    }
+                    word_bits += word_p * shannonEntropy(outcomes);
+                });
+            }
+
+            std::vector<std::string> separators = {"", "-", "_", ".", "!", "@", "#"};
+            std::map<std::string, double> separator_distribution;
+            for (size_t i = 0; i < separators.size(); i++) {
+                if (add_special_chars) {
+                    separator_distribution[separators[i]] += i >= 3 ? 0.5 / (separators.size() - 3) : 0.5 / 3;
+                } else {
+                    separator_distribution[separators[i]] += 1.0 / separators.size();
+                }
+            }
+
+            separator_bits = shannonEntropy(separator_distribution);
+            entropy_cache[key.str()] = word_bits;
+            entropy_cache[key.str() + ":sep"] = separator_bits;
+        }
+
+        double bits = num_words * word_bits + std::max(0, num_words - 1) * separator_bits;
+        if (add_numbers) {
+            bits += std::log2(3.0) + std::log2(10000.0);
+        }
+        return bits;
+    }
+
+    double componentEntropy(const Component& component) {
+        switch (component.type) {
+            case Component::TEXT:
+                return 0.0;
+
+            case Component::WORD: {
+                int min_length = componentInt(component, "min_length", 3);
+                int max_length = componentInt(component, "max_length", 10);
+                double bits = wordEntropy(min_length, max_length);
+                bool random_case = !componentFlag(component, "capitalize") &&
+                                   !componentFlag(component, "uppercase") &&
+                                   !componentFlag(component, "lowercase") &&
+                                   componentFlag(component, "random_case");
+                if (random_case) {
+                    // Every letter independently flips case
+                    forEachSuitableWord(min_length, max_length, [&bits](std::string_view word, double p) {
+                        bits += p * std::count_if(word.begin(), word.end(), ::isalpha);
+                    });
+                }
+                return bits;
+            }
+
+            case Component::RANDOM_CHARS: {
+                std::string char_pool = componentCharPool(component);
+                if (char_pool.empty()) {
+                    return 0.0;
+                }
+                std::map<std::string, double> distribution;
+                for (char c : char_pool) {
+                    distribution[std::string(1, c)] += 1.0 / char_pool.size();
+                }
+                return componentInt(component, "length", 4) * shannonEntropy(distribution);
+            }
+
+            case Component::NUMBER: {
+                int min_val = componentInt(component, "min", 0);
+                int max_val = componentInt(component, "max", 9999);
+                return max_val > min_val ? std::log2(static_cast<double>(max_val) - min_val + 1) : 0.0;
+            }
+
+            case Component::SEPARATOR: {
+                std::vector<std::string> separators = componentSeparators(component);
+                std::map<std::string, double> distribution;
+                for (const auto& separator : separators) {
+                    distribution[separator] += 1.0 / separators.size();
+                }
+                return shannonEntropy(distribution);
+            }
+        }
+        return 0.0;
+    }
+
+    double customEntropy(const std::vector<Component>& components) {
+        double bits = 0.0;
+        for (const auto& component : components) {
+            bits += componentEntropy(component);
+        }
+        return bits;
+    }
+
+    // Shortest length for which the policy reaches target_bits
+    PasswordPolicy sizePasswordPolicy(PasswordPolicy policy, double target_bits, int max_length = 1024) {
+        std::vector<CharacterClass> classes = policyClasses(policy);
+        if (classes.empty()) {
+            throw std::invalid_argument("No character types selected");
+        }
+
+        int required = 0;
+        size_t pool_size = 0;
+        for (const auto& cls : classes) {
+            required += cls.min_count;
+            pool_size += cls.chars.size();
+        }
+
+        // The keyspace never exceeds pool_size^length, which bounds the search from below
+        int length = std::max(4, required);
+        if (pool_size > 1) {
+            length = std::max(length, static_cast<int>(std::floor(target_bits / std::log2(static_cast<double>(pool_size)))));
+        }
+
+        for (; length <= max_length; length++) {
+            policy.length = length;
+            if (passwordEntropy(policy) >= target_bits) {
+                return policy;
+            }
+        }
+        throw std::invalid_argument("Target entropy not reachable with this policy");
+    }
+
+    int sizeMemorableWords(double target_bits, bool add_numbers = true,
+                           int word_min_length = 3, int word_max_length = 8, int max_words = 64) {
+        for (int num_words = 1; num_words <= max_words; num_words++) {
+            if (memorableEntropy(num_words, add_numbers, word_min_length, word_max_length) >= target_bits) {
+                return num_words;
+            }
+        }
+        throw std::invalid_argument("Target entropy not reachable with this word list");
+    }
+
+    int sizeComplexMemorableWords(double target_bits, bool add_special_chars = true,
+                                  bool add_numbers = true, bool transform_words = true, int max_words = 64) {
+        for (int num_words = 1; num_words <= max_words; num_words++) {
+            if (complexMemorableEntropy(num_words, add_special_chars, add_numbers, transform_words) >= target_bits) {
+                return num_words;
+            }
+        }
+        throw std::invalid_argument("Target entropy not reachable with this word list");
+    }
+
+    // Grows the random character component with the most bits per character until the
+    // template reaches target_bits; other components are left as configured
+    std::vector<Component> sizeCustomTemplate(std::vector<Component> components, double target_bits) {
+        double bits = customEntropy(components);
+        if (bits >= target_bits) {
+            return components;
+        }
+
+        Component* best = nullptr;
+        double best_bits_per_char = 0.0;
+        for (auto& component : components) {
+            if (component.type != Component::RANDOM_CHARS) {
+                continue;
+            }
+            Component single = component;
+            single.config["length"] = "1";
+            double per_char = componentEntropy(single);
+            if (per_char > best_bits_per_char) {
+                best_bits_per_char = per_char;
+                best = &component;
+            }
+        }
+
+        if (best == nullptr) {
+            throw std::invalid_argument("Template has no random characters to extend");
+        }
+
+        int extra = static_cast<int>(std::ceil((target_bits - bits) / best_bits_per_char - 1e-9));
+        best->config["length"] = std::to_string(componentInt(*best, "length", 4) + extra);
+        return components;
+    }
+
+    struct PasswordAnalysis {
+        enum Feedback : uint32_t {
+            TOO_SHORT = 1,
+            FEW_TYPES = 2,
+            REPEATS = 4,
+            SEQUENCES = 8,
+            COMMON = 16,
+            KEYBOARD_WALK = 32,
+            GUESSABLE = 64
+        };
+
+        int score;
+        const char* strength;
+        uint32_t feedback_flags;
+        int length;
+        bool has_lowercase;
+        bool has_uppercase;
+        bool has_digits;
+        bool has_special;
+        bool has_uncased;           // letters of a script without case
+        int unique_chars;
+        int longest_run;
+        int keyboard_walk;          // keys in the longest walk on any layout
+        const char* walk_layout;
+        double log2_guesses;        // from the guess model, -1 when none is loaded
+
+        // Tips are kept as flags and only rendered when someone shows them
+        std::vector<std::string> feedback() const {
+            static const char* const tips[] = {
+                "Too short", "Use different character types", "Too many repeated characters",
+                "Avoid simple sequences", "Avoid common passwords", "Avoid keyboard patterns",
+                "Easy to guess from patterns in leaked passwords"
+            };
+            std::vector<std::string> result;
+            for (int bit = 0; bit < 7; bit++) {
+                if (feedback_flags & (1u << bit)) {
+                    result.push_back(tips[bit]);
+                }
+            }
+            return result;
+        }
+    };
+
+    PasswordAnalysis checkPasswordStrength(std::string_view password) {
+        PasswordAnalysis analysis;
+        analysis.score = 0;
+        analysis.feedback_flags = 0;
+
+        // Non-ASCII bytes switch to codepoints, so a multibyte letter counts once
+        CharacterProfile profile = character_kernel.profile(password);
+        CodepointProfile codepoints;
+        uint32_t classes = profile.classes;
+        analysis.length = password.length();
+        analysis.unique_chars = profile.uniqueCount();
+        analysis.longest_run = profile.longest_run;
+        if ((profile.classes & CharacterProfile::OTHER) && codepoints.build(password, character_kernel)) {
+            classes = codepoints.classes;
+            analysis.length = codepoints.length;
+            analysis.unique_chars = codepoints.unique;
+            analysis.longest_run = codepoints.longest_run;
+        }
+
+        if (analysis.length >= 16) {
+            analysis.score += 3;
+        } else if (analysis.length >= 12) {
+            analysis.score += 2;
+        } else if (analysis.length >= 8) {
+            analysis.score += 1;
+        } else {
+            analysis.feedback_flags |= PasswordAnalysis::TOO_SHORT;
+        }
+
+        analysis.has_lowercase = classes & CharacterProfile::LOWERCASE;
+        analysis.has_uppercase = classes & CharacterProfile::UPPERCASE;
+        analysis.has_digits = classes & CharacterProfile::DIGIT;
+        analysis.has_special = classes & CharacterProfile::SPECIAL;
+        analysis.has_uncased = classes & CharacterProfile::UNCASED;
+
+        int char_types = analysis.has_lowercase + analysis.has_uppercase +
+                        analysis.has_digits + analysis.has_special + analysis.has_uncased;
+        analysis.score += char_types;
+
+        if (char_types < 3) {
+            analysis.feedback_flags |= PasswordAnalysis::FEW_TYPES;
+        }
+
+        if (analysis.unique_chars >= analysis.length * 0.8) {
+            analysis.score += 2;
+        } else if (analysis.unique_chars >= analysis.length * 0.6) {
+            analysis.score += 1;
+        } else {
+            analysis.feedback_flags |= PasswordAnalysis::REPEATS;
+        }
+
+        // Runs of three or more come from the kernel; the sequence tables are compiled once
+        static const std::regex sequence_patterns[] = {
+            std::regex(R"((012|123|234|345|456|567|678|789|890))"),
+            std::regex(R"((abc|bcd|cde|def|efg|fgh|ghi|hij|ijk|jkl|klm|lmn|mno|nop|opq|pqr|qrs|rst|stu|tuv|uvw|vwx|wxy|xyz))")
+        };
+
+        SecureString lower_password(password);
+        std::transform(lower_password.begin(), lower_password.end(), lower_password.begin(), ::tolower);
+
+        bool pattern_found = analysis.longest_run >= 3;
+        for (const auto& pattern : sequence_patterns) {
+            if (pattern_found) {
+                break;
+            }
+            pattern_found = std::regex_search(lower_password, pattern);
+        }
+
+        if (pattern_found) {
+            analysis.feedback_flags |= PasswordAnalysis::SEQUENCES;
+        }
+
+        KeyboardWalkDetector::Walk walk = KeyboardWalkDetector::longestWalk(password);
+        analysis.keyboard_walk = walk.length;
+        analysis.walk_layout = walk.layout;
+        if (walk.obvious()) {
+            analysis.feedback_flags |= PasswordAnalysis::KEYBOARD_WALK;
+            pattern_found = true;
+        }
+
+        if (pattern_found) {
+            analysis.score -= 2;
+        }
+
+        static const std::vector<std::string> common_passwords = {"password", "123456", "qwerty", "admin", "login", "welcome"};
+        for (const auto& common : common_passwords) {
+            if (lower_password.find(common) != std::string::npos) {
+                analysis.score -= 3;
+                analysis.feedback_flags |= PasswordAnalysis::COMMON;
+                break;
+            }
+        }
+
+        analysis.score = std::max(0, analysis.score);
+
+        // Reported next to the score rather than folded into it
+        analysis.log2_guesses = -1.0;
+        if (guess_model) {
+            analysis.log2_guesses = guess_model->log2Guesses(password);
+            if (analysis.log2_guesses < GuessModel::kGuessable) {
+                analysis.feedback_flags |= PasswordAnalysis::GUESSABLE;
+            }
+        }
+
+        if (analysis.score >= 10) {
+            analysis.strength = "Excellent";
+        } else if (analysis.score >= 8) {
+            analysis.strength = "Very Strong";
+        } else if (analysis.score >= 6) {
+            analysis.strength = "Strong";
+        } else if (analysis.score >= 4) {
+            analysis.strength = "Medium";
+        } else if (analysis.score >= 2) {
+            analysis.strength = "Weak";
+        } else {
+            analysis.strength = "Very Weak";
+        }
+
+        return analysis;
+    }
+};
+
+// Lazy, pull-based password source. Nothing is generated until an item is requested,
+// and filters are applied to each candidate as it is drawn, so take(n) does exactly
+// the work needed for n accepted passwords:
+//
+//     for (const SecureString& password : PasswordStream(gen, "memorable:4").minScore(6).unique().take(5))
+//
+// Builder calls on a temporary return it by value, so such chains are safe in range-for.
+class PasswordStream {
+public:
+    typedef std::function<bool(const SecureString&)> Filter;
+
+private:
+    static constexpr size_t kMaxRejections = 10000;
+
+    PasswordGenerator* gen;
+    std::function<SecureString()> source;
+    std::vector<Filter> filters;
+    size_t limit = std::numeric_limits<size_t>::max();
+    size_t produced = 0;
+
+    // Draws until a candidate passes every filter
+    bool pull(SecureString& out) {
+        if (produced >= limit) {
+            return false;
+        }
+        for (size_t rejected = 0; rejected < kMaxRejections; rejected++) {
+            SecureString candidate = source();
+            bool accepted = true;
+            for (const auto& filter : filters) {
+                if (!filter(candidate)) {
+                    accepted = false;
+                    break;
+                }
+            }
+            if (accepted) {
+                out = std::move(candidate);
+                produced++;
+                return true;
+            }
+        }
+        throw std::runtime_error("Filters rejected " + std::to_string(kMaxRejections) + " candidates in a row");
+    }
+
+public:
+    class iterator {
+    private:
+        PasswordStream* stream = nullptr;
+        SecureString current;
+
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef SecureString value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const SecureString* pointer;
+        typedef const SecureString& reference;
+
+        iterator() = default;
+        explicit iterator(PasswordStream* owner) : stream(owner) {
+            ++*this;
+        }
+
+        reference operator*() const { return current; }
+        pointer operator->() const { return &current; }
+
+        iterator& operator++() {
+            if (stream != nullptr && !stream->pull(current)) {
+                stream = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return stream == other.stream; }
+        bool operator!=(const iterator& other) const { return stream != other.stream; }
+    };
+
+    PasswordStream(PasswordGenerator& generator, std::function<SecureString()> password_source)
+        : gen(&generator), source(std::move(password_source)) {}
+
+    // Endless passwords of one mode spec (see PasswordGenerator::compileSpec)
+    PasswordStream(PasswordGenerator& generator, const std::string& spec) : gen(&generator) {
+        auto compiled = std::make_shared<PasswordGenerator::GenerationSpec>(generator.compileSpec(spec));
+        source = [&generator, compiled] { return generator.generate(*compiled); };
+    }
+
+    PasswordStream& filter(Filter predicate) & {
+        filters.push_back(std::move(predicate));
+        return *this;
+    }
+
+    PasswordStream filter(Filter predicate) && {
+        return std::move(filter(std::move(predicate)));
+    }
+
+    // Keeps passwords whose checkPasswordStrength score is at least `score`
+    PasswordStream& minScore(int score) & {
+        PasswordGenerator* owner = gen;
+        return filter([owner, score](const SecureString& password) {
+            return owner->checkPasswordStrength(password).score >= score;
+        });
+    }
+
+    PasswordStream minScore(int score) && {
+        return std::move(minScore(score));
+    }
+
+    // Drops passwords containing any blocklisted word, compared case-insensitively
+    PasswordStream& blocklist(const std::vector<std::string>& words) & {
+        auto lowered = std::make_shared<std::vector<std::string>>();
+        for (std::string word : words) {
+            std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+            if (!word.empty()) {
+                lowered->push_back(word);
+            }
+        }
+        return filter([lowered](const SecureString& password) {
+            SecureString folded(password);
+            std::transform(folded.begin(), folded.end(), folded.begin(), ::tolower);
+            for (const auto& word : *lowered) {
+                if (folded.find(word) != SecureString::npos) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    PasswordStream blocklist(const std::vector<std::string>& words) && {
+        return std::move(blocklist(words));
+    }
+
+    // Drops repeats of passwords already produced. Only 64-bit digests are remembered,
+    // so no secret is retained; a digest collision merely costs one extra draw.
+    PasswordStream& unique() & {
+        auto seen = std::make_shared<std::unordered_set<size_t>>();
+        return filter([seen](const SecureString& password) {
+            return seen->insert(std::hash<std::string_view>()(password.view())).second;
+        });
+    }
+
+    PasswordStream unique() && {
+        return std::move(unique());
+    }
+
+    PasswordStream& take(size_t count) & {
+        limit = std::min(limit, produced + count);
+        return *this;
+    }
+
+    PasswordStream take(size_t count) && {
+        return std::move(take(count));
+    }
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+};
+
+// Streams a "user,policy" CSV into a "user,password[,hash]" CSV. The calling thread
+// reads and parses rows into chunks, worker threads generate them with their own
+// PasswordGenerator and compiled-spec cache, and a writer thread emits chunks in input
+// order. At most kMaxChunksPerWorker chunks per worker exist at any time, whether
+// queued, in progress or waiting for the writer, so memory does not grow with the file.
+class ProvisioningPipeline {
+public:
+    struct Stats {
+        size_t rows = 0;
+        size_t written = 0;
+        size_t failed = 0;
+    };
+
+private:
+    static constexpr size_t kChunkRows = 512;
+    static constexpr size_t kMaxChunksPerWorker = 4;
+    static constexpr size_t kMaxCachedSpecs = 256;
+
+    struct Row {
+        size_t line;
+        std::string user;
+        std::string spec;
+    };
+
+    struct Chunk {
+        size_t sequence;
+        std::vector<Row> rows;
+        SecureStringList passwords;    // one per row, empty on failure
+        std::vector<std::string> hashes;
+        std::vector<std::string> errors;
+    };
+
+    PasswordGenerator& source;
+    const PasswordHasher* hasher;
+    unsigned worker_count;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::unique_ptr<Chunk>> pending;
+    std::map<size_t, std::unique_ptr<Chunk>> finished;
+    size_t in_flight = 0;
+    bool input_done = false;
+
+    // Splits one CSV record, reading further lines while a quoted field is open
+    static bool readRecord(std::istream& in, std::vector<std::string>& fields, size_t& line) {
+        fields.clear();
+        std::string text;
+        if (!std::getline(in, text)) {
+            return false;
+        }
+        line++;
+
+        std::string field;
+        bool quoted = false;
+        for (size_t i = 0;; i++) {
+            if (i == text.size()) {
+                if (quoted && std::getline(in, text)) {
+                    line++;
+                    field += '\n';
+                    i = static_cast<size_t>(-1);
+                    continue;
+                }
+                break;
+            }
+
+            char c = text[i];
+            if (quoted) {
+                if (c == '"' && i + 1 < text.size() && text[i + 1] == '"') {
+                    field += '"';
+                    i++;
+                } else if (c == '"') {
+                    quoted = false;
+                } else {
+                    field += c;
+                }
+            } else if (c == '"') {
+                quoted = true;
+            } else if (c == ',') {
+                fields.push_back(field);
+                field.clear();
+            } else if (c != '\r') {
+                field += c;
+            }
+        }
+        fields.push_back(field);
+        return true;
+    }
+
+    template <typename String>
+    static void writeField(std::ostream& out, const String& value) {
+        if (value.find_first_of(",\"\r\n") == String::npos) {
+            out << value;
+            return;
+        }
+        out << '"';
+        for (char c : value) {
+            if (c == '"') {
+                out << '"';
+            }
+            out << c;
+        }
+        out << '"';
+    }
+
+    void work() {
+        PasswordGenerator gen;
+        gen.shareLibraries(source);
+        std::map<std::string, PasswordGenerator::GenerationSpec> specs;
+
+        while (true) {
+            std::unique_ptr<Chunk> chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return !pending.empty() || input_done; });
+                if (pending.empty()) {
+                    return;
+                }
+                chunk = std::move(pending.front());
+                pending.pop_front();
+            }
+
+            chunk->passwords.resize(chunk->rows.size());
+            chunk->errors.resize(chunk->rows.size());
+            for (size_t i = 0; i < chunk->rows.size(); i++) {
+                const Row& row = chunk->rows[i];
+                try {
+                    auto cached = specs.find(row.spec);
+                    if (cached == specs.end()) {
+                        if (specs.size() >= kMaxCachedSpecs) {
+                            specs.clear();
+                        }
+                        cached = specs.emplace(row.spec, gen.compileSpec(row.spec)).first;
+                    }
+                    chunk->passwords[i] = gen.generate(cached->second);
+                } catch (const std::exception& e) {
+                    chunk->errors[i] = e.what();
+                }
+            }
+
+            if (hasher != nullptr) {
+                chunk->hashes = hasher->hash(chunk->passwords);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished[chunk->sequence] = std::move(chunk);
+            }
+            changed.notify_all();
+        }
+    }
+
+    void write(std::ostream& out, Stats& stats) {
+        size_t next = 0;
+        while (true) {
+            std::unique_ptr<Chunk> chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this, next] {
+                    return finished.count(next) != 0 || (input_done && in_flight == 0);
+                });
+                auto it = finished.find(next);
+                if (it == finished.end()) {
+                    return;
+                }
+                chunk = std::move(it->second);
+                finished.erase(it);
+            }
+
+            for (size_t i = 0; i < chunk->rows.size(); i++) {
+                if (!chunk->errors[i].empty()) {
+                    std::cerr << "line " << chunk->rows[i].line << ": " << chunk->errors[i] << "\n";
+                    stats.failed++;
+                    continue;
+                }
+                writeField(out, chunk->rows[i].user);
+                out << ',';
+                writeField(out, chunk->passwords[i]);
+                if (!chunk->hashes.empty()) {
+                    out << ',' << chunk->hashes[i];
+                }
+                out << '\n';
+                stats.written++;
+            }
+            next++;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                in_flight--;
+            }
+            changed.notify_all();
+        }
+    }
+
+    void submit(std::unique_ptr<Chunk> chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return in_flight < worker_count * kMaxChunksPerWorker; });
+        in_flight++;
+        pending.push_back(std::move(chunk));
+        lock.unlock();
+        changed.notify_all();
+    }
+
+public:
+    ProvisioningPipeline(PasswordGenerator& libraries, const PasswordHasher* row_hasher = nullptr,
+                         unsigned workers = std::thread::hardware_concurrency())
+        : source(libraries), hasher(row_hasher), worker_count(std::max(1u, workers)) {}
+
+    // Rows whose first field is "user" are treated as a header and skipped
+    Stats run(std::istream& in, std::ostream& out) {
+        Stats stats;
+        input_done = false;
+        in_flight = 0;
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < worker_count; i++) {
+            workers.emplace_back([this] { work(); });
+        }
+        std::thread writer([this, &out, &stats] { write(out, stats); });
+
+        out << "user,password" << (hasher != nullptr ? ",hash" : "") << "\n";
+
+        std::vector<std::string> fields;
+        size_t line = 0;
+        size_t sequence = 0;
+        std::unique_ptr<Chunk> chunk(new Chunk());
+        try {
+            while (readRecord(in, fields, line)) {
+                if (fields.size() == 1 && fields[0].empty()) {
+                    continue;
+                }
+                if (stats.rows == 0 && line == 1 && fields[0] == "user") {
+                    continue;
+                }
+                stats.rows++;
+                chunk->rows.push_back({line, fields[0], fields.size() > 1 ? fields[1] : ""});
+                if (chunk->rows.size() == kChunkRows) {
+                    chunk->sequence = sequence++;
+                    submit(std::move(chunk));
+                    chunk.reset(new Chunk());
+                }
+            }
+            if (!chunk->rows.empty()) {
+                chunk->sequence = sequence++;
+                submit(std::move(chunk));
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                input_done = true;
+            }
+            changed.notify_all();
+            for (auto& worker : workers) worker.join();
+            writer.join();
+            throw;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            input_done = true;
+        }
+        changed.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        writer.join();
+        out.flush();
+        return stats;
+    }
+};
+
+// Writes passwords of one character policy as newline-terminated lines straight into a
+// mapped file. Every line is length + 1 bytes, so line i starts at i * (length + 1): the
+// file is sized before anything is generated and each worker fills its own contiguous
+// run of lines with its own generator. Nothing is buffered or funnelled through a
+// writer thread, so output scales with cores until the storage becomes the limit.
+class BulkWriter {
+public:
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        unsigned threads = 0;
+    };
+
+private:
+    unsigned worker_count;
+
+public:
+    explicit BulkWriter(unsigned workers = std::thread::hardware_concurrency())
+        : worker_count(std::max(1u, workers)) {}
+
+    // On failure the partial file is removed
+    Stats write(const std::string& path, const PasswordGenerator::PasswordPolicy& policy, uint64_t count) {
+        // Rejects a bad policy before the file is created
+        std::shared_ptr<const PasswordGenerator::CompiledPolicy> compiled = PasswordGenerator().compilePolicy(policy);
+
+        uint64_t record = static_cast<uint64_t>(policy.length) + 1;
+        if (count > std::numeric_limits<size_t>::max() / record) {
+            throw std::length_error("Output file too large");
+        }
+
+        Stats stats;
+        stats.records = count;
+        stats.bytes = count * record;
+        stats.threads = static_cast<unsigned>(std::max<uint64_t>(1, std::min<uint64_t>(worker_count, count)));
+
+        std::vector<std::exception_ptr> errors(stats.threads);
+        {
+            MappedOutputFile output(path, static_cast<size_t>(stats.bytes));
+            std::vector<std::thread> workers;
+            uint64_t share = count / stats.threads, extra = count % stats.threads;
+            for (unsigned t = 0; t < stats.threads; t++) {
+                uint64_t first = share * t + std::min<uint64_t>(t, extra);
+                uint64_t lines = share + (t < extra ? 1 : 0);
+                workers.emplace_back([&, t, first, lines] {
+                    try {
+                        PasswordGenerator gen;
+                        char* line = output.data() + first * record;
+                        for (uint64_t i = 0; i < lines; i++, line += record) {
+                            gen.generatePasswordInto(line, *compiled);
+                            line[policy.length] = '\n';
+                        }
+                    } catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        for (const auto& error : errors) {
+            if (error) {
+                std::remove(path.c_str());
+                std::rethrow_exception(error);
+            }
+        }
+        return stats;
+    }
+};
+
+// Passwords for one spec generated ahead of time by a background thread, so a request
+// is a pop from a ring instead of a full generation. The ring is Vyukov's bounded queue:
+// every slot carries a sequence number that says whether it is ready to be written
+// (sequence == position) or read (sequence == position + 1), so the producer and any
+// number of consumers never take a lock. Consumers only lock to wake the producer when
+// the ring drops to the low watermark; it then refills up to the high watermark.
+// Slots are wiped as soon as their password is moved out.
+class PasswordPool {
+public:
+    struct Metrics {
+        uint64_t hits = 0;       // requests served from the ring
+        uint64_t misses = 0;     // requests that found it empty and generated inline
+        uint64_t refills = 0;    // times the producer woke up to top it up
+        uint64_t produced = 0;   // passwords the producer generated
+        size_t available = 0;
+    };
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence{0};
+        SecureString password;
+        PasswordGenerator::GenerationInfo info;
+    };
+
+    PasswordGenerator producer_gen;
+    PasswordGenerator fallback_gen;
+    PasswordGenerator::GenerationSpec spec;
+    std::mutex fallback_mutex;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    size_t low_watermark;
+    size_t high_watermark;
+    alignas(64) std::atomic<size_t> head{0};   // next position to read
+    alignas(64) std::atomic<size_t> tail{0};   // next position to write, producer only
+
+    alignas(64) std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> refills{0};
+    std::atomic<uint64_t> produced{0};
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> refill_requested{true};
+    std::atomic<bool> stopping{false};
+    std::thread producer;
+
+    size_t available() const {
+        size_t written = tail.load(std::memory_order_acquire);
+        size_t read = head.load(std::memory_order_acquire);
+        return written > read ? written - read : 0;
+    }
+
+    // Single producer: the tail is only advanced here, so no compare-and-swap is needed
+    bool push(SecureString& password, PasswordGenerator::GenerationInfo& info) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Slot& slot = slots[position & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != position) {
+            return false;
+        }
+        slot.password = std::move(password);
+        slot.info = std::move(info);
+        slot.sequence.store(position + 1, std::memory_order_release);
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(SecureString& password, PasswordGenerator::GenerationInfo* info) {
+        size_t position = head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t ready = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (ready == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    password = std::move(slot.password);
+                    secureZero(&slot.password[0], slot.password.capacity());
+                    if (info != nullptr) {
+                        *info = std::move(slot.info);
+                    }
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (ready < 0) {
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void requestRefill() {
+        if (!refill_requested.exchange(true, std::memory_order_acq_rel)) {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            wake.notify_one();
+        }
+    }
+
+    void produce() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait(lock, [this] { return stopping || refill_requested.load(std::memory_order_acquire); });
+                if (stopping) {
+                    return;
+                }
+            }
+            refills.fetch_add(1, std::memory_order_relaxed);
+
+            while (available() < high_watermark && !stopping.load(std::memory_order_relaxed)) {
+                PasswordGenerator::GenerationInfo info;
+                SecureString password;
+                try {
+                    password = producer_gen.generate(spec, &info);
+                } catch (const std::exception&) {
+                    return;  // every request then misses, and take() reports the error
+                }
+                if (!push(password, info)) {
+                    break;
+                }
+                produced.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // A consumer that crossed the low watermark while the flag was still set did
+            // not notify, so look again before sleeping
+            refill_requested.store(false, std::memory_order_release);
+            if (available() <= low_watermark) {
+                refill_requested.store(true, std::memory_order_release);
+            }
+        }
+    }
+
+public:
+    // capacity is rounded up to a power of two; the watermarks default to a quarter and
+    // all of it
+    PasswordPool(PasswordGenerator& source, const std::string& spec_text, size_t capacity = 64,
+                 size_t low = 0, size_t high = 0)
+        : spec(source.compileSpec(spec_text)) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+        high_watermark = high > 0 ? std::min(high, size) : size;
+        low_watermark = std::min(low > 0 ? low : size / 4, high_watermark - 1);
+
+        producer_gen.shareLibraries(source);
+        fallback_gen.shareLibraries(source);
+        producer = std::thread(&PasswordPool::produce, this);
+    }
+
+    PasswordPool(const PasswordPool&) = delete;
+    PasswordPool& operator=(const PasswordPool&) = delete;
+
+    ~PasswordPool() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping.store(true);
+        }
+        wake.notify_one();
+        producer.join();
+    }
+
+    // O(1) when the ring has a password; otherwise generates one on the calling thread
+    SecureString take(PasswordGenerator::GenerationInfo* info = nullptr) {
+        SecureString password;
+        bool hit = pop(password, info);
+        if (available() <= low_watermark) {
+            requestRefill();
+        }
+        if (hit) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return password;
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(fallback_mutex);
+        return fallback_gen.generate(spec, info);
+    }
+
+    Metrics metrics() const {
+        Metrics result;
+        result.hits = hits.load(std::memory_order_relaxed);
+        result.misses = misses.load(std::memory_order_relaxed);
+        result.refills = refills.load(std::memory_order_relaxed);
+        result.produced = produced.load(std::memory_order_relaxed);
+        result.available = available();
+        return result;
+    }
+};
+
+// Tail probability of the chi-square distribution with df degrees of freedom, through
+// the regularized upper incomplete gamma function Q(df / 2, statistic / 2)
+inline double chiSquarePValue(double statistic, int df) {
+    if (df <= 0) {
+        return 1.0;
+    }
+    if (!std::isfinite(statistic)) {
+        return 0.0;
+    }
+    double a = df / 2.0;
+    double x = statistic / 2.0;
+    if (x <= 0) {
+        return 1.0;
+    }
+    double log_prefix = -x + a * std::log(x) - std::lgamma(a);
+
+    if (x < a + 1) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < 10000 && term > sum * 1e-16; n++) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return std::max(0.0, 1.0 - sum * std::exp(log_prefix));
+    }
+
+    // Continued fraction, evaluated with the modified Lentz method
+    const double tiny = 1e-300;
+    double b = x + 1 - a;
+    double c = 1 / tiny;
+    double d = 1 / b;
+    double h = d;
+    for (int i = 1; i < 10000; i++) {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1) < 1e-15) {
+            break;
+        }
+    }
+    return std::exp(log_prefix) * h;
+}
+
+// Checks that generators make their random choices uniformly. Each mode generates
+// passwords on every core until its share of the time budget runs out, parses each
+// one back into the choices that produced it and only bumps counters, so memory does
+// not depend on the sample count. Every test is a chi-square test: either goodness of
+// fit against the distribution the generator is meant to draw from, or independence
+// (homogeneity) between positions or neighbouring choices.
+class RandomnessAudit {
+public:
+    struct TestResult {
+        std::string name;
+        double statistic;
+        int df;
+        double p_value;
+    };
+
+    struct ModeReport {
+        std::string mode;
+        uint64_t samples = 0;
+        uint64_t unparsed = 0;
+        double seconds = 0;
+        std::vector<TestResult> tests;
+    };
+
+    static constexpr double kSuspicious = 1e-4;
+
+private:
+    // Observed counts against expected shares; cells with no expected share must stay empty
+    struct FitCounter {
+        std::string name;
+        std::vector<double> expected;
+        std::vector<uint64_t> observed;
+
+        FitCounter(std::string test_name, std::vector<double> shares)
+            : name(std::move(test_name)), expected(std::move(shares)), observed(expected.size(), 0) {}
+
+        void add(size_t cell) { observed[cell]++; }
+
+        TestResult result() const {
+            uint64_t total = 0;
+            for (uint64_t count : observed) total += count;
+            double statistic = 0;
+            int cells = 0;
+            for (size_t i = 0; i < observed.size(); i++) {
+                double wanted = expected[i] * total;
+                if (wanted <= 0) {
+                    if (observed[i] > 0) statistic = std::numeric_limits<double>::infinity();
+                    continue;
+                }
+                double diff = observed[i] - wanted;
+                statistic += diff * diff / wanted;
+                cells++;
+            }
+            return {name, statistic, cells - 1, chiSquarePValue(statistic, cells - 1)};
+        }
+    };
+
+    // Contingency table tested for independence of row and column
+    struct TableCounter {
+        std::string name;
+        size_t rows;
+        size_t cols;
+        std::vector<uint64_t> counts;
+
+        TableCounter(std::string test_name, size_t row_count, size_t col_count)
+            : name(std::move(test_name)), rows(row_count), cols(col_count), counts(row_count * col_count, 0) {}
+
+        void add(size_t row, size_t col) { counts[row * cols + col]++; }
+
+        TestResult result() const {
+            std::vector<double> row_sums(rows, 0), col_sums(cols, 0);
+            double total = 0;
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < cols; c++) {
+                    row_sums[r] += counts[r * cols + c];
+                    col_sums[c] += counts[r * cols + c];
+                    total += counts[r * cols + c];
+                }
+            }
+            double statistic = 0;
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < cols; c++) {
+                    if (row_sums[r] > 0 && col_sums[c] > 0) {
+                        double wanted = row_sums[r] * col_sums[c] / total;
+                        double diff = counts[r * cols + c] - wanted;
+                        statistic += diff * diff / wanted;
+                    }
+                }
+            }
+            int used_rows = static_cast<int>(std::count_if(row_sums.begin(), row_sums.end(), [](double v) { return v > 0; }));
+            int used_cols = static_cast<int>(std::count_if(col_sums.begin(), col_sums.end(), [](double v) { return v > 0; }));
+            int df = std::max(0, (used_rows - 1) * (used_cols - 1));
+            return {name, statistic, df, chiSquarePValue(statistic, df)};
+        }
+    };
+
+    struct Counters {
+        std::vector<FitCounter> fits;
+        std::vector<TableCounter> tables;
+        uint64_t samples = 0;
+        uint64_t unparsed = 0;
+
+        void merge(const Counters& other) {
+            for (size_t i = 0; i < fits.size(); i++) {
+                for (size_t j = 0; j < fits[i].observed.size(); j++) fits[i].observed[j] += other.fits[i].observed[j];
+            }
+            for (size_t i = 0; i < tables.size(); i++) {
+                for (size_t j = 0; j < tables[i].counts.size(); j++) tables[i].counts[j] += other.tables[i].counts[j];
+            }
+            samples += other.samples;
+            unparsed += other.unparsed;
+        }
+    };
+
+    // Builds a worker's empty counters and returns the function that draws one
+    // password and records it
+    typedef std::function<std::function<void(Counters&)>(PasswordGenerator&, Counters&)> ModeSetup;
+
+    static constexpr size_t kWordBins = 64;
+    static constexpr size_t kPairBins = 16;
+
+    PasswordGenerator& source;
+    std::map<std::string, ModeSetup> modes;
+
+    static size_t wordBin(std::string_view word) {
+        std::string lowered(word);
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+        size_t hash = std::hash<std::string>()(lowered);
+        secureZero(&lowered[0], lowered.size());
+        return hash % kWordBins;
+    }
+
+    // Expected share of each word bin, from the probabilities getRandomWord uses
+    static std::vector<double> wordShares(PasswordGenerator& gen, int min_length, int max_length) {
+        std::vector<double> shares(kWordBins, 0);
+        gen.forEachSuitableWord(min_length, max_length, [&shares](std::string_view word, double p) {
+            shares[wordBin(word)] += p;
+        });
+        return shares;
+    }
+
+    static std::vector<double> uniform(size_t cells) {
+        return std::vector<double>(cells, 1.0 / cells);
+    }
+
+    static std::string className(const std::string& chars) {
+        if (std::islower(static_cast<unsigned char>(chars[0]))) return "lowercase";
+        if (std::isupper(static_cast<unsigned char>(chars[0]))) return "uppercase";
+        if (std::isdigit(static_cast<unsigned char>(chars[0]))) return "digit";
+        return "special";
+    }
+
+    static std::function<void(Counters&)> setupStandard(PasswordGenerator& gen, Counters& counters) {
+        PasswordGenerator::PasswordPolicy policy;
+        std::vector<PasswordGenerator::CharacterClass> classes = gen.policyClasses(policy);
+
+        auto class_of = std::make_shared<std::array<int, 256>>();
+        auto index_of = std::make_shared<std::array<int, 256>>();
+        class_of->fill(-1);
+        for (size_t k = 0; k < classes.size(); k++) {
+            for (size_t i = 0; i < classes[k].chars.size(); i++) {
+                unsigned char c = static_cast<unsigned char>(classes[k].chars[i]);
+                (*class_of)[c] = static_cast<int>(k);
+                (*index_of)[c] = static_cast<int>(i);
+            }
+        }
+
+        // fits: [k] characters within class k, [classes + k] adjacent pairs within class k
+        for (const auto& cls : classes) {
+            counters.fits.emplace_back(className(cls.chars) + " characters", uniform(cls.chars.size()));
+        }
+        for (const auto& cls : classes) {
+            counters.fits.emplace_back("adjacent " + className(cls.chars) + " pairs",
+                                       uniform(cls.chars.size() * cls.chars.size()));
+        }
+        // tables: [0] class by position
+        counters.tables.emplace_back("class by position", policy.length, classes.size());
+
+        std::vector<size_t> sizes;
+        for (const auto& cls : classes) sizes.push_back(cls.chars.size());
+
+        std::shared_ptr<const PasswordGenerator::CompiledPolicy> compiled = gen.compilePolicy(policy);
+        return [&gen, policy, compiled, class_of, index_of, sizes](Counters& out) {
+            SecureString password = gen.generatePassword(*compiled);
+            if (static_cast<int>(password.size()) != policy.length) {
+                out.unparsed++;
+                return;
+            }
+            int previous_class = -1, previous_index = 0;
+            for (size_t pos = 0; pos < password.size(); pos++) {
+                unsigned char c = static_cast<unsigned char>(password[pos]);
+                int k = (*class_of)[c];
+                if (k < 0) {
+                    out.unparsed++;
+                    return;
+                }
+                int index = (*index_of)[c];
+                out.fits[k].add(index);
+                out.tables[0].add(pos, k);
+                if (k == previous_class) {
+                    out.fits[sizes.size() + k].add(previous_index * sizes[k] + index);
+                }
+                previous_class = k;
+                previous_index = index;
+            }
+        };
+    }
+
+    static std::function<void(Counters&)> setupMemorable(PasswordGenerator& gen, Counters& counters) {
+        // fits: [0] word choice, [1..3] number digits; tables: [0] adjacent words, [1] digit pairs
+        counters.fits.emplace_back("word choice", wordShares(gen, 3, 8));
+        for (int d = 1; d <= 3; d++) {
+            counters.fits.emplace_back("number digit " + std::to_string(d), uniform(10));
+        }
+        counters.tables.emplace_back("adjacent words", kPairBins, kPairBins);
+        counters.tables.emplace_back("number digits 1 and 2", 10, 10);
+
+        return [&gen](Counters& out) {
+            SecureString password = gen.generateMemorablePassword();
+            std::vector<std::string_view> words;
+            std::string_view rest = password.view();
+            for (size_t dash; (dash = rest.find('-')) != std::string_view::npos; rest.remove_prefix(dash + 1)) {
+                words.push_back(rest.substr(0, dash));
+            }
+            if (words.size() != 3 || rest.size() < 4) {
+                out.unparsed++;
+                return;
+            }
+            std::string_view number = rest.substr(rest.size() - 3);
+            words.push_back(rest.substr(0, rest.size() - 3));
+            if (!std::all_of(number.begin(), number.end(), ::isdigit)) {
+                out.unparsed++;
+                return;
+            }
+
+            size_t previous = 0;
+            for (size_t i = 0; i < words.size(); i++) {
+                size_t bin = wordBin(words[i]);
+                out.fits[0].add(bin);
+                if (i > 0) out.tables[0].add(previous % kPairBins, bin % kPairBins);
+                previous = bin;
+            }
+            for (int d = 0; d < 3; d++) {
+                out.fits[1 + d].add(number[d] - '0');
+            }
+            out.tables[1].add(number[0] - '0', number[1] - '0');
+        };
+    }
+
+    // Audited without word transforms or length padding, which would hide the choices
+    // being checked: separators, the number and its position, and the words
+    static std::function<void(Counters&)> setupComplex(PasswordGenerator& gen, Counters& counters) {
+        static const std::string separators = "-_.!@#";
+
+        // fits: [0] separator ("" plus six characters), [1] number position,
+        // [2] and [3] number digits, [4] word choice; tables: [0] adjacent words
+        counters.fits.emplace_back("separator choice", uniform(7));
+        counters.fits.emplace_back("number position", uniform(3));
+        counters.fits.emplace_back("number digit 1", uniform(10));
+        counters.fits.emplace_back("number digit 2", uniform(10));
+        counters.fits.emplace_back("word choice", wordShares(gen, 4, 8));
+        counters.tables.emplace_back("adjacent words", kPairBins, kPairBins);
+
+        return [&gen](Counters& out) {
+            SecureString password = gen.generateComplexMemorablePassword(3, true, true, false, 0);
+            std::string_view text = password.view();
+            size_t first = text.find_first_of("0123456789");
+            if (first == std::string_view::npos) {
+                out.unparsed++;
+                return;
+            }
+            size_t last = first;
+            while (last < text.size() && std::isdigit(static_cast<unsigned char>(text[last]))) last++;
+            std::string_view number = text.substr(first, last - first);
+            out.fits[1].add(first == 0 ? 0 : last == text.size() ? 2 : 1);
+            out.fits[2].add(number[0] - '0');
+            out.fits[3].add(number[1] - '0');
+
+            SecureString rest(text.substr(0, first));
+            rest.append(text.substr(last));
+            std::vector<std::string_view> words;
+            std::string_view remaining = rest.view();
+            int visible = 0;
+            for (size_t i = 0; i < remaining.size(); i++) {
+                size_t option = separators.find(remaining[i]);
+                if (option != std::string::npos) {
+                    out.fits[0].add(1 + option);
+                    visible++;
+                }
+            }
+            for (int i = visible; i < 2; i++) {
+                out.fits[0].add(0);
+            }
+
+            // Words are only separable when neither separator was empty
+            if (visible == 2) {
+                size_t start = 0;
+                for (size_t i = 0; i <= remaining.size(); i++) {
+                    if (i == remaining.size() || separators.find(remaining[i]) != std::string::npos) {
+                        words.push_back(remaining.substr(start, i - start));
+                        start = i + 1;
+                    }
+                }
+                size_t previous = 0;
+                for (size_t i = 0; i < words.size(); i++) {
+                    size_t bin = wordBin(words[i]);
+                    out.fits[4].add(bin);
+                    if (i > 0) out.tables[0].add(previous % kPairBins, bin % kPairBins);
+                    previous = bin;
+                }
+            }
+        };
+    }
+
+    static std::function<void(Counters&)> setupTemplate(PasswordGenerator& gen, Counters& counters) {
+        static const std::string separators = "-_.!@#";
+        auto components = std::make_shared<std::vector<PasswordGenerator::Component>>(
+            PasswordGenerator::parseTemplate("{word:lowercase}{sep}{chars:length=6;types=uppercase}{number:max=99;padding=2}"));
+
+        // fits: [0] separator, [1] characters, [2] number value, [3] word choice;
+        // tables: [0] characters by position, [1] adjacent characters
+        counters.fits.emplace_back("separator choice", uniform(separators.size()));
+        counters.fits.emplace_back("random characters", uniform(26));
+        counters.fits.emplace_back("number value", uniform(100));
+        counters.fits.emplace_back("word choice", wordShares(gen, 3, 10));
+        counters.tables.emplace_back("characters by position", 6, 26);
+        counters.tables.emplace_back("adjacent characters", 26, 26);
+
+        return [&gen, components](Counters& out) {
+            SecureString password = gen.buildCustomPassword(*components);
+            std::string_view text = password.view();
+            if (text.size() < 10) {
+                out.unparsed++;
+                return;
+            }
+            std::string_view number = text.substr(text.size() - 2);
+            std::string_view chars = text.substr(text.size() - 8, 6);
+            size_t option = separators.find(text[text.size() - 9]);
+            if (option == std::string::npos || !std::all_of(chars.begin(), chars.end(), ::isupper) ||
+                !std::all_of(number.begin(), number.end(), ::isdigit)) {
+                out.unparsed++;
+                return;
+            }
+
+            out.fits[0].add(option);
+            for (size_t i = 0; i < chars.size(); i++) {
+                out.fits[1].add(chars[i] - 'A');
+                out.tables[0].add(i, chars[i] - 'A');
+                if (i > 0) out.tables[1].add(chars[i - 1] - 'A', chars[i] - 'A');
+            }
+            out.fits[2].add((number[0] - '0') * 10 + (number[1] - '0'));
+            out.fits[3].add(wordBin(text.substr(0, text.size() - 9)));
+        };
+    }
+
+public:
+    explicit RandomnessAudit(PasswordGenerator& libraries) : source(libraries) {
+        modes["standard"] = setupStandard;
+        modes["memorable"] = setupMemorable;
+        modes["complex"] = setupComplex;
+        modes["template"] = setupTemplate;
+    }
+
+    std::vector<std::string> modeNames() const {
+        std::vector<std::string> names;
+        for (const auto& mode : modes) names.push_back(mode.first);
+        return names;
+    }
+
+    // Runs one mode on `threads` workers for `seconds`
+    ModeReport run(const std::string& mode, double seconds, unsigned threads = std::thread::hardware_concurrency()) {
+        auto setup = modes.find(mode);
+        if (setup == modes.end()) {
+            throw std::invalid_argument("Unknown audit mode '" + mode + "'");
+        }
+        threads = std::max(1u, threads);
+
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(seconds));
+        std::vector<Counters> results(threads);
+        std::vector<std::exception_ptr> failures(threads);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                try {
+                    PasswordGenerator gen;
+                    gen.shareLibraries(source);
+                    auto sample = setup->second(gen, results[t]);
+                    while (std::chrono::steady_clock::now() < deadline) {
+                        for (int i = 0; i < 256; i++) {
+                            sample(results[t]);
+                        }
+                        results[t].samples += 256;
+                    }
+                } catch (...) {
+                    failures[t] = std::current_exception();
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (auto& failure : failures) {
+            if (failure) std::rethrow_exception(failure);
+        }
+
+        for (unsigned t = 1; t < threads; t++) {
+            results[0].merge(results[t]);
+        }
+
+        ModeReport report;
+        report.mode = mode;
+        report.samples = results[0].samples;
+        report.unparsed = results[0].unparsed;
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (const auto& fit : results[0].fits) report.tests.push_back(fit.result());
+        for (const auto& table : results[0].tables) report.tests.push_back(table.result());
+        return report;
+    }
+};
+
+// Blocking TCP stream with a read buffer for line protocols. The buffer comes from the
+// secure pool, as lines carry passwords.
+class Socket {
+public:
+#ifdef _WIN32
+    using Handle = SOCKET;
+    static constexpr Handle kInvalid = INVALID_SOCKET;
+#else
+    using Handle = int;
+    static constexpr Handle kInvalid = -1;
+#endif
+    static constexpr size_t kMaxLine = 4096;
+
+private:
+    Handle handle = kInvalid;
+    SecureVector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+
+    explicit Socket(Handle native) : handle(native) {}
+
+    static void startup() {
+#ifdef _WIN32
+        static const bool started = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        if (!started) {
+            throw std::runtime_error("Cannot start Winsock");
+        }
+#endif
+    }
+
+    // Replies are single small lines, which Nagle's algorithm would hold back waiting
+    // for the peer's delayed acknowledgement
+    void configure() {
+        int one = 1;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+#ifdef SO_NOSIGPIPE
+        setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    }
+
+    static Socket open(const std::string& host, uint16_t port, bool listening) {
+        startup();
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        std::string service = std::to_string(port);
+        if (getaddrinfo(host.c_str(), service.c_str(), &hints, &found) != 0) {
+            throw std::runtime_error("Cannot resolve '" + host + "'");
+        }
+
+        Socket result;
+        for (addrinfo* address = found; address != nullptr && result.handle == kInvalid; address = address->ai_next) {
+            Socket candidate(::socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+            if (candidate.handle == kInvalid) {
+                continue;
+            }
+            bool ready;
+            if (listening) {
+#ifndef _WIN32
+                int one = 1;
+                setsockopt(candidate.handle, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+                ready = ::bind(candidate.handle, address->ai_addr, static_cast<socklen_t>(address->ai_addrlen)) == 0 &&
+                        ::listen(candidate.handle, SOMAXCONN) == 0;
+            } else {
+                ready = ::connect(candidate.handle, address->ai_addr, static_cast<socklen_t>(address->ai_addrlen)) == 0;
+            }
+            if (ready) {
+                result = std::move(candidate);
+            }
+        }
+        freeaddrinfo(found);
+
+        if (result.handle == kInvalid) {
+            throw std::runtime_error((listening ? "Cannot listen on " : "Cannot connect to ") + host + ":" + service);
+        }
+        if (!listening) {
+            result.configure();
+        }
+        return result;
+    }
+
+public:
+    Socket() = default;
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    Socket(Socket&& other) noexcept { *this = std::move(other); }
+
+    Socket& operator=(Socket&& other) noexcept {
+        if (this != &other) {
+            close();
+            handle = other.handle;
+            buffer = std::move(other.buffer);
+            begin = other.begin;
+            end = other.end;
+            other.handle = kInvalid;
+        }
+        return *this;
+    }
+
+    ~Socket() { close(); }
+
+    static Socket connect(const std::string& host, uint16_t port) {
+        return open(host, port, false);
+    }
+
+    static Socket listen(const std::string& host, uint16_t port) {
+        return open(host, port, true);
+    }
+
+    // Next connection; an invalid socket when the attempt failed on the client's side
+    Socket accept() {
+        Socket connection(::accept(handle, nullptr, nullptr));
+        if (connection.handle == kInvalid) {
+#ifdef _WIN32
+            int error = WSAGetLastError();
+            bool transient = error == WSAECONNRESET || error == WSAEINTR;
+#else
+            bool transient = errno == EINTR || errno == ECONNABORTED || errno == EPROTO;
+#endif
+            if (!transient) {
+                throw std::runtime_error("Cannot accept connections");
+            }
+            return connection;
+        }
+        connection.configure();
+        return connection;
+    }
+
+    bool valid() const {
+        return handle != kInvalid;
+    }
+
+    void close() {
+        if (handle != kInvalid) {
+#ifdef _WIN32
+            closesocket(handle);
+#else
+            ::close(handle);
+#endif
+            handle = kInvalid;
+        }
+    }
+
+    // Reads up to a newline, which is dropped with any '\r' before it. False when the
+    // peer closed the stream; a line longer than kMaxLine throws.
+    template <typename String>
+    bool readLine(String& line) {
+        if (buffer.empty()) {
+            buffer.resize(kMaxLine);
+        }
+        for (;;) {
+            const char* newline = static_cast<const char*>(std::memchr(buffer.data() + begin, '\n', end - begin));
+            if (newline != nullptr) {
+                size_t length = static_cast<size_t>(newline - (buffer.data() + begin));
+                if (length > 0 && buffer[begin + length - 1] == '\r') {
+                    length--;
+                }
+                line.assign(buffer.data() + begin, length);
+                begin = static_cast<size_t>(newline - buffer.data()) + 1;
+                return true;
+            }
+            if (begin > 0) {
+                std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (end == buffer.size()) {
+                throw std::length_error("Line longer than " + std::to_string(kMaxLine) + " bytes");
+            }
+#ifdef _WIN32
+            int received = ::recv(handle, buffer.data() + end, static_cast<int>(buffer.size() - end), 0);
+#else
+            ssize_t received = ::recv(handle, buffer.data() + end, buffer.size() - end, 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (received <= 0) {
+                return false;
+            }
+            end += static_cast<size_t>(received);
+        }
+    }
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            int sent = ::send(handle, data, static_cast<int>(std::min<size_t>(size, 1u << 30)), 0);
+#else
+#ifdef MSG_NOSIGNAL
+            ssize_t sent = ::send(handle, data, size, MSG_NOSIGNAL);
+#else
+            ssize_t sent = ::send(handle, data, size, 0);
+#endif
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (sent <= 0) {
+                throw std::runtime_error("Connection lost");
+            }
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+    }
+};
+
+// Serves generation and strength checks over a line protocol, one thread per connection:
+//   GEN SPEC         ->  OK PASSWORD
+//   CHECK PASSWORD   ->  OK SCORE LOG2_GUESSES STRENGTH   (log2 guesses -1 without a model)
+//   otherwise        ->  ERR MESSAGE
+// GEN is served from a PasswordPool per spec, shared by all connections. Connections past
+// the limit get "ERR Too many connections" and are closed.
+// Passwords travel in clear text, so bind it to the loopback interface.
+class PasswordService {
+public:
+    static constexpr size_t kPooledSpecs = 16;    // specs with a pool; others generate inline
+    static constexpr size_t kCachedSpecs = 64;    // compiled specs kept per connection
+    static constexpr size_t kMaxConnections = 256;
+
+    struct Counters {
+        std::atomic<uint64_t> connections{0};
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> refused{0};
+        std::atomic<size_t> active{0};
+    };
+
+private:
+    // Shared with the connection threads, which may outlive the service
+    struct Pools {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<PasswordPool>> by_spec;
+    };
+
+    PasswordGenerator& libraries;
+    Socket listener;
+    size_t max_connections;
+    std::shared_ptr<Counters> counters = std::make_shared<Counters>();
+    std::shared_ptr<Pools> pools = std::make_shared<Pools>();
+
+    // The pool for a spec, created on first use while there is room; null once the table
+    // is full, so a client cycling through specs cannot start unbounded producer threads
+    static std::shared_ptr<PasswordPool> poolFor(Pools& pools, PasswordGenerator& gen, const std::string& text) {
+        std::lock_guard<std::mutex> lock(pools.mutex);
+        auto found = pools.by_spec.find(text);
+        if (found != pools.by_spec.end()) {
+            return found->second;
+        }
+        if (pools.by_spec.size() >= kPooledSpecs) {
+            return nullptr;
+        }
+        auto pool = std::make_shared<PasswordPool>(gen, text);  // throws for a bad spec
+        pools.by_spec.emplace(text, pool);
+        return pool;
+    }
+
+    static void respond(PasswordGenerator& gen, Pools& pools,
+                        std::unordered_map<std::string, PasswordGenerator::GenerationSpec>& specs,
+                        const SecureString& request, SecureString& reply) {
+        std::string_view line = request.view();
+        if (line.compare(0, 4, "GEN ") == 0) {
+            std::string text(line.substr(4));
+            reply.assign("OK ");
+            if (std::shared_ptr<PasswordPool> pool = poolFor(pools, gen, text)) {
+                reply += pool->take();
+                return;
+            }
+            auto found = specs.find(text);
+            if (found == specs.end()) {
+                if (specs.size() >= kCachedSpecs) {
+                    specs.clear();
+                }
+                found = specs.emplace(text, gen.compileSpec(text)).first;
+            }
+            reply += gen.generate(found->second);
+        } else if (line.compare(0, 6, "CHECK ") == 0) {
+            PasswordGenerator::PasswordAnalysis analysis = gen.checkPasswordStrength(line.substr(6));
+            char fields[48];
+            std::snprintf(fields, sizeof(fields), "OK %d %.1f ", analysis.score, analysis.log2_guesses);
+            reply.assign(fields);
+            reply += analysis.strength;
+        } else {
+            throw std::invalid_argument("Expected GEN SPEC or CHECK PASSWORD");
+        }
+    }
+
+    // Owns everything it touches, so it can outlive the service that accepted it
+    static void serveConnection(Socket connection, std::unique_ptr<PasswordGenerator> gen,
+                                std::shared_ptr<Counters> counters, std::shared_ptr<Pools> pools) {
+        std::unordered_map<std::string, PasswordGenerator::GenerationSpec> specs;
+        SecureString request, reply;
+        try {
+            while (connection.readLine(request)) {
+                try {
+                    respond(*gen, *pools, specs, request, reply);
+                } catch (const std::exception& e) {
+                    reply.assign("ERR ");
+                    reply += e.what();
+                    std::replace(reply.begin(), reply.end(), '\n', ' ');
+                    counters->errors++;
+                }
+                counters->requests++;
+                reply += '\n';
+                connection.writeAll(reply.data(), reply.size());
+            }
+        } catch (const std::length_error& e) {
+            // Without a newline in sight the stream cannot be split into requests any more
+            reply.assign("ERR ");
+            reply += e.what();
+            reply += '\n';
+            try {
+                connection.writeAll(reply.data(), reply.size());
+            } catch (const std::exception&) {
+            }
+        } catch (const std::exception&) {
+            // The client went away mid-reply; nothing is left to tell it
+        }
+        counters->active--;
+    }
+
+public:
+    PasswordService(PasswordGenerator& source, const std::string& host, uint16_t port,
+                    size_t connection_limit = kMaxConnections)
+        : libraries(source), listener(Socket::listen(host, port)), max_connections(std::max<size_t>(connection_limit, 1)) {}
+
+    // Accepts connections until accepting fails
+    void run() {
+        for (;;) {
+            Socket connection = listener.accept();
+            if (!connection.valid()) {
+                continue;
+            }
+            if (counters->active.load() >= max_connections) {
+                static const char kBusy[] = "ERR Too many connections\n";
+                try {
+                    connection.writeAll(kBusy, sizeof(kBusy) - 1);
+                } catch (const std::exception&) {
+                }
+                counters->refused++;
+                continue;
+            }
+            std::unique_ptr<PasswordGenerator> gen(new PasswordGenerator());
+            gen->shareLibraries(libraries);
+            counters->connections++;
+            counters->active++;
+            try {
+                std::thread(serveConnection, std::move(connection), std::move(gen), counters, pools).detach();
+            } catch (const std::system_error&) {
+                counters->active--;  // out of threads; the connection closes unanswered
+            }
+        }
+    }
+
+    const Counters& stats() const {
+        return *counters;
+    }
+};
+
+// Latency histogram in the style of HdrHistogram: 128 linear buckets per power of two,
+// so a reported value is within 1% of the recorded ones, in fixed memory for any range.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 7;
+    static constexpr int kMaxBits = 40;  // nanoseconds up to 2^40, about 18 minutes
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t largest = 0;
+    double sum = 0;
+
+    static size_t indexOf(uint64_t value) {
+        int top = 63;
+        while (top > kSubBits && (value >> top) == 0) {
+            top--;
+        }
+        int shift = top - kSubBits;
+        return (static_cast<size_t>(shift) << kSubBits) + static_cast<size_t>(value >> shift);
+    }
+
+    static uint64_t lowest(size_t index) {
+        int shift = std::max(0, static_cast<int>(index >> kSubBits) - 1);
+        return static_cast<uint64_t>(index - (static_cast<size_t>(shift) << kSubBits)) << shift;
+    }
+
+public:
+    LatencyHistogram() : counts(static_cast<size_t>(kMaxBits - kSubBits + 1) << kSubBits, 0) {}
+
+    void record(uint64_t nanoseconds) {
+        nanoseconds = std::min<uint64_t>(nanoseconds, (1ull << kMaxBits) - 1);
+        counts[indexOf(nanoseconds)]++;
+        total++;
+        largest = std::max(largest, nanoseconds);
+        sum += static_cast<double>(nanoseconds);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        largest = std::max(largest, other.largest);
+        sum += other.sum;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t max() const {
+        return largest;
+    }
+
+    double mean() const {
+        return total > 0 ? sum / total : 0.0;
+    }
+
+    // Smallest value at or above `percent` of the recordings, as the top of its bucket
+    uint64_t percentile(double percent) const {
+        uint64_t rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * total));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(largest, lowest(i + 1) - 1);
+            }
+        }
+        return largest;
+    }
+};
+
+// Open-loop load for a PasswordService. Requests arrive as a Poisson process at the
+// target rate whatever the server is doing, and go out on whichever connection is free.
+// Latency runs from when a request was due rather than when it was sent, so a stall is
+// charged to every request queued behind it, not just the one that hit it (coordinated
+// omission). Time from send to reply is kept apart as service time.
+class LoadGenerator {
+public:
+    struct Profile {
+        std::string spec;  // "check" for a strength check
+        double weight = 1;
+    };
+
+    struct Report {
+        double seconds = 0;
+        uint64_t completed = 0;
+        uint64_t errors = 0;
+        uint64_t missed = 0;  // still unsent when the drain time ran out
+        LatencyHistogram latency;
+        LatencyHistogram service;
+        std::vector<LatencyHistogram> by_profile;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string host;
+    uint16_t port;
+    std::vector<Profile> mix;
+    double rate;
+    unsigned connections;
+
+    std::mutex schedule_mutex;
+    std::mt19937_64 schedule_rng{std::random_device{}()};
+    Clock::time_point next_due;
+
+    Clock::time_point nextDue() {
+        std::lock_guard<std::mutex> lock(schedule_mutex);
+        Clock::time_point due = next_due;
+        std::exponential_distribution<double> gap(rate);
+        next_due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap(schedule_rng)));
+        return due;
+    }
+
+    void drive(Socket& connection, Clock::time_point end, Clock::time_point give_up, Report& report) {
+        std::vector<double> weights;
+        for (const auto& profile : mix) {
+            weights.push_back(profile.weight);
+        }
+        std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+        std::mt19937 rng(std::random_device{}());
+
+        SecureString request, reply;
+        SecureString last_password("Password1!");
+        for (;;) {
+            Clock::time_point due = nextDue();
+            if (due >= end) {
+                return;
+            }
+            if (Clock::now() >= give_up) {
+                report.missed++;
+                continue;
+            }
+            size_t chosen = pick(rng);
+            const Profile& profile = mix[chosen];
+            request.assign(profile.spec == "check" ? "CHECK " : "GEN ");
+            request += profile.spec == "check" ? last_password.view() : std::string_view(profile.spec);
+            request += '\n';
+
+            std::this_thread::sleep_until(due);
+            Clock::time_point sent = Clock::now();
+            connection.writeAll(request.data(), request.size());
+            if (!connection.readLine(reply)) {
+                throw std::runtime_error("Server closed the connection");
+            }
+            Clock::time_point done = Clock::now();
+
+            if (reply.view().compare(0, 3, "OK ") != 0) {
+                report.errors++;
+                continue;
+            }
+            if (profile.spec != "check") {
+                last_password.assign(reply.data() + 3, reply.size() - 3);
+            }
+            uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(done - due).count();
+            report.latency.record(latency);
+            report.by_profile[chosen].record(latency);
+            report.service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count());
+            report.completed++;
+        }
+    }
+
+public:
+    LoadGenerator(std::string server_host, uint16_t server_port, std::vector<Profile> profiles, double requests_per_second,
+                  unsigned connection_count)
+        : host(std::move(server_host)), port(server_port), mix(std::move(profiles)), rate(requests_per_second),
+          connections(connection_count) {
+        if (mix.empty() || rate <= 0 || connections == 0) {
+            throw std::invalid_argument("Load needs a request mix, a positive rate and a connection");
+        }
+    }
+
+    // [WEIGHT:]SPEC, or [WEIGHT:]check for strength checks of generated passwords
+    static Profile parseProfile(const std::string& text) {
+        Profile profile;
+        profile.spec = text;
+        size_t colon = text.find(':');
+        if (colon != std::string::npos && colon > 0 &&
+            text.find_first_not_of("0123456789.") >= colon) {
+            profile.weight = std::stod(text.substr(0, colon));
+            profile.spec = text.substr(colon + 1);
+        }
+        if (profile.weight <= 0 || profile.spec.empty()) {
+            throw std::invalid_argument("Bad request profile '" + text + "'");
+        }
+        return profile;
+    }
+
+    static std::vector<Profile> defaultMix() {
+        return {{"standard:16", 30},
+                {"memorable:4", 20},
+                {"complex:3", 15},
+                {"template:{word:capitalize}{sep:options=-,.}{number:max=99;padding=2}", 15},
+                {"check", 20}};
+    }
+
+    const std::vector<Profile>& profiles() const {
+        return mix;
+    }
+
+    // Sends load for `seconds`, then waits up to `drain` seconds for queued requests
+    Report run(double seconds, double drain) {
+        std::vector<Socket> sockets;
+        for (unsigned c = 0; c < connections; c++) {
+            sockets.push_back(Socket::connect(host, port));
+        }
+
+        std::vector<Report> reports(connections);
+        for (auto& report : reports) {
+            report.by_profile.resize(mix.size());
+        }
+        std::vector<std::exception_ptr> errors(connections);
+        std::vector<std::thread> threads;
+
+        Clock::time_point start = Clock::now();
+        next_due = start;
+        Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        Clock::time_point give_up = end + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(drain));
+        for (unsigned c = 0; c < connections; c++) {
+            threads.emplace_back([&, c] {
+                try {
+                    drive(sockets[c], end, give_up, reports[c]);
+                } catch (...) {
+                    errors[c] = std::current_exception();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        Report total = std::move(reports[0]);
+        for (unsigned c = 1; c < connections; c++) {
+            total.completed += reports[c].completed;
+            total.errors += reports[c].errors;
+            total.missed += reports[c].missed;
+            total.latency.merge(reports[c].latency);
+            total.service.merge(reports[c].service);
+            for (size_t p = 0; p < mix.size(); p++) {
+                total.by_profile[p].merge(reports[c].by_profile[p]);
+            }
+        }
+        total.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return total;
+    }
+};
+
+class UserInterface {
+private:
+    PasswordGenerator gen;
+    std::map<std::string, std::unique_ptr<PasswordPool>> pools;   // quick generation, by spec
+
+    // Started on first use, so later requests for the same type are served pre-generated
+    PasswordPool& pool(const std::string& spec) {
+        std::unique_ptr<PasswordPool>& entry = pools[spec];
+        if (!entry) {
+            entry.reset(new PasswordPool(gen, spec, 32));
+        }
+        return *entry;
+    }
+
+public:
+    bool askYesNo(const std::string& prompt, bool default_value = true) {
+        std::string default_text = default_value ? "y" : "n";
+        std::string input;
+
+        while (true) {
+            std::cout << prompt << " (y/n, default " << default_text << "): ";
+            std::getline(std::cin, input);
+
+            if (input.empty()) {
+                return default_value;
+            }
+
+            std::transform(input.begin(), input.end(), input.begin(), ::tolower);
+
+            if (input == "y" || input == "yes") {
+                return true;
+            } else if (input == "n" || input == "no") {
+                return false;
+            } else {
+                std::cout << "Please enter 'y' or 'n'\n";
+            }
+        }
+    }
+
+    int askNumber(const std::string& prompt, int min_val = 1, int max_val = 100, int default_val = -1) {
+        std::string input;
+
+        while (true) {
+            if (default_val != -1) {
+                std::cout << prompt << " (default " << default_val << "): ";
+            } else {
+                std::cout << prompt << ": ";
+            }
+
+            std::getline(std::cin, input);
+
+            if (input.empty() && default_val != -1) {
+                return default_val;
+            }
+
+            try {
+                int value = std::stoi(input);
+                if (value >= min_val && value <= max_val) {
+                    return value;
+                } else {
+                    std::cout << "Value must be between " << min_val << " and " << max_val << "\n";
+                }
+            } catch (const std::exception&) {
+                std::cout << "Please enter a valid number\n";
+            }
+        }
+    }
+
+    std::string askString(const std::string& prompt, const std::string& default_val = "") {
+        std::string input;
+
+        if (!default_val.empty()) {
+            std::cout << prompt << " (default '" << default_val << "'): ";
+        } else {
+            std::cout << prompt << ": ";
+        }
+
+        std::getline(std::cin, input);
+
+        return input.empty() && !default_val.empty() ? default_val : input;
+    }
+
+    void showMenu() {
+        std::cout << "\n" << std::string(50, '=') << "\n";
+        std::cout << "           PASSWORD GENERATOR\n";
+        std::cout << std::string(50, '=') << "\n";
+        std::cout << "1. Standard password\n";
+        std::cout << "2. Memorable password\n";
+        std::cout << "3. Complex memorable password\n";
+        std::cout << "4. Custom password builder\n";
+        std::cout << "5. Multiple passwords\n";
+        std::cout << "6. Check password strength\n";
+        std::cout << "7. Quick generation\n";
+        std::cout << "8. Generate by complexity level\n";
+        std::cout << "9. Generate by target entropy\n";
+        std::cout << "10. Pronounceable password\n";
+        std::cout << "0. Exit\n";
+        std::cout << std::string(50, '=') << "\n";
+    }
+
+    // Interactive component editor shared by the custom builder; false when cancelled
+    bool askComponents(std::vector<PasswordGenerator::Component>& components) {
+        std::cout << "\nAvailable component types:\n";
+        std::cout << "1. Text (fixed string)\n";
+        std::cout << "2. Random word\n";
+        std::cout << "3. Random characters\n";
+        std::cout << "4. Number\n";
+        std::cout << "5. Separator\n";
+
+        while (true) {
+            std::cout << "\n--- Component #" << (components.size() + 1) << " ---\n";
+            std::cout << "Choose component type:\n";
+            std::cout << "1. Text\n";
+            std::cout << "2. Random word\n";
+            std::cout << "3. Random characters\n";
+            std::cout << "4. Number\n";
+            std::cout << "5. Separator\n";
+            std::cout << "6. Finish and create password\n";
+            std::cout << "0. Cancel\n";
+
+            int choice = askNumber("Your choice", 0, 6);
+
+            if (choice == 0) {
+                return false;
+            } else if (choice == 6) {
+                break;
+            } else if (choice == 1) {
+                // Text component
+                std::string text = askString("Enter text");
+                if (!text.empty()) {
+                    PasswordGenerator::Component comp(PasswordGenerator::Component::TEXT);
+                    comp.value = text;
+                    components.push_back(comp);
+                }
+
+            } else if (choice == 2) {
+                // Random word component
+                std::cout << "\nWord settings:\n";
+                int min_len = askNumber("Minimum word length", 2, 15, 4);
+                int max_len = askNumber("Maximum word length", min_len, 20, 8);
+
+                std::cout << "\nTransformation:\n";
+                std::cout << "1. No changes\n";
+                std::cout << "2. Capitalize first letter\n";
+                std::cout << "3. All uppercase\n";
+                std::cout << "4. All lowercase\n";
+                std::cout << "5. Random case\n";
+
+                int transform = askNumber("Choose transformation", 1, 5, 2);
+
+                PasswordGenerator::Component comp(PasswordGenerator::Component::WORD);
+                comp.config["min_length"] = std::to_string(min_len);
+                comp.config["max_length"] = std::to_string(max_len);
+                comp.config["capitalize"] = (transform == 2) ? "true" : "false";
+                comp.config["uppercase"] = (transform == 3) ? "true" : "false";
+                comp.config["lowercase"] = (transform == 4) ? "true" : "false";
+                comp.config["random_case"] = (transform == 5) ? "true" : "false";
+
+                if (askYesNo("Add letter to number replacements (a->4, e->3, etc)?", false)) {
+                    comp.config["replacements"] = "true";
+                }
+
+                components.push_back(comp);
+
+            } else if (choice == 3) {
+                // Random characters component
+                int length = askNumber("Length", 1, 20, 4);
+
+                std::cout << "\nCharacter types:\n";
+                std::vector<std::string> types;
+                if (askYesNo("Lowercase letters?", true)) {
+                    types.push_back("lowercase");
+                }
+                if (askYesNo("Uppercase letters?", true)) {
+                    types.push_back("uppercase");
+                }
+                if (askYesNo("Digits?", true)) {
+                    types.push_back("digits");
+                }
+                if (askYesNo("Special characters?", false)) {
+                    types.push_back("special");
+                }
+
+                if (!types.empty()) {
+                    PasswordGenerator::Component comp(PasswordGenerator::Component::RANDOM_CHARS);
+                    comp.config["length"] = std::to_string(length);
+
+                    std::string types_str;
+                    for (size_t i = 0; i < types.size(); i++) {
+                        types_str += types[i];
+                        if (i < types.size() - 1) types_str += ",";
+                    }
+                    comp.config["types"] = types_str;
+
+                    components.push_back(comp);
+                }
+
+            } else if (choice == 4) {
+                // Number component
+                int min_val = askNumber("Minimum value", 0, 999999, 0);
+                int max_val = askNumber("Maximum value", min_val, 999999, 999);
+                int padding = askNumber("Pad with zeros to length (0 = no padding)", 0, 10, 0);
+
+                PasswordGenerator::Component comp(PasswordGenerator::Component::NUMBER);
+                comp.config["min"] = std::to_string(min_val);
+                comp.config["max"] = std::to_string(max_val);
+                comp.config["padding"] = std::to_string(padding);
+
+                components.push_back(comp);
+
+            } else if (choice == 5) {
+                // Separator component
+                std::cout << "\nChoose separator:\n";
+                std::cout << "1. Hyphen (-)\n";
+                std::cout << "2. Underscore (_)\n";
+                std::cout << "3. Dot (.)\n";
+                std::cout << "4. Exclamation (!)\n";
+                std::cout << "5. At sign (@)\n";
+                std::cout << "6. Hash (#)\n";
+                std::cout << "7. Random from all\n";
+                std::cout << "8. Custom\n";
+
+                int sep_choice = askNumber("Choice", 1, 8, 7);
+
+                PasswordGenerator::Component comp(PasswordGenerator::Component::SEPARATOR);
+
+                if (sep_choice == 8) {
+                    std::string custom_seps = askString("Enter possible separators (space-separated)");
+                    std::istringstream iss(custom_seps);
+                    std::string sep;
+                    while (iss >> sep) {
+                        comp.options.push_back(sep);
+                    }
+                } else {
+                    std::vector<std::vector<std::string>> sep_options = {
+                        {"-"}, {"_"}, {"."}, {"!"}, {"@"}, {"#"},
+                        {"-", "_", ".", "!", "@", "#"}
+                    };
+                    comp.options = sep_options[sep_choice - 1];
+                }
+
+                components.push_back(comp);
+            }
+
+            std::cout << "✓ Component added! Total components: " << components.size() << "\n";
+        }
+
+        return true;
+    }
+
+    void buildCustomPasswordInteractive() {
+        std::cout << "\n--- CUSTOM PASSWORD BUILDER ---\n";
+        std::cout << "Build a password from components of your choice!\n";
+
+        std::vector<PasswordGenerator::Component> components;
+        if (!askComponents(components)) {
+            return;
+        }
+
+        if (components.empty()) {
+            std::cout << "No components added\n";
+            return;
+        }
+
+        std::cout << "\nCreating password from " << components.size() << " components...\n";
+
+        // Generate multiple variants
+        SecureStringList passwords;
+        for (int i = 0; i < 3; i++) {
+            SecureString password = gen.buildCustomPassword(components);
+            passwords.push_back(password);
+
+            auto analysis = gen.checkPasswordStrength(password);
+            std::cout << "\n" << (i + 1) << ". " << password << "\n";
+            std::cout << "   Strength: " << analysis.strength << " | Length: " << analysis.length
+                      << " | Score: " << analysis.score << "\n";
+        }
+
+        if (askYesNo("\nSave one of the passwords?", true)) {
+            int choice = askNumber("Choose password to save (1-3)", 1, 3, 1);
+            savePasswordToFile(passwords[choice - 1]);
+        }
+    }
+
+    // Turns class shares given in percent into policy weights; classes left blank split
+    // the remaining share in proportion to their size
+    void askWeights(PasswordGenerator::PasswordPolicy& policy) {
+        std::vector<std::pair<std::string, double*>> entries;
+        if (policy.use_lowercase) entries.push_back({"lowercase letters", &policy.weight_lowercase});
+        if (policy.use_uppercase) entries.push_back({"uppercase letters", &policy.weight_uppercase});
+        if (policy.use_digits) entries.push_back({"digits", &policy.weight_digits});
+        if (policy.use_special) entries.push_back({"special characters", &policy.weight_special});
+        std::vector<PasswordGenerator::CharacterClass> classes = gen.policyClasses(policy);
+
+        std::cout << "\nShare of each type in percent (blank = natural share):\n";
+        std::vector<double> shares;
+        double specified = 0.0, unspecified_size = 0.0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            std::string input = askString("Share of " + entries[i].first + " (%)");
+            double share = -1.0;
+            if (!input.empty()) {
+                try {
+                    share = std::stod(input);
+                } catch (const std::exception&) {
+                    std::cout << "Not a number, using natural share\n";
+                }
+            }
+            if (share >= 0.0) {
+                specified += share;
+            } else {
+                unspecified_size += classes[i].chars.size();
+            }
+            shares.push_back(share);
+        }
+
+        if (specified > 100.0 || (specified >= 100.0 && unspecified_size > 0)) {
+            throw std::invalid_argument("Shares leave nothing for the remaining types");
+        }
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            *entries[i].second = shares[i] >= 0.0 ? shares[i]
+                                                   : (100.0 - specified) * classes[i].chars.size() / unspecified_size;
+            if (*entries[i].second == 0.0) {
+                throw std::invalid_argument("Disable a character type instead of giving it a 0% share");
+            }
+        }
+
+        std::string per_char = askString("Per-character weights, e.g. 'a=3 7=0' (blank = none)");
+        std::istringstream iss(per_char);
+        std::string item;
+        while (iss >> item) {
+            if (item.size() < 3 || item[1] != '=') {
+                std::cout << "Skipping '" << item << "'\n";
+                continue;
+            }
+            policy.char_weights[item[0]] = std::stod(item.substr(2));
+        }
+    }
+
+    void createStandardPassword() {
+        std::cout << "\n--- STANDARD PASSWORD ---\n";
+
+        if (askYesNo("Use your own alphabet (any Unicode characters)?", false)) {
+            createAlphabetPassword();
+            return;
+        }
+
+        int length = askNumber("Password length", 4, 128, 12);
+
+        std::cout << "\nCharacter types:\n";
+        bool use_uppercase = askYesNo("Use uppercase letters (A-Z)?", true);
+        bool use_lowercase = askYesNo("Use lowercase letters (a-z)?", true);
+        bool use_digits = askYesNo("Use digits (0-9)?", true);
+        bool use_special = askYesNo("Use special characters (!@#$%^&*)?", true);
+
+        if (!use_uppercase && !use_lowercase && !use_digits && !use_special) {
+            std::cout << "At least one character type must be selected. Enabling all types.\n";
+            use_uppercase = use_lowercase = use_digits = use_special = true;
+        }
+
+        bool exclude_ambiguous = askYesNo("Exclude ambiguous characters (i,l,1,L,o,0,O)?", false);
+
+        std::cout << "\nMinimum requirements (0 = not required):\n";
+        PasswordGenerator::PasswordPolicy policy;
+        policy.length = length;
+        policy.use_uppercase = use_uppercase;
+        policy.use_lowercase = use_lowercase;
+        policy.use_digits = use_digits;
+        policy.use_special = use_special;
+        policy.exclude_ambiguous = exclude_ambiguous;
+        policy.min_uppercase = use_uppercase ? askNumber("Minimum uppercase letters", 0, length / 2, 1) : 0;
+        policy.min_lowercase = use_lowercase ? askNumber("Minimum lowercase letters", 0, length / 2, 1) : 0;
+        policy.min_digits = use_digits ? askNumber("Minimum digits", 0, length / 2, 1) : 0;
+        policy.min_special = use_special ? askNumber("Minimum special characters", 0, length / 2, 1) : 0;
+
+        try {
+            if (askYesNo("Customize character weights?", false)) {
+                askWeights(policy);
+            }
+
+            SecureString password = gen.generatePassword(policy);
+
+            std::cout << "\nGenerated password: " << password << "\n";
+            std::cout << "Entropy: " << std::fixed << std::setprecision(1) << gen.passwordEntropy(policy) << " bits\n";
+
+            auto analysis = gen.checkPasswordStrength(password);
+            std::cout << "Password strength: " << analysis.strength << " (score: " << analysis.score << ")\n";
+
+            if (askYesNo("\nSave password to file?", false)) {
+                savePasswordToFile(password);
+            }
+
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << "\n";
+        }
+    }
+
+    void createAlphabetPassword() {
+        try {
+            Utf8Alphabet alphabet(askString("Alphabet (every character once, e.g. αβγδ0123)"));
+            if (askYesNo("Exclude some characters?", false)) {
+                alphabet = alphabet.without(askString("Characters to exclude"));
+            }
+
+            bool in_bytes = askYesNo("Limit the length in bytes instead of characters?", false);
+            int length = in_bytes ? askNumber("Maximum bytes", 4, 512, 32) : askNumber("Password length", 4, 128, 12);
+
+            PasswordGenerator::GenerationInfo info;
+            SecureString password = gen.generateAlphabetPassword(
+                alphabet, length, in_bytes ? Utf8Alphabet::BYTES : Utf8Alphabet::CODEPOINTS, &info);
+
+            std::cout << "\nGenerated password: " << password << "\n";
+            std::cout << "Alphabet: " << alphabet.size() << " characters\n";
+            std::cout << "Entropy: " << std::fixed << std::setprecision(1) << info.entropy_bits << " bits ("
+                      << password.size() << " bytes)\n";
+
+            auto analysis = gen.checkPasswordStrength(password);
+            std::cout << "Password strength: " << analysis.strength << " (score: " << analysis.score << ")\n";
+
+            if (askYesNo("\nSave password to file?", false)) {
+                savePasswordToFile(password);
+            }
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << "\n";
+        }
+    }
+
+    void createMemorablePassword() {
+        std::cout << "\n--- MEMORABLE PASSWORD ---\n";
+
+        int num_words = askNumber("Number of words", 2, 8, 4);
+
+        std::cout << "\nChoose separator:\n";
+        std::cout << "1. Hyphen (-)\n";
+        std::cout << "2. Underscore (_)\n";
+        std::cout << "3. Dot (.)\n";
+        std::cout << "4. No separator\n";
+
+        int separator_choice = askNumber("Choose option", 1, 4, 1);
+        std::vector<std::string> separators = {"-", "_", ".", ""};
+        std::string separator = separators[separator_choice - 1];
+
+        bool capitalize = askYesNo("Capitalize first letters?", true);
+        bool add_numbers = askYesNo("Add numbers at the end?", true);
+
+        int word_min_length = askNumber("Minimum word length", 3, 10, 4);
+        int word_max_length = askNumber("Maximum word length", word_min_length, 15, 8);
+
+        SecureString password = gen.generateMemorablePassword(num_words, separator, add_numbers,
+                                                            capitalize, word_min_length, word_max_length);
+
+        std::cout << "\nGenerated password: " << password << "\n";
+
+        auto analysis = gen.checkPasswordStrength(password);
+        std::cout << "Password strength: " << analysis.strength << " (score: " << analysis.score << ")\n";
+
+        if (askYesNo("\nSave password to file?", false)) {
+            savePasswordToFile(password);
+        }
+    }
+
+    void createComplexMemorablePassword() {
+        std::cout << "\n--- COMPLEX MEMORABLE PASSWORD ---\n";
+
+        int num_words = askNumber("Number of words", 2, 6, 3);
+        bool add_special_chars = askYesNo("Add special characters?", true);
+        bool add_numbers = askYesNo("Add numbers?", true);
+        bool transform_words = askYesNo("Apply word transformations (letter to number replacements)?", true);
+        int min_length = askNumber("Minimum password length", 12, 50, 16);
+
+        std::cout << "\nGenerating options...\n";
+
+        SecureStringList passwords;
+        for (int i = 0; i < 3; i++) {
+            SecureString password = gen.generateComplexMemorablePassword(num_words, add_special_chars,
+                                                                       add_numbers, transform_words, min_length);
+            passwords.push_back(password);
+
+            auto analysis = gen.checkPasswordStrength(password);
+            std::cout << "\n" << (i + 1) << ". " << password << "\n";
+            std::cout << "   Strength: " << analysis.strength << " | Length: " << analysis.length
+                      << " | Score: " << analysis.score << "\n";
+        }
+
+        int choice = askNumber("\nChoose password to save (1-3, 0 = don't save)", 0, 3, 0);
+
+        if (choice > 0) {
+            std::cout << "\nSelected password: " << passwords[choice - 1] << "\n";
+
+            if (askYesNo("Save password to file?", false)) {
+                savePasswordToFile(passwords[choice - 1]);
+            }
+        }
+    }
 
-        while (true) {
-            std::cout << "\n--- Component #" << (components.size() + 1) << " ---\n";
-            std::cout << "Choose component type:\n";
-            std::cout << "1. Text\n";
-            std::cout << "2. Random word\n";
-            std::cout << "3. Random characters\n";
-            std::cout << "4. Number\n";
-            std::cout << "5. Separator\n";
-            std::cout << "6. Finish and create password\n";
-            std::cout << "0. Cancel\n";
+    void createPasswordByComplexity() {
+        std::cout << "\n--- PASSWORD BY COMPLEXITY LEVEL ---\n";
+        std::cout << "Choose complexity level from 1 to 10:\n\n";
 
-            int choice = askNumber("Your choice", 0, 6);
+        for (int i = 1; i <= 10; i++) {
+            std::cout << std::setw(2) << i << ". " << gen.getComplexityDescription(i) << "\n";
+        }
 
-            if (choice == 0) {
-                return;
-            } else if (choice == 6) {
-                break;
-            } else if (choice == 1) {
-                // Text component
-                std::string text = askString("Enter text");
-                if (!text.empty()) {
-                    PasswordGenerator::Component comp(PasswordGenerator::Component::TEXT);
-                    comp.value = text;
-                    components.push_back(comp);
+        std::cout << "\n";
+        int complexity = askNumber("Choose complexity level", 1, 10, 5);
+
+        std::cout << "\nSelected level: " << gen.getComplexityDescription(complexity) << "\n";
+
+        int count = askNumber("Number of password variants", 1, 10, 3);
+
+        std::cout << "\nGenerated passwords (complexity level " << complexity << "):\n";
+        SecureStringList passwords;
+
+        // The policy guarantees every enabled class, so the composition needs no analysis
+        PasswordGenerator::PasswordPolicy policy = gen.getComplexityPolicy(complexity);
+        std::vector<std::string> composition;
+        if (policy.use_lowercase) composition.push_back("lowercase");
+        if (policy.use_uppercase) composition.push_back("uppercase");
+        if (policy.use_digits) composition.push_back("digits");
+        if (policy.use_special) composition.push_back("special");
+
+        for (int i = 0; i < count; i++) {
+            try {
+                PasswordGenerator::GenerationInfo info;
+                SecureString password = gen.generatePasswordByComplexity(complexity, &info);
+                passwords.push_back(password);
+
+                std::cout << "\n" << (i + 1) << ". " << password << "\n";
+                std::cout << "   Entropy: " << std::fixed << std::setprecision(1) << info.entropy_bits
+                          << " bits | Length: " << password.length() << "\n";
+
+                std::cout << "   Composition: ";
+                for (size_t j = 0; j < composition.size(); j++) {
+                    std::cout << composition[j];
+                    if (j < composition.size() - 1) std::cout << ", ";
                 }
+                std::cout << "\n";
 
-            } else if (choice == 2) {
-                // Random word component
-                std::cout << "\nWord settings:\n";
-                int min_len = askNumber("Minimum word length", 2, 15, 4);
-                int max_len = askNumber("Maximum word length", min_len, 20, 8);
+            } catch (const std::exception& e) {
+                std::cout << "Error generating password " << (i + 1) << ": " << e.what() << "\n";
+            }
+        }
 
-                std::cout << "\nTransformation:\n";
-                std::cout << "1. No changes\n";
-                std::cout << "2. Capitalize first letter\n";
-                std::cout << "3. All uppercase\n";
-                std::cout << "4. All lowercase\n";
-                std::cout << "5. Random case\n";
+        if (!passwords.empty()) {
+            if (askYesNo("\nSave passwords to file?", false)) {
+                savePasswordsToFile(passwords);
+            }
 
-                int transform = askNumber("Choose transformation", 1, 5, 2);
+            if (passwords.size() > 1 && askYesNo("Save one selected password separately?", false)) {
+                int choice = askNumber("Choose password (1-" + std::to_string(passwords.size()) + ")",
+                                     1, passwords.size());
+                savePasswordToFile(passwords[choice - 1]);
+            }
+        }
+    }
 
-                PasswordGenerator::Component comp(PasswordGenerator::Component::WORD);
-                comp.config["min_length"] = std::to_string(min_len);
-                comp.config["max_length"] = std::to_string(max_len);
-                comp.config["capitalize"] = (transform == 2) ? "true" : "false";
-                comp.config["uppercase"] = (transform == 3) ? "true" : "false";
-                comp.config["lowercase"] = (transform == 4) ? "true" : "false";
-                comp.config["random_case"] = (transform == 5) ? "true" : "false";
+    void createPasswordByEntropy() {
+        std::cout << "\n--- PASSWORD BY TARGET ENTROPY ---\n";
+
+        int target_bits = askNumber("Target entropy in bits", 16, 512, 80);
+
+        std::cout << "\nChoose password type:\n";
+        std::cout << "1. Standard password\n";
+        std::cout << "2. Memorable password\n";
+        std::cout << "3. Complex memorable password\n";
+        std::cout << "4. Custom template\n";
+
+        int password_type = askNumber("Choose type", 1, 4, 1);
+
+        try {
+            SecureStringList passwords;
+
+            if (password_type == 1) {
+                PasswordGenerator::PasswordPolicy policy;
+                policy.use_uppercase = askYesNo("Use uppercase letters (A-Z)?", true);
+                policy.use_lowercase = askYesNo("Use lowercase letters (a-z)?", true);
+                policy.use_digits = askYesNo("Use digits (0-9)?", true);
+                policy.use_special = askYesNo("Use special characters (!@#$%^&*)?", true);
+                policy.exclude_ambiguous = askYesNo("Exclude ambiguous characters (i,l,1,L,o,0,O)?", false);
+
+                std::cout << "\nMinimum requirements (0 = not required):\n";
+                policy.min_uppercase = policy.use_uppercase ? askNumber("Minimum uppercase letters", 0, 16, 1) : 0;
+                policy.min_lowercase = policy.use_lowercase ? askNumber("Minimum lowercase letters", 0, 16, 1) : 0;
+                policy.min_digits = policy.use_digits ? askNumber("Minimum digits", 0, 16, 1) : 0;
+                policy.min_special = policy.use_special ? askNumber("Minimum special characters", 0, 16, 1) : 0;
+
+                policy = gen.sizePasswordPolicy(policy, target_bits);
+                std::cout << "\nShortest length: " << policy.length << " characters ("
+                          << std::fixed << std::setprecision(1) << gen.passwordEntropy(policy) << " bits, keyspace "
+                          << gen.passwordKeyspace(policy).toString() << ")\n";
+
+                for (int i = 0; i < 3; i++) {
+                    passwords.push_back(gen.generatePassword(policy));
+                }
+            } else if (password_type == 2) {
+                bool capitalize = askYesNo("Capitalize first letters?", true);
+                bool add_numbers = askYesNo("Add numbers at the end?", true);
+                int word_min_length = askNumber("Minimum word length", 3, 10, 4);
+                int word_max_length = askNumber("Maximum word length", word_min_length, 15, 8);
+
+                int num_words = gen.sizeMemorableWords(target_bits, add_numbers, word_min_length, word_max_length);
+                std::cout << "\nShortest configuration: " << num_words << " words ("
+                          << std::fixed << std::setprecision(1)
+                          << gen.memorableEntropy(num_words, add_numbers, word_min_length, word_max_length) << " bits)\n";
+
+                for (int i = 0; i < 3; i++) {
+                    passwords.push_back(gen.generateMemorablePassword(num_words, "-", add_numbers, capitalize,
+                                                                      word_min_length, word_max_length));
+                }
+            } else if (password_type == 3) {
+                bool add_special_chars = askYesNo("Add special characters?", true);
+                bool add_numbers = askYesNo("Add numbers?", true);
+                bool transform_words = askYesNo("Apply word transformations (letter to number replacements)?", true);
+
+                int num_words = gen.sizeComplexMemorableWords(target_bits, add_special_chars, add_numbers, transform_words);
+                std::cout << "\nShortest configuration: " << num_words << " words ("
+                          << std::fixed << std::setprecision(1)
+                          << gen.complexMemorableEntropy(num_words, add_special_chars, add_numbers, transform_words)
+                          << " bits)\n";
+
+                for (int i = 0; i < 3; i++) {
+                    passwords.push_back(gen.generateComplexMemorablePassword(num_words, add_special_chars,
+                                                                             add_numbers, transform_words, 0));
+                }
+            } else {
+                std::vector<PasswordGenerator::Component> components;
+                if (!askComponents(components) || components.empty()) {
+                    return;
+                }
+
+                components = gen.sizeCustomTemplate(components, target_bits);
+                std::cout << "\nTemplate entropy: " << std::fixed << std::setprecision(1)
+                          << gen.customEntropy(components) << " bits\n";
+
+                for (int i = 0; i < 3; i++) {
+                    passwords.push_back(gen.buildCustomPassword(components));
+                }
+            }
+
+            std::cout << "\nGenerated passwords:\n";
+            for (size_t i = 0; i < passwords.size(); i++) {
+                std::cout << (i + 1) << ". " << passwords[i] << "\n";
+            }
+
+            int choice = askNumber("\nChoose password to save (1-3, 0 = don't save)", 0, 3, 0);
+            if (choice > 0) {
+                savePasswordToFile(passwords[choice - 1]);
+            }
+
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << "\n";
+        }
+    }
+
+    void createPronounceablePassword() {
+        std::cout << "\n--- PRONOUNCEABLE PASSWORD ---\n";
+
+        int length = askNumber("Password length", 6, 64, 12);
+        bool capitalize = askYesNo("Capitalize first letter?", true);
+        bool add_numbers = askYesNo("Add two digits at the end?", true);
+        int count = askNumber("Number of password variants", 1, 10, 3);
+
+        std::cout << "\nAverage entropy for these settings: " << std::fixed << std::setprecision(1)
+                  << gen.pronounceableEntropy(length, add_numbers) << " bits\n";
+        std::cout << "\nGenerated passwords:\n";
+
+        SecureStringList passwords;
+        for (int i = 0; i < count; i++) {
+            PasswordGenerator::GenerationInfo info;
+            passwords.push_back(gen.generatePronounceablePassword(length, capitalize, add_numbers, &info));
+            std::cout << (i + 1) << ". " << passwords.back() << " | " << std::setprecision(1)
+                      << info.entropy_bits << " bits\n";
+        }
+
+        int choice = askNumber("\nChoose password to save (0 = don't save)", 0, count, 0);
+        if (choice > 0) {
+            savePasswordToFile(passwords[choice - 1]);
+        }
+    }
+
+    void createMultiplePasswords() {
+        std::cout << "\n--- MULTIPLE PASSWORDS ---\n";
+
+        int count = askNumber("Number of passwords to generate", 1, 50, 5);
+
+        std::cout << "\nChoose password type:\n";
+        std::cout << "1. Standard passwords\n";
+        std::cout << "2. Memorable passwords\n";
+        std::cout << "3. Complex memorable passwords\n";
+
+        int password_type = askNumber("Choose type", 1, 3, 1);
+
+        int length = 0, num_words = 0;
+        if (password_type == 1) {
+            length = askNumber("Password length", 4, 128, 12);
+        } else if (password_type == 2) {
+            num_words = askNumber("Number of words", 2, 8, 4);
+        } else {
+            num_words = askNumber("Number of words", 2, 6, 3);
+        }
+        int min_score = askNumber("Minimum strength score (0 = any)", 0, 12, 0);
+
+        // The stream is lazy, so info always describes the password it just yielded
+        PasswordGenerator::GenerationInfo info;
+        PasswordStream stream(gen, [this, &info, password_type, length, num_words] {
+            if (password_type == 1) {
+                return gen.generatePassword(length, true, true, true, true, false, 1, 1, 1, 1, &info);
+            } else if (password_type == 2) {
+                return gen.generateMemorablePassword(num_words, "-", true, true, 3, 8, &info);
+            }
+            return gen.generateComplexMemorablePassword(num_words, true, true, true, 16, &info);
+        });
+        stream.unique().take(count);
+        if (min_score > 0) {
+            stream.minScore(min_score);
+        }
+
+        std::cout << "\nGenerated passwords:\n";
+        SecureStringList passwords;
+        try {
+            for (const SecureString& password : stream) {
+                passwords.push_back(password);
+                std::cout << std::setw(2) << passwords.size() << ". " << password << " | " << std::fixed
+                          << std::setprecision(1) << info.entropy_bits << " bits\n";
+            }
+        } catch (const std::exception& e) {
+            std::cout << "Stopped after " << passwords.size() << " passwords: " << e.what() << "\n";
+        }
+
+        if (!passwords.empty() && askYesNo("\nSave all passwords to file?", false)) {
+            savePasswordsToFile(passwords);
+        }
+    }
+
+    void checkPasswordStrength() {
+        std::cout << "\n--- PASSWORD STRENGTH CHECK ---\n";
+
+        std::string password = askString("Enter password to check");
+
+        if (password.empty()) {
+            std::cout << "Password cannot be empty\n";
+            return;
+        }
+
+        auto analysis = gen.checkPasswordStrength(password);
+
+        std::cout << "\nPASSWORD ANALYSIS: '" << password << "'\n";
+        std::cout << std::string(50, '=') << "\n";
+        std::cout << "Password strength: " << analysis.strength << "\n";
+        std::cout << "Length: " << analysis.length << " characters\n";
+        std::cout << "Score: " << analysis.score << "/15\n";
+        std::cout << "Unique characters: " << analysis.unique_chars << "\n";
+        if (analysis.feedback_flags & PasswordGenerator::PasswordAnalysis::KEYBOARD_WALK) {
+            std::cout << "Keyboard walk: " << analysis.keyboard_walk << " keys on " << analysis.walk_layout << "\n";
+        }
+        if (analysis.log2_guesses >= 0.0) {
+            std::cout << "Estimated guesses: 2^" << std::fixed << std::setprecision(1) << analysis.log2_guesses
+                      << " (trained model)\n";
+        }
+
+        std::cout << "\nPassword composition:\n";
+        std::cout << "   • Lowercase letters: " << (analysis.has_lowercase ? "✓" : "✗") << "\n";
+        std::cout << "   • Uppercase letters: " << (analysis.has_uppercase ? "✓" : "✗") << "\n";
+        std::cout << "   • Digits: " << (analysis.has_digits ? "✓" : "✗") << "\n";
+        std::cout << "   • Special characters: " << (analysis.has_special ? "✓" : "✗") << "\n";
+
+        if (analysis.feedback_flags != 0) {
+            std::cout << "\nRecommendations:\n";
+            for (const auto& tip : analysis.feedback()) {
+                std::cout << "   • " << tip << "\n";
+            }
+        }
+    }
+
+    void quickGenerate() {
+        std::cout << "\n--- QUICK GENERATION ---\n";
+
+        std::cout << "Choose quick generation type:\n";
+        std::cout << "1. Standard password (16 characters)\n";
+        std::cout << "2. Short password (8 characters)\n";
+        std::cout << "3. Long password (24 characters)\n";
+        std::cout << "4. Memorable password\n";
+        std::cout << "5. Complex memorable password\n";
+
+        int quick_type = askNumber("Choose type", 1, 5, 1);
+        int count = askNumber("Number of passwords", 1, 10, 3);
+
+        std::cout << "\nGenerated passwords:\n";
+        SecureStringList passwords;
+
+        static const char* const specs[] = {"standard:16", "standard:8", "standard:24", "memorable:4", "complex:3"};
+        PasswordPool& quick_pool = pool(specs[quick_type - 1]);
+
+        for (int i = 0; i < count; i++) {
+            PasswordGenerator::GenerationInfo info;
+            SecureString password = quick_pool.take(&info);
+            passwords.push_back(password);
+            std::cout << (i + 1) << ". " << password << " | " << std::fixed << std::setprecision(1)
+                      << info.entropy_bits << " bits\n";
+        }
+
+        PasswordPool::Metrics metrics = quick_pool.metrics();
+        std::cout << "(pre-generated: " << metrics.hits << " served, " << metrics.misses << " generated on demand, "
+                  << metrics.refills << " refills)\n";
+
+        if (askYesNo("\nSave passwords to file?", false)) {
+            savePasswordsToFile(passwords, specs[quick_type - 1]);
+        }
+    }
+
+    // Offers a standard hash to store next to saved passwords; null means plain output
+    std::unique_ptr<PasswordHasher> askHasher() {
+        int choice = askNumber("Add password hashes? (0 = no, 1 = PBKDF2-SHA256, 2 = sha512-crypt)", 0, 2, 0);
+        if (choice == 0) {
+            return nullptr;
+        }
+        return std::unique_ptr<PasswordHasher>(new PasswordHasher(
+            choice == 1 ? PasswordHasher::PBKDF2_SHA256 : PasswordHasher::SHA512_CRYPT));
+    }
+
+    // Appends to passwords.pgjn, encrypted when PSWD_GEN_JOURNAL_KEY holds a passphrase
+    void appendToJournal(const SecureStringList& passwords, const std::string& policy) {
+        try {
+            const char* passphrase = std::getenv("PSWD_GEN_JOURNAL_KEY");
+            GenerationJournal journal("passwords.pgjn", passphrase != nullptr ? passphrase : "");
+            if (journal.recoveredBytes() > 0) {
+                std::cout << "Cut a torn tail of " << journal.recoveredBytes() << " bytes from the journal\n";
+            }
+            journal.append(policy, passwords);
+            std::cout << passwords.size() << " password(s) appended to 'passwords.pgjn'"
+                      << (journal.isEncrypted() ? " (encrypted)" : "") << "\n";
+        } catch (const std::exception& e) {
+            std::cout << "Error saving: " << e.what() << "\n";
+        }
+    }
+
+    void savePasswordToFile(const SecureString& password, const std::string& policy = "interactive") {
+        if (askNumber("Save to (1 = text file, 2 = journal)", 1, 2, 1) == 2) {
+            SecureStringList single;
+            single.push_back(password);
+            appendToJournal(single, policy);
+            return;
+        }
+
+        try {
+            std::unique_ptr<PasswordHasher> hasher = askHasher();
+
+            std::time_t now = std::time(nullptr);
+            std::tm* local_time = std::localtime(&now);
+
+            std::ostringstream timestamp;
+            timestamp << std::put_time(local_time, "%Y-%m-%d %H:%M:%S");
+
+            std::ofstream file("password.txt");
+            file << "Generated password (" << timestamp.str() << "):\n";
+            file << password;
+            if (hasher) {
+                file << "\t" << hasher->hash(password);
+            }
+            file << "\n";
+            file.close();
+
+            std::cout << "Password saved to 'password.txt'\n";
+        } catch (const std::exception& e) {
+            std::cout << "Error saving: " << e.what() << "\n";
+        }
+    }
+
+    // Fixed-width binary batch with strength scores, for import jobs
+    void saveBatchFile(const SecureStringList& passwords) {
+        try {
+            size_t width = 0;
+            for (const auto& password : passwords) {
+                width = std::max(width, password.size());
+            }
 
-                if (askYesNo("Add letter to number replacements (a->4, e->3, etc)?", false)) {
-                    comp.config["replacements"] = "true";
-                }
+            BatchWriter writer("passwords.pgbt", "interactive", static_cast<uint32_t>(std::max<size_t>(width, 1)), true);
+            for (const auto& password : passwords) {
+                writer.add(password, gen.checkPasswordStrength(password).score);
+            }
+            writer.finish();
 
-                components.push_back(comp);
+            std::cout << passwords.size() << " passwords saved to 'passwords.pgbt'\n";
+        } catch (const std::exception& e) {
+            std::cout << "Error saving: " << e.what() << "\n";
+        }
+    }
 
-            } else if (choice == 3) {
-                // Random characters component
-                int length = askNumber("Length", 1, 20, 4);
+    void savePasswordsToFile(const SecureStringList& passwords, const std::string& policy = "interactive") {
+        int format = askNumber("File format (1 = text, 2 = binary batch, 3 = journal)", 1, 3, 1);
+        if (format == 2) {
+            saveBatchFile(passwords);
+            return;
+        }
+        if (format == 3) {
+            appendToJournal(passwords, policy);
+            return;
+        }
 
-                std::cout << "\nCharacter types:\n";
-                std::vector<std::string> types;
-                if (askYesNo("Lowercase letters?", true)) {
-                    types.push_back("lowercase");
-                }
-                if (askYesNo("Uppercase letters?", true)) {
-                    types.push_back("uppercase");
-                }
-                if (askYesNo("Digits?", true)) {
-                    types.push_back("digits");
-                }
-                if (askYesNo("Special characters?", false)) {
-                    types.push_back("special");
-                }
+        try {
+            std::unique_ptr<PasswordHasher> hasher = askHasher();
+            std::vector<std::string> hashes;
+            if (hasher) {
+                auto start = std::chrono::steady_clock::now();
+                hashes = hasher->hash(passwords);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                std::cout << "Hashed " << passwords.size() << " passwords with " << hasher->schemeName()
+                          << " in " << std::fixed << std::setprecision(2) << elapsed.count() << " s\n";
+            }
 
-                if (!types.empty()) {
-                    PasswordGenerator::Component comp(PasswordGenerator::Component::RANDOM_CHARS);
-                    comp.config["length"] = std::to_string(length);
+            std::time_t now = std::time(nullptr);
+            std::tm* local_time = std::localtime(&now);
 
-                    std::string types_str;
-                    for (size_t i = 0; i < types.size(); i++) {
-                        types_str += types[i];
-                        if (i < types.size() - 1) types_str += ",";
-                    }
-                    comp.config["types"] = types_str;
+            std::ostringstream timestamp;
+            timestamp << std::put_time(local_time, "%Y-%m-%d %H:%M:%S");
 
-                    components.push_back(comp);
+            std::ofstream file("passwords.txt");
+            file << "Generated passwords (" << timestamp.str() << "):\n";
+            file << std::string(40, '=') << "\n";
+
+            for (size_t i = 0; i < passwords.size(); i++) {
+                file << (i + 1) << ". " << passwords[i];
+                if (!hashes.empty()) {
+                    file << "\t" << hashes[i];
                 }
+                file << "\n";
+            }
+            file.close();
 
-            } else if (choice == 4) {
-                // Number component
-                int min_val = askNumber("Minimum value", 0, 999999, 0);
-                int max_val = askNumber("Maximum value", min_val, 999999, 999);
-                int padding = askNumber("Pad with zeros to length (0 = no padding)", 0, 10, 0);
+            std::cout << passwords.size() << " passwords saved to 'passwords.txt'\n";
+        } catch (const std::exception& e) {
+            std::cout << "Error saving: " << e.what() << "\n";
+        }
+    }
 
-                PasswordGenerator::Component comp(PasswordGenerator::Component::NUMBER);
-                comp.config["min"] = std::to_string(min_val);
-                comp.config["max"] = std::to_string(max_val);
-                comp.config["padding"] = std::to_string(padding);
+    // Loads the compiled word list named by PSWD_GEN_WORDLIST, or words.pgwl if present,
+    // the pronounceable model named by PSWD_GEN_MARKOV, or markov.pgmk, and the guess
+    // model named by PSWD_GEN_GUESSES, or guesses.pggm
+    void loadWordLibrary() {
+        const char* configured = std::getenv("PSWD_GEN_WORDLIST");
+        std::string path = configured != nullptr ? configured : "words.pgwl";
 
-                components.push_back(comp);
+        if (!std::ifstream(path)) {
+            std::cout << "No compiled word library found, using built-in words\n";
+        } else {
+            try {
+                auto start = std::chrono::steady_clock::now();
+                size_t count = gen.loadWordlist(path);
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                std::cout << "Loaded " << count << " words from '" << path << "' in "
+                          << std::fixed << std::setprecision(3) << elapsed.count() << " ms\n";
+            } catch (const std::exception& e) {
+                std::cout << "Could not load word library: " << e.what() << "\n";
+                std::cout << "Using built-in words\n";
+            }
+        }
 
-            } else if (choice == 5) {
-                // Separator component
-                std::cout << "\nChoose separator:\n";
-                std::cout << "1. Hyphen (-)\n";
-                std::cout << "2. Underscore (_)\n";
-                std::cout << "3. Dot (.)\n";
-                std::cout << "4. Exclamation (!)\n";
-                std::cout << "5. At sign (@)\n";
-                std::cout << "6. Hash (#)\n";
-                std::cout << "7. Random from all\n";
-                std::cout << "8. Custom\n";
+        const char* model_path = std::getenv("PSWD_GEN_MARKOV");
+        std::string markov_path = model_path != nullptr ? model_path : "markov.pgmk";
+        if (std::ifstream(markov_path)) {
+            try {
+                gen.loadMarkovModel(markov_path);
+                std::cout << "Loaded pronounceable model from '" << markov_path << "'\n";
+            } catch (const std::exception& e) {
+                std::cout << "Could not load pronounceable model: " << e.what() << "\n";
+            }
+        }
 
-                int sep_choice = askNumber("Choice", 1, 8, 7);
+        const char* guesses_path = std::getenv("PSWD_GEN_GUESSES");
+        std::string guess_path = guesses_path != nullptr ? guesses_path : "guesses.pggm";
+        if (std::ifstream(guess_path)) {
+            try {
+                gen.loadGuessModel(guess_path);
+                std::cout << "Loaded guess model from '" << guess_path << "'\n";
+            } catch (const std::exception& e) {
+                std::cout << "Could not load guess model: " << e.what() << "\n";
+            }
+        }
+    }
 
-                PasswordGenerator::Component comp(PasswordGenerator::Component::SEPARATOR);
+    void run() {
+        std::cout << "Welcome to Password Generator!\n";
+        std::cout << "Checking word libraries availability...\n";
+        loadWordLibrary();
 
-                if (sep_choice == 8) {
-                    std::string custom_seps = askString("Enter possible separators (space-separated)");
-                    std::istringstream iss(custom_seps);
-                    std::string sep;
-                    while (iss >> sep) {
-                        comp.options.push_back(sep);
-                    }
+        while (true) {
+            showMenu();
+
+            try {
+                std::string choice = askString("\nChoose action (0-10)");
+
+                if (choice == "0") {
+                    std::cout << "\nGoodbye! Keep your passwords safe!\n";
+                    break;
+                } else if (choice == "1") {
+                    createStandardPassword();
+                } else if (choice == "2") {
+                    createMemorablePassword();
+                } else if (choice == "3") {
+                    createComplexMemorablePassword();
+                } else if (choice == "4") {
+                    buildCustomPasswordInteractive();
+                } else if (choice == "5") {
+                    createMultiplePasswords();
+                } else if (choice == "6") {
+                    checkPasswordStrength();
+                } else if (choice == "7") {
+                    quickGenerate();
+                } else if (choice == "8") {
+                    createPasswordByComplexity();
+                } else if (choice == "9") {
+                    createPasswordByEntropy();
+                } else if (choice == "10") {
+                    createPronounceablePassword();
                 } else {
-                    std::vector<std::vector<std::string>> sep_options = {
-                        {"-"}, {"_"}, {"."}, {"!"}, {"@"}, {"#"},
-                        {"-", "_", ".", "!", "@", "#"}
-                    };
-                    comp.options = sep_options[sep_choice - 1];
+                    std::cout << "Invalid choice. Try again.\n";
                 }
 
-                components.push_back(comp);
+            } catch (const std::exception& e) {
+                std::cout << "Error occurred: " << e.what() << "\n";
+                std::cout << "Try again or choose another option.\n";
             }
 
-            std::cout << "✓ Component added! Total components: " << components.size() << "\n";
+            std::cout << "\nPress Enter to continue...";
+            std::cin.ignore();
         }
+    }
+};
 
-        if (components.empty()) {
-            std::cout << "No components added\n";
-            return;
+// Non-interactive entry points for offline and batch work
+class CommandLineInterface {
+private:
+    std::vector<std::string> args;
+
+    int usage() {
+        std::cout << "Usage:\n";
+        std::cout << "  cpp_pswd_gen                                   interactive menu\n";
+        std::cout << "  cpp_pswd_gen compile-wordlist OUT IN...        compile text word lists\n";
+        std::cout << "  cpp_pswd_gen wordlist-info FILE [--verify]     describe a compiled word list\n";
+        std::cout << "  cpp_pswd_gen build-markov OUT ORDER CORPUS...  train a pronounceable model\n";
+        std::cout << "  cpp_pswd_gen build-guesses OUT ORDER CORPUS... train a guess-number model\n";
+        std::cout << "  cpp_pswd_gen guesses [FILE]                    log2 guesses for each line of FILE\n";
+        std::cout << "  cpp_pswd_gen provision SPEC COUNT [SCHEME [ROUNDS]]\n";
+        std::cout << "                                                 passwords with hashes, one per line\n";
+        std::cout << "  cpp_pswd_gen provision-csv IN OUT [SCHEME [ROUNDS]]\n";
+        std::cout << "                                                 user,policy CSV to user,password CSV\n";
+        std::cout << "  cpp_pswd_gen audit [SECONDS] [MODE...]          chi-square audit of random choices\n";
+        std::cout << "  cpp_pswd_gen batch SPEC COUNT OUT [--indexed] [--no-strength]\n";
+        std::cout << "                                                 binary batch with strength scores\n";
+        std::cout << "  cpp_pswd_gen bulk SPEC COUNT OUT [THREADS]       one password per line, generated\n";
+        std::cout << "                                                 in place in a mapped file\n";
+        std::cout << "  cpp_pswd_gen batch-info FILE [INDEX...] [--verify]\n";
+        std::cout << "                                                 describe a batch or print records\n";
+        std::cout << "  cpp_pswd_gen tokens SPEC COUNT [OUT]           API keys or codes, one per line\n";
+        std::cout << "  cpp_pswd_gen token-check SPEC TOKEN...         check token shape and checksum\n";
+        std::cout << "  cpp_pswd_gen rotate SPEC HISTORY [DISTANCE [KEEP]]\n";
+        std::cout << "                                                 new password more than DISTANCE (3) edits\n";
+        std::cout << "                                                 from the last KEEP (24), then recorded\n";
+        std::cout << "  cpp_pswd_gen history-check HISTORY PASSWORD [DISTANCE]\n";
+        std::cout << "                                                 closest history entry within DISTANCE\n";
+        std::cout << "  cpp_pswd_gen journal SPEC COUNT FILE [CLIENTS]\n";
+        std::cout << "                                                 append to a durable journal from\n";
+        std::cout << "                                                 CLIENTS (16) concurrent requests\n";
+        std::cout << "  cpp_pswd_gen journal-read FILE                 print journal records\n";
+        std::cout << "  cpp_pswd_gen serve [HOST:]PORT [MAX_CONN]      answer GEN SPEC and CHECK PASSWORD lines\n";
+        std::cout << "  cpp_pswd_gen loadgen [HOST:]PORT RATE SECONDS [CONNECTIONS] [[WEIGHT:]SPEC|check...]\n";
+        std::cout << "                                                 open-loop load on CONNECTIONS (16),\n";
+        std::cout << "                                                 with latency percentiles\n";
+        std::cout << "  cpp_pswd_gen validate SPEC FILE [--exact] [--summary]\n";
+        std::cout << "                                                 policy violations of each line, with\n";
+        std::cout << "                                                 SPEC's length as a minimum unless exact\n";
+        std::cout << "  cpp_pswd_gen reuse FILE [SIMILARITY [TOP]]     TOP (20) largest clusters of passwords\n";
+        std::cout << "                                                 at least SIMILARITY (0.5) alike after\n";
+        std::cout << "                                                 case and leet folding\n";
+        std::cout << "  cpp_pswd_gen cpu-info                          instruction sets and kernels in use\n";
+        std::cout << "  cpp_pswd_gen keyspace SPEC                     size of a policy's keyspace\n";
+        std::cout << "  cpp_pswd_gen unrank SPEC INDEX                 password at an index of the keyspace\n";
+        std::cout << "  cpp_pswd_gen rank SPEC PASSWORD                index of a password in the keyspace\n";
+        std::cout << "  cpp_pswd_gen sample SPEC COUNT [SHARD/SHARDS]  uniform passwords, optionally from\n";
+        std::cout << "                                                 one of SHARDS disjoint index ranges\n";
+        std::cout << "    SPEC:   standard:LEN, complexity:LEVEL, memorable:WORDS, complex:WORDS,\n";
+        std::cout << "            pronounceable:LEN, template:TEXT (e.g. template:{word:capitalize}{number:max=99}),\n";
+        std::cout << "            alphabet:LEN:CHARS (LEN in codepoints, or bytes as e.g. 32b),\n";
+        std::cout << "            token:ENCODING[+crc]:BYTES[:PREFIX] with hex, base32 or base64url\n";
+        std::cout << "            bulk, validate, keyspace, unrank, rank and sample take standard:LEN or complexity:LEVEL\n";
+        std::cout << "    SCHEME: pbkdf2-sha256 (default) or sha512-crypt\n";
+        std::cout << "    Journals are encrypted when PSWD_GEN_JOURNAL_KEY holds a passphrase\n";
+        std::cout << "    HOST defaults to 127.0.0.1; passwords cross the connection in clear text\n";
+        std::cout << "    --simd=scalar|sse4.2|avx2|avx512 (or PSWD_GEN_SIMD) caps the instruction sets used\n";
+        return 2;
+    }
+
+    int compileWordlist() {
+        if (args.size() < 3) {
+            return usage();
         }
 
-        std::cout << "\nCreating password from " << components.size() << " components...\n";
+        WordlistCompiler compiler;
+        for (size_t i = 2; i < args.size(); i++) {
+            size_t accepted = compiler.addTextFile(args[i]);
+            std::cout << "Read " << accepted << " words from '" << args[i] << "'\n";
+        }
 
-        // Generate multiple variants
-        std::vector<std::string> passwords;
-        for (int i = 0; i < 3; i++) {
-            std::string password = gen.buildCustomPassword(components);
-            passwords.push_back(password);
+        compiler.write(args[1]);
+        std::cout << "Wrote " << compiler.size() << " unique words to '" << args[1] << "'\n";
+        return 0;
+    }
 
-            auto analysis = gen.checkPasswordStrength(password);
-            std::cout << "\n" << (i + 1) << ". " << password << "\n";
-            std::cout << "   Strength: " << analysis.strength << " | Length: " << analysis.length
-                      << " | Score: " << analysis.score << "\n";
+    int wordlistInfo() {
+        if (args.size() < 2) {
+            return usage();
         }
 
-        if (askYesNo("\nSave one of the passwords?", true)) {
-            int choice = askNumber("Choose password to save (1-3)", 1, 3, 1);
-            savePasswordToFile(passwords[choice - 1]);
-        }
-    }
+        auto start = std::chrono::steady_clock::now();
+        BinaryWordlist wordlist(args[1]);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
 
-    void createStandardPassword() {
-        std::cout << "\n--- STANDARD PASSWORD ---\n";
+        std::cout << "Words: " << wordlist.size() << (wordlist.weighted() ? " (weighted)" : "") << "\n";
+        std::cout << "Load time: " << std::fixed << std::setprecision(3) << elapsed.count() << " ms\n";
+        for (int length = 1; length <= BinaryWordlist::kMaxWordLength; length++) {
+            auto range = wordlist.lengthRange(length, length);
+            if (range.second > range.first) {
+                std::cout << "  length " << std::setw(2) << length << ": " << (range.second - range.first) << "\n";
+            }
+        }
 
-        int length = askNumber("Password length", 4, 128, 12);
+        if (args.size() > 2 && args[2] == "--verify") {
+            bool valid = wordlist.verify();
+            std::cout << "Entries and checksum: " << (valid ? "OK" : "CORRUPT") << "\n";
+            return valid ? 0 : 1;
+        }
+        return 0;
+    }
 
-        std::cout << "\nCharacter types:\n";
-        bool use_uppercase = askYesNo("Use uppercase letters (A-Z)?", true);
-        bool use_lowercase = askYesNo("Use lowercase letters (a-z)?", true);
-        bool use_digits = askYesNo("Use digits (0-9)?", true);
-        bool use_special = askYesNo("Use special characters (!@#$%^&*)?", true);
+    int buildMarkov() {
+        if (args.size() < 4) {
+            return usage();
+        }
 
-        if (!use_uppercase && !use_lowercase && !use_digits && !use_special) {
-            std::cout << "At least one character type must be selected. Enabling all types.\n";
-            use_uppercase = use_lowercase = use_digits = use_special = true;
+        MarkovModel model(std::stoi(args[2]));
+        for (size_t i = 3; i < args.size(); i++) {
+            model.trainFile(args[i]);
         }
+        model.build();
+        model.save(args[1]);
 
-        bool exclude_ambiguous = askYesNo("Exclude ambiguous characters (i,l,1,L,o,0,O)?", false);
+        std::cout << "Wrote order-" << model.getOrder() << " model to '" << args[1] << "'\n";
+        std::cout << "Entropy of 10 letters: " << std::fixed << std::setprecision(1)
+                  << model.expectedEntropy(10) << " bits\n";
+        return 0;
+    }
 
-        std::cout << "\nMinimum requirements (0 = not required):\n";
-        int min_uppercase = use_uppercase ? askNumber("Minimum uppercase letters", 0, length / 2, 1) : 0;
-        int min_lowercase = use_lowercase ? askNumber("Minimum lowercase letters", 0, length / 2, 1) : 0;
-        int min_digits = use_digits ? askNumber("Minimum digits", 0, length / 2, 1) : 0;
-        int min_special = use_special ? askNumber("Minimum special characters", 0, length / 2, 1) : 0;
+    int buildGuesses() {
+        if (args.size() < 4) {
+            return usage();
+        }
 
-        try {
-            std::string password = gen.generatePassword(length, use_uppercase, use_lowercase,
-                                                       use_digits, use_special, exclude_ambiguous,
-                                                       min_uppercase, min_lowercase, min_digits, min_special);
+        GuessModelTrainer trainer(std::stoi(args[2]));
+        for (size_t i = 3; i < args.size(); i++) {
+            trainer.trainFile(args[i]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        trainer.write(args[1]);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        GuessModel model(args[1]);
+        std::cout << "Wrote order-" << model.getOrder() << " guess model of " << trainer.size() << " passwords to '"
+                  << args[1] << "' (" << model.slotCount() * 4 / 1024 << " KiB of slots) in " << std::fixed
+                  << std::setprecision(1) << elapsed.count() << " s\n";
+        return 0;
+    }
 
-            std::cout << "\nGenerated password: " << password << "\n";
+    // Prints "log2 guesses<TAB>password" for each line; standard input without a file
+    int guesses() {
+        if (args.size() > 2) {
+            return usage();
+        }
 
-            auto analysis = gen.checkPasswordStrength(password);
-            std::cout << "Password strength: " << analysis.strength << " (score: " << analysis.score << ")\n";
+        PasswordGenerator gen;
+        loadLibraries(gen);
+        const GuessModel* model = gen.guessModel();
+        if (model == nullptr) {
+            std::cerr << "No guess model; build guesses.pggm with build-guesses or set PSWD_GEN_GUESSES\n";
+            return 2;
+        }
 
-            if (askYesNo("\nSave password to file?", false)) {
-                savePasswordToFile(password);
+        std::ifstream input_file;
+        if (args.size() > 1 && args[1] != "-") {
+            input_file.open(args[1], std::ios::binary);
+            if (!input_file) {
+                throw std::runtime_error("Cannot open '" + args[1] + "'");
             }
-
-        } catch (const std::exception& e) {
-            std::cout << "Error: " << e.what() << "\n";
         }
+        std::istream& in = input_file.is_open() ? input_file : std::cin;
+
+        uint64_t count = 0, guessable = 0;
+        std::chrono::duration<double> scoring(0);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            auto start = std::chrono::steady_clock::now();
+            double bits = model->log2Guesses(line);
+            scoring += std::chrono::steady_clock::now() - start;
+            count++;
+            guessable += bits < GuessModel::kGuessable;
+            std::cout << std::fixed << std::setprecision(1) << bits << "\t" << line << "\n";
+        }
+        secureZero(&line[0], line.size());
+
+        std::cerr << count << " passwords, " << guessable << " under 2^" << std::fixed << std::setprecision(1)
+                  << GuessModel::kGuessable << " guesses, " << std::setprecision(0)
+                  << scoring.count() * 1e9 / std::max<uint64_t>(1, count) << " ns each\n";
+        return 0;
     }
 
-    void createMemorablePassword() {
-        std::cout << "\n--- MEMORABLE PASSWORD ---\n";
+    // Same word library lookup as the interactive menu, without the chatter
+    void loadLibraries(PasswordGenerator& gen) {
+        const char* wordlist_path = std::getenv("PSWD_GEN_WORDLIST");
+        std::string path = wordlist_path != nullptr ? wordlist_path : "words.pgwl";
+        if (std::ifstream(path)) {
+            gen.loadWordlist(path);
+        }
 
-        int num_words = askNumber("Number of words", 2, 8, 4);
+        const char* model_path = std::getenv("PSWD_GEN_MARKOV");
+        std::string markov_path = model_path != nullptr ? model_path : "markov.pgmk";
+        if (std::ifstream(markov_path)) {
+            gen.loadMarkovModel(markov_path);
+        }
 
-        std::cout << "\nChoose separator:\n";
-        std::cout << "1. Hyphen (-)\n";
-        std::cout << "2. Underscore (_)\n";
-        std::cout << "3. Dot (.)\n";
-        std::cout << "4. No separator\n";
+        const char* guesses_path = std::getenv("PSWD_GEN_GUESSES");
+        std::string guess_path = guesses_path != nullptr ? guesses_path : "guesses.pggm";
+        if (std::ifstream(guess_path)) {
+            gen.loadGuessModel(guess_path);
+        }
+    }
 
-        int separator_choice = askNumber("Choose option", 1, 4, 1);
-        std::vector<std::string> separators = {"-", "_", ".", ""};
-        std::string separator = separators[separator_choice - 1];
+    // Prints "password<TAB>hash" lines so accounts can be provisioned from one pass
+    // over the secrets
+    int provision() {
+        if (args.size() < 3) {
+            return usage();
+        }
 
-        bool capitalize = askYesNo("Capitalize first letters?", true);
-        bool add_numbers = askYesNo("Add numbers at the end?", true);
+        PasswordHasher::Scheme scheme = PasswordHasher::PBKDF2_SHA256;
+        if (args.size() > 3 && !PasswordHasher::parseScheme(args[3], scheme)) {
+            std::cerr << "Unknown hash scheme '" << args[3] << "'\n";
+            return 2;
+        }
+        unsigned rounds = args.size() > 4 ? static_cast<unsigned>(std::stoul(args[4])) : 0;
+        PasswordHasher hasher(scheme, rounds);
 
-        int word_min_length = askNumber("Minimum word length", 3, 10, 4);
-        int word_max_length = askNumber("Maximum word length", word_min_length, 15, 8);
+        PasswordGenerator gen;
+        loadLibraries(gen);
 
-        std::string password = gen.generateMemorablePassword(num_words, separator, add_numbers,
-                                                            capitalize, word_min_length, word_max_length);
+        int count = std::stoi(args[2]);
+        SecureStringList passwords;
+        for (int i = 0; i < count; i++) {
+            passwords.push_back(gen.generateFromSpec(args[1]));
+        }
 
-        std::cout << "\nGenerated password: " << password << "\n";
+        std::vector<std::string> hashes = hasher.hash(passwords);
+        for (size_t i = 0; i < passwords.size(); i++) {
+            std::cout << passwords[i] << "\t" << hashes[i] << "\n";
+        }
+        return 0;
+    }
 
-        auto analysis = gen.checkPasswordStrength(password);
-        std::cout << "Password strength: " << analysis.strength << " (score: " << analysis.score << ")\n";
+    // "-" stands for standard input or output
+    int provisionCsv() {
+        if (args.size() < 3) {
+            return usage();
+        }
 
-        if (askYesNo("\nSave password to file?", false)) {
-            savePasswordToFile(password);
+        std::unique_ptr<PasswordHasher> hasher;
+        if (args.size() > 3) {
+            PasswordHasher::Scheme scheme;
+            if (!PasswordHasher::parseScheme(args[3], scheme)) {
+                std::cerr << "Unknown hash scheme '" << args[3] << "'\n";
+                return 2;
+            }
+            unsigned rounds = args.size() > 4 ? static_cast<unsigned>(std::stoul(args[4])) : 0;
+            hasher.reset(new PasswordHasher(scheme, rounds));
         }
-    }
 
-    void createComplexMemorablePassword() {
-        std::cout << "\n--- COMPLEX MEMORABLE PASSWORD ---\n";
+        std::ifstream input_file;
+        if (args[1] != "-") {
+            input_file.open(args[1]);
+            if (!input_file) {
+                throw std::runtime_error("Cannot open " + args[1]);
+            }
+        }
+        std::ofstream output_file;
+        if (args[2] != "-") {
+            output_file.open(args[2]);
+            if (!output_file) {
+                throw std::runtime_error("Cannot create " + args[2]);
+            }
+        }
 
-        int num_words = askNumber("Number of words", 2, 6, 3);
-        bool add_special_chars = askYesNo("Add special characters?", true);
-        bool add_numbers = askYesNo("Add numbers?", true);
-        bool transform_words = askYesNo("Apply word transformations (letter to number replacements)?", true);
-        int min_length = askNumber("Minimum password length", 12, 50, 16);
+        PasswordGenerator gen;
+        loadLibraries(gen);
 
-        std::cout << "\nGenerating options...\n";
+        auto start = std::chrono::steady_clock::now();
+        ProvisioningPipeline pipeline(gen, hasher.get());
+        ProvisioningPipeline::Stats stats = pipeline.run(args[1] == "-" ? std::cin : input_file,
+                                                         args[2] == "-" ? std::cout : output_file);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-        std::vector<std::string> passwords;
-        for (int i = 0; i < 3; i++) {
-            std::string password = gen.generateComplexMemorablePassword(num_words, add_special_chars,
-                                                                       add_numbers, transform_words, min_length);
-            passwords.push_back(password);
+        std::cerr << "Provisioned " << stats.written << " of " << stats.rows << " users in "
+                  << std::fixed << std::setprecision(2) << elapsed.count() << " s\n";
+        return stats.failed == 0 ? 0 : 1;
+    }
 
-            auto analysis = gen.checkPasswordStrength(password);
-            std::cout << "\n" << (i + 1) << ". " << password << "\n";
-            std::cout << "   Strength: " << analysis.strength << " | Length: " << analysis.length
-                      << " | Score: " << analysis.score << "\n";
-        }
+    // Splits the time budget evenly over the requested modes (all by default)
+    int audit() {
+        double seconds = args.size() > 1 ? std::stod(args[1]) : 10.0;
 
-        int choice = askNumber("\nChoose password to save (1-3, 0 = don't save)", 0, 3, 0);
+        PasswordGenerator gen;
+        loadLibraries(gen);
+        RandomnessAudit harness(gen);
 
-        if (choice > 0) {
-            std::cout << "\nSelected password: " << passwords[choice - 1] << "\n";
+        std::vector<std::string> modes(args.begin() + std::min<size_t>(2, args.size()), args.end());
+        if (modes.empty()) {
+            modes = harness.modeNames();
+        }
 
-            if (askYesNo("Save password to file?", false)) {
-                savePasswordToFile(passwords[choice - 1]);
+        int suspicious = 0;
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        for (const auto& mode : modes) {
+            RandomnessAudit::ModeReport report = harness.run(mode, seconds / modes.size(), threads);
+            std::cout << "\n" << report.mode << ": " << report.samples << " samples in " << std::fixed
+                      << std::setprecision(1) << report.seconds << " s on " << threads << " threads ("
+                      << std::setprecision(0) << report.samples / report.seconds << "/s)";
+            if (report.unparsed > 0) {
+                std::cout << ", " << report.unparsed << " unparsed";
+            }
+            std::cout << "\n";
+
+            for (const auto& test : report.tests) {
+                bool flagged = test.p_value < RandomnessAudit::kSuspicious;
+                suspicious += flagged;
+                std::cout << "  " << std::left << std::setw(28) << test.name << std::right
+                          << " chi2 " << std::setw(14) << std::setprecision(1) << test.statistic
+                          << "  df " << std::setw(5) << test.df
+                          << "  p " << std::setw(10) << std::scientific << std::setprecision(3) << test.p_value
+                          << std::fixed << (flagged ? "  BIASED" : "") << "\n";
             }
         }
-    }
 
-    void createPasswordByComplexity() {
-        std::cout << "\n--- PASSWORD BY COMPLEXITY LEVEL ---\n";
-        std::cout << "Choose complexity level from 1 to 10:\n\n";
+        std::cout << "\n" << suspicious << " test(s) below p = " << std::scientific << std::setprecision(0)
+                  << RandomnessAudit::kSuspicious << std::defaultfloat << "\n";
+        return suspicious == 0 ? 0 : 1;
+    }
 
-        for (int i = 1; i <= 10; i++) {
-            std::cout << std::setw(2) << i << ". " << gen.getComplexityDescription(i) << "\n";
+public:
+    // Character policies have a known length and get fixed-width records; other modes,
+    // or --indexed, get an offset table instead
+    int batch() {
+        if (args.size() < 4) {
+            return usage();
+        }
+        bool force_indexed = false, with_strength = true;
+        for (size_t i = 4; i < args.size(); i++) {
+            if (args[i] == "--indexed") {
+                force_indexed = true;
+            } else if (args[i] == "--no-strength") {
+                with_strength = false;
+            } else {
+                return usage();
+            }
         }
 
-        std::cout << "\n";
-        int complexity = askNumber("Choose complexity level", 1, 10, 5);
-
-        std::cout << "\nSelected level: " << gen.getComplexityDescription(complexity) << "\n";
+        PasswordGenerator gen;
+        loadLibraries(gen);
+        PasswordGenerator::GenerationSpec spec = gen.compileSpec(args[1]);
+        uint32_t width = 0;
+        if (spec.mode == PasswordGenerator::GenerationSpec::POLICY && !force_indexed) {
+            width = static_cast<uint32_t>(spec.policy.length);
+        }
 
-        int count = askNumber("Number of password variants", 1, 10, 3);
+        long long count = std::stoll(args[2]);
+        auto start = std::chrono::steady_clock::now();
+        BatchWriter writer(args[3], args[1], width, with_strength);
+        for (long long i = 0; i < count; i++) {
+            SecureString password = gen.generate(spec);
+            writer.add(password, with_strength ? gen.checkPasswordStrength(password).score : 0);
+        }
+        writer.finish();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-        std::cout << "\nGenerated passwords (complexity level " << complexity << "):\n";
-        std::vector<std::string> passwords;
+        std::cout << "Wrote " << writer.size() << " passwords to '" << args[3] << "' in " << std::fixed
+                  << std::setprecision(2) << elapsed.count() << " s\n";
+        return 0;
+    }
 
-        for (int i = 0; i < count; i++) {
-            try {
-                std::string password = gen.generatePasswordByComplexity(complexity);
-                passwords.push_back(password);
+    int bulk() {
+        if (args.size() < 4 || args.size() > 5) {
+            return usage();
+        }
 
-                auto analysis = gen.checkPasswordStrength(password);
+        PasswordGenerator gen;
+        PasswordGenerator::PasswordPolicy policy = policySpec(gen, args[1]);
+        uint64_t count = std::stoull(args[2]);
+        BulkWriter writer(args.size() > 4 ? static_cast<unsigned>(std::stoul(args[4]))
+                                          : std::thread::hardware_concurrency());
 
-                std::cout << "\n" << (i + 1) << ". " << password << "\n";
-                std::cout << "   Strength: " << analysis.strength << " | Length: " << analysis.length
-                          << " | Score: " << analysis.score << "/15\n";
+        auto start = std::chrono::steady_clock::now();
+        BulkWriter::Stats stats = writer.write(args[3], policy, count);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-                std::vector<std::string> composition;
-                if (analysis.has_lowercase) composition.push_back("lowercase");
-                if (analysis.has_uppercase) composition.push_back("uppercase");
-                if (analysis.has_digits) composition.push_back("digits");
-                if (analysis.has_special) composition.push_back("special");
+        std::cout << "Wrote " << stats.records << " passwords to '" << args[3] << "' in " << std::fixed
+                  << std::setprecision(2) << elapsed.count() << " s on " << stats.threads << " threads ("
+                  << std::setprecision(0) << stats.bytes / 1e6 / std::max(elapsed.count(), 1e-9) << " MB/s)\n";
+        return 0;
+    }
 
-                std::cout << "   Composition: ";
-                for (size_t j = 0; j < composition.size(); j++) {
-                    std::cout << composition[j];
-                    if (j < composition.size() - 1) std::cout << ", ";
-                }
-                std::cout << "\n";
+    int batchInfo() {
+        if (args.size() < 2) {
+            return usage();
+        }
 
-            } catch (const std::exception& e) {
-                std::cout << "Error generating password " << (i + 1) << ": " << e.what() << "\n";
+        BatchFile batch(args[1]);
+        bool verify = false;
+        std::vector<uint64_t> indexes;
+        for (size_t i = 2; i < args.size(); i++) {
+            if (args[i] == "--verify") {
+                verify = true;
+            } else {
+                indexes.push_back(std::stoull(args[i]));
             }
         }
 
-        if (!passwords.empty()) {
-            if (askYesNo("\nSave passwords to file?", false)) {
-                savePasswordsToFile(passwords);
+        if (indexes.empty()) {
+            std::cout << "Policy: " << batch.policy() << "\n";
+            std::cout << "Records: " << batch.size() << "\n";
+            if (batch.indexed()) {
+                std::cout << "Layout: indexed\n";
+            } else {
+                std::cout << "Layout: fixed width " << batch.recordWidth() << "\n";
             }
-
-            if (passwords.size() > 1 && askYesNo("Save one selected password separately?", false)) {
-                int choice = askNumber("Choose password (1-" + std::to_string(passwords.size()) + ")",
-                                     1, passwords.size());
-                savePasswordToFile(passwords[choice - 1]);
+            std::cout << "Strength scores: " << (batch.hasStrength() ? "yes" : "no") << "\n";
+        }
+        for (uint64_t index : indexes) {
+            std::cout << batch.record(index);
+            if (batch.hasStrength()) {
+                std::cout << "\t" << static_cast<int>(batch.strength(index));
             }
+            std::cout << "\n";
+        }
+
+        if (verify) {
+            bool valid = batch.verify();
+            std::cout << "Checksum: " << (valid ? "OK" : "MISMATCH") << "\n";
+            return valid ? 0 : 1;
         }
+        return 0;
     }
 
-    void createMultiplePasswords() {
-        std::cout << "\n--- MULTIPLE PASSWORDS ---\n";
+    static TokenGenerator::Format tokenSpec(PasswordGenerator& gen, const std::string& text) {
+        PasswordGenerator::GenerationSpec spec = gen.compileSpec(text);
+        if (spec.mode != PasswordGenerator::GenerationSpec::TOKEN) {
+            throw std::invalid_argument("'" + text + "' is not a token spec");
+        }
+        return spec.token;
+    }
 
-        int count = askNumber("Number of passwords to generate", 1, 50, 5);
+    // Mints into a 1 MiB block of lines and writes it out whole
+    int tokens() {
+        if (args.size() < 3 || args.size() > 4) {
+            return usage();
+        }
 
-        std::cout << "\nChoose password type:\n";
-        std::cout << "1. Standard passwords\n";
-        std::cout << "2. Memorable passwords\n";
-        std::cout << "3. Complex memorable passwords\n";
+        PasswordGenerator gen;
+        TokenGenerator::Format format = tokenSpec(gen, args[1]);
+        uint64_t count = std::stoull(args[2]);
+        std::ofstream output_file;
+        if (args.size() > 3) {
+            createPrivateFile(args[3]);  // the keys are live credentials
+            output_file.open(args[3], std::ios::binary | std::ios::trunc);
+            if (!output_file) {
+                throw std::runtime_error("Cannot create " + args[3]);
+            }
+        }
+        std::ostream& out = args.size() > 3 ? output_file : std::cout;
+
+        TokenGenerator generator;
+        size_t line = format.length() + 1;
+        size_t per_block = std::max<size_t>(1, (1 << 20) / line);
+        SecureVector<char> block(per_block * line);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t done = 0; done < count;) {
+            size_t lines = static_cast<size_t>(std::min<uint64_t>(per_block, count - done));
+            generator.mintLines(format, lines, block.data());
+            out.write(block.data(), static_cast<std::streamsize>(lines * line));
+            done += lines;
+        }
+        out.flush();
+        secureZero(block.data(), block.size());
+        if (!out) {
+            throw std::runtime_error("Cannot write tokens");
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-        int password_type = askNumber("Choose type", 1, 3, 1);
+        std::cerr << "Minted " << count << " tokens of " << 8 * format.bytes << " bits in " << std::fixed
+                  << std::setprecision(2) << elapsed.count() << " s ("
+                  << std::setprecision(0) << count * line / 1e6 / std::max(elapsed.count(), 1e-9) << " MB/s)\n";
+        return 0;
+    }
 
-        std::cout << "\nGenerated passwords:\n";
-        std::vector<std::string> passwords;
+    int tokenCheck() {
+        if (args.size() < 3) {
+            return usage();
+        }
 
-        int length = 0, num_words = 0;
-        if (password_type == 1) {
-            length = askNumber("Password length", 4, 128, 12);
-        } else if (password_type == 2) {
-            num_words = askNumber("Number of words", 2, 8, 4);
-        } else {
-            num_words = askNumber("Number of words", 2, 6, 3);
+        PasswordGenerator gen;
+        TokenGenerator::Format format = tokenSpec(gen, args[1]);
+        int invalid = 0;
+        for (size_t i = 2; i < args.size(); i++) {
+            bool valid = TokenGenerator::verify(format, args[i]);
+            invalid += !valid;
+            std::cout << args[i] << ": " << (valid ? "OK" : "INVALID") << "\n";
         }
+        return invalid == 0 ? 0 : 1;
+    }
 
-        for (int i = 0; i < count; i++) {
-            try {
-                std::string password;
-                if (password_type == 1) {
-                    password = gen.generatePassword(length);
-                } else if (password_type == 2) {
-                    password = gen.generateMemorablePassword(num_words);
-                } else {
-                    password = gen.generateComplexMemorablePassword(num_words);
-                }
+    // The history file holds one password per line, oldest first; a missing file is an
+    // empty history
+    static PasswordHistory loadHistory(const std::string& path, size_t keep) {
+        PasswordHistory history(keep);
+        if (std::ifstream(path)) {
+            history.load(path);
+        }
+        return history;
+    }
 
-                passwords.push_back(password);
-                auto analysis = gen.checkPasswordStrength(password);
-                std::cout << std::setw(2) << (i + 1) << ". " << password << " | "
-                          << analysis.strength << " (" << analysis.score << " points)\n";
+    int rotate() {
+        if (args.size() < 3 || args.size() > 5) {
+            return usage();
+        }
+        int distance = args.size() > 3 ? std::stoi(args[3]) : 3;
+        size_t keep = args.size() > 4 ? std::stoul(args[4]) : 24;
+
+        PasswordGenerator gen;
+        loadLibraries(gen);
+        PasswordHistory history = loadHistory(args[2], keep);
+        SecureString password = gen.generateAvoiding(gen.compileSpec(args[1]), history, distance);
+
+        history.add(password);
+        history.save(args[2]);
+        std::cout << password << "\n";
+        return 0;
+    }
 
-            } catch (const std::exception& e) {
-                std::cout << "Error generating password " << (i + 1) << ": " << e.what() << "\n";
-            }
+    int historyCheck() {
+        if (args.size() < 3 || args.size() > 4) {
+            return usage();
         }
+        int distance = args.size() > 3 ? std::stoi(args[3]) : 3;
 
-        if (!passwords.empty() && askYesNo("\nSave all passwords to file?", false)) {
-            savePasswordsToFile(passwords);
+        PasswordHistory history = loadHistory(args[1], std::numeric_limits<size_t>::max());
+        auto start = std::chrono::steady_clock::now();
+        PasswordHistory::Match match = history.closest(args[2], distance);
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (match.found) {
+            std::cout << "Too similar: " << match.distance << " edit(s) from entry " << match.index + 1
+                      << " of " << history.size() << "\n";
+        } else {
+            std::cout << "OK: no entry of " << history.size() << " within " << distance << " edit(s)\n";
         }
+        std::cout << "Compared " << history.stats().compared << ", filtered " << history.stats().skipped
+                  << " in " << std::fixed << std::setprecision(1) << elapsed.count() << " us\n";
+        return match.found ? 1 : 0;
     }
 
-    void checkPasswordStrength() {
-        std::cout << "\n--- PASSWORD STRENGTH CHECK ---\n";
+    // The passphrase comes from the environment, never the command line where other
+    // users could see it
+    static std::unique_ptr<GenerationJournal> openJournal(const std::string& path,
+                                                          GenerationJournal::Access access) {
+        const char* passphrase = std::getenv("PSWD_GEN_JOURNAL_KEY");
+        std::unique_ptr<GenerationJournal> journal(new GenerationJournal(
+            path, passphrase != nullptr ? passphrase : "", GenerationJournal::kDefaultRounds, access));
+        if (journal->recoveredBytes() > 0) {
+            std::cerr << (access == GenerationJournal::READ_ONLY ? "Skipped" : "Cut") << " a torn tail of "
+                      << journal->recoveredBytes() << " bytes from '" << path << "'\n";
+        }
+        return journal;
+    }
 
-        std::string password = askString("Enter password to check");
+    // Each client appends one password at a time and waits until it is durable, like a
+    // request handler would; group commit lets them share fsyncs
+    int journal() {
+        if (args.size() < 4 || args.size() > 5) {
+            return usage();
+        }
+        uint64_t count = std::stoull(args[2]);
+        unsigned clients = args.size() > 4 ? static_cast<unsigned>(std::stoul(args[4])) : 16;
+        if (clients == 0) {
+            return usage();
+        }
 
-        if (password.empty()) {
-            std::cout << "Password cannot be empty\n";
-            return;
+        PasswordGenerator gen;
+        loadLibraries(gen);
+        gen.compileSpec(args[1]);
+        std::unique_ptr<GenerationJournal> journal = openJournal(args[3], GenerationJournal::APPEND);
+
+        std::vector<std::exception_ptr> errors(clients);
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned c = 0; c < clients; c++) {
+            uint64_t share = count / clients + (c < count % clients ? 1 : 0);
+            threads.emplace_back([&, c, share] {
+                try {
+                    PasswordGenerator client;
+                    client.shareLibraries(gen);
+                    PasswordGenerator::GenerationSpec spec = client.compileSpec(args[1]);
+                    for (uint64_t i = 0; i < share; i++) {
+                        PasswordGenerator::GenerationInfo info;
+                        SecureString password = client.generate(spec, &info);
+                        journal->append(info.policy, password.view());
+                    }
+                } catch (...) {
+                    errors[c] = std::current_exception();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
         }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        GenerationJournal::Stats stats = journal->stats();
+        std::cerr << "Appended " << stats.records << " records (" << stats.bytes << " bytes) in " << std::fixed
+                  << std::setprecision(2) << elapsed.count() << " s with " << stats.commits << " fsyncs, "
+                  << std::setprecision(1) << static_cast<double>(stats.records) / std::max<uint64_t>(1, stats.commits)
+                  << " records per fsync\n";
+        return 0;
+    }
 
-        auto analysis = gen.checkPasswordStrength(password);
+    int journalRead() {
+        if (args.size() != 2) {
+            return usage();
+        }
 
-        std::cout << "\nPASSWORD ANALYSIS: '" << password << "'\n";
-        std::cout << std::string(50, '=') << "\n";
-        std::cout << "Password strength: " << analysis.strength << "\n";
-        std::cout << "Length: " << analysis.length << " characters\n";
-        std::cout << "Score: " << analysis.score << "/15\n";
-        std::cout << "Unique characters: " << analysis.unique_chars << "\n";
+        std::unique_ptr<GenerationJournal> journal = openJournal(args[1], GenerationJournal::READ_ONLY);
+        journal->forEach([](const GenerationJournal::Entry& entry) {
+            std::time_t seconds = static_cast<std::time_t>(entry.timestamp_ms / 1000);
+            std::cout << std::put_time(std::localtime(&seconds), "%Y-%m-%d %H:%M:%S") << "."
+                      << std::setw(3) << std::setfill('0') << entry.timestamp_ms % 1000 << std::setfill(' ')
+                      << "\t" << entry.policy << "\t" << entry.record << "\n";
+        });
+        return 0;
+    }
 
-        std::cout << "\nPassword composition:\n";
-        std::cout << "   • Lowercase letters: " << (analysis.has_lowercase ? "✓" : "✗") << "\n";
-        std::cout << "   • Uppercase letters: " << (analysis.has_uppercase ? "✓" : "✗") << "\n";
-        std::cout << "   • Digits: " << (analysis.has_digits ? "✓" : "✗") << "\n";
-        std::cout << "   • Special characters: " << (analysis.has_special ? "✓" : "✗") << "\n";
+    // Prints "line<TAB>violations" for each failing line, never the password itself
+    int validate() {
+        if (args.size() < 3) {
+            return usage();
+        }
+        bool exact = false, summary_only = false;
+        for (size_t i = 3; i < args.size(); i++) {
+            if (args[i] == "--exact") {
+                exact = true;
+            } else if (args[i] == "--summary") {
+                summary_only = true;
+            } else {
+                return usage();
+            }
+        }
 
-        if (!analysis.feedback.empty()) {
-            std::cout << "\nRecommendations:\n";
-            for (const auto& tip : analysis.feedback) {
-                std::cout << "   • " << tip << "\n";
+        PasswordGenerator gen;
+        PolicyValidator validator = gen.policyValidator(policySpec(gen, args[1]), exact);
+        std::vector<std::string> names(1u << PolicyValidator::kViolationKinds);
+        std::string out;
+        auto start = std::chrono::steady_clock::now();
+        PolicyValidator::Summary summary = validator.checkFile(args[2], [&](uint64_t line, uint32_t violations) {
+            if (summary_only) {
+                return;
+            }
+            if (names[violations].empty()) {
+                names[violations] = PolicyValidator::describe(violations);
+            }
+            out += std::to_string(line);
+            out += '\t';
+            out += names[violations];
+            out += '\n';
+            if (out.size() >= (1 << 16)) {
+                std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+                out.clear();
+            }
+        });
+        std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+        std::cout.flush();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cerr << summary.lines << " passwords, " << summary.compliant << " compliant, "
+                  << summary.lines - summary.compliant << " in violation (" << std::fixed << std::setprecision(2)
+                  << elapsed.count() << " s, " << std::setprecision(0)
+                  << summary.bytes / std::max(elapsed.count(), 1e-9) / 1e6 << " MB/s)\n";
+        for (int bit = 0; bit < PolicyValidator::kViolationKinds; bit++) {
+            if (summary.by_violation[bit] > 0) {
+                std::cerr << "  " << std::left << std::setw(18) << PolicyValidator::violationName(bit) << std::right
+                          << summary.by_violation[bit] << "\n";
             }
         }
+        return summary.compliant == summary.lines ? 0 : 1;
     }
 
-    void quickGenerate() {
-        std::cout << "\n--- QUICK GENERATION ---\n";
-
-        std::cout << "Choose quick generation type:\n";
-        std::cout << "1. Standard password (16 characters)\n";
-        std::cout << "2. Short password (8 characters)\n";
-        std::cout << "3. Long password (24 characters)\n";
-        std::cout << "4. Memorable password\n";
-        std::cout << "5. Complex memorable password\n";
-
-        int quick_type = askNumber("Choose type", 1, 5, 1);
-        int count = askNumber("Number of passwords", 1, 10, 3);
+    // Clusters of near-duplicate passwords in a dump, largest first, with each variant's count
+    int reuse() {
+        if (args.size() < 2 || args.size() > 4) {
+            return usage();
+        }
+        double similarity = args.size() > 2 ? std::stod(args[2]) : 0.5;
+        size_t top = args.size() > 3 ? static_cast<size_t>(std::stoull(args[3])) : 20;
+        constexpr size_t kShownVariants = 10;
+
+        auto start = std::chrono::steady_clock::now();
+        VariantClusterer clusterer(args[1], similarity);
+        clusterer.run();
+        VariantClusterer::Summary summary;
+        std::vector<VariantClusterer::Cluster> clusters = clusterer.clusters(top, summary);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        for (size_t i = 0; i < clusters.size(); i++) {
+            const VariantClusterer::Cluster& cluster = clusters[i];
+            std::cout << "Cluster " << i + 1 << ": " << cluster.size << " entries, " << cluster.variants.size()
+                      << (cluster.variants.size() == 1 ? " variant\n" : " variants\n");
+            for (size_t j = 0; j < std::min(kShownVariants, cluster.variants.size()); j++) {
+                std::cout << std::setw(10) << cluster.variants[j].second << "  " << cluster.variants[j].first << "\n";
+            }
+            if (cluster.variants.size() > kShownVariants) {
+                std::cout << "            ... " << cluster.variants.size() - kShownVariants << " more\n";
+            }
+        }
+        std::cout.flush();
 
-        std::cout << "\nGenerated passwords:\n";
-        std::vector<std::string> passwords;
+        std::cerr << summary.entries << " passwords, " << summary.clustered_entries << " in " << summary.clusters
+                  << " clusters (" << summary.varied_clusters << " with variants), largest " << summary.largest
+                  << "; " << summary.checks << " similarity checks (" << std::fixed << std::setprecision(2)
+                  << elapsed.count() << " s)\n";
+        return 0;
+    }
 
-        for (int i = 0; i < count; i++) {
-            std::string password;
+    // Instruction sets found and the implementation each vectorized kernel runs
+    int cpuInfo() {
+        if (args.size() != 1) {
+            return usage();
+        }
 
-            switch (quick_type) {
-                case 1:
-                    password = gen.generatePassword(16);
-                    break;
-                case 2:
-                    password = gen.generatePassword(8);
-                    break;
-                case 3:
-                    password = gen.generatePassword(24);
-                    break;
-                case 4:
-                    password = gen.generateMemorablePassword();
-                    break;
-                case 5:
-                    password = gen.generateComplexMemorablePassword();
-                    break;
-            }
+        const CpuFeatures& detected = CpuFeatures::detected();
+        const CpuFeatures& cpu = CpuFeatures::get();
+        std::cout << "CPU level:     " << CpuFeatures::levelName(detected.level()) << "\n";
+        std::cout << "Kernel level:  " << CpuFeatures::levelName(cpu.level())
+                  << (cpu.level() < detected.level() ? " (capped by PSWD_GEN_SIMD or --simd)" : "") << "\n";
+
+        static const char* const profile_kernels[] = {"scalar", "ssse3", "avx2"};
+        static const char* const chacha_kernels[] = {"scalar", "avx2 (8 blocks)", "avx512 (16 blocks)"};
+        static const char* const token_kernels[] = {"scalar", "avx2"};
+        std::cout << "  character profile  " << profile_kernels[CharacterKernel::bestLevel()] << "\n";
+        std::cout << "  chacha20           " << chacha_kernels[ChaCha20::bestLevel()] << "\n";
+        std::cout << "  token encoding     " << token_kernels[TokenGenerator::bestLevel()] << "\n";
+#if defined(PSWD_GEN_VECTOR_EXTENSIONS) && defined(PSWD_GEN_X86)
+        std::cout << "  sha-2 lanes        "
+                  << (cpu.avx2 ? "avx2 (8 x sha-256, 4 x sha-512)" : "128-bit (4 x sha-256, 2 x sha-512)") << "\n";
+#elif defined(PSWD_GEN_VECTOR_EXTENSIONS)
+        std::cout << "  sha-2 lanes        128-bit (4 x sha-256, 2 x sha-512)\n";
+#else
+        std::cout << "  sha-2 lanes        scalar\n";
+#endif
+        return 0;
+    }
 
-            passwords.push_back(password);
-            auto analysis = gen.checkPasswordStrength(password);
-            std::cout << (i + 1) << ". " << password << " | " << analysis.strength << "\n";
+    // HOST:PORT, or PORT on the loopback interface
+    static std::pair<std::string, uint16_t> parseAddress(const std::string& text) {
+        size_t colon = text.rfind(':');
+        std::string host = colon == std::string::npos ? "127.0.0.1" : text.substr(0, colon);
+        unsigned long port = std::stoul(text.substr(colon == std::string::npos ? 0 : colon + 1));
+        if (host.empty() || port == 0 || port > 65535) {
+            throw std::invalid_argument("Bad address '" + text + "'");
         }
+        return {host, static_cast<uint16_t>(port)};
+    }
 
-        if (askYesNo("\nSave passwords to file?", false)) {
-            savePasswordsToFile(passwords);
+    int serve() {
+        if (args.size() < 2 || args.size() > 3) {
+            return usage();
         }
+        auto address = parseAddress(args[1]);
+        size_t max_connections = args.size() > 2 ? std::stoul(args[2]) : PasswordService::kMaxConnections;
+
+        PasswordGenerator gen;
+        loadLibraries(gen);
+        PasswordService service(gen, address.first, address.second, max_connections);
+        std::cerr << "Serving on " << address.first << ":" << address.second << "\n";
+        service.run();
+        return 0;
     }
 
-    void savePasswordToFile(const std::string& password) {
-        try {
-            std::time_t now = std::time(nullptr);
-            std::tm* local_time = std::localtime(&now);
+    static void printLatencies(const LatencyHistogram& histogram, const std::string& label) {
+        std::cout << std::fixed << std::setprecision(3);
+        for (double percent : {50.0, 90.0, 99.0, 99.9}) {
+            std::cout << std::setw(9) << histogram.percentile(percent) / 1e6;
+        }
+        std::cout << std::setw(9) << histogram.max() / 1e6 << "  " << label << "\n";
+    }
 
-            std::ostringstream timestamp;
-            timestamp << std::put_time(local_time, "%Y-%m-%d %H:%M:%S");
+    int loadgen() {
+        if (args.size() < 4) {
+            return usage();
+        }
+        auto address = parseAddress(args[1]);
+        double rate = std::stod(args[2]);
+        double seconds = std::stod(args[3]);
+        size_t first_profile = 4;
+        unsigned connections = 16;
+        if (args.size() > 4 && args[4].find_first_not_of("0123456789") == std::string::npos) {
+            connections = static_cast<unsigned>(std::stoul(args[4]));
+            first_profile = 5;
+        }
+        std::vector<LoadGenerator::Profile> mix;
+        for (size_t i = first_profile; i < args.size(); i++) {
+            mix.push_back(LoadGenerator::parseProfile(args[i]));
+        }
+        if (mix.empty()) {
+            mix = LoadGenerator::defaultMix();
+        }
 
-            std::ofstream file("password.txt");
-            file << "Generated password (" << timestamp.str() << "):\n";
-            file << password << "\n";
-            file.close();
+        // A bad spec is reported here rather than as a stream of ERR replies
+        PasswordGenerator gen;
+        for (const auto& profile : mix) {
+            if (profile.spec != "check") {
+                gen.compileSpec(profile.spec);
+            }
+        }
 
-            std::cout << "Password saved to 'password.txt'\n";
-        } catch (const std::exception& e) {
-            std::cout << "Error saving: " << e.what() << "\n";
+        LoadGenerator load(address.first, address.second, mix, rate, connections);
+        LoadGenerator::Report report = load.run(seconds, std::max(1.0, seconds / 10));
+
+        std::cout << "Offered " << std::fixed << std::setprecision(0) << rate << " req/s for " << std::setprecision(1)
+                  << seconds << " s on " << connections << " connections\n";
+        std::cout << "Completed " << report.completed << " requests in " << std::setprecision(2) << report.seconds
+                  << " s (" << std::setprecision(1) << report.completed / report.seconds << " req/s), "
+                  << report.errors << " errors, " << report.missed << " never sent\n";
+        std::cout << "      p50      p90      p99    p99.9      max  (ms)\n";
+        printLatencies(report.latency, "latency from when each request was due");
+        printLatencies(report.service, "service time from when it was sent");
+        for (size_t p = 0; p < mix.size(); p++) {
+            printLatencies(report.by_profile[p], mix[p].spec);
         }
+        return report.errors > 0 || report.missed > 0 ? 1 : 0;
     }
 
-    void savePasswordsToFile(const std::vector<std::string>& passwords) {
-        try {
-            std::time_t now = std::time(nullptr);
-            std::tm* local_time = std::localtime(&now);
-
-            std::ostringstream timestamp;
-            timestamp << std::put_time(local_time, "%Y-%m-%d %H:%M:%S");
+    // Keyspace commands need a character policy, not a word or template mode
+    static PasswordGenerator::PasswordPolicy policySpec(PasswordGenerator& gen, const std::string& text) {
+        PasswordGenerator::GenerationSpec spec = gen.compileSpec(text);
+        if (spec.mode != PasswordGenerator::GenerationSpec::POLICY) {
+            throw std::invalid_argument("'" + text + "' is not a character policy");
+        }
+        return spec.policy;
+    }
 
-            std::ofstream file("passwords.txt");
-            file << "Generated passwords (" << timestamp.str() << "):\n";
-            file << std::string(40, '=') << "\n";
+    int keyspace() {
+        if (args.size() < 2) {
+            return usage();
+        }
 
-            for (size_t i = 0; i < passwords.size(); i++) {
-                file << (i + 1) << ". " << passwords[i] << "\n";
-            }
-            file.close();
+        PasswordGenerator gen;
+        auto index = gen.keyspaceIndex(policySpec(gen, args[1]));
+        std::cout << index->size().toString() << "\n";
+        std::cout << std::fixed << std::setprecision(1) << index->size().log2() << " bits\n";
+        return 0;
+    }
 
-            std::cout << passwords.size() << " passwords saved to 'passwords.txt'\n";
-        } catch (const std::exception& e) {
-            std::cout << "Error saving: " << e.what() << "\n";
+    int unrank() {
+        if (args.size() < 3) {
+            return usage();
         }
+
+        PasswordGenerator gen;
+        auto index = gen.keyspaceIndex(policySpec(gen, args[1]));
+        std::cout << index->unrank(BigUnsigned::fromString(args[2])) << "\n";
+        return 0;
     }
 
-    void run() {
-        std::cout << "Welcome to Password Generator!\n";
-        std::cout << "Checking word libraries availability...\n";
+    int rank() {
+        if (args.size() < 3) {
+            return usage();
+        }
 
-        while (true) {
-            showMenu();
+        PasswordGenerator gen;
+        auto index = gen.keyspaceIndex(policySpec(gen, args[1]));
+        std::cout << index->rank(args[2]).toString() << "\n";
+        return 0;
+    }
 
-            try {
-                std::string choice = askString("\nChoose action (0-8)");
+    // Shard i of n covers indexes [size * i / n, size * (i + 1) / n), so machines given
+    // different shards of the same policy can never produce the same password
+    int sample() {
+        if (args.size() < 3) {
+            return usage();
+        }
 
-                if (choice == "0") {
-                    std::cout << "\nGoodbye! Keep your passwords safe!\n";
-                    break;
-                } else if (choice == "1") {
-                    createStandardPassword();
-                } else if (choice == "2") {
-                    createMemorablePassword();
-                } else if (choice == "3") {
-                    createComplexMemorablePassword();
-                } else if (choice == "4") {
-                    buildCustomPasswordInteractive();
-                } else if (choice == "5") {
-                    createMultiplePasswords();
-                } else if (choice == "6") {
-                    checkPasswordStrength();
-                } else if (choice == "7") {
-                    quickGenerate();
-                } else if (choice == "8") {
-                    createPasswordByComplexity();
-                } else {
-                    std::cout << "Invalid choice. Try again.\n";
-                }
+        PasswordGenerator gen;
+        auto index = gen.keyspaceIndex(policySpec(gen, args[1]));
+        int count = std::stoi(args[2]);
 
-            } catch (const std::exception& e) {
-                std::cout << "Error occurred: " << e.what() << "\n";
-                std::cout << "Try again or choose another option.\n";
+        BigUnsigned begin, end = index->size();
+        if (args.size() > 3) {
+            size_t slash = args[3].find('/');
+            if (slash == std::string::npos) {
+                return usage();
             }
+            uint32_t shard = static_cast<uint32_t>(std::stoul(args[3].substr(0, slash)));
+            uint32_t shards = static_cast<uint32_t>(std::stoul(args[3].substr(slash + 1)));
+            if (shards == 0 || shard >= shards) {
+                std::cerr << "Shard must be below the number of shards\n";
+                return 2;
+            }
+            begin = index->size() * BigUnsigned(shard);
+            begin.divSmall(shards);
+            end = index->size() * BigUnsigned(shard + 1);
+            end.divSmall(shards);
+        }
 
-            std::cout << "\nPress Enter to continue...";
-            std::cin.ignore();
+        std::random_device entropy;
+        for (int i = 0; i < count; i++) {
+            std::cout << index->sample(entropy, begin, end) << "\n";
+        }
+        return 0;
+    }
+
+    int run(const std::vector<std::string>& arguments) {
+        args = arguments;
+        const std::string& command = args[0];
+
+        if (command == "compile-wordlist") {
+            return compileWordlist();
+        } else if (command == "wordlist-info") {
+            return wordlistInfo();
+        } else if (command == "build-markov") {
+            return buildMarkov();
+        } else if (command == "build-guesses") {
+            return buildGuesses();
+        } else if (command == "guesses") {
+            return guesses();
+        } else if (command == "provision") {
+            return provision();
+        } else if (command == "provision-csv") {
+            return provisionCsv();
+        } else if (command == "audit") {
+            return audit();
+        } else if (command == "batch") {
+            return batch();
+        } else if (command == "bulk") {
+            return bulk();
+        } else if (command == "batch-info") {
+            return batchInfo();
+        } else if (command == "tokens") {
+            return tokens();
+        } else if (command == "token-check") {
+            return tokenCheck();
+        } else if (command == "rotate") {
+            return rotate();
+        } else if (command == "history-check") {
+            return historyCheck();
+        } else if (command == "journal") {
+            return journal();
+        } else if (command == "journal-read") {
+            return journalRead();
+        } else if (command == "cpu-info") {
+            return cpuInfo();
+        } else if (command == "validate") {
+            return validate();
+        } else if (command == "reuse") {
+            return reuse();
+        } else if (command == "serve") {
+            return serve();
+        } else if (command == "loadgen") {
+            return loadgen();
+        } else if (command == "keyspace") {
+            return keyspace();
+        } else if (command == "unrank") {
+            return unrank();
+        } else if (command == "rank") {
+            return rank();
+        } else if (command == "sample") {
+            return sample();
         }
+        return usage();
     }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        // --simd=LEVEL may appear anywhere and overrides PSWD_GEN_SIMD; either has to be
+        // settled before the first kernel picks its implementation
+        std::vector<std::string> arguments;
+        CpuFeatures::get();
+        SecureMemoryPool::instance().reportProtection();
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument.compare(0, 7, "--simd=") == 0) {
+                CpuFeatures::limit(CpuFeatures::parseLevel(argument.substr(7)));
+            } else {
+                arguments.push_back(argument);
+            }
+        }
+
+        if (!arguments.empty()) {
+            CommandLineInterface cli;
+            return cli.run(arguments);
+        }
+
         UserInterface ui;
         ui.run();
     } catch (const std::exception& e) {